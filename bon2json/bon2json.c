@@ -7,79 +7,11 @@
 //  This is free software, under the MIT license (see LICENSE.txt for details).
 
 #include <stdio.h>
-#include <jansson.h>
+#include <stdlib.h>
 #include <bon/bon.h>
 
 
-json_t* uint64_2_json(uint64_t u64)
-{
-	if (u64 <= 0x7fffffffffffffffULL) {
-		return json_integer( (int64_t)u64 );
-	} else {
-		fprintf(stderr, "Uint64 too large for jansson - converting to double");
-		return json_real( (double)u64 );
-	}
-}
-
-json_t* bon2json(bon_r_doc* B, bon_value* v)
-{
-	switch (bon_r_value_type(B, v))
-	{
-		case BON_LOGICAL_NIL:
-			return json_null();
-			
-		case BON_LOGICAL_BOOL:
-			return json_boolean( bon_r_bool(B, v) );
-			
-			
-		case BON_LOGICAL_UINT:
-			return uint64_2_json( bon_r_uint(B, v) );
-			
-			
-		case BON_LOGICAL_SINT:
-			return json_integer( bon_r_int(B, v) );
-			
-			
-		case BON_LOGICAL_DOUBLE:
-			return json_real( bon_r_double(B, v) );
-			
-			
-		case BON_LOGICAL_STRING:
-			return json_string( bon_r_cstr(B, v) );
-			
-			
-		case BON_LOGICAL_LIST: {
-			json_t* jarray = json_array();
-			bon_size size = bon_r_list_size(B, v);
-			for (bon_size ix=0; ix<size; ++ix) {
-				json_t* elem = bon2json( B, bon_r_list_elem(B, v, ix) );
-				json_array_append_new( jarray, elem );
-			}
-			return jarray;
-		}
-			
-		case BON_LOGICAL_OBJECT: {
-			json_t* jobj = json_object();
-			
-			bon_size size = bon_r_obj_size(B, v);
-			
-			for (bon_size ix=0; ix<size; ++ix) {
-				const char*  bkey = bon_r_obj_key(B, v, ix);
-				bon_value*   bval = bon_r_obj_value(B, v, ix);
-				json_t* val = bon2json(B, bval);
-				json_object_set_new(jobj, bkey, val);
-			}
-			
-			return jobj;
-		}
-			
-		default:
-			fprintf(stderr, "Unknown BON type\n");
-			return NULL;
-	}
-}
-
-bon_bool handle_bon(const uint8_t* data, size_t size, size_t flags, FILE* out)
+bon_bool handle_bon(const uint8_t* data, size_t size, unsigned flags, FILE* out)
 {
 	if (!data) { return BON_FALSE; }
 	
@@ -91,26 +23,21 @@ bon_bool handle_bon(const uint8_t* data, size_t size, size_t flags, FILE* out)
 		return BON_FALSE;
 	}
 	
-	json_t* json = bon2json(B, bon_r_root(B));
+	// Streamed straight from the BON document, without building a JSON tree:
+	bon_bool win = bon_r_write_json(B, bon_r_root(B), bon_file_writer, out, flags);
 	
-	if (json) {
-		if (json_dumpf(json, out, flags) != 0) {
-			fprintf(stderr, "json_dumpf failed\n");
-			return BON_FALSE;
-		}
-		
-		if (out == stdout)
-			fprintf(stdout, "\n");
-		
-		return BON_TRUE;
-	} else {
-		return BON_FALSE;
+	if (!win) {
+		fprintf(stderr, "Failed to write JSON%s%s\n", bon_r_error(B) ? ": " : "",
+				  bon_r_error(B) ? bon_r_err_str(B) : "");
+	} else if (out == stdout) {
+		fprintf(stdout, "\n");
 	}
 	
 	bon_r_close(B);
+	return win;
 }
 
-bon_bool handle_file(const char* path, size_t flags, FILE* out)
+bon_bool handle_file(const char* path, unsigned flags, FILE* out)
 {
 	bon_size size;
 	uint8_t* data = bon_read_file(&size, path);
@@ -148,23 +75,16 @@ int main(int argc, const char * argv[])
 {
 	bon_bool didParseFile = BON_FALSE;
 	FILE* out = stdout;
-	size_t flags = 0;
+	unsigned flags = 0;
 	/* Flags:
-	 JSON_INDENT(n)
-	 JSON_COMPACT
-	 JSON_ENSURE_ASCII
-	 JSON_SORT_KEYS
-	 JSON_PRESERVE_ORDER
-	 JSON_ENCODE_ANY
-	 JSON_ESCAPE_SLASH
+	 BON_JSON_INDENT(n)
+	 BON_JSON_COMPACT
+	 BON_JSON_ENSURE_ASCII
+	 BON_JSON_ESCAPE_SLASH
 	 */
 	
-	flags |= JSON_INDENT(4);
-	flags |= JSON_PRESERVE_ORDER;
-	flags |= JSON_ESCAPE_SLASH;   // Security
-	
-	flags |= JSON_ENCODE_ANY; // Forgiving
-		
+	flags |= BON_JSON_INDENT(4);
+	flags |= BON_JSON_ESCAPE_SLASH;   // Security
 	
 	for (int i=1; i<argc; ++i) {
 		if (argv[i][0] == '-') {
@@ -101,7 +101,10 @@ const char* bon_err_str(bon_error err)
 		"BON_ERR_NARROWING",
 		"BON_ERR_NULL_OBJ",
 		
-		"BON_ERR_NOT_UTF8"
+		"BON_ERR_NOT_UTF8",
+		
+		"BON_ERR_READ_ERROR",
+		"BON_ERR_BAD_LOG"
 	};
 	
 	return err_str[err];
@@ -176,7 +179,11 @@ void bon_print_aggr(bon_r_doc* B, const bon_type* aggType, bon_reader* br, FILE*
 		case BON_CTRL_FLOAT_LE:
 		case BON_CTRL_FLOAT_BE:
 		case BON_CTRL_DOUBLE_LE:
-		case BON_CTRL_DOUBLE_BE: {
+		case BON_CTRL_DOUBLE_BE:
+		case BON_CTRL_HALF_LE:
+		case BON_CTRL_HALF_BE:
+		case BON_CTRL_BF16_LE:
+		case BON_CTRL_BF16_BE: {
 			double dbl = br_read_double(br, id);
 			bon_print_float(out, dbl);
 		} break;
@@ -292,10 +299,22 @@ void bon_print(bon_r_doc* B, bon_value* v, FILE* out, size_t indent)
 		} break;
 			
 			
+		case BON_VALUE_TABLE: {
+			fprintf(out, "[ ");
+			bon_size size = v->u.table->num_rows;
+			for (bon_size i=0; i<size; ++i) {
+				bon_print(B, bon_r_table_row(B, v->u.table, i), out, indent);
+				if (i != size-1)
+					fprintf(out, ", ");
+			}
+			fprintf(out, " ]");
+		} break;
+			
+			
 		case BON_VALUE_AGGREGATE: {
 			bon_value_agg* agg = v->u.agg;
 			bon_size byteSize = bon_aggregate_payload_size(&agg->type);
-			bon_reader br = make_br(NULL, agg->data, byteSize,  BON_BAD_BLOCK_ID);
+			bon_reader br = make_br(NULL, bon_agg_payload(agg), byteSize,  BON_BAD_BLOCK_ID);
 			bon_print_aggr(B, &agg->type, &br, out);
 			if (br.nbytes!=0) {
 				fprintf(stderr, "Bad aggregate\n");
@@ -42,6 +42,7 @@ typedef size_t bon_size;
 
 typedef uint64_t bon_block_id;
 #define BON_BAD_BLOCK_ID (bon_block_id)(-1)
+#define BON_PAD_BLOCK_ID (bon_block_id)(-2)  // Padding written by bon_w_block_pack. Never referenced.
 
 typedef struct bon_value  bon_value;
 
@@ -84,6 +85,10 @@ typedef enum {
 	
 	BON_ERR_NOT_UTF8,               // Key or string not UTF8 when reading OR writing
 	
+	// bon_log:
+	BON_ERR_READ_ERROR,             // Failed to open or read a file
+	BON_ERR_BAD_LOG,                // Not a BON log segment
+	
 	BON_NUM_ERR
 } bon_error;
 
@@ -105,6 +110,7 @@ typedef enum {
 	BON_CTRL_BLOCK_BEGIN = 'D',    BON_CTRL_BLOCK_END   = 'd',
 	BON_CTRL_TRUE        = 'E',    BON_CTRL_FALSE       = 'e',
 	BON_CTRL_FOOTER      = 'F',    BON_CTRL_FOOTER_CRC  = 'f',
+	BON_CTRL_FOOTER_XXH64 = 'i',   // 'i' xxh64_le 'i'. See BON_W_FLAG_XXH64.
 	
 	BON_CTRL_LIST_VLQ    = 'L',
 	BON_CTRL_NIL         = 'N',
@@ -122,6 +128,22 @@ typedef enum {
 	BON_CTRL_FLOAT_LE   = 'X',     BON_CTRL_FLOAT_BE   = 'x',
 	BON_CTRL_DOUBLE_LE  = 'Y',     BON_CTRL_DOUBLE_BE  = 'y',
 	
+	// 16-bit floats: IEEE 754 half precision, and bfloat16 (the upper half of a float)
+	BON_CTRL_HALF_LE    = 'H',     BON_CTRL_HALF_BE    = 'h',
+	BON_CTRL_BF16_LE    = 'G',     BON_CTRL_BF16_BE    = 'g',
+	
+	// An array of integers, delta and/or bit packed. See bon_w_pack_ints.
+	BON_CTRL_INTS       = 'Z',
+	
+	// A block with an LZ compressed payload. See BON_W_FLAG_COMPRESS_BLOCKS.
+	BON_CTRL_BLOCK_LZ   = 'K',
+	
+	// A list of objects stored column by column. See bon_w_table_begin.
+	BON_CTRL_TABLE      = 'M',
+	
+	// Ends a block instead of BON_CTRL_BLOCK_END: 'c' crc32_le 'c'. See BON_W_FLAG_BLOCK_CRC.
+	BON_CTRL_BLOCK_END_CRC = 'c',
+	
 	// Open-ended list and object
 	BON_CTRL_LIST_BEGIN  = '[',    BON_CTRL_LIST_END  = ']',  //  0x5B   0x5D
 	BON_CTRL_OBJ_BEGIN   = '{',    BON_CTRL_OBJ_END   = '}',  //  0x7B   0x7D
@@ -136,6 +158,8 @@ typedef enum {
 	BON_CTRL_UINT64   = BON_CTRL_UINT64_LE,
 	BON_CTRL_FLOAT    = BON_CTRL_FLOAT_LE,
 	BON_CTRL_DOUBLE   = BON_CTRL_DOUBLE_LE,
+	BON_CTRL_HALF     = BON_CTRL_HALF_LE,
+	BON_CTRL_BF16     = BON_CTRL_BF16_LE,
 #else
 	BON_CTRL_SINT16   = BON_CTRL_SINT16_BE,
 	BON_CTRL_UINT16   = BON_CTRL_UINT16_BE,
@@ -144,7 +168,9 @@ typedef enum {
 	BON_CTRL_SINT64   = BON_CTRL_SINT64_BE,
 	BON_CTRL_UINT64   = BON_CTRL_UINT64_BE,
 	BON_CTRL_FLOAT    = BON_CTRL_FLOAT_BE,
-	BON_CTRL_DOUBLE   = BON_CTRL_DOUBLE_BE
+	BON_CTRL_DOUBLE   = BON_CTRL_DOUBLE_BE,
+	BON_CTRL_HALF     = BON_CTRL_HALF_BE,
+	BON_CTRL_BF16     = BON_CTRL_BF16_BE
 #endif
 } bon_ctrl;
 
@@ -185,6 +211,12 @@ typedef enum {
 	BON_TYPE_DOUBLE_LE = BON_CTRL_DOUBLE_LE,
 	BON_TYPE_DOUBLE_BE = BON_CTRL_DOUBLE_BE,
 	
+	// Only in packed aggregates. Stored as uint16_t.
+	BON_TYPE_HALF_LE = BON_CTRL_HALF_LE,
+	BON_TYPE_HALF_BE = BON_CTRL_HALF_BE,
+	BON_TYPE_BF16_LE = BON_CTRL_BF16_LE,
+	BON_TYPE_BF16_BE = BON_CTRL_BF16_BE,
+	
 	BON_TYPE_SINT16   = BON_CTRL_SINT16,
 	BON_TYPE_UINT16   = BON_CTRL_UINT16,
 	BON_TYPE_SINT32   = BON_CTRL_SINT32,
@@ -192,7 +224,9 @@ typedef enum {
 	BON_TYPE_SINT64   = BON_CTRL_SINT64,
 	BON_TYPE_UINT64   = BON_CTRL_UINT64,
 	BON_TYPE_FLOAT  = BON_CTRL_FLOAT,
-	BON_TYPE_DOUBLE  = BON_CTRL_DOUBLE
+	BON_TYPE_DOUBLE  = BON_CTRL_DOUBLE,
+	BON_TYPE_HALF    = BON_CTRL_HALF,
+	BON_TYPE_BF16    = BON_CTRL_BF16
 } bon_type_id;
 
 //------------------------------------------------------------------------------
@@ -245,6 +279,8 @@ bon_type* bon_new_type_struct(bon_size n, const char** names, bon_type** types);
  i8 i16 i32 i64   - signed integer
  f                - float
  d                - double
+ f16              - half precision float (stored as uint16_t)
+ bf16             - bfloat16 (stored as uint16_t)
  {...}            - object. Interleave $ (key placeholder) and types.
  [3f]             - array of three floats
  [#u8]            - array of bytes (array size given in vargs as bon_size)
@@ -253,6 +289,18 @@ bon_type* bon_new_type_struct(bon_size n, const char** names, bon_type** types);
  */
 bon_type* bon_new_type_fmt(const char* fmt, ...);
 
+/*
+ The *_fmt functions (bon_w_pack_fmt, bon_r_unpack_fmt, bon_r_unpack_ptr_fmt)
+ cache the types they build, per thread, keyed on the format and its arguments.
+ Repeated calls with the same format, sizes and keys therefore don't allocate.
+ For the hottest loops, build the type once with bon_new_type_fmt
+ and use bon_w_pack, bon_r_unpack or bon_r_unpack_ptr instead.
+ */
+
+// Frees the types cached for the *_fmt functions by the calling thread.
+// With pthreads this happens by itself when a thread exits. Elsewhere, call it before a thread exits.
+void      bon_fmt_cache_clear(void);
+
 // Returns true if the two types are exactly equal
 bon_bool  bon_type_eq(const bon_type* a, const bon_type* b);
 
@@ -276,6 +324,7 @@ typedef struct {
  free(vec.data);
  */
 bon_bool bon_vec_writer(void* userData, const void* data, uint64_t nbytes);
+bon_bool bon_vec_patcher(void* userData, uint64_t back, const void* data, uint64_t nbytes);
 	
 
 /*
@@ -287,6 +336,7 @@ bon_bool bon_vec_writer(void* userData, const void* data, uint64_t nbytes);
  fclose( fp );
 */
 bon_bool bon_file_writer(void* user, const void* data, uint64_t nbytes);
+bon_bool bon_file_patcher(void* user, uint64_t back, const void* data, uint64_t nbytes);
 
 
 
@@ -314,6 +364,14 @@ bon_bool bon_file_writer(void* user, const void* data, uint64_t nbytes);
  */
 typedef bon_bool (*bon_w_writer_t)(void* userData, const void* data, uint64_t nbytes);
 
+/*
+ A patcher lets the bon_w_doc go back and overwrite bytes it has already written,
+ which is how blocks written with bon_w_block_begin get their real size.
+ 'data' should replace the 'nbytes' bytes starting 'back' bytes before the current end.
+ The writer's position must be left at the end. Return false if the patch failed.
+ */
+typedef bon_bool (*bon_w_patcher_t)(void* userData, uint64_t back, const void* data, uint64_t nbytes);
+
 
 typedef struct bon_w_doc bon_w_doc;
 
@@ -328,10 +386,31 @@ typedef enum {
 	BON_W_FLAG_SKIP_HEADER_FOOTER  =  1 << 1,
 	
 	// Save cpu by not checking strings for utf8 correctness
-	BON_W_FLAG_SKIP_STRING_CHECKS   =  1 << 2
+	BON_W_FLAG_SKIP_STRING_CHECKS   =  1 << 2,
+	
+	// bon_w_pack_array encodes integer arrays with BON_INTS_AUTO (see bon_w_pack_ints)
+	BON_W_FLAG_ENCODE_INTS          =  1 << 3,
+	
+	// bon_w_block and bon_w_blocks LZ compress blocks when that makes them smaller
+	BON_W_FLAG_COMPRESS_BLOCKS      =  1 << 4,
+	
+	/*
+	 End each block with a CRC-32 of its payload (as stored, i.e. compressed if it is).
+	 Readers check it when the block is first loaded, so only blocks actually used are hashed.
+	 */
+	BON_W_FLAG_BLOCK_CRC            =  1 << 5,
+	
+	// Like BON_W_FLAG_CRC, but with a 64-bit xxHash (XXH64), which is many times faster. Wins over BON_W_FLAG_CRC.
+	BON_W_FLAG_XXH64                =  1 << 6
 } bon_w_flags;
 
 
+// Size of the write buffer used by bon_w_new
+#define BON_W_DEFAULT_BUFF_SIZE (64*1024)
+
+// Initial capacity used by bon_w_new_mem
+#define BON_W_DEFAULT_MEM_SIZE  1024
+
 // Top level structure
 bon_w_doc*   bon_w_new        (bon_w_writer_t writer, void* userData, bon_w_flags flags);
 void         bon_w_flush      (bon_w_doc* B);  // Flush writes to the writer
@@ -339,14 +418,127 @@ void         bon_w_flush      (bon_w_doc* B);  // Flush writes to the writer
 // Writes footer and flushes. Returns final error (if any)
 bon_error    bon_w_close      (bon_w_doc* B);
 
+/*
+ Reusing one bon_w_doc for many small documents (e.g. RPC messages)
+ saves the allocation of the bon_w_doc and its write buffer for each one.
+ 
+ bon_w_doc* B = bon_w_new_sized(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT, 1024);
+ for each message {
+     vec.size = 0;
+     bon_w_reset( B, bon_vec_writer, &vec, BON_W_FLAG_DEFAULT );
+     write_bon( B );
+     bon_w_finish( B );
+     send( vec.data, vec.size );
+ }
+ bon_w_free( B );
+ */
+
+// Like bon_w_new, but with a write buffer of 'buff_size' bytes. 0 means unbuffered.
+bon_w_doc*   bon_w_new_sized  (bon_w_writer_t writer, void* userData, bon_w_flags flags,
+										 bon_size buff_size);
+
+// Writes footer and flushes, but keeps B alive for reuse. Returns final error (if any)
+bon_error    bon_w_finish     (bon_w_doc* B);
+
+// Starts a new document in B. Anything not yet flushed is discarded.
+void         bon_w_reset      (bon_w_doc* B, bon_w_writer_t writer, void* userData, bon_w_flags flags);
+
+// Frees B without writing anything more. bon_w_close == bon_w_finish + bon_w_free
+void         bon_w_free       (bon_w_doc* B);
+
+/*
+ Encoding straight to memory, without a writer and without copying:
+ 
+ bon_w_doc* B = bon_w_new_mem(BON_W_FLAG_DEFAULT);
+ write_bon( B );
+ bon_w_finish( B );
+ bon_size size;
+ uint8_t* data = bon_w_mem_take(B, &size);  // data is now yours to free
+ bon_w_free( B );
+ 
+ Passing a NULL writer to bon_w_new_sized or bon_w_reset also selects memory mode.
+ In memory mode the write buffer is the output: it grows as needed and is never flushed.
+ */
+bon_w_doc*   bon_w_new_mem    (bon_w_flags flags);
+
+// The output so far. Owned by B, and only valid until the next write.
+const uint8_t* bon_w_mem_data (const bon_w_doc* B, bon_size* out_size);
+
+// Hands the output over to the caller (free it with free). B can then be reset and reused.
+uint8_t*     bon_w_mem_take   (bon_w_doc* B, bon_size* out_size);
+
+/*
+ Encoding into a buffer of exactly the right size:
+ 
+ bon_w_doc* M = bon_w_new_measure(BON_W_FLAG_CRC);
+ write_bon( M );
+ bon_w_finish( M );
+ bon_size size = bon_w_size( M );  // Includes header and footer
+ bon_w_free( M );
+ 
+ uint8_t* slot = alloc_slot( size );
+ bon_w_doc* B = bon_w_new_fixed(slot, size, BON_W_FLAG_CRC);
+ write_bon( B );
+ bon_w_close( B );  // BON_ERR_WRITE_ERROR if 'slot' was too small
+ 
+ A measuring doc stores nothing and skips the CRC computation (the footer has a fixed size).
+ A fixed doc writes into 'dst' and never allocates. bon_w_mem_data works on it too.
+ Resetting either with a NULL writer keeps its mode. Resetting with a writer allocates
+ a write buffer of BON_W_DEFAULT_BUFF_SIZE, and the fixed buffer is no longer used.
+ */
+bon_w_doc*   bon_w_new_measure(bon_w_flags flags);
+bon_w_doc*   bon_w_new_fixed  (void* dst, bon_size capacity, bon_w_flags flags);
+
+// Number of bytes written to B so far (including buffered bytes), in any mode.
+bon_size     bon_w_size       (const bon_w_doc* B);
+
 void              bon_w_set_error  (bon_w_doc* B, bon_error err);
 static bon_error  bon_w_error      (bon_w_doc* B);
 const char*       bon_w_err_str    (bon_w_doc* B); // Human readable error message
 
+/*
+ An open-ended block has an unknown size, so readers must parse it eagerly.
+ If B can patch its output (memory, fixed and measuring docs, or a writer with a patcher)
+ bon_w_block_begin reserves a padded size field, which bon_w_block_end fills in.
+ The block can then be loaded lazily, just like one written with bon_w_block.
+ If the size can't be patched (e.g. already flushed past and hashed into the CRC) it stays 0.
+ */
 void         bon_w_block_begin  (bon_w_doc* B, bon_block_id block_id);  // open-ended
 void         bon_w_block_end    (bon_w_doc* B);
+
+// Lets B patch the sizes of open-ended blocks. Use with the matching writer. Cleared by bon_w_reset.
+void         bon_w_set_patcher  (bon_w_doc* B, bon_w_patcher_t patcher);
 void         bon_w_block        (bon_w_doc* B, bon_block_id block_id, const void* data, bon_size nbytes);
 
+// A block for bon_w_blocks.
+typedef struct {
+	bon_block_id  id;
+	const void*   data;
+	bon_size      nbytes;
+} bon_w_block_src;
+
+/*
+ Same as calling bon_w_block for each of the 'count' blocks, in order.
+ With BON_W_FLAG_COMPRESS_BLOCKS they are compressed on 'num_threads' threads
+ (including the calling one, 0 means one per core) before being written.
+ */
+void         bon_w_blocks       (bon_w_doc* B, const bon_w_block_src* blocks, bon_size count,
+                                 unsigned num_threads);
+
+/*
+ Writes packed data as a block of its own, with the data (after the type) starting at
+ a multiple of 'align' bytes from the start of the document.
+ 'align' must be a power of two, e.g. 16 or 64 for SIMD, or 4096 for mapping pages.
+ Use it where you would use bon_w_block, and refer to the block with bon_w_block_ref.
+ 
+ The padding is a block with the id BON_PAD_BLOCK_ID, which is never referred to,
+ so any reader skips it. At most 'align' + 14 bytes are added.
+ The data is only aligned in memory if the whole document is loaded at an address
+ with the same alignment. Check with bon_r_payload_align.
+ */
+void         bon_w_block_pack   (bon_w_doc* B, bon_block_id block_id,
+                                 const void* data, bon_size nbytes, bon_type* type, bon_size align);
+
 
 // The different types of values:
 static void  bon_w_obj_begin   (bon_w_doc* B);
@@ -371,6 +563,16 @@ static void  bon_w_sint64     (bon_w_doc* B, int64_t val);
 static void  bon_w_float      (bon_w_doc* B, float val);
 static void  bon_w_double     (bon_w_doc* B, double val);
 
+/*
+ Many numbers at once, e.g. the elements of a list.
+ Produces the exact same bytes as calling bon_w_uint64 etc once per value,
+ but classifies and encodes the values in bulk, straight into the write buffer.
+ */
+void         bon_w_uint64s    (bon_w_doc* B, const uint64_t* vals, bon_size n);
+void         bon_w_sint64s    (bon_w_doc* B, const int64_t*  vals, bon_size n);
+void         bon_w_floats     (bon_w_doc* B, const float*    vals, bon_size n);
+void         bon_w_doubles    (bon_w_doc* B, const double*   vals, bon_size n);
+
 // Write a value read from another BON-file:
 void         bon_w_value     (bon_w_doc* B, bon_value* val);
 
@@ -387,6 +589,54 @@ void         bon_w_pack_fmt(bon_w_doc* B, const void* data, bon_size nbytes,
 void         bon_w_pack_array(bon_w_doc* B, const void* data, bon_size nbytes,
 										bon_size n_elem, bon_type_id type);
 
+/*
+ Integer arrays can be stored encoded, in blocks of BON_INTS_BLOCK values.
+ Each block stores the offset of each value from the smallest one, using as few bits as needed.
+ Optionally the differences between consecutive values are stored instead (BON_INTS_DELTA),
+ which is great for timestamps and indices. Signed values or differences
+ should also be zigzag mapped (BON_INTS_ZIGZAG: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...).
+ 
+ Readers decode these transparently: they look like any packed array of that type.
+ Unpacking into an array of the same (native) type decodes straight into the destination.
+ */
+#define BON_INTS_BLOCK 128
+
+typedef enum {
+	BON_INTS_FOR     = 0,       // Frame of reference bit packing of the values themselves
+	BON_INTS_DELTA   = 1 << 0,
+	BON_INTS_ZIGZAG  = 1 << 1,
+	BON_INTS_AUTO    = 1 << 7,  // Whichever is smallest - or a plain array, if that is no larger.
+} bon_ints_codec;
+
+// 'type' should be a native integer type. Anything else is written with bon_w_pack_array.
+void         bon_w_pack_ints (bon_w_doc* B, const void* data, bon_size nbytes,
+									  bon_size n_elem, bon_type_id type, bon_ints_codec codec);
+
+/*
+ A table is a list of objects with the same keys, stored as one schema followed by
+ one contiguous column per key. No key is repeated, and readers can scan a column
+ without touching the others.
+ 
+ Write the rows as objects into the doc returned by bon_w_table_begin, then call
+ bon_w_table_end to write the table to B:
+ 
+ bon_w_doc* T = bon_w_table_begin(B);
+ for (...) {
+     bon_w_obj_begin(T);
+     bon_w_key(T, "id");    bon_w_uint64(T, id);
+     bon_w_key(T, "name");  bon_w_cstring(T, name);
+     bon_w_obj_end(T);
+ }
+ bon_w_table_end(B, T);  // Frees T
+ 
+ All rows must have the same keys in the same order, and each column must be all
+ numbers, all bools or all strings. Numbers are stored as the smallest type that holds
+ them all exactly. Rows that don't fit a table (or no rows) are written as a plain list.
+ Readers see the table as a list of objects either way.
+ */
+bon_w_doc*   bon_w_table_begin (bon_w_doc* B);
+void         bon_w_table_end   (bon_w_doc* B, bon_w_doc* rows);
+
 
 
 //------------------------------------------------------------------------------
@@ -404,12 +654,19 @@ typedef enum {
 	BON_R_FLAG_DEFAULT      =  0,
 	
 	/*
-	 Will trigger BON_ERR_MISSING_CRC If the BON file has no CRC,
+	 Will trigger BON_ERR_MISSING_CRC If the BON file has no CRC (or XXH64),
 	 or BON_ERR_WRONG_CRC if it is incorrect.
 	 No further parsning of the file will be atempted.
 	 */
 	BON_R_FLAG_REQUIRE_CRC  =  1 << 0,
 	
+	/*
+	 Block checksums (see BON_W_FLAG_BLOCK_CRC) are always checked when a block is loaded,
+	 giving BON_ERR_WRONG_CRC. With this flag, loading a block without one is BON_ERR_MISSING_CRC.
+	 Documents without blocks are not affected (use BON_R_FLAG_REQUIRE_CRC for those).
+	 */
+	BON_R_FLAG_REQUIRE_BLOCK_CRC  =  1 << 1,
+	
 	// Save cpu by not checking strings for utf8 correctness
 	BON_R_FLAG_SKIP_STRING_CHECKS   =  1 << 2
 } bon_r_flags;
@@ -420,6 +677,28 @@ bon_r_doc*   bon_r_open   (const uint8_t* data, bon_size nbytes, bon_r_flags fla
 void         bon_r_close  (bon_r_doc* B);
 bon_value*   bon_r_root   (bon_r_doc* B); // Access the root object
 bon_error    bon_r_error  (bon_r_doc* B);
+
+/*
+ Unpacking of large aggregates (a megabyte or more, e.g. huge arrays) is split
+ into ranges handled by 'num_threads' threads, including the calling one.
+ Arrays of structs are split on struct boundaries. The result is identical to a serial unpack.
+ The default is 1 (everything on the calling thread). 0 means one thread per core.
+ */
+void         bon_r_set_num_threads(bon_r_doc* B, unsigned num_threads);
+
+/*
+ Like bon_r_open followed by bon_r_set_num_threads, except the threads are also used
+ for BON_R_FLAG_REQUIRE_CRC: big files are checksummed in one piece per thread.
+ */
+bon_r_doc*   bon_r_open_threaded(const uint8_t* data, bon_size nbytes, bon_r_flags flags,
+                                 unsigned num_threads);
+
+/*
+ Blocks written with BON_W_FLAG_COMPRESS_BLOCKS are decompressed when first accessed.
+ This decompresses all of them up front instead, split over the threads set above.
+ Returns false (with BON_ERR_BAD_BLOCK, or a CRC error) if any of them is corrupt.
+ */
+bon_bool     bon_r_decompress_blocks(bon_r_doc* B);
 const char*  bon_r_err_str(bon_r_doc* B); // Human readable error message
 
 
@@ -471,6 +750,15 @@ static double    bon_r_double  (bon_r_doc* B, bon_value* val);
 static const char*  bon_r_cstr  (bon_r_doc* B, bon_value* val);  // zero-ended UTF-8
 static bon_size     bon_r_strlen(bon_r_doc* B, bon_value* val);  // in bytes (UTF-8)
 
+/*
+ Elements of packed aggregates (e.g. a huge array of floats) are read in place:
+ only the elements you touch get a bon_value. Array and struct elements stay valid until bon_r_close.
+ Number elements share BON_R_NUMBER_SLOTS values round-robin, so such a pointer is only valid
+ until that many more numbers have been read. Read the number out (e.g. with bon_r_double) instead of keeping it.
+ For bulk access, use the bon_r_unpack functions below.
+ */
+#define BON_R_NUMBER_SLOTS 64
+
 // Returns 0 if it is not a list.
 static bon_size    bon_r_list_size(bon_r_doc* B, bon_value* list);
 static bon_value*  bon_r_list_elem(bon_r_doc* B, bon_value* list, bon_size ix);
@@ -534,10 +822,128 @@ const void* bon_r_unpack_ptr    (bon_r_doc* B, bon_value* srcVal,
 const void* bon_r_unpack_ptr_fmt(bon_r_doc* B, bon_value* srcVal,
 										   bon_size nbytes, const char* fmt, ...);
 
+/*
+ Alignment of the data returned by bon_r_unpack_ptr: the largest power of two
+ that divides its address (capped at 4096). 0 if 'srcVal' is not an aggregate.
+ */
+bon_size    bon_r_payload_align (bon_r_doc* B, bon_value* srcVal);
+
 // Quick access to a pointer e.g. pointer of bytes or floats
 const void* bon_r_unpack_array(bon_r_doc* B, bon_value* srcVal,
 									    bon_size nelem, bon_type_id type);
 
+// Reads a packed array of 'nelem' uint8 (e.g. colors) as floats in [0, 1].
+bon_bool    bon_r_unpack_unorm8(bon_r_doc* B, bon_value* srcVal,
+										  float* dst, bon_size nelem);
+
+
+/*
+ Unpacking many aggregates with the same layout (e.g. vertices or records)?
+ Compile the conversion once, into a flat program of memcpy runs and conversion kernels,
+ then run that on each aggregate.
+ 
+ bon_plan* plan = bon_r_new_plan(B, vals[0], dstType);
+ for (int i=0; i<n; ++i) {
+     if (!bon_r_unpack_plan(B, vals[i], &out[i], sizeof(out[i]), plan)) {
+         // vals[i] had another type: fall back to bon_r_unpack
+     }
+ }
+ bon_free_plan(plan);
+ 
+ bon_r_new_plan returns NULL if 'srcVal' is not an aggregate, or can't be converted to 'dstType'.
+ The plan may not outlive B.
+ bon_r_unpack uses plans internally when unpacking lists of aggregates.
+ */
+typedef struct bon_plan bon_plan;
+
+bon_plan*   bon_r_new_plan   (bon_r_doc* B, bon_value* srcVal, const bon_type* dstType);
+bon_bool    bon_r_unpack_plan(bon_r_doc* B, bon_value* srcVal,
+									   void* dst, bon_size nbytes, const bon_plan* plan);
+void        bon_free_plan    (bon_plan* plan);
+
+
+/*
+ Unpacks an array of 'nelem' structs into one array per field ("struct of arrays"),
+ in a single pass over the source. Fields are converted to their destination types as needed.
+ 
+ bon_type* vec3 = bon_new_type_fmt("[3f]");
+ bon_type* rgba = bon_new_type_fmt("[4u8]");
+ bon_soa_field fields[] = {
+     {"pos",   vec3, positions, 0},
+     {"color", rgba, colors,    0},
+ };
+ bon_r_unpack_soa(B, verts, n, fields, 2);
+ 
+ Fails if 'srcVal' is not a packed array of 'nelem' structs, or lacks a key.
+ */
+typedef struct {
+	const char*      key;     // Field of the source struct
+	const bon_type*  type;    // Type of each destination element
+	void*            dst;     // Destination of the first element
+	bon_size         stride;  // Bytes from one destination element to the next. 0 means the size of 'type'.
+} bon_soa_field;
+
+bon_bool    bon_r_unpack_soa (bon_r_doc* B, bon_value* srcVal, bon_size nelem,
+										const bon_soa_field* fields, bon_size nfields);
+
+
+/*
+ Parts of packed arrays, for tiled or streaming access to huge arrays
+ without unpacking all of them. Elements are [begin, end).
+ 
+ // Pointer to elements 1000000 to 1000100, if they are stored as floats:
+ const float* ptr = bon_r_unpack_range_ptr(B, val, 1000000, 1000100, float_type);
+ 
+ // Any compatible type, converted:
+ double dbls[100];
+ bon_r_unpack_range(B, val, 1000000, 1000100, dbls, sizeof(dbls), double_type);
+ 
+ // Only the 'pos' of vertices [0, n), each written 'sizeof(MyVert)' bytes apart:
+ bon_r_unpack_field(B, verts, 0, n, "pos", &my_verts[0].pos, sizeof(MyVert), vec3_type);
+ */
+
+// Returns NULL unless the elements are stored exactly as 'elemType'.
+const void* bon_r_unpack_range_ptr(bon_r_doc* B, bon_value* srcVal,
+											  bon_size begin, bon_size end, const bon_type* elemType);
+
+// 'nbytes' must be (end-begin) times the size of 'elemType'.
+bon_bool    bon_r_unpack_range    (bon_r_doc* B, bon_value* srcVal,
+											  bon_size begin, bon_size end,
+											  void* dst, bon_size nbytes, const bon_type* elemType);
+
+// For arrays of structs. A 'stride' of 0 means the size of 'fieldType'.
+bon_bool    bon_r_unpack_field    (bon_r_doc* B, bon_value* srcVal,
+											  bon_size begin, bon_size end, const char* key,
+											  void* dst, bon_size stride, const bon_type* fieldType);
+
+
+/*
+ Tables (see bon_w_table_begin) are lists of objects to the accessors above.
+ These give direct access to their columns, with bon_r_list_size rows each.
+ 
+ bon_value* col = bon_r_table_col_value(B, table, "price");
+ const float* prices = bon_r_unpack_array(B, col, n, BON_TYPE_FLOAT);  // If stored as floats
+ bon_r_unpack_fmt(B, col, dst, n * sizeof(double), "[#d]", n);        // Any number column
+ */
+typedef struct {
+	const char*     key;
+	bon_type_id     type;     // A number type, BON_TYPE_BOOL (a byte per row) or BON_TYPE_STRING
+	bon_size        size;     // Number of rows
+	const void*     data;     // A value per row, not necessarily aligned. For strings: the zero ended strings.
+	const uint8_t*  offsets;  // BON_TYPE_STRING only: size+1 uint32_le. Row i starts at 'data' + offsets[i].
+} bon_column;
+
+bon_bool           bon_r_is_table        (bon_r_doc* B, bon_value* val);
+bon_size           bon_r_table_cols      (bon_r_doc* B, bon_value* val);
+const bon_column*  bon_r_table_col       (bon_r_doc* B, bon_value* val, bon_size ix);  // NULL if out of range
+const bon_column*  bon_r_table_get_col   (bon_r_doc* B, bon_value* val, const char* key);
+
+// String 'row' of a BON_TYPE_STRING column. NULL if out of range.
+const char*        bon_column_str        (const bon_column* col, bon_size row, bon_size* out_size);
+
+// The column as a packed array (bools as uint8), or as a list for strings. Made once, on demand.
+bon_value*         bon_r_table_col_value (bon_r_doc* B, bon_value* val, const char* key);
+
 
 //------------------------------------------------------------------------------
 
@@ -546,6 +952,25 @@ const void* bon_r_unpack_array(bon_r_doc* B, bon_value* srcVal,
 // Useful for debugging.
 void bon_print(bon_r_doc* B, bon_value* value, FILE* out, size_t indent);
 
+
+/*
+ Writes 'value' as JSON text, laid out like jansson's json_dumpf with the same flags
+ (JSON_INDENT(n), JSON_COMPACT, JSON_ENSURE_ASCII and JSON_ESCAPE_SLASH), keys in document order.
+ The output is streamed through a buffer to 'writer'. Packed aggregates and tables
+ are written element by element, straight from their bytes, so no JSON tree is built.
+ NaN and infinities are written as 0e666, 1e99999 and -1e99999, which jansson reads back.
+ Returns false on a write error, or on values that can't be written (e.g. broken block references).
+ 
+ bon_r_write_json(B, bon_r_root(B), bon_file_writer, stdout, BON_JSON_INDENT(4));
+ */
+#define BON_JSON_INDENT(n)      ((unsigned)(n) & 0x1F)
+#define BON_JSON_COMPACT        0x20
+#define BON_JSON_ENSURE_ASCII   0x40
+#define BON_JSON_ESCAPE_SLASH   0x400
+
+bon_bool bon_r_write_json(bon_r_doc* B, bon_value* value, bon_w_writer_t writer, void* userData,
+								  unsigned flags);
+
 //------------------------------------------------------------------------------
 
 #include "inline.h"
@@ -0,0 +1,1257 @@
+//
+//  convert.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#include "bon.h"
+#include "private.h"
+#include <string.h>       // memcpy
+
+
+//------------------------------------------------------------------------------
+// Kernels for casting arrays of native numbers, e.g. float -> double.
+
+
+#define BON_CAST_FN(Src, Dst)                                              \
+/**/  static bon_bool bon_cast_##Src##_##Dst(const void* src_v, void* dst_v, \
+/**/                                         bon_size n)                  \
+/**/  {                                                                    \
+/**/      const Src* src = (const Src*)src_v;                              \
+/**/      Dst*       dst = (Dst*)dst_v;                                    \
+/**/      for (bon_size ix=0; ix<n; ++ix) {                                \
+/**/          dst[ix] = (Dst)src[ix];                                      \
+/**/      }                                                                \
+/**/      return BON_TRUE;                                                 \
+/**/  }
+
+/* Real -> integer: fails with narrowing if a value (after truncation) is out of range, or NaN.
+   'Lo' and 'Hi' are exclusive bounds. */
+#define BON_CAST_FN_CHECKED(Src, Dst, Lo, Hi)                              \
+/**/  static bon_bool bon_cast_##Src##_##Dst(const void* src_v, void* dst_v, \
+/**/                                         bon_size n)                  \
+/**/  {                                                                    \
+/**/      const Src* src = (const Src*)src_v;                              \
+/**/      Dst*       dst = (Dst*)dst_v;                                    \
+/**/      for (bon_size ix=0; ix<n; ++ix) {                                \
+/**/          double v = (double)src[ix];                                  \
+/**/          if (!(Lo < v && v < Hi)) {                                   \
+/**/              return BON_FALSE;                                        \
+/**/          }                                                            \
+/**/          dst[ix] = (Dst)src[ix];                                      \
+/**/      }                                                                \
+/**/      return BON_TRUE;                                                 \
+/**/  }
+
+#define BON_CAST_FNS_INT(Src)    \
+/**/  BON_CAST_FN(Src, double)   \
+/**/  BON_CAST_FN(Src, float)    \
+/**/  BON_CAST_FN(Src, int64_t)  \
+/**/  BON_CAST_FN(Src, int32_t)  \
+/**/  BON_CAST_FN(Src, int16_t)  \
+/**/  BON_CAST_FN(Src, int8_t)   \
+/**/  BON_CAST_FN(Src, uint64_t) \
+/**/  BON_CAST_FN(Src, uint32_t) \
+/**/  BON_CAST_FN(Src, uint16_t) \
+/**/  BON_CAST_FN(Src, uint8_t)
+
+// -2^63 - 2048 is the closest double below -2^63
+#define BON_CAST_FNS_REAL(Src)                                                              \
+/**/  BON_CAST_FN(Src, double)                                                              \
+/**/  BON_CAST_FN(Src, float)                                                               \
+/**/  BON_CAST_FN_CHECKED(Src, int64_t,  -9223372036854777856.0, 9223372036854775808.0)     \
+/**/  BON_CAST_FN_CHECKED(Src, int32_t,  -2147483649.0,          2147483648.0)              \
+/**/  BON_CAST_FN_CHECKED(Src, int16_t,  -32769.0,               32768.0)                   \
+/**/  BON_CAST_FN_CHECKED(Src, int8_t,   -129.0,                 128.0)                     \
+/**/  BON_CAST_FN_CHECKED(Src, uint64_t, -1.0,                   18446744073709551616.0)    \
+/**/  BON_CAST_FN_CHECKED(Src, uint32_t, -1.0,                   4294967296.0)              \
+/**/  BON_CAST_FN_CHECKED(Src, uint16_t, -1.0,                   65536.0)                   \
+/**/  BON_CAST_FN_CHECKED(Src, uint8_t,  -1.0,                   256.0)
+
+BON_CAST_FNS_REAL(double)
+BON_CAST_FNS_REAL(float)
+BON_CAST_FNS_INT(int64_t)
+BON_CAST_FNS_INT(int32_t)
+BON_CAST_FNS_INT(int16_t)
+BON_CAST_FNS_INT(int8_t)
+BON_CAST_FNS_INT(uint64_t)
+BON_CAST_FNS_INT(uint32_t)
+BON_CAST_FNS_INT(uint16_t)
+BON_CAST_FNS_INT(uint8_t)
+
+// Division (rather than multiplying by 1/255) so that 255 -> exactly 1.
+static bon_bool bon_cast_unorm8(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	for (bon_size ix=0; ix<n; ++ix) {
+		dst[ix] = (float)src[ix] / 255.0f;
+	}
+	return BON_TRUE;
+}
+
+
+//------------------------------------------------------------------------------
+// 16-bit floats
+
+
+float bon_half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp  = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+	uint32_t bits;
+	
+	if (exp == 0x1f) {
+		bits = sign | 0x7f800000 | (mant << 13); // Inf or NaN
+	} else if (exp != 0) {
+		bits = sign | ((exp + (127 - 15)) << 23) | (mant << 13);
+	} else {
+		// Zero or subnormal: exactly mant * 2^-24
+		float f = (float)mant * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+	
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// See https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+uint16_t bon_float_to_half(float f)
+{
+	const uint32_t f32_inf      = 255 << 23;
+	const uint32_t f16_max      = (127 + 16) << 23;  // Rounds to Inf from here
+	const uint32_t denorm_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+	
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint32_t sign = x & 0x80000000u;
+	x ^= sign;
+	
+	uint16_t h;
+	if (x >= f16_max) {
+		h = (x > f32_inf ? 0x7e00 : 0x7c00); // NaN -> quiet NaN, Inf -> Inf
+	} else if (x < (113 << 23)) {
+		// Subnormal or zero: let the FPU do the rounding
+		float a, magic;
+		memcpy(&a, &x, sizeof(a));
+		memcpy(&magic, &denorm_magic, sizeof(magic));
+		a += magic;
+		memcpy(&x, &a, sizeof(x));
+		h = (uint16_t)(x - denorm_magic);
+	} else {
+		uint32_t mant_odd = (x >> 13) & 1;
+		x += ((uint32_t)(15 - 127) << 23) + 0xfff + mant_odd;
+		h = (uint16_t)(x >> 13);
+	}
+	
+	return h | (uint16_t)(sign >> 16);
+}
+
+float bon_bf16_to_float(uint16_t b)
+{
+	uint32_t bits = (uint32_t)b << 16;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+uint16_t bon_float_to_bf16(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	if ((x & 0x7fffffff) > 0x7f800000) {
+		return (uint16_t)((x >> 16) | 0x40); // Keep NaN a (quiet) NaN
+	}
+	x += 0x7fff + ((x >> 16) & 1);
+	return (uint16_t)(x >> 16);
+}
+
+#define BON_HALF_FNS(Name)                                                     \
+/**/  static bon_bool bon_cast_##Name##_float(const void* src_v, void* dst_v,   \
+/**/                                          bon_size n)                      \
+/**/  {                                                                         \
+/**/      const uint16_t* src = (const uint16_t*)src_v;                         \
+/**/      float*          dst = (float*)dst_v;                                  \
+/**/      for (bon_size ix=0; ix<n; ++ix) {                                     \
+/**/          dst[ix] = bon_##Name##_to_float(src[ix]);                         \
+/**/      }                                                                     \
+/**/      return BON_TRUE;                                                      \
+/**/  }                                                                         \
+/**/  static bon_bool bon_cast_float_##Name(const void* src_v, void* dst_v,     \
+/**/                                        bon_size n)                        \
+/**/  {                                                                         \
+/**/      const float*    src = (const float*)src_v;                            \
+/**/      uint16_t*       dst = (uint16_t*)dst_v;                               \
+/**/      for (bon_size ix=0; ix<n; ++ix) {                                     \
+/**/          dst[ix] = bon_float_to_##Name(src[ix]);                           \
+/**/      }                                                                     \
+/**/      return BON_TRUE;                                                      \
+/**/  }
+
+BON_HALF_FNS(half)
+BON_HALF_FNS(bf16)
+
+
+// Reverses the bytes of each element, i.e. converts between big and little endian.
+#define BON_BSWAP_FN(Bits)                                                         \
+/**/  static bon_bool bon_bswap##Bits(const void* src_v, void* dst_v, bon_size n)  \
+/**/  {                                                                            \
+/**/      const uint##Bits##_t* src = (const uint##Bits##_t*)src_v;                \
+/**/      uint##Bits##_t*       dst = (uint##Bits##_t*)dst_v;                      \
+/**/      for (bon_size ix=0; ix<n; ++ix) {                                        \
+/**/          dst[ix] = swap_endian_uint##Bits(src[ix]);                           \
+/**/      }                                                                        \
+/**/      return BON_TRUE;                                                         \
+/**/  }
+
+BON_BSWAP_FN(16)
+BON_BSWAP_FN(32)
+BON_BSWAP_FN(64)
+
+
+//------------------------------------------------------------------------------
+// SIMD versions of the most common casts.
+// Compiled for SSE2, AVX2 and AVX-512 regardless of the compiler flags,
+// and picked at runtime depending on the CPU.
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define BON_SIMD_X86 1
+#  include <immintrin.h>
+#  define BON_SSE2    __attribute__((target("sse2")))
+#  define BON_AVX2    __attribute__((target("avx2")))
+#  define BON_AVX512  __attribute__((target("avx512f,avx512bw")))
+#  define BON_F16C    __attribute__((target("avx2,f16c")))
+#else
+#  define BON_SIMD_X86 0
+#endif
+
+
+#if BON_SIMD_X86
+
+/* Float -> int kernels check for narrowing with exclusive float bounds.
+   -2147483904 is the closest float below -2^31. */
+#define BON_F2I_LO_int32_t   -2147483904.0f
+#define BON_F2I_HI_int32_t    2147483648.0f
+#define BON_F2I_LO_int16_t   -32769.0f
+#define BON_F2I_HI_int16_t    32768.0f
+#define BON_F2I_LO_int8_t    -129.0f
+#define BON_F2I_HI_int8_t     128.0f
+#define BON_F2I_LO_uint16_t  -1.0f
+#define BON_F2I_HI_uint16_t   65536.0f
+#define BON_F2I_LO_uint8_t   -1.0f
+#define BON_F2I_HI_uint8_t    256.0f
+
+
+//------------------------------------------------------------------------------
+// SSE2: 4 floats at a time
+
+
+static BON_SSE2 bon_bool bon_cast_float_double_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	double*      dst = (double*)dst_v;
+	bon_size ix = 0;
+	for (; ix+4 <= n; ix += 4) {
+		__m128 v = _mm_loadu_ps(src + ix);
+		_mm_storeu_pd(dst + ix,     _mm_cvtps_pd(v));
+		_mm_storeu_pd(dst + ix + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	return bon_cast_float_double(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_double_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const double* src = (const double*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+4 <= n; ix += 4) {
+		__m128 a = _mm_cvtpd_ps(_mm_loadu_pd(src + ix));
+		__m128 b = _mm_cvtpd_ps(_mm_loadu_pd(src + ix + 2));
+		_mm_storeu_ps(dst + ix, _mm_movelh_ps(a, b));
+	}
+	return bon_cast_double_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_int32_t_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int32_t* src = (const int32_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+4 <= n; ix += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + ix));
+		_mm_storeu_ps(dst + ix, _mm_cvtepi32_ps(v));
+	}
+	return bon_cast_int32_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_int16_t_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int16_t* src = (const int16_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i v  = _mm_loadu_si128((const __m128i*)(src + ix));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // Sign extend
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(dst + ix,     _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(dst + ix + 4, _mm_cvtepi32_ps(hi));
+	}
+	return bon_cast_int16_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_int8_t_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int8_t* src = (const int8_t*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m128i v   = _mm_loadu_si128((const __m128i*)(src + ix));
+		__m128i w0  = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+		__m128i w1  = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+		_mm_storeu_ps(dst + ix,      _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(w0, w0), 16)));
+		_mm_storeu_ps(dst + ix + 4,  _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(w0, w0), 16)));
+		_mm_storeu_ps(dst + ix + 8,  _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(w1, w1), 16)));
+		_mm_storeu_ps(dst + ix + 12, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(w1, w1), 16)));
+	}
+	return bon_cast_int8_t_float(src + ix, dst + ix, n - ix);
+}
+
+// Four vectors of 4 floats, from 16 bytes
+BON_INLINE BON_SSE2 void bon_u8x16_to_f32_sse2(__m128i v, __m128* out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i w0 = _mm_unpacklo_epi8(v, zero);
+	__m128i w1 = _mm_unpackhi_epi8(v, zero);
+	out[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w0, zero));
+	out[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w0, zero));
+	out[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w1, zero));
+	out[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w1, zero));
+}
+
+static BON_SSE2 bon_bool bon_cast_uint8_t_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m128 f[4];
+		bon_u8x16_to_f32_sse2(_mm_loadu_si128((const __m128i*)(src + ix)), f);
+		for (int i=0; i<4; ++i) {
+			_mm_storeu_ps(dst + ix + 4*i, f[i]);
+		}
+	}
+	return bon_cast_uint8_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_unorm8_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	const __m128 scale = _mm_set1_ps(255.0f);
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m128 f[4];
+		bon_u8x16_to_f32_sse2(_mm_loadu_si128((const __m128i*)(src + ix)), f);
+		for (int i=0; i<4; ++i) {
+			_mm_storeu_ps(dst + ix + 4*i, _mm_div_ps(f[i], scale));
+		}
+	}
+	return bon_cast_unorm8(src + ix, dst + ix, n - ix);
+}
+
+// Truncates 4 floats to int32. Returns false if any is out of [lo, hi] (exclusive) or NaN.
+BON_INLINE BON_SSE2 bon_bool bon_f32x4_to_i32_sse2(const float* src, __m128 lo, __m128 hi,
+																			 __m128i* out)
+{
+	__m128 v  = _mm_loadu_ps(src);
+	__m128 ok = _mm_and_ps(_mm_cmpgt_ps(v, lo), _mm_cmplt_ps(v, hi));
+	if (_mm_movemask_ps(ok) != 0xF) {
+		return BON_FALSE;
+	}
+	*out = _mm_cvttps_epi32(v);
+	return BON_TRUE;
+}
+
+static BON_SSE2 bon_bool bon_cast_float_int32_t_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	int32_t*     dst = (int32_t*)dst_v;
+	const __m128 lo = _mm_set1_ps(BON_F2I_LO_int32_t);
+	const __m128 hi = _mm_set1_ps(BON_F2I_HI_int32_t);
+	bon_size ix = 0;
+	for (; ix+4 <= n; ix += 4) {
+		__m128i i;
+		if (!bon_f32x4_to_i32_sse2(src + ix, lo, hi, &i)) { return BON_FALSE; }
+		_mm_storeu_si128((__m128i*)(dst + ix), i);
+	}
+	return bon_cast_float_int32_t(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_float_int16_t_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	int16_t*     dst = (int16_t*)dst_v;
+	const __m128 lo = _mm_set1_ps(BON_F2I_LO_int16_t);
+	const __m128 hi = _mm_set1_ps(BON_F2I_HI_int16_t);
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i a, b;
+		if (!bon_f32x4_to_i32_sse2(src + ix,     lo, hi, &a)) { return BON_FALSE; }
+		if (!bon_f32x4_to_i32_sse2(src + ix + 4, lo, hi, &b)) { return BON_FALSE; }
+		_mm_storeu_si128((__m128i*)(dst + ix), _mm_packs_epi32(a, b));
+	}
+	return bon_cast_float_int16_t(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_float_uint16_t_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	uint16_t*    dst = (uint16_t*)dst_v;
+	const __m128  lo   = _mm_set1_ps(BON_F2I_LO_uint16_t);
+	const __m128  hi   = _mm_set1_ps(BON_F2I_HI_uint16_t);
+	const __m128i bias = _mm_set1_epi32(32768);
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i a, b;
+		if (!bon_f32x4_to_i32_sse2(src + ix,     lo, hi, &a)) { return BON_FALSE; }
+		if (!bon_f32x4_to_i32_sse2(src + ix + 4, lo, hi, &b)) { return BON_FALSE; }
+		// No unsigned 32->16 pack in SSE2: pack signed around the bias, then flip it back.
+		__m128i s = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+		_mm_storeu_si128((__m128i*)(dst + ix), _mm_xor_si128(s, _mm_set1_epi16((short)0x8000)));
+	}
+	return bon_cast_float_uint16_t(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_float_int8_t_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	int8_t*      dst = (int8_t*)dst_v;
+	const __m128 lo = _mm_set1_ps(BON_F2I_LO_int8_t);
+	const __m128 hi = _mm_set1_ps(BON_F2I_HI_int8_t);
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i a, b;
+		if (!bon_f32x4_to_i32_sse2(src + ix,     lo, hi, &a)) { return BON_FALSE; }
+		if (!bon_f32x4_to_i32_sse2(src + ix + 4, lo, hi, &b)) { return BON_FALSE; }
+		__m128i w = _mm_packs_epi32(a, b);
+		_mm_storel_epi64((__m128i*)(dst + ix), _mm_packs_epi16(w, w));
+	}
+	return bon_cast_float_int8_t(src + ix, dst + ix, n - ix);
+}
+
+static BON_SSE2 bon_bool bon_cast_float_uint8_t_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	uint8_t*     dst = (uint8_t*)dst_v;
+	const __m128 lo = _mm_set1_ps(BON_F2I_LO_uint8_t);
+	const __m128 hi = _mm_set1_ps(BON_F2I_HI_uint8_t);
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i a, b;
+		if (!bon_f32x4_to_i32_sse2(src + ix,     lo, hi, &a)) { return BON_FALSE; }
+		if (!bon_f32x4_to_i32_sse2(src + ix + 4, lo, hi, &b)) { return BON_FALSE; }
+		__m128i w = _mm_packs_epi32(a, b);
+		_mm_storel_epi64((__m128i*)(dst + ix), _mm_packus_epi16(w, w));
+	}
+	return bon_cast_float_uint8_t(src + ix, dst + ix, n - ix);
+}
+
+
+//------------------------------------------------------------------------------
+// AVX2: 8 floats at a time
+
+
+static BON_AVX2 bon_bool bon_cast_float_double_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	double*      dst = (double*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		_mm256_storeu_pd(dst + ix,     _mm256_cvtps_pd(_mm_loadu_ps(src + ix)));
+		_mm256_storeu_pd(dst + ix + 4, _mm256_cvtps_pd(_mm_loadu_ps(src + ix + 4)));
+	}
+	return bon_cast_float_double(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_double_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const double* src = (const double*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		_mm_storeu_ps(dst + ix,     _mm256_cvtpd_ps(_mm256_loadu_pd(src + ix)));
+		_mm_storeu_ps(dst + ix + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + ix + 4)));
+	}
+	return bon_cast_double_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_int32_t_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int32_t* src = (const int32_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + ix));
+		_mm256_storeu_ps(dst + ix, _mm256_cvtepi32_ps(v));
+	}
+	return bon_cast_int32_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_int16_t_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int16_t* src = (const int16_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + ix)));
+		_mm256_storeu_ps(dst + ix, _mm256_cvtepi32_ps(v));
+	}
+	return bon_cast_int16_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_int8_t_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const int8_t* src = (const int8_t*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(src + ix)));
+		_mm256_storeu_ps(dst + ix, _mm256_cvtepi32_ps(v));
+	}
+	return bon_cast_int8_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_uint8_t_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + ix)));
+		_mm256_storeu_ps(dst + ix, _mm256_cvtepi32_ps(v));
+	}
+	return bon_cast_uint8_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_unorm8_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + ix)));
+		_mm256_storeu_ps(dst + ix, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	return bon_cast_unorm8(src + ix, dst + ix, n - ix);
+}
+
+// Truncates 8 floats to int32. Returns false if any is out of [lo, hi] (exclusive) or NaN.
+BON_INLINE BON_AVX2 bon_bool bon_f32x8_to_i32_avx2(const float* src, __m256 lo, __m256 hi,
+																			 __m256i* out)
+{
+	__m256 v  = _mm256_loadu_ps(src);
+	__m256 ok = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GT_OQ), _mm256_cmp_ps(v, hi, _CMP_LT_OQ));
+	if (_mm256_movemask_ps(ok) != 0xFF) {
+		return BON_FALSE;
+	}
+	*out = _mm256_cvttps_epi32(v);
+	return BON_TRUE;
+}
+
+BON_INLINE BON_AVX2 void bon_store_i32x8_int32_t_avx2(int32_t* dst, __m256i v)
+{
+	_mm256_storeu_si256((__m256i*)dst, v);
+}
+
+BON_INLINE BON_AVX2 void bon_store_i32x8_int16_t_avx2(int16_t* dst, __m256i v)
+{
+	__m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storeu_si128((__m128i*)dst, w);
+}
+
+BON_INLINE BON_AVX2 void bon_store_i32x8_uint16_t_avx2(uint16_t* dst, __m256i v)
+{
+	__m128i w = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storeu_si128((__m128i*)dst, w);
+}
+
+BON_INLINE BON_AVX2 void bon_store_i32x8_int8_t_avx2(int8_t* dst, __m256i v)
+{
+	__m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storel_epi64((__m128i*)dst, _mm_packs_epi16(w, w));
+}
+
+BON_INLINE BON_AVX2 void bon_store_i32x8_uint8_t_avx2(uint8_t* dst, __m256i v)
+{
+	__m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(w, w));
+}
+
+#define BON_CAST_F2I_AVX2(Dst)                                                            \
+/**/  static BON_AVX2 bon_bool bon_cast_float_##Dst##_avx2(const void* src_v, void* dst_v, \
+/**/                                                       bon_size n)                  \
+/**/  {                                                                                  \
+/**/      const float* src = (const float*)src_v;                                        \
+/**/      Dst*         dst = (Dst*)dst_v;                                                \
+/**/      const __m256 lo = _mm256_set1_ps(BON_F2I_LO_##Dst);                            \
+/**/      const __m256 hi = _mm256_set1_ps(BON_F2I_HI_##Dst);                            \
+/**/      bon_size ix = 0;                                                               \
+/**/      for (; ix+8 <= n; ix += 8) {                                                   \
+/**/          __m256i i;                                                                 \
+/**/          if (!bon_f32x8_to_i32_avx2(src + ix, lo, hi, &i)) { return BON_FALSE; }    \
+/**/          bon_store_i32x8_##Dst##_avx2(dst + ix, i);                                 \
+/**/      }                                                                              \
+/**/      return bon_cast_float_##Dst(src + ix, dst + ix, n - ix);                       \
+/**/  }
+
+BON_CAST_F2I_AVX2(int32_t)
+BON_CAST_F2I_AVX2(int16_t)
+BON_CAST_F2I_AVX2(uint16_t)
+BON_CAST_F2I_AVX2(int8_t)
+BON_CAST_F2I_AVX2(uint8_t)
+
+
+//------------------------------------------------------------------------------
+// AVX-512: 16 floats at a time
+
+
+static BON_AVX512 bon_bool bon_cast_float_double_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	double*      dst = (double*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		_mm512_storeu_pd(dst + ix,     _mm512_cvtps_pd(_mm256_loadu_ps(src + ix)));
+		_mm512_storeu_pd(dst + ix + 8, _mm512_cvtps_pd(_mm256_loadu_ps(src + ix + 8)));
+	}
+	return bon_cast_float_double(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_double_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const double* src = (const double*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		_mm256_storeu_ps(dst + ix,     _mm512_cvtpd_ps(_mm512_loadu_pd(src + ix)));
+		_mm256_storeu_ps(dst + ix + 8, _mm512_cvtpd_ps(_mm512_loadu_pd(src + ix + 8)));
+	}
+	return bon_cast_double_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_int32_t_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const int32_t* src = (const int32_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		_mm512_storeu_ps(dst + ix, _mm512_cvtepi32_ps(_mm512_loadu_si512(src + ix)));
+	}
+	return bon_cast_int32_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_int16_t_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const int16_t* src = (const int16_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m512i v = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(src + ix)));
+		_mm512_storeu_ps(dst + ix, _mm512_cvtepi32_ps(v));
+	}
+	return bon_cast_int16_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_int8_t_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const int8_t* src = (const int8_t*)src_v;
+	float*        dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m512i v = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)(src + ix)));
+		_mm512_storeu_ps(dst + ix, _mm512_cvtepi32_ps(v));
+	}
+	return bon_cast_int8_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_uint8_t_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(src + ix)));
+		_mm512_storeu_ps(dst + ix, _mm512_cvtepi32_ps(v));
+	}
+	return bon_cast_uint8_t_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_unorm8_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint8_t* src = (const uint8_t*)src_v;
+	float*         dst = (float*)dst_v;
+	const __m512 scale = _mm512_set1_ps(255.0f);
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(src + ix)));
+		_mm512_storeu_ps(dst + ix, _mm512_div_ps(_mm512_cvtepi32_ps(v), scale));
+	}
+	return bon_cast_unorm8(src + ix, dst + ix, n - ix);
+}
+
+// Truncates 16 floats to int32. Returns false if any is out of [lo, hi] (exclusive) or NaN.
+BON_INLINE BON_AVX512 bon_bool bon_f32x16_to_i32_avx512(const float* src, __m512 lo, __m512 hi,
+																					__m512i* out)
+{
+	__m512 v = _mm512_loadu_ps(src);
+	__mmask16 ok = _mm512_cmp_ps_mask(v, lo, _CMP_GT_OQ) & _mm512_cmp_ps_mask(v, hi, _CMP_LT_OQ);
+	if (ok != 0xFFFF) {
+		return BON_FALSE;
+	}
+	*out = _mm512_cvttps_epi32(v);
+	return BON_TRUE;
+}
+
+// The values are range checked, so plain truncation suffices for all widths.
+BON_INLINE BON_AVX512 void bon_store_i32x16_int32_t_avx512(int32_t* dst, __m512i v)
+{
+	_mm512_storeu_si512(dst, v);
+}
+
+BON_INLINE BON_AVX512 void bon_store_i32x16_int16_t_avx512(int16_t* dst, __m512i v)
+{
+	_mm256_storeu_si256((__m256i*)dst, _mm512_cvtepi32_epi16(v));
+}
+
+BON_INLINE BON_AVX512 void bon_store_i32x16_uint16_t_avx512(uint16_t* dst, __m512i v)
+{
+	_mm256_storeu_si256((__m256i*)dst, _mm512_cvtepi32_epi16(v));
+}
+
+BON_INLINE BON_AVX512 void bon_store_i32x16_int8_t_avx512(int8_t* dst, __m512i v)
+{
+	_mm_storeu_si128((__m128i*)dst, _mm512_cvtepi32_epi8(v));
+}
+
+BON_INLINE BON_AVX512 void bon_store_i32x16_uint8_t_avx512(uint8_t* dst, __m512i v)
+{
+	_mm_storeu_si128((__m128i*)dst, _mm512_cvtepi32_epi8(v));
+}
+
+#define BON_CAST_F2I_AVX512(Dst)                                                            \
+/**/  static BON_AVX512 bon_bool bon_cast_float_##Dst##_avx512(const void* src_v, void* dst_v, \
+/**/                                                           bon_size n)                  \
+/**/  {                                                                                      \
+/**/      const float* src = (const float*)src_v;                                            \
+/**/      Dst*         dst = (Dst*)dst_v;                                                    \
+/**/      const __m512 lo = _mm512_set1_ps(BON_F2I_LO_##Dst);                                \
+/**/      const __m512 hi = _mm512_set1_ps(BON_F2I_HI_##Dst);                                \
+/**/      bon_size ix = 0;                                                                   \
+/**/      for (; ix+16 <= n; ix += 16) {                                                     \
+/**/          __m512i i;                                                                     \
+/**/          if (!bon_f32x16_to_i32_avx512(src + ix, lo, hi, &i)) { return BON_FALSE; }     \
+/**/          bon_store_i32x16_##Dst##_avx512(dst + ix, i);                                  \
+/**/      }                                                                                  \
+/**/      return bon_cast_float_##Dst(src + ix, dst + ix, n - ix);                           \
+/**/  }
+
+BON_CAST_F2I_AVX512(int32_t)
+BON_CAST_F2I_AVX512(int16_t)
+BON_CAST_F2I_AVX512(uint16_t)
+BON_CAST_F2I_AVX512(int8_t)
+BON_CAST_F2I_AVX512(uint8_t)
+
+
+//------------------------------------------------------------------------------
+// 16-bit floats. bfloat16 is just a shift. Half precision needs F16C or AVX-512.
+
+
+static BON_SSE2 bon_bool bon_cast_bf16_float_sse2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint16_t* src = (const uint16_t*)src_v;
+	float*          dst = (float*)dst_v;
+	const __m128i zero = _mm_setzero_si128();
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + ix));
+		_mm_storeu_si128((__m128i*)(dst + ix),     _mm_unpacklo_epi16(zero, v));
+		_mm_storeu_si128((__m128i*)(dst + ix + 4), _mm_unpackhi_epi16(zero, v));
+	}
+	return bon_cast_bf16_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX2 bon_bool bon_cast_bf16_float_avx2(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint16_t* src = (const uint16_t*)src_v;
+	float*          dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + ix)));
+		_mm256_storeu_si256((__m256i*)(dst + ix), _mm256_slli_epi32(v, 16));
+	}
+	return bon_cast_bf16_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_bf16_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint16_t* src = (const uint16_t*)src_v;
+	float*          dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m512i v = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src + ix)));
+		_mm512_storeu_si512(dst + ix, _mm512_slli_epi32(v, 16));
+	}
+	return bon_cast_bf16_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_F16C bon_bool bon_cast_half_float_f16c(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint16_t* src = (const uint16_t*)src_v;
+	float*          dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + ix));
+		_mm256_storeu_ps(dst + ix, _mm256_cvtph_ps(v));
+	}
+	return bon_cast_half_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_F16C bon_bool bon_cast_float_half_f16c(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	uint16_t*    dst = (uint16_t*)dst_v;
+	bon_size ix = 0;
+	for (; ix+8 <= n; ix += 8) {
+		__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + ix), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i*)(dst + ix), h);
+	}
+	return bon_cast_float_half(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_half_float_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const uint16_t* src = (const uint16_t*)src_v;
+	float*          dst = (float*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + ix));
+		_mm512_storeu_ps(dst + ix, _mm512_cvtph_ps(v));
+	}
+	return bon_cast_half_float(src + ix, dst + ix, n - ix);
+}
+
+static BON_AVX512 bon_bool bon_cast_float_half_avx512(const void* src_v, void* dst_v, bon_size n)
+{
+	const float* src = (const float*)src_v;
+	uint16_t*    dst = (uint16_t*)dst_v;
+	bon_size ix = 0;
+	for (; ix+16 <= n; ix += 16) {
+		__m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + ix), _MM_FROUND_TO_NEAREST_INT);
+		_mm256_storeu_si256((__m256i*)(dst + ix), h);
+	}
+	return bon_cast_float_half(src + ix, dst + ix, n - ix);
+}
+
+
+//------------------------------------------------------------------------------
+// Byte swapping, 16 bytes (SSE2), 32 bytes (AVX2) or 64 bytes (AVX-512) at a time
+
+
+// SSE2 has no byte shuffle: swap the 16-bit words, then the bytes within them.
+BON_INLINE BON_SSE2 __m128i bon_bswap16x8_sse2(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+#define BON_BSWAP_SSE2(Bits, WordShuffle)                                             \
+/**/  static BON_SSE2 bon_bool bon_bswap##Bits##_sse2(const void* src_v, void* dst_v, \
+/**/                                                  bon_size n)                   \
+/**/  {                                                                               \
+/**/      const uint8_t* src = (const uint8_t*)src_v;                                 \
+/**/      uint8_t*       dst = (uint8_t*)dst_v;                                       \
+/**/      const bon_size per_vec = 128 / Bits;                                        \
+/**/      bon_size ix = 0;                                                            \
+/**/      for (; ix + per_vec <= n; ix += per_vec) {                                  \
+/**/          __m128i v = _mm_loadu_si128((const __m128i*)(src + ix * Bits/8));       \
+/**/          WordShuffle                                                             \
+/**/          _mm_storeu_si128((__m128i*)(dst + ix * Bits/8), bon_bswap16x8_sse2(v)); \
+/**/      }                                                                           \
+/**/      return bon_bswap##Bits(src + ix * Bits/8, dst + ix * Bits/8, n - ix);       \
+/**/  }
+
+BON_BSWAP_SSE2(16, ;)
+BON_BSWAP_SSE2(32, v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);)
+BON_BSWAP_SSE2(64, v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);)
+
+// pshufb masks reversing each 2, 4 or 8 byte group of a 16 byte lane
+#define BON_BSWAP_MASK_16  14,15,12,13,10,11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1
+#define BON_BSWAP_MASK_32  12,13,14,15, 8, 9,10,11, 4, 5, 6, 7, 0, 1, 2, 3
+#define BON_BSWAP_MASK_64   8, 9,10,11,12,13,14,15, 0, 1, 2, 3, 4, 5, 6, 7
+
+#define BON_BSWAP_AVX2(Bits)                                                          \
+/**/  static BON_AVX2 bon_bool bon_bswap##Bits##_avx2(const void* src_v, void* dst_v, \
+/**/                                                  bon_size n)                   \
+/**/  {                                                                               \
+/**/      const uint8_t* src = (const uint8_t*)src_v;                                 \
+/**/      uint8_t*       dst = (uint8_t*)dst_v;                                       \
+/**/      const __m256i mask = _mm256_set_epi8(BON_BSWAP_MASK_##Bits,                 \
+/**/                                           BON_BSWAP_MASK_##Bits);                \
+/**/      const bon_size per_vec = 256 / Bits;                                        \
+/**/      bon_size ix = 0;                                                            \
+/**/      for (; ix + per_vec <= n; ix += per_vec) {                                  \
+/**/          __m256i v = _mm256_loadu_si256((const __m256i*)(src + ix * Bits/8));    \
+/**/          _mm256_storeu_si256((__m256i*)(dst + ix * Bits/8),                      \
+/**/                              _mm256_shuffle_epi8(v, mask));                      \
+/**/      }                                                                           \
+/**/      return bon_bswap##Bits(src + ix * Bits/8, dst + ix * Bits/8, n - ix);       \
+/**/  }
+
+BON_BSWAP_AVX2(16)
+BON_BSWAP_AVX2(32)
+BON_BSWAP_AVX2(64)
+
+#define BON_BSWAP_AVX512(Bits)                                                            \
+/**/  static BON_AVX512 bon_bool bon_bswap##Bits##_avx512(const void* src_v, void* dst_v, \
+/**/                                                      bon_size n)                   \
+/**/  {                                                                                   \
+/**/      const uint8_t* src = (const uint8_t*)src_v;                                     \
+/**/      uint8_t*       dst = (uint8_t*)dst_v;                                           \
+/**/      const __m512i mask = _mm512_broadcast_i32x4(_mm_set_epi8(BON_BSWAP_MASK_##Bits)); \
+/**/      const bon_size per_vec = 512 / Bits;                                            \
+/**/      bon_size ix = 0;                                                                \
+/**/      for (; ix + per_vec <= n; ix += per_vec) {                                      \
+/**/          __m512i v = _mm512_loadu_si512(src + ix * Bits/8);                          \
+/**/          _mm512_storeu_si512(dst + ix * Bits/8, _mm512_shuffle_epi8(v, mask));       \
+/**/      }                                                                               \
+/**/      return bon_bswap##Bits(src + ix * Bits/8, dst + ix * Bits/8, n - ix);           \
+/**/  }
+
+BON_BSWAP_AVX512(16)
+BON_BSWAP_AVX512(32)
+BON_BSWAP_AVX512(64)
+
+
+//------------------------------------------------------------------------------
+// Picking the kernels
+
+
+#define BON_SIMD_KERNELS(Level)                                                      \
+/**/  static bon_cast_fn bon_cast_kernel_##Level(bon_type_id src, bon_type_id dst)   \
+/**/  {                                                                              \
+/**/      if (src == BON_TYPE_FLOAT) {                                               \
+/**/          switch (dst) {                                                         \
+/**/              case BON_TYPE_DOUBLE:  return bon_cast_float_double_##Level;       \
+/**/              case BON_TYPE_SINT32:  return bon_cast_float_int32_t_##Level;      \
+/**/              case BON_TYPE_SINT16:  return bon_cast_float_int16_t_##Level;      \
+/**/              case BON_TYPE_UINT16:  return bon_cast_float_uint16_t_##Level;     \
+/**/              case BON_TYPE_SINT8:   return bon_cast_float_int8_t_##Level;       \
+/**/              case BON_TYPE_UINT8:   return bon_cast_float_uint8_t_##Level;      \
+/**/              default:               return NULL;                                \
+/**/          }                                                                      \
+/**/      }                                                                          \
+/**/      if (dst == BON_TYPE_FLOAT) {                                               \
+/**/          switch (src) {                                                         \
+/**/              case BON_TYPE_DOUBLE:  return bon_cast_double_float_##Level;       \
+/**/              case BON_TYPE_SINT32:  return bon_cast_int32_t_float_##Level;      \
+/**/              case BON_TYPE_SINT16:  return bon_cast_int16_t_float_##Level;      \
+/**/              case BON_TYPE_SINT8:   return bon_cast_int8_t_float_##Level;       \
+/**/              case BON_TYPE_UINT8:   return bon_cast_uint8_t_float_##Level;      \
+/**/              case BON_TYPE_BF16:    return bon_cast_bf16_float_##Level;         \
+/**/              default:               return NULL;                                \
+/**/          }                                                                      \
+/**/      }                                                                          \
+/**/      return NULL;                                                               \
+/**/  }
+
+BON_SIMD_KERNELS(sse2)
+BON_SIMD_KERNELS(avx2)
+BON_SIMD_KERNELS(avx512)
+
+// F16C comes with practically every AVX2 cpu, but is a feature of its own.
+static bon_bool bon_has_f16c(void)
+{
+	static int s_f16c = -1; // Racing threads will all store the same value.
+	if (s_f16c < 0) {
+		__builtin_cpu_init();
+		s_f16c = (__builtin_cpu_supports("f16c") ? 1 : 0);
+	}
+	return (bon_bool)s_f16c;
+}
+
+static bon_cast_fn bon_half_kernel_simd(bon_type_id src, bon_type_id dst, bon_simd_level level)
+{
+	if (src == BON_TYPE_HALF && dst == BON_TYPE_FLOAT) {
+		if (level >= BON_SIMD_AVX512)                  { return bon_cast_half_float_avx512; }
+		if (level >= BON_SIMD_AVX2 && bon_has_f16c())  { return bon_cast_half_float_f16c;   }
+	}
+	if (src == BON_TYPE_FLOAT && dst == BON_TYPE_HALF) {
+		if (level >= BON_SIMD_AVX512)                  { return bon_cast_float_half_avx512; }
+		if (level >= BON_SIMD_AVX2 && bon_has_f16c())  { return bon_cast_float_half_f16c;   }
+	}
+	return NULL;
+}
+
+static bon_simd_level bon_simd_detect(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") &&
+		 __builtin_cpu_supports("avx512bw")) { return BON_SIMD_AVX512; }
+	if (__builtin_cpu_supports("avx2"))     { return BON_SIMD_AVX2;   }
+	if (__builtin_cpu_supports("sse2"))     { return BON_SIMD_SSE2;   }
+	return BON_SIMD_NONE;
+}
+
+#else // !BON_SIMD_X86
+
+static bon_simd_level bon_simd_detect(void)
+{
+	return BON_SIMD_NONE;
+}
+
+#endif // BON_SIMD_X86
+
+
+// -1 until first use. Racing threads will all store the same value.
+static int s_simd_level     = -1;
+static int s_simd_supported = -1;
+
+bon_simd_level bon_get_simd_level(void)
+{
+	if (s_simd_level < 0) {
+		s_simd_supported = bon_simd_detect();
+		s_simd_level     = s_simd_supported;
+	}
+	return (bon_simd_level)s_simd_level;
+}
+
+bon_simd_level bon_set_simd_level(bon_simd_level level)
+{
+	bon_get_simd_level();
+	s_simd_level = ((int)level < s_simd_supported ? (int)level : s_simd_supported);
+	return (bon_simd_level)s_simd_level;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+// Byte swapping of elements of 'size' bytes
+static bon_cast_fn bon_bswap_kernel(bon_size size)
+{
+#if BON_SIMD_X86
+	bon_simd_level level = bon_get_simd_level();
+	if (level >= BON_SIMD_AVX512) {
+		return size==2 ? bon_bswap16_avx512 : size==4 ? bon_bswap32_avx512 : bon_bswap64_avx512;
+	}
+	if (level >= BON_SIMD_AVX2) {
+		return size==2 ? bon_bswap16_avx2 : size==4 ? bon_bswap32_avx2 : bon_bswap64_avx2;
+	}
+	if (level >= BON_SIMD_SSE2) {
+		return size==2 ? bon_bswap16_sse2 : size==4 ? bon_bswap32_sse2 : bon_bswap64_sse2;
+	}
+#endif
+	return size==2 ? bon_bswap16 : size==4 ? bon_bswap32 : bon_bswap64;
+}
+
+// Elements per chunk when swapping into a temporary before casting
+#define BON_SWAP_CHUNK 256
+
+// Runs 'first' a chunk at a time into a (cache hot) temporary, then 'second' on that.
+static bon_bool bon_chain_cast(const void* src_v, bon_size src_size, bon_cast_fn first,
+										 void* dst_v, bon_size dst_size, bon_cast_fn second,
+										 bon_size n)
+{
+	const uint8_t* src  = (const uint8_t*)src_v;
+	uint8_t*       dst  = (uint8_t*)dst_v;
+	uint64_t       tmp[BON_SWAP_CHUNK]; // Aligned for any element type
+	
+	if (!first || !second) {
+		return BON_FALSE;
+	}
+	
+	while (n > 0) {
+		bon_size m = (n < BON_SWAP_CHUNK ? n : BON_SWAP_CHUNK);
+		if (!first(src, tmp, m) || !second(tmp, dst, m)) {
+			return BON_FALSE;
+		}
+		src += m * src_size;
+		dst += m * dst_size;
+		n   -= m;
+	}
+	
+	return BON_TRUE;
+}
+
+// Swaps a chunk at a time into a temporary, then casts that.
+static bon_bool bon_swap_cast(const void* src, bon_size src_size,
+										void* dst, bon_size dst_size,
+										bon_cast_fn cast, bon_size n)
+{
+	return bon_chain_cast(src, src_size, bon_bswap_kernel(src_size), dst, dst_size, cast, n);
+}
+
+// 16-bit floats to anything but float go via float
+#define BON_VIA_FLOAT_FN(Src, SrcId, Dst, DstId)                                          \
+/**/  static bon_bool bon_cast_##Src##_##Dst(const void* src, void* dst, bon_size n)      \
+/**/  {                                                                                   \
+/**/      return bon_chain_cast(src, 2,           bon_cast_kernel(SrcId, BON_TYPE_FLOAT), \
+/**/                            dst, sizeof(Dst), bon_cast_kernel(BON_TYPE_FLOAT, DstId), \
+/**/                            n);                                                       \
+/**/  }
+
+#define BON_VIA_FLOAT_FNS(Src, SrcId)                          \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, double,   BON_TYPE_DOUBLE)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, int64_t,  BON_TYPE_SINT64)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, int32_t,  BON_TYPE_SINT32)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, int16_t,  BON_TYPE_SINT16)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, int8_t,   BON_TYPE_SINT8)   \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, uint64_t, BON_TYPE_UINT64)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, uint32_t, BON_TYPE_UINT32)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, uint16_t, BON_TYPE_UINT16)  \
+/**/  BON_VIA_FLOAT_FN(Src, SrcId, uint8_t,  BON_TYPE_UINT8)
+
+BON_VIA_FLOAT_FNS(half, BON_TYPE_HALF)
+BON_VIA_FLOAT_FNS(bf16, BON_TYPE_BF16)
+
+// Non-native endian 'Src' (given by its native type) to native 'Dst'
+#define BON_SWAP_CAST_FN(Src, SrcId, Dst, DstId)                                      \
+/**/  static bon_bool bon_swap_cast_##Src##_##Dst(const void* src, void* dst,         \
+/**/                                              bon_size n)                        \
+/**/  {                                                                               \
+/**/      return bon_swap_cast(src, bon_type_size(SrcId), dst, sizeof(Dst),           \
+/**/                           bon_cast_kernel(SrcId, DstId), n);                     \
+/**/  }
+
+#define BON_SWAP_CAST_FNS(Src, SrcId)                          \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, double,   BON_TYPE_DOUBLE)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, float,    BON_TYPE_FLOAT)   \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, int64_t,  BON_TYPE_SINT64)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, int32_t,  BON_TYPE_SINT32)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, int16_t,  BON_TYPE_SINT16)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, int8_t,   BON_TYPE_SINT8)   \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, uint64_t, BON_TYPE_UINT64)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, uint32_t, BON_TYPE_UINT32)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, uint16_t, BON_TYPE_UINT16)  \
+/**/  BON_SWAP_CAST_FN(Src, SrcId, uint8_t,  BON_TYPE_UINT8)
+
+BON_SWAP_CAST_FNS(double,   BON_TYPE_DOUBLE)
+BON_SWAP_CAST_FNS(float,    BON_TYPE_FLOAT)
+BON_SWAP_CAST_FNS(int64_t,  BON_TYPE_SINT64)
+BON_SWAP_CAST_FNS(int32_t,  BON_TYPE_SINT32)
+BON_SWAP_CAST_FNS(int16_t,  BON_TYPE_SINT16)
+BON_SWAP_CAST_FNS(uint64_t, BON_TYPE_UINT64)
+BON_SWAP_CAST_FNS(uint32_t, BON_TYPE_UINT32)
+BON_SWAP_CAST_FNS(uint16_t, BON_TYPE_UINT16)
+BON_SWAP_CAST_FNS(half,     BON_TYPE_HALF)
+BON_SWAP_CAST_FNS(bf16,     BON_TYPE_BF16)
+
+#define BON_SWAP_CAST_DST(Src, SrcId)                                        \
+/**/  if (dst == SrcId) {                                                    \
+/**/      return bon_bswap_kernel(bon_type_size(SrcId)); /* Just the swap */ \
+/**/  }                                                                      \
+/**/  switch (dst) {                                                         \
+/**/      case BON_TYPE_DOUBLE:  return bon_swap_cast_##Src##_double;        \
+/**/      case BON_TYPE_FLOAT:   return bon_swap_cast_##Src##_float;         \
+/**/      case BON_TYPE_SINT64:  return bon_swap_cast_##Src##_int64_t;       \
+/**/      case BON_TYPE_SINT32:  return bon_swap_cast_##Src##_int32_t;       \
+/**/      case BON_TYPE_SINT16:  return bon_swap_cast_##Src##_int16_t;       \
+/**/      case BON_TYPE_SINT8:   return bon_swap_cast_##Src##_int8_t;        \
+/**/      case BON_TYPE_UINT64:  return bon_swap_cast_##Src##_uint64_t;      \
+/**/      case BON_TYPE_UINT32:  return bon_swap_cast_##Src##_uint32_t;      \
+/**/      case BON_TYPE_UINT16:  return bon_swap_cast_##Src##_uint16_t;      \
+/**/      case BON_TYPE_UINT8:   return bon_swap_cast_##Src##_uint8_t;       \
+/**/      default:               return NULL;                                \
+/**/  }
+
+#if __LITTLE_ENDIAN__
+#  define BON_FOREIGN(T)  T##_BE
+#else
+#  define BON_FOREIGN(T)  T##_LE
+#endif
+
+// Non-native endian numbers -> native numbers
+static bon_cast_fn bon_swap_cast_kernel(bon_type_id src, bon_type_id dst)
+{
+	switch (src) {
+		case BON_FOREIGN(BON_TYPE_DOUBLE):  BON_SWAP_CAST_DST(double,   BON_TYPE_DOUBLE)
+		case BON_FOREIGN(BON_TYPE_FLOAT):   BON_SWAP_CAST_DST(float,    BON_TYPE_FLOAT)
+		case BON_FOREIGN(BON_TYPE_SINT64):  BON_SWAP_CAST_DST(int64_t,  BON_TYPE_SINT64)
+		case BON_FOREIGN(BON_TYPE_SINT32):  BON_SWAP_CAST_DST(int32_t,  BON_TYPE_SINT32)
+		case BON_FOREIGN(BON_TYPE_SINT16):  BON_SWAP_CAST_DST(int16_t,  BON_TYPE_SINT16)
+		case BON_FOREIGN(BON_TYPE_UINT64):  BON_SWAP_CAST_DST(uint64_t, BON_TYPE_UINT64)
+		case BON_FOREIGN(BON_TYPE_UINT32):  BON_SWAP_CAST_DST(uint32_t, BON_TYPE_UINT32)
+		case BON_FOREIGN(BON_TYPE_UINT16):  BON_SWAP_CAST_DST(uint16_t, BON_TYPE_UINT16)
+		case BON_FOREIGN(BON_TYPE_HALF):    BON_SWAP_CAST_DST(half,     BON_TYPE_HALF)
+		case BON_FOREIGN(BON_TYPE_BF16):    BON_SWAP_CAST_DST(bf16,     BON_TYPE_BF16)
+		default:                            return NULL;
+	}
+}
+
+#define BON_CAST_DST(Src)                                                    \
+/**/  switch (dst) {                                                         \
+/**/      case BON_TYPE_DOUBLE:  return bon_cast_##Src##_double;             \
+/**/      case BON_TYPE_FLOAT:   return bon_cast_##Src##_float;              \
+/**/      case BON_TYPE_SINT64:  return bon_cast_##Src##_int64_t;            \
+/**/      case BON_TYPE_SINT32:  return bon_cast_##Src##_int32_t;            \
+/**/      case BON_TYPE_SINT16:  return bon_cast_##Src##_int16_t;            \
+/**/      case BON_TYPE_SINT8:   return bon_cast_##Src##_int8_t;             \
+/**/      case BON_TYPE_UINT64:  return bon_cast_##Src##_uint64_t;           \
+/**/      case BON_TYPE_UINT32:  return bon_cast_##Src##_uint32_t;           \
+/**/      case BON_TYPE_UINT16:  return bon_cast_##Src##_uint16_t;           \
+/**/      case BON_TYPE_UINT8:   return bon_cast_##Src##_uint8_t;            \
+/**/      default:               return NULL;                                \
+/**/  }
+
+bon_cast_fn bon_cast_kernel(bon_type_id src, bon_type_id dst)
+{
+#if BON_SIMD_X86
+	bon_simd_level level = bon_get_simd_level();
+	bon_cast_fn simd = NULL;
+	if (!simd && level >= BON_SIMD_AVX512)  { simd = bon_cast_kernel_avx512(src, dst); }
+	if (!simd && level >= BON_SIMD_AVX2)    { simd = bon_cast_kernel_avx2(src, dst);   }
+	if (!simd && level >= BON_SIMD_SSE2)    { simd = bon_cast_kernel_sse2(src, dst);   }
+	if (!simd)                              { simd = bon_half_kernel_simd(src, dst, level); }
+	if (simd) {
+		return simd;
+	}
+#endif
+	
+	if (src == BON_TYPE_FLOAT && dst == BON_TYPE_HALF) { return bon_cast_float_half; }
+	if (src == BON_TYPE_FLOAT && dst == BON_TYPE_BF16) { return bon_cast_float_bf16; }
+	
+	switch (src) {
+		case BON_TYPE_DOUBLE:  BON_CAST_DST(double)
+		case BON_TYPE_FLOAT:   BON_CAST_DST(float)
+		case BON_TYPE_SINT64:  BON_CAST_DST(int64_t)
+		case BON_TYPE_SINT32:  BON_CAST_DST(int32_t)
+		case BON_TYPE_SINT16:  BON_CAST_DST(int16_t)
+		case BON_TYPE_SINT8:   BON_CAST_DST(int8_t)
+		case BON_TYPE_UINT64:  BON_CAST_DST(uint64_t)
+		case BON_TYPE_UINT32:  BON_CAST_DST(uint32_t)
+		case BON_TYPE_UINT16:  BON_CAST_DST(uint16_t)
+		case BON_TYPE_UINT8:   BON_CAST_DST(uint8_t)
+		case BON_TYPE_HALF:    BON_CAST_DST(half)
+		case BON_TYPE_BF16:    BON_CAST_DST(bf16)
+		default:               return bon_swap_cast_kernel(src, dst);
+	}
+}
+
+bon_cast_fn bon_unorm8_kernel(void)
+{
+#if BON_SIMD_X86
+	switch (bon_get_simd_level()) {
+		case BON_SIMD_AVX512:  return bon_cast_unorm8_avx512;
+		case BON_SIMD_AVX2:    return bon_cast_unorm8_avx2;
+		case BON_SIMD_SSE2:    return bon_cast_unorm8_sse2;
+		default:               break;
+	}
+#endif
+	return bon_cast_unorm8;
+}
@@ -6,128 +6,266 @@
 //  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
 //  This is free software, under the MIT license (see LICENSE.txt for details).
 
+#include "bon.h"
+#include "private.h"
 #include "crc32.h"
 
 
-/*
-// Computed by
-void make_crc_table(void)
+//------------------------------------------------------------------------------
+// Polynomial arithmetic modulo P (bit reflected, so x^0 is the top bit), used to combine crcs.
+
+
+// a * b mod P
+static uint32_t crc_multmodp(uint32_t a, uint32_t b)
 {
-	unsigned long c;
-	int n, k;
-   
-	for (n = 0; n < 256; n++) {
-		c = (unsigned long) n;
-		for (k = 0; k < 8; k++) {
-         if (c & 1)
-				c = 0xedb88320L ^ (c >> 1);
-         else
-				c = c >> 1;
+	uint32_t m = 1u << 31;
+	uint32_t p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) {
+				break;
+			}
 		}
-		crc_table[n] = c;
+		m >>= 1;
+		b = (b & 1) ? 0xedb88320u ^ (b >> 1) : b >> 1;
 	}
+	return p;
 }
- */
-
-uint32_t crc_table[256] = {
-	0x0,         0x77073096,  0xEE0E612C,  0x990951BA,
-	0x76DC419,   0x706AF48F,  0xE963A535,  0x9E6495A3,
-	0xEDB8832,   0x79DCB8A4,  0xE0D5E91E,  0x97D2D988,
-	0x9B64C2B,   0x7EB17CBD,  0xE7B82D07,  0x90BF1D91,
-	0x1DB71064,  0x6AB020F2,  0xF3B97148,  0x84BE41DE,
-	0x1ADAD47D,  0x6DDDE4EB,  0xF4D4B551,  0x83D385C7,
-	0x136C9856,  0x646BA8C0,  0xFD62F97A,  0x8A65C9EC,
-	0x14015C4F,  0x63066CD9,  0xFA0F3D63,  0x8D080DF5,
-	0x3B6E20C8,  0x4C69105E,  0xD56041E4,  0xA2677172,
-	0x3C03E4D1,  0x4B04D447,  0xD20D85FD,  0xA50AB56B,
-	0x35B5A8FA,  0x42B2986C,  0xDBBBC9D6,  0xACBCF940,
-	0x32D86CE3,  0x45DF5C75,  0xDCD60DCF,  0xABD13D59,
-	0x26D930AC,  0x51DE003A,  0xC8D75180,  0xBFD06116,
-	0x21B4F4B5,  0x56B3C423,  0xCFBA9599,  0xB8BDA50F,
-	0x2802B89E,  0x5F058808,  0xC60CD9B2,  0xB10BE924,
-	0x2F6F7C87,  0x58684C11,  0xC1611DAB,  0xB6662D3D,
-	0x76DC4190,  0x1DB7106,   0x98D220BC,  0xEFD5102A,
-	0x71B18589,  0x6B6B51F,   0x9FBFE4A5,  0xE8B8D433,
-	0x7807C9A2,  0xF00F934,   0x9609A88E,  0xE10E9818,
-	0x7F6A0DBB,  0x86D3D2D,   0x91646C97,  0xE6635C01,
-	0x6B6B51F4,  0x1C6C6162,  0x856530D8,  0xF262004E,
-	0x6C0695ED,  0x1B01A57B,  0x8208F4C1,  0xF50FC457,
-	0x65B0D9C6,  0x12B7E950,  0x8BBEB8EA,  0xFCB9887C,
-	0x62DD1DDF,  0x15DA2D49,  0x8CD37CF3,  0xFBD44C65,
-	0x4DB26158,  0x3AB551CE,  0xA3BC0074,  0xD4BB30E2,
-	0x4ADFA541,  0x3DD895D7,  0xA4D1C46D,  0xD3D6F4FB,
-	0x4369E96A,  0x346ED9FC,  0xAD678846,  0xDA60B8D0,
-	0x44042D73,  0x33031DE5,  0xAA0A4C5F,  0xDD0D7CC9,
-	0x5005713C,  0x270241AA,  0xBE0B1010,  0xC90C2086,
-	0x5768B525,  0x206F85B3,  0xB966D409,  0xCE61E49F,
-	0x5EDEF90E,  0x29D9C998,  0xB0D09822,  0xC7D7A8B4,
-	0x59B33D17,  0x2EB40D81,  0xB7BD5C3B,  0xC0BA6CAD,
-	0xEDB88320,  0x9ABFB3B6,  0x3B6E20C,   0x74B1D29A,
-	0xEAD54739,  0x9DD277AF,  0x4DB2615,   0x73DC1683,
-	0xE3630B12,  0x94643B84,  0xD6D6A3E,   0x7A6A5AA8,
-	0xE40ECF0B,  0x9309FF9D,  0xA00AE27,   0x7D079EB1,
-	0xF00F9344,  0x8708A3D2,  0x1E01F268,  0x6906C2FE,
-	0xF762575D,  0x806567CB,  0x196C3671,  0x6E6B06E7,
-	0xFED41B76,  0x89D32BE0,  0x10DA7A5A,  0x67DD4ACC,
-	0xF9B9DF6F,  0x8EBEEFF9,  0x17B7BE43,  0x60B08ED5,
-	0xD6D6A3E8,  0xA1D1937E,  0x38D8C2C4,  0x4FDFF252,
-	0xD1BB67F1,  0xA6BC5767,  0x3FB506DD,  0x48B2364B,
-	0xD80D2BDA,  0xAF0A1B4C,  0x36034AF6,  0x41047A60,
-	0xDF60EFC3,  0xA867DF55,  0x316E8EEF,  0x4669BE79,
-	0xCB61B38C,  0xBC66831A,  0x256FD2A0,  0x5268E236,
-	0xCC0C7795,  0xBB0B4703,  0x220216B9,  0x5505262F,
-	0xC5BA3BBE,  0xB2BD0B28,  0x2BB45A92,  0x5CB36A04,
-	0xC2D7FFA7,  0xB5D0CF31,  0x2CD99E8B,  0x5BDEAE1D,
-	0x9B64C2B0,  0xEC63F226,  0x756AA39C,  0x26D930A,
-	0x9C0906A9,  0xEB0E363F,  0x72076785,  0x5005713,
-	0x95BF4A82,  0xE2B87A14,  0x7BB12BAE,  0xCB61B38,
-	0x92D28E9B,  0xE5D5BE0D,  0x7CDCEFB7,  0xBDBDF21,
-	0x86D3D2D4,  0xF1D4E242,  0x68DDB3F8,  0x1FDA836E,
-	0x81BE16CD,  0xF6B9265B,  0x6FB077E1,  0x18B74777,
-	0x88085AE6,  0xFF0F6A70,  0x66063BCA,  0x11010B5C,
-	0x8F659EFF,  0xF862AE69,  0x616BFFD3,  0x166CCF45,
-	0xA00AE278,  0xD70DD2EE,  0x4E048354,  0x3903B3C2,
-	0xA7672661,  0xD06016F7,  0x4969474D,  0x3E6E77DB,
-	0xAED16A4A,  0xD9D65ADC,  0x40DF0B66,  0x37D83BF0,
-	0xA9BCAE53,  0xDEBB9EC5,  0x47B2CF7F,  0x30B5FFE9,
-	0xBDBDF21C,  0xCABAC28A,  0x53B39330,  0x24B4A3A6,
-	0xBAD03605,  0xCDD70693,  0x54DE5729,  0x23D967BF,
-	0xB3667A2E,  0xC4614AB8,  0x5D681B02,  0x2A6F2B94,
-	0xB40BBE37,  0xC30C8EA1,  0x5A05DF1B,  0x2D02EF8D
-};
-
-int crc_table_computed = 0;
-
-void make_crc_table(void)
+
+// x2n_table[k] = x^(2^k) mod P
+static uint32_t x2n_table[32];
+
+static void make_x2n_table(void)
 {
-	unsigned long c;
-	int n, k;
-   
-	for (n = 0; n < 256; n++) {
-		c = (unsigned long) n;
-		for (k = 0; k < 8; k++) {
-         if (c & 1)
-				c = 0xedb88320L ^ (c >> 1);
-         else
-				c = c >> 1;
+	uint32_t p = 1u << 30; // x^1
+	x2n_table[0] = p;
+	for (int k = 1; k < 32; k++) {
+		x2n_table[k] = p = crc_multmodp(p, p);
+	}
+}
+
+// x^(n * 2^k) mod P
+static uint32_t crc_x2nmodp(uint64_t n, unsigned k)
+{
+	uint32_t p = 1u << 31; // x^0
+	for (; n; n >>= 1, k++) {
+		if (n & 1) {
+			p = crc_multmodp(x2n_table[k & 31], p);
 		}
-		crc_table[n] = (uint32_t)c;
 	}
-	crc_table_computed = 1;
+	return p;
 }
 
-uint32_t crc_update(uint32_t c, const uint8_t* buf, uint64_t len)
+
+//------------------------------------------------------------------------------
+// Slicing-by-8: eight bytes per step with eight tables.
+// crc_tables[0] is the classic byte-at-a-time table,
+// crc_tables[k][n] is the crc of byte n followed by k zero bytes.
+
+
+static uint32_t crc_tables[8][256];
+static int crc_tables_computed = 0;
+
+static void make_crc_tables(void)
+{
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		crc_tables[0][n] = c;
+	}
+	
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = crc_tables[0][n];
+		for (int t = 1; t < 8; t++) {
+			c = crc_tables[0][c & 0xff] ^ (c >> 8);
+			crc_tables[t][n] = c;
+		}
+	}
+	
+	make_x2n_table();
+	crc_tables_computed = 1;
+}
+
+static uint32_t crc_update_sliced(uint32_t c, const uint8_t* buf, uint64_t len)
 {
-	if (!crc_table_computed)
-		make_crc_table();
+	const uint32_t (*T)[256] = (const uint32_t (*)[256])crc_tables;
 	
-	for (uint64_t n = 0; n < len; n++) {
-		c = crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
+	for (; len >= 8; len -= 8, buf += 8) {
+		// Byte by byte so it works on big endian too (compilers merge these into one load).
+		uint32_t lo = c ^ ((uint32_t)buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24);
+		uint32_t hi =      (uint32_t)buf[4] | (uint32_t)buf[5] << 8 | (uint32_t)buf[6] << 16 | (uint32_t)buf[7] << 24;
+		c = T[7][lo & 0xff] ^ T[6][(lo >> 8) & 0xff] ^ T[5][(lo >> 16) & 0xff] ^ T[4][lo >> 24] ^
+		    T[3][hi & 0xff] ^ T[2][(hi >> 8) & 0xff] ^ T[1][(hi >> 16) & 0xff] ^ T[0][hi >> 24];
+	}
+	
+	for (; len > 0; len--, buf++) {
+		c = T[0][(c ^ *buf) & 0xff] ^ (c >> 8);
 	}
 	return c;
 }
 
+
+//------------------------------------------------------------------------------
+// Folding with carry-less multiplication (PCLMULQDQ), after
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+// Four 128-bit lanes are folded 64 bytes at a time, then into one lane,
+// then Barrett-reduced to 32 bits.
+
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#  define BON_CRC_CLMUL 1
+#  include <immintrin.h>
+#  define BON_PCLMUL  __attribute__((target("sse2,pclmul")))
+#else
+#  define BON_CRC_CLMUL 0
+#endif
+
+
+#if BON_CRC_CLMUL
+
+// At least this many bytes for the folding to pay off (and it needs 64).
+#define BON_CRC_CLMUL_MIN 64
+
+// 'len' must be a multiple of 16, and at least 64.
+BON_PCLMUL static uint32_t crc_update_clmul(uint32_t crc, const uint8_t* buf, uint64_t len)
+{
+	// Fold distances (x^k mod P, bit reflected) for 512 and 128 bits, 64 -> 32 bits, and Barrett's mu and P.
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0,            0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+	__m128i x5, x6, x7, x8;
+	
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	buf += 64;
+	len -= 64;
+	
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+		
+		buf += 64;
+		len -= 64;
+	}
+	
+	// Fold the four lanes into one:
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	
+	// The rest, 16 bytes at a time:
+	while (len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+		buf += 16;
+		len -= 16;
+	}
+	
+	// 128 -> 64 bits:
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	
+	// Barrett reduction to 32 bits:
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	
+	return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+// -1 until first use (see crc_init).
+static int s_has_pclmul = -1;
+
+static int crc_use_clmul(void)
+{
+	if (s_has_pclmul < 0) {
+		__builtin_cpu_init();
+		s_has_pclmul = __builtin_cpu_supports("pclmul") ? 1 : 0;
+	}
+	// Obey bon_set_simd_level, so the portable path can be tested (and benchmarked) too.
+	return s_has_pclmul && bon_get_simd_level() >= BON_SIMD_SSE2;
+}
+
+#endif // BON_CRC_CLMUL
+
+
+//------------------------------------------------------------------------------
+
+
+void crc_init(void)
+{
+	if (!crc_tables_computed)
+		make_crc_tables();
+	
+#if BON_CRC_CLMUL
+	crc_use_clmul();
+#endif
+}
+
+uint32_t crc_update(uint32_t c, const uint8_t* buf, uint64_t len)
+{
+	if (!crc_tables_computed)
+		make_crc_tables();
+	
+#if BON_CRC_CLMUL
+	if (len >= BON_CRC_CLMUL_MIN && crc_use_clmul()) {
+		uint64_t folded = len & ~(uint64_t)15;
+		c = crc_update_clmul(c, buf, folded);
+		buf += folded;
+		len -= folded;
+	}
+#endif
+	
+	return crc_update_sliced(c, buf, len);
+}
+
 uint32_t crc_calc(const uint8_t* data, uint64_t size)
 {
 	return crc_update(0xffffffff, data, size) ^ 0xffffffff;
 }
+
+uint32_t crc_combine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+{
+	if (!crc_tables_computed)
+		make_crc_tables();
+	
+	// Appending size2 bytes multiplies crc1 by x^(8*size2):
+	return crc_multmodp(crc_x2nmodp(size2, 3), crc1) ^ crc2;
+}
@@ -28,7 +28,20 @@
  */
 uint32_t crc_update(uint32_t crc_inv, const uint8_t* data, uint64_t size);
 
+/*
+ Computes the lookup tables, which the other functions otherwise do on first use.
+ Call this before using them from several threads at once.
+ */
+void crc_init(void);
+
 // Calcualte the crc of the given bytes.
 uint32_t crc_calc(const uint8_t* data, uint64_t size);
 
+/*
+ Given crc1 = crc_calc(A, size1) and crc2 = crc_calc(B, size2),
+ returns crc_calc of A followed by B.
+ This lets the crc of a big buffer be calculated in independent pieces.
+ */
+uint32_t crc_combine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
 #endif
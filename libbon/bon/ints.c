@@ -0,0 +1,359 @@
+//
+//  ints.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#include "bon.h"
+#include "private.h"
+#include <string.h>       // memcpy
+
+
+//------------------------------------------------------------------------------
+// Encoded integer arrays (see bon_w_pack_ints)
+
+/*
+ With BON_INTS_DELTA, the payload starts with the first value (as a vlq).
+ Then comes one block per BON_INTS_BLOCK values (the last one may be shorter):
+
+   uint8_t  width       bits per value, 0-64
+   vlq      base        smallest value of the block
+   uint8_t  bits[]      ceil(m * width / 8) bytes: value k - base at bit k*width, LSB first.
+
+ The values are first widened to 64 bits (sign- or zero extended), then (optionally)
+ replaced by the difference to the previous value (BON_INTS_DELTA, the first one to itself),
+ then (optionally) zigzag-mapped (BON_INTS_ZIGZAG). All arithmetic wraps.
+ */
+
+
+bon_type_id bon_ints_native_type(bon_type_id t)
+{
+	switch (t) {
+		case BON_TYPE_SINT8:      return BON_TYPE_SINT8;
+		case BON_TYPE_UINT8:      return BON_TYPE_UINT8;
+		case BON_TYPE_SINT16_LE:
+		case BON_TYPE_SINT16_BE:  return BON_TYPE_SINT16;
+		case BON_TYPE_UINT16_LE:
+		case BON_TYPE_UINT16_BE:  return BON_TYPE_UINT16;
+		case BON_TYPE_SINT32_LE:
+		case BON_TYPE_SINT32_BE:  return BON_TYPE_SINT32;
+		case BON_TYPE_UINT32_LE:
+		case BON_TYPE_UINT32_BE:  return BON_TYPE_UINT32;
+		case BON_TYPE_SINT64_LE:
+		case BON_TYPE_SINT64_BE:  return BON_TYPE_SINT64;
+		case BON_TYPE_UINT64_LE:
+		case BON_TYPE_UINT64_BE:  return BON_TYPE_UINT64;
+		default:                  return (bon_type_id)0;
+	}
+}
+
+// Element 'ix' of an array of native integers, widened to 64 bits.
+BON_INLINE uint64_t bon_ints_load(const void* data, bon_size ix, bon_type_id t)
+{
+	switch (t) {
+		case BON_TYPE_SINT8:   return (uint64_t)(int64_t)((const int8_t*)data)[ix];
+		case BON_TYPE_UINT8:   return ((const uint8_t*)data)[ix];
+		case BON_TYPE_SINT16:  return (uint64_t)(int64_t)((const int16_t*)data)[ix];
+		case BON_TYPE_UINT16:  return ((const uint16_t*)data)[ix];
+		case BON_TYPE_SINT32:  return (uint64_t)(int64_t)((const int32_t*)data)[ix];
+		case BON_TYPE_UINT32:  return ((const uint32_t*)data)[ix];
+		default:               return ((const uint64_t*)data)[ix];
+	}
+}
+
+BON_INLINE uint64_t bon_zigzag(uint64_t d)
+{
+	return (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+}
+
+BON_INLINE uint64_t bon_unzigzag(uint64_t z)
+{
+	return (z >> 1) ^ (~(z & 1) + 1);
+}
+
+BON_INLINE unsigned bon_bit_width(uint64_t x)
+{
+	return x == 0 ? 0 : 64 - (unsigned)__builtin_clzll(x);
+}
+
+// The values of block 'block' as they are bit packed (before subtracting the base).
+static bon_size bon_ints_transform(const void* data, bon_size n, bon_size block,
+											  bon_type_id t, unsigned codec, uint64_t* out)
+{
+	bon_size begin = block * BON_INTS_BLOCK;
+	bon_size m     = (n - begin < BON_INTS_BLOCK ? n - begin : BON_INTS_BLOCK);
+	uint64_t prev  = bon_ints_load(data, begin > 0 ? begin - 1 : 0, t);
+	
+	for (bon_size k=0; k<m; ++k) {
+		uint64_t x = bon_ints_load(data, begin + k, t);
+		uint64_t v = x;
+		if (codec & BON_INTS_DELTA)  { v = x - prev; }
+		if (codec & BON_INTS_ZIGZAG) { v = bon_zigzag(v); }
+		out[k] = v;
+		prev   = x;
+	}
+	
+	return m;
+}
+
+static unsigned bon_ints_frame(const uint64_t* vals, bon_size m, uint64_t* out_base)
+{
+	uint64_t lo = UINT64_MAX, hi = 0;
+	for (bon_size k=0; k<m; ++k) {
+		if (vals[k] < lo) { lo = vals[k]; }
+		if (vals[k] > hi) { hi = vals[k]; }
+	}
+	if (m == 0) { lo = hi = 0; }
+	*out_base = lo;
+	return bon_bit_width(hi - lo);
+}
+
+bon_size bon_ints_encoded_size(const void* data, bon_size n, bon_type_id t, unsigned codec)
+{
+	uint64_t vals[BON_INTS_BLOCK];
+	bon_size size = 0;
+	
+	if ((codec & BON_INTS_DELTA) && n > 0) {
+		size += bon_vlq_size(bon_ints_load(data, 0, t));
+	}
+	
+	for (bon_size block=0; block * BON_INTS_BLOCK < n; ++block) {
+		bon_size m = bon_ints_transform(data, n, block, t, codec, vals);
+		uint64_t base  = 0;
+		unsigned width = bon_ints_frame(vals, m, &base);
+		size += 1 + bon_vlq_size(base) + (m * width + 7) / 8;
+	}
+	
+	return size;
+}
+
+bon_size bon_ints_encode_block(uint8_t* out, const void* data, bon_size n, bon_size block,
+										 bon_type_id t, unsigned codec)
+{
+	uint64_t vals[BON_INTS_BLOCK];
+	bon_size m = bon_ints_transform(data, n, block, t, codec, vals);
+	uint64_t base;
+	unsigned width = bon_ints_frame(vals, m, &base);
+	
+	uint8_t* p = out;
+	if ((codec & BON_INTS_DELTA) && block == 0) {
+		p += bon_w_vlq_to(p, bon_ints_load(data, 0, t));
+	}
+	*p++ = (uint8_t)width;
+	p += bon_w_vlq_to(p, base);
+	
+	bon_size nbits = (m * width + 7) / 8;
+	
+	// Accumulate up to 64 bits at a time, and flush them whole bytes at a time:
+	uint64_t acc   = 0;
+	unsigned used  = 0;  // bits in acc
+	uint8_t* bits  = p;
+	for (bon_size k=0; k<m; ++k) {
+		uint64_t v = vals[k] - base;
+		acc |= v << used;
+		if (used + width >= 64) {
+			for (unsigned b=0; b<8; ++b) { *bits++ = (uint8_t)(acc >> (8*b)); }
+			unsigned taken = 64 - used;
+			acc  = (taken < 64 ? v >> taken : 0);
+			used = used + width - 64;
+		} else {
+			used += width;
+		}
+	}
+	for (; used > 0; used = (used > 8 ? used - 8 : 0)) {
+		*bits++ = (uint8_t)acc;
+		acc >>= 8;
+	}
+	
+	return (bon_size)(p - out) + nbits;
+}
+
+
+//------------------------------------------------------------------------------
+// Decoding
+
+
+BON_INLINE uint64_t bon_load_le64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+#if __BIG_ENDIAN__
+	v = swap_endian_uint64(v);
+#endif
+	return v;
+}
+
+// Reads a vlq without passing 'end'. Returns NULL on error.
+static const uint8_t* bon_ints_vlq(const uint8_t* p, const uint8_t* end, uint64_t* out)
+{
+	uint64_t r = 0;
+	for (uint32_t size=1; p < end; ++size) {
+		uint8_t in = *p++;
+		r = (r << 7) | (uint64_t)(in & 0x7f);
+		if ((in & 0x80) == 0) {
+			*out = r;
+			return p;
+		}
+		if (size == BON_VARINT_MAX_LEN) { break; }
+	}
+	return NULL;
+}
+
+bon_bool bon_ints_check(const uint8_t* enc, bon_size nbytes, unsigned codec, bon_size n)
+{
+	const uint8_t* p   = enc;
+	const uint8_t* end = enc + nbytes;
+	
+	uint64_t start;
+	if ((codec & BON_INTS_DELTA) && n > 0 && !(p = bon_ints_vlq(p, end, &start))) {
+		return BON_FALSE;
+	}
+	
+	for (bon_size begin=0; begin<n; begin += BON_INTS_BLOCK) {
+		bon_size m = (n - begin < BON_INTS_BLOCK ? n - begin : BON_INTS_BLOCK);
+		if (p == end) { return BON_FALSE; }
+		unsigned width = *p++;
+		uint64_t base;
+		if (width > 64 || !(p = bon_ints_vlq(p, end, &base))) { return BON_FALSE; }
+		bon_size nbits = (m * width + 7) / 8;
+		if ((bon_size)(end - p) < nbits) { return BON_FALSE; }
+		p += nbits;
+	}
+	
+	return p == end;
+}
+
+// Value k of a block is at bit k*width of 'bits'. Never reads at or past 'end'.
+static void bon_ints_unpack_scalar(const uint8_t* bits, const uint8_t* end, unsigned width,
+											  uint64_t base, bon_bool zigzag, uint64_t* out, bon_size k, bon_size m)
+{
+	const uint64_t mask = (width == 64 ? ~0ULL : (1ULL << width) - 1);
+	
+	for (; k<m; ++k) {
+		bon_size bit   = k * width;
+		const uint8_t* p = bits + bit / 8;
+		unsigned shift = (unsigned)(bit % 8);
+	
+		uint64_t word;
+		if (end - p >= 8) {
+			word = bon_load_le64(p);
+		} else {
+			word = 0;
+			for (unsigned b=0; p + b < end; ++b) { word |= (uint64_t)p[b] << (8*b); }
+		}
+		uint64_t v = word >> shift;
+		if (shift + width > 64) {
+			v |= (uint64_t)p[8] << (64 - shift);
+		}
+		v = base + (v & mask);
+		out[k] = (zigzag ? bon_unzigzag(v) : v);
+	}
+}
+
+
+#if defined(__GNUC__) && defined(__x86_64__) && __LITTLE_ENDIAN__
+#  define BON_INTS_AVX2 1
+#  include <immintrin.h>
+
+// Four values at a time with 64-bit gathers. Only for width <= 56, so a value never spans nine bytes.
+// Returns how many values it did, leaving the rest (near 'end') to the scalar code.
+static __attribute__((target("avx2")))
+bon_size bon_ints_unpack_avx2(const uint8_t* bits, const uint8_t* end, unsigned width,
+										uint64_t base, bon_bool zigzag, uint64_t* out, bon_size m)
+{
+	const __m256i one   = _mm256_set1_epi64x(1);
+	const __m256i zero  = _mm256_setzero_si256();
+	const __m256i mask  = _mm256_set1_epi64x((long long)((1ULL << width) - 1));
+	const __m256i basev = _mm256_set1_epi64x((long long)base);
+	const __m256i seven = _mm256_set1_epi64x(7);
+	const __m256i step  = _mm256_set1_epi64x((long long)(4 * width));
+	__m256i bit = _mm256_set_epi64x(3 * width, 2 * width, width, 0);
+	
+	bon_size k = 0;
+	for (; k+4 <= m && (bon_size)(end - bits) >= ((k + 3) * width) / 8 + 8; k += 4) {
+		__m256i word = _mm256_i64gather_epi64((const long long*)bits, _mm256_srli_epi64(bit, 3), 1);
+		__m256i v    = _mm256_srlv_epi64(word, _mm256_and_si256(bit, seven));
+		v = _mm256_add_epi64(_mm256_and_si256(v, mask), basev);
+		if (zigzag) {
+			__m256i sign = _mm256_sub_epi64(zero, _mm256_and_si256(v, one));
+			v = _mm256_xor_si256(_mm256_srli_epi64(v, 1), sign);
+		}
+		_mm256_storeu_si256((__m256i*)(out + k), v);
+		bit = _mm256_add_epi64(bit, step);
+	}
+	return k;
+}
+
+#else
+#  define BON_INTS_AVX2 0
+#endif
+
+// Unpacks a block, and undoes the zigzag mapping.
+static void bon_ints_unpack(const uint8_t* bits, const uint8_t* end, unsigned width,
+									 uint64_t base, bon_bool zigzag, uint64_t* out, bon_size m)
+{
+	bon_size k = 0;
+#if BON_INTS_AVX2
+	if (width <= 56 && bon_get_simd_level() >= BON_SIMD_AVX2) {
+		k = bon_ints_unpack_avx2(bits, end, width, base, zigzag, out, m);
+	}
+#endif
+	bon_ints_unpack_scalar(bits, end, width, base, zigzag, out, k, m);
+}
+
+// Undo delta, and narrow to the element type. Returns the last value.
+#define BON_INTS_STORE_FN(T)                                                         \
+/**/  static uint64_t bon_ints_store_##T(const uint64_t* vals, bon_size m, bon_bool delta, \
+/**/                                     uint64_t prev, T* dst)                        \
+/**/  {                                                                                \
+/**/      if (delta) {                                                                 \
+/**/          for (bon_size k=0; k<m; ++k) { prev += vals[k]; dst[k] = (T)prev; }      \
+/**/      } else {                                                                     \
+/**/          for (bon_size k=0; k<m; ++k) { dst[k] = (T)vals[k]; }                    \
+/**/      }                                                                            \
+/**/      return prev;                                                                 \
+/**/  }
+
+BON_INTS_STORE_FN(uint8_t)
+BON_INTS_STORE_FN(uint16_t)
+BON_INTS_STORE_FN(uint32_t)
+BON_INTS_STORE_FN(uint64_t)
+
+bon_bool bon_ints_decode(const uint8_t* enc, bon_size nbytes, unsigned codec,
+								 bon_type_id t, void* dst_v, bon_size n)
+{
+	const uint8_t* p    = enc;
+	const uint8_t* end  = enc + nbytes;
+	uint8_t*       dst  = (uint8_t*)dst_v;
+	bon_size       size = bon_type_size(t);
+	bon_bool       delta = (codec & BON_INTS_DELTA) != 0;
+	uint64_t       prev = 0;
+	uint64_t       vals[BON_INTS_BLOCK];
+	
+	if (delta && n > 0 && !(p = bon_ints_vlq(p, end, &prev))) {
+		return BON_FALSE;
+	}
+	
+	for (bon_size begin=0; begin<n; begin += BON_INTS_BLOCK) {
+		bon_size m = (n - begin < BON_INTS_BLOCK ? n - begin : BON_INTS_BLOCK);
+		if (p == end) { return BON_FALSE; }
+		unsigned width = *p++;
+		uint64_t base  = 0;
+		if (!(p = bon_ints_vlq(p, end, &base))) { return BON_FALSE; }
+		bon_ints_unpack(p, end, width, base, (codec & BON_INTS_ZIGZAG) != 0, vals, m);
+		p += (m * width + 7) / 8;
+	
+		void* out = dst + begin * size;
+		switch (size) {
+			case 1:  prev = bon_ints_store_uint8_t (vals, m, delta, prev, (uint8_t*)out);   break;
+			case 2:  prev = bon_ints_store_uint16_t(vals, m, delta, prev, (uint16_t*)out);  break;
+			case 4:  prev = bon_ints_store_uint32_t(vals, m, delta, prev, (uint32_t*)out);  break;
+			default: prev = bon_ints_store_uint64_t(vals, m, delta, prev, (uint64_t*)out);  break;
+		}
+	}
+	
+	return BON_TRUE;
+}
@@ -0,0 +1,453 @@
+//
+//  json.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#include "bon.h"
+#include "private.h"
+#include "utf.h"          // utf8_check_first, utf8_check_full
+#include <inttypes.h>     // PRIu64
+#include <math.h>         // isnan, isinf
+#include <stdio.h>        // snprintf
+#include <stdlib.h>       // malloc, free
+#include <string.h>       // memcpy, strchr, memmove
+
+
+//------------------------------------------------------------------------------
+// Streaming JSON output, laid out like jansson's json_dumpf.
+
+
+// The same special values as jansson (see JSON_ALLOW_NAN_INF in jansson_config.h)
+#define BON_JSON_NAN_STR      "0e666"
+#define BON_JSON_POS_INF_STR  "1e99999"
+#define BON_JSON_NEG_INF_STR  "-1e99999"
+
+#define BON_JSON_BUFF_SIZE    (64*1024)
+
+typedef struct {
+	bon_r_doc*      B;
+	bon_w_writer_t  writer;
+	void*           userData;
+	unsigned        flags;
+	uint8_t*        buff;
+	bon_size        buff_ix;
+	bon_bool        ok;        // False after a writer error or a bad value
+} bon_json;
+
+static void bon_json_flush(bon_json* J)
+{
+	if (J->buff_ix > 0 && J->ok && !J->writer(J->userData, J->buff, J->buff_ix)) {
+		J->ok = BON_FALSE;
+	}
+	J->buff_ix = 0;
+}
+
+BON_INLINE void bon_json_raw(bon_json* J, const void* data, bon_size n)
+{
+	if (J->buff_ix + n > BON_JSON_BUFF_SIZE) {
+		bon_json_flush(J);
+		if (n > BON_JSON_BUFF_SIZE) {
+			// Big strings go right through
+			if (J->ok && !J->writer(J->userData, data, n)) {
+				J->ok = BON_FALSE;
+			}
+			return;
+		}
+	}
+	memcpy(J->buff + J->buff_ix, data, n);
+	J->buff_ix += n;
+}
+
+BON_INLINE void bon_json_cstr(bon_json* J, const char* str)
+{
+	bon_json_raw(J, str, strlen(str));
+}
+
+// A newline and indentation, or (if 'space') a space unless compact.
+static void bon_json_indent(bon_json* J, unsigned depth, bon_bool space)
+{
+	static const char spaces[] = "                                "; // BON_JSON_INDENT(31) at most
+	const unsigned indent = BON_JSON_INDENT(J->flags);
+	
+	if (indent > 0) {
+		bon_json_raw(J, "\n", 1);
+		for (unsigned i=0; i<depth; ++i) {
+			bon_json_raw(J, spaces, indent);
+		}
+	} else if (space && !(J->flags & BON_JSON_COMPACT)) {
+		bon_json_raw(J, " ", 1);
+	}
+}
+
+// 'size' bytes of valid UTF-8
+static void bon_json_string(bon_json* J, const char* str, bon_size size)
+{
+	const char* end = str + size;
+	bon_json_raw(J, "\"", 1);
+	
+	while (str < end) {
+		// Copy everything that needs no escaping in one go:
+		const char* run = str;
+		while (str < end) {
+			uint8_t c = (uint8_t)*str;
+			if (c < 0x20 || c == '"' || c == '\\' || (c == '/' && (J->flags & BON_JSON_ESCAPE_SLASH)) ||
+				 (c >= 0x80 && (J->flags & BON_JSON_ENSURE_ASCII))) {
+				break;
+			}
+			++str;
+		}
+		if (str != run) {
+			bon_json_raw(J, run, (bon_size)(str - run));
+		}
+		if (str == end) {
+			break;
+		}
+		
+		int32_t codepoint = (uint8_t)*str;
+		int     count     = 1;
+		if (codepoint >= 0x80) {
+			count = utf8_check_first(*str);
+			if (count <= 1 || end - str < count || !utf8_check_full(str, count, &codepoint)) {
+				J->ok = BON_FALSE;
+				return;
+			}
+		}
+		str += count;
+		
+		char seq[16];
+		switch (codepoint) {
+			case '\\': bon_json_raw(J, "\\\\", 2); break;
+			case '"':  bon_json_raw(J, "\\\"", 2); break;
+			case '\b': bon_json_raw(J, "\\b",  2); break;
+			case '\f': bon_json_raw(J, "\\f",  2); break;
+			case '\n': bon_json_raw(J, "\\n",  2); break;
+			case '\r': bon_json_raw(J, "\\r",  2); break;
+			case '\t': bon_json_raw(J, "\\t",  2); break;
+			case '/':  bon_json_raw(J, "\\/",  2); break;
+			default:
+				if (codepoint < 0x10000) {
+					snprintf(seq, sizeof(seq), "\\u%04x", (unsigned)codepoint);
+				} else {
+					// Not in the BMP: a UTF-16 surrogate pair
+					codepoint -= 0x10000;
+					snprintf(seq, sizeof(seq), "\\u%04x\\u%04x",
+								(unsigned)(0xD800 | ((codepoint & 0xffc00) >> 10)),
+								(unsigned)(0xDC00 | (codepoint & 0x003ff)));
+				}
+				bon_json_cstr(J, seq);
+		}
+	}
+	
+	bon_json_raw(J, "\"", 1);
+}
+
+static void bon_json_uint(bon_json* J, uint64_t u64)
+{
+	char buff[32];
+	bon_json_raw(J, buff, (bon_size)snprintf(buff, sizeof(buff), "%"PRIu64, u64));
+}
+
+static void bon_json_sint(bon_json* J, int64_t s64)
+{
+	char buff[32];
+	bon_json_raw(J, buff, (bon_size)snprintf(buff, sizeof(buff), "%"PRIi64, s64));
+}
+
+// Like jansson: "%.17g", always with a '.' or an 'e', and no '+' or leading zeros in the exponent.
+static void bon_json_double(bon_json* J, double dbl)
+{
+	if (isnan(dbl)) { bon_json_cstr(J, BON_JSON_NAN_STR); return; }
+	if (isinf(dbl)) { bon_json_cstr(J, dbl < 0 ? BON_JSON_NEG_INF_STR : BON_JSON_POS_INF_STR); return; }
+	
+	char buff[64];
+	int length = snprintf(buff, sizeof(buff), "%.17g", dbl);
+	
+	for (char* c = buff; *c; ++c) {
+		if (*c == ',') { *c = '.'; } // Whatever the locale
+	}
+	
+	if (!strchr(buff, '.') && !strchr(buff, 'e')) {
+		buff[length++] = '.';
+		buff[length++] = '0';
+		buff[length]   = '\0';
+	}
+	
+	char* start = strchr(buff, 'e');
+	if (start) {
+		start++;
+		char* end = start + 1;
+		if (*start == '-') {
+			start++;
+		}
+		while (*end == '0') {
+			end++;
+		}
+		if (end != start) {
+			memmove(start, end, (size_t)(length - (end - buff)) + 1);
+			length -= (int)(end - start);
+		}
+	}
+	
+	bon_json_raw(J, buff, (bon_size)length);
+}
+
+// One element of a packed aggregate, straight from its bytes.
+static void bon_json_aggr(bon_json* J, const bon_type* type, bon_reader* br, unsigned depth)
+{
+	switch (type->id) {
+		case BON_TYPE_ARRAY: {
+			const bon_type_array* arr = type->u.array;
+			bon_json_raw(J, "[", 1);
+			if (arr->size == 0) {
+				bon_json_raw(J, "]", 1);
+				break;
+			}
+			bon_json_indent(J, depth + 1, BON_FALSE);
+			for (bon_size i=0; i<arr->size && J->ok && !br->error; ++i) {
+				bon_json_aggr(J, arr->type, br, depth + 1);
+				if (i + 1 < arr->size) {
+					bon_json_raw(J, ",", 1);
+					bon_json_indent(J, depth + 1, BON_TRUE);
+				}
+			}
+			bon_json_indent(J, depth, BON_FALSE);
+			bon_json_raw(J, "]", 1);
+		} break;
+		
+		case BON_TYPE_STRUCT: {
+			const bon_type_struct* strct = type->u.strct;
+			bon_json_raw(J, "{", 1);
+			if (strct->size == 0) {
+				bon_json_raw(J, "}", 1);
+				break;
+			}
+			bon_json_indent(J, depth + 1, BON_FALSE);
+			for (bon_size i=0; i<strct->size && J->ok && !br->error; ++i) {
+				const bon_kt* kt = &strct->kts[i];
+				bon_json_string(J, kt->key, strlen(kt->key));
+				bon_json_cstr(J, (J->flags & BON_JSON_COMPACT) ? ":" : ": ");
+				bon_json_aggr(J, &kt->type, br, depth + 1);
+				if (i + 1 < strct->size) {
+					bon_json_raw(J, ",", 1);
+					bon_json_indent(J, depth + 1, BON_TRUE);
+				}
+			}
+			bon_json_indent(J, depth, BON_FALSE);
+			bon_json_raw(J, "}", 1);
+		} break;
+		
+		case BON_CTRL_SINT8:
+		case BON_CTRL_SINT16_LE:
+		case BON_CTRL_SINT16_BE:
+		case BON_CTRL_SINT32_LE:
+		case BON_CTRL_SINT32_BE:
+		case BON_CTRL_SINT64_LE:
+		case BON_CTRL_SINT64_BE:
+			bon_json_sint(J, br_read_sint64(br, type->id));
+			break;
+		
+		case BON_CTRL_UINT8:
+		case BON_CTRL_UINT16_LE:
+		case BON_CTRL_UINT16_BE:
+		case BON_CTRL_UINT32_LE:
+		case BON_CTRL_UINT32_BE:
+		case BON_CTRL_UINT64_LE:
+		case BON_CTRL_UINT64_BE:
+			bon_json_uint(J, br_read_uint64(br, type->id));
+			break;
+		
+		case BON_CTRL_FLOAT_LE:
+		case BON_CTRL_FLOAT_BE:
+		case BON_CTRL_DOUBLE_LE:
+		case BON_CTRL_DOUBLE_BE:
+		case BON_CTRL_HALF_LE:
+		case BON_CTRL_HALF_BE:
+		case BON_CTRL_BF16_LE:
+		case BON_CTRL_BF16_BE:
+			bon_json_double(J, br_read_double(br, type->id));
+			break;
+		
+		default:
+			J->ok = BON_FALSE;
+	}
+}
+
+// Cell 'row' of a table column.
+static void bon_json_cell(bon_json* J, const bon_column* col, bon_size row)
+{
+	if (col->type == BON_TYPE_STRING) {
+		bon_size size;
+		const char* str = bon_column_str(col, row, &size);
+		if (!str) {
+			J->ok = BON_FALSE;
+			return;
+		}
+		bon_json_string(J, str, size);
+	} else if (col->type == BON_TYPE_BOOL) {
+		bon_json_cstr(J, ((const uint8_t*)col->data)[row] ? "true" : "false");
+	} else {
+		bon_type   type = { col->type, { NULL } };
+		bon_size   size = bon_type_size(col->type);
+		bon_reader br   = make_br(J->B, (const uint8_t*)col->data + row * size, size, BON_BAD_BLOCK_ID);
+		bon_json_aggr(J, &type, &br, 0);
+	}
+}
+
+static void bon_json_value(bon_json* J, bon_value* v, unsigned depth)
+{
+	v = bon_r_follow_refs(J->B, v);
+	if (!v) {
+		J->ok = BON_FALSE;
+		return;
+	}
+	
+	const char* key_sep = (J->flags & BON_JSON_COMPACT) ? ":" : ": ";
+	
+	switch (v->type) {
+		case BON_VALUE_NIL:
+			bon_json_raw(J, "null", 4);
+			break;
+		
+		case BON_VALUE_BOOL:
+			bon_json_cstr(J, v->u.boolean ? "true" : "false");
+			break;
+		
+		case BON_VALUE_UINT64:
+			bon_json_uint(J, v->u.u64);
+			break;
+		
+		case BON_VALUE_SINT64:
+			bon_json_sint(J, v->u.s64);
+			break;
+		
+		case BON_VALUE_DOUBLE:
+			bon_json_double(J, v->u.dbl);
+			break;
+		
+		case BON_VALUE_STRING:
+			bon_json_string(J, v->u.str.ptr, v->u.str.size);
+			break;
+		
+		case BON_VALUE_LIST: {
+			const bon_list* list = &v->u.list;
+			bon_json_raw(J, "[", 1);
+			if (list->size == 0) {
+				bon_json_raw(J, "]", 1);
+				break;
+			}
+			bon_json_indent(J, depth + 1, BON_FALSE);
+			for (bon_size i=0; i<list->size && J->ok; ++i) {
+				bon_json_value(J, &list->data[i], depth + 1);
+				if (i + 1 < list->size) {
+					bon_json_raw(J, ",", 1);
+					bon_json_indent(J, depth + 1, BON_TRUE);
+				}
+			}
+			bon_json_indent(J, depth, BON_FALSE);
+			bon_json_raw(J, "]", 1);
+		} break;
+		
+		case BON_VALUE_OBJ: {
+			const bon_obj* obj = &v->u.obj;
+			bon_json_raw(J, "{", 1);
+			if (obj->size == 0) {
+				bon_json_raw(J, "}", 1);
+				break;
+			}
+			bon_json_indent(J, depth + 1, BON_FALSE);
+			for (bon_size i=0; i<obj->size && J->ok; ++i) {
+				bon_kv* kv = &obj->data[i];
+				bon_json_string(J, kv->key, strlen(kv->key));
+				bon_json_cstr(J, key_sep);
+				bon_json_value(J, &kv->val, depth + 1);
+				if (i + 1 < obj->size) {
+					bon_json_raw(J, ",", 1);
+					bon_json_indent(J, depth + 1, BON_TRUE);
+				}
+			}
+			bon_json_indent(J, depth, BON_FALSE);
+			bon_json_raw(J, "}", 1);
+		} break;
+		
+		case BON_VALUE_TABLE: {
+			// Row by row, straight from the columns:
+			const bon_value_table* table = v->u.table;
+			bon_json_raw(J, "[", 1);
+			if (table->num_rows == 0) {
+				bon_json_raw(J, "]", 1);
+				break;
+			}
+			bon_json_indent(J, depth + 1, BON_FALSE);
+			for (bon_size row=0; row<table->num_rows && J->ok; ++row) {
+				bon_json_raw(J, "{", 1);
+				if (table->num_cols == 0) {
+					bon_json_raw(J, "}", 1);
+				} else {
+					bon_json_indent(J, depth + 2, BON_FALSE);
+					for (bon_size ci=0; ci<table->num_cols; ++ci) {
+						const bon_column* col = &table->cols[ci].col;
+						bon_json_string(J, col->key, strlen(col->key));
+						bon_json_cstr(J, key_sep);
+						bon_json_cell(J, col, row);
+						if (ci + 1 < table->num_cols) {
+							bon_json_raw(J, ",", 1);
+							bon_json_indent(J, depth + 2, BON_TRUE);
+						}
+					}
+					bon_json_indent(J, depth + 1, BON_FALSE);
+					bon_json_raw(J, "}", 1);
+				}
+				if (row + 1 < table->num_rows) {
+					bon_json_raw(J, ",", 1);
+					bon_json_indent(J, depth + 1, BON_TRUE);
+				}
+			}
+			bon_json_indent(J, depth, BON_FALSE);
+			bon_json_raw(J, "]", 1);
+		} break;
+		
+		case BON_VALUE_AGGREGATE: {
+			// Element by element, straight from the packed bytes:
+			const bon_value_agg* agg = v->u.agg;
+			const uint8_t* payload = bon_agg_payload(agg);
+			if (!payload) {
+				J->ok = BON_FALSE;
+				break;
+			}
+			bon_size   nbytes = bon_aggregate_payload_size(&agg->type);
+			bon_reader br     = make_br(J->B, payload, nbytes, BON_BAD_BLOCK_ID);
+			bon_json_aggr(J, &agg->type, &br, depth);
+			if (br.error || br.nbytes != 0) {
+				J->ok = BON_FALSE;
+			}
+		} break;
+		
+		default:
+			J->ok = BON_FALSE;
+	}
+}
+
+bon_bool bon_r_write_json(bon_r_doc* B, bon_value* val, bon_w_writer_t writer, void* userData,
+								  unsigned flags)
+{
+	bon_json J;
+	J.B        = B;
+	J.writer   = writer;
+	J.userData = userData;
+	J.flags    = flags;
+	J.buff     = BON_ALLOC_TYPE(BON_JSON_BUFF_SIZE, uint8_t);
+	J.buff_ix  = 0;
+	J.ok       = (J.buff != NULL);
+	
+	if (J.ok) {
+		bon_json_value(&J, val, 0);
+		bon_json_flush(&J);
+	}
+	
+	free(J.buff);
+	return J.ok;
+}
@@ -0,0 +1,588 @@
+//
+//  log.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200809L  // mmap, truncate
+#endif
+
+#include "log.h"
+#include "private.h"
+#include "crc32.h"
+#include <stdlib.h>       // malloc, free, realloc, calloc, ...
+#include <string.h>       // memcmp, memcpy, strlen
+
+#if defined(_WIN32)
+#  include <io.h>         // _chsize_s
+#else
+#  include <fcntl.h>      // open
+#  include <sys/mman.h>   // mmap
+#  include <sys/stat.h>   // fstat
+#  include <unistd.h>     // close, truncate
+#endif
+
+
+#define BON_LOG_MAGIC         "BONLOG01"
+#define BON_IDX_MAGIC         "BONIDX01"
+#define BON_LOG_MAGIC_SIZE    8
+#define BON_LOG_FRAME_HEADER  12  // uint32 size + uint64 timestamp
+#define BON_LOG_ENTRY_SIZE    16  // uint64 offset + uint64 timestamp
+#define BON_LOG_FOOTER_SIZE   6   // f crc32 f
+
+
+typedef struct {
+	uint64_t  offset;
+	uint64_t  timestamp;
+} bon_log_entry;
+
+typedef struct {
+	bon_size        size;
+	bon_size        cap;
+	bon_log_entry*  data;
+} bon_log_entries;
+
+struct bon_log {
+	FILE*      seg;
+	FILE*      idx;
+	bon_size   count;  // Number of records
+	bon_size   end;    // Size of the segment
+	bon_error  error;  // If any
+};
+
+struct bon_log_reader {
+	const uint8_t*   seg;
+	bon_size         seg_size;  // Mapped size
+	bon_size         count;     // Number of valid records
+	bon_log_entries  idx;
+	bon_error        error;     // If any
+};
+
+
+//------------------------------------------------------------------------------
+// Little endian, independent of the host
+
+
+BON_INLINE void bon_log_put_u32(uint8_t* out, uint32_t v)
+{
+	for (int i=0; i<4; ++i) {
+		out[i] = (uint8_t)(v >> (8*i));
+	}
+}
+
+BON_INLINE void bon_log_put_u64(uint8_t* out, uint64_t v)
+{
+	for (int i=0; i<8; ++i) {
+		out[i] = (uint8_t)(v >> (8*i));
+	}
+}
+
+BON_INLINE uint32_t bon_log_get_u32(const uint8_t* in)
+{
+	uint32_t v = 0;
+	for (int i=3; i>=0; --i) {
+		v = (v << 8) | in[i];
+	}
+	return v;
+}
+
+BON_INLINE uint64_t bon_log_get_u64(const uint8_t* in)
+{
+	uint64_t v = 0;
+	for (int i=7; i>=0; --i) {
+		v = (v << 8) | in[i];
+	}
+	return v;
+}
+
+
+//------------------------------------------------------------------------------
+// Files
+
+
+// Returns NULL for empty or missing files. *out_ok is false only for missing or unreadable files.
+static const uint8_t* bon_log_map(const char* path, bon_size* out_size, bon_bool* out_ok)
+{
+	*out_size = 0;
+	*out_ok   = BON_FALSE;
+	
+#if defined(_WIN32)
+	FILE* fp = fopen(path, "rb");
+	if (!fp) { return NULL; }
+	fclose(fp);
+	uint8_t* data = bon_read_file(out_size, path);
+	*out_ok = (data != NULL);
+	return data;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return NULL; }
+	
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return NULL;
+	}
+	
+	*out_ok = BON_TRUE;
+	
+	if (info.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED) {
+		*out_ok = BON_FALSE;
+		return NULL;
+	}
+	
+	*out_size = (bon_size)info.st_size;
+	return (const uint8_t*)data;
+#endif
+}
+
+static void bon_log_unmap(const uint8_t* data, bon_size size)
+{
+	if (!data) { return; }
+	
+#if defined(_WIN32)
+	(void)size;
+	free((void*)data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+static bon_bool bon_log_truncate(const char* path, bon_size size)
+{
+#if defined(_WIN32)
+	FILE* fp = fopen(path, "r+b");
+	if (!fp) { return BON_FALSE; }
+	bon_bool ok = (_chsize_s(_fileno(fp), (__int64)size) == 0);
+	fclose(fp);
+	return ok;
+#else
+	return truncate(path, (off_t)size) == 0;
+#endif
+}
+
+// path + ".idx". Free the result.
+static char* bon_log_idx_path(const char* path)
+{
+	size_t len = strlen(path);
+	char* idx_path = BON_ALLOC_TYPE(len + 5, char);
+	memcpy(idx_path, path, len);
+	memcpy(idx_path + len, ".idx", 5);
+	return idx_path;
+}
+
+// A missing or corrupt index file gives an empty index (which will then be rebuilt).
+static void bon_log_read_index(const char* idx_path, bon_log_entries* idx)
+{
+	idx->size = 0;
+	
+	bon_size size;
+	bon_bool ok;
+	const uint8_t* data = bon_log_map(idx_path, &size, &ok);
+	
+	if (size >= BON_LOG_MAGIC_SIZE && memcmp(data, BON_IDX_MAGIC, BON_LOG_MAGIC_SIZE) == 0) {
+		bon_size n = (size - BON_LOG_MAGIC_SIZE) / BON_LOG_ENTRY_SIZE;
+		BON_VECTOR_EXPAND(*idx, bon_log_entry, n);
+		
+		for (bon_size i=0; i<n; ++i) {
+			const uint8_t* in = data + BON_LOG_MAGIC_SIZE + i * BON_LOG_ENTRY_SIZE;
+			idx->data[i].offset    = bon_log_get_u64(in);
+			idx->data[i].timestamp = bon_log_get_u64(in + 8);
+		}
+	}
+	
+	bon_log_unmap(data, size);
+}
+
+static bon_bool bon_log_write_entry(FILE* fp, uint64_t offset, uint64_t timestamp)
+{
+	uint8_t entry[BON_LOG_ENTRY_SIZE];
+	bon_log_put_u64(entry,     offset);
+	bon_log_put_u64(entry + 8, timestamp);
+	return fwrite(entry, 1, BON_LOG_ENTRY_SIZE, fp) == BON_LOG_ENTRY_SIZE;
+}
+
+
+//------------------------------------------------------------------------------
+// Scanning
+
+
+// Is 'doc' a BON document with a correct CRC footer?
+static bon_bool bon_log_check_crc(const uint8_t* doc, bon_size size)
+{
+	if (size < BON_LOG_FOOTER_SIZE ||
+		 doc[size-1] != BON_CTRL_FOOTER_CRC ||
+		 doc[size-6] != BON_CTRL_FOOTER_CRC)
+	{
+		return BON_FALSE;
+	}
+	
+	uint32_t crc_calced = crc_calc(doc, size - BON_LOG_FOOTER_SIZE);
+	uint32_t crc_read   = bon_log_get_u32(doc + size - 5);
+	return crc_calced == crc_read;
+}
+
+// Size of the complete and valid frame at 'offset', or 0 if there is none.
+static bon_size bon_log_frame_size(const uint8_t* seg, bon_size seg_size, bon_size offset)
+{
+	if (offset + BON_LOG_FRAME_HEADER > seg_size) {
+		return 0;
+	}
+	
+	bon_size size = bon_log_get_u32(seg + offset);
+	if (seg_size - offset - BON_LOG_FRAME_HEADER < size) {
+		return 0; // Truncated
+	}
+	
+	if (!bon_log_check_crc(seg + offset + BON_LOG_FRAME_HEADER, size)) {
+		return 0;
+	}
+	
+	return BON_LOG_FRAME_HEADER + size;
+}
+
+/*
+ Finds the valid records of a segment, using the index to skip ahead.
+ Only the records from the last usable index entry and on are validated.
+ Index entries pointing at invalid records are dropped, and missing entries are added.
+ Returns the number of records, and sets *out_end to the end of the last one.
+ */
+static bon_size bon_log_scan(const uint8_t* seg, bon_size seg_size, bon_log_entries* idx,
+									  bon_size* out_end)
+{
+	while (idx->size > 0) {
+		const bon_log_entry* e = &idx->data[idx->size - 1];
+		if (e->offset >= BON_LOG_MAGIC_SIZE &&
+			 bon_log_frame_size(seg, seg_size, e->offset) != 0 &&
+			 bon_log_get_u64(seg + e->offset + 4) == e->timestamp)
+		{
+			break;
+		}
+		idx->size--;
+	}
+	
+	bon_size count  = (idx->size == 0 ? 0 : (idx->size - 1) * BON_LOG_INDEX_INTERVAL);
+	bon_size offset = (idx->size == 0 ? BON_LOG_MAGIC_SIZE : idx->data[idx->size - 1].offset);
+	
+	for (;;) {
+		bon_size n = bon_log_frame_size(seg, seg_size, offset);
+		if (n == 0) {
+			break;
+		}
+		
+		if (count == idx->size * BON_LOG_INDEX_INTERVAL) {
+			BON_VECTOR_EXPAND(*idx, bon_log_entry, 1);
+			idx->data[idx->size - 1].offset    = offset;
+			idx->data[idx->size - 1].timestamp = bon_log_get_u64(seg + offset + 4);
+		}
+		
+		count  += 1;
+		offset += n;
+	}
+	
+	*out_end = offset;
+	return count;
+}
+
+
+//------------------------------------------------------------------------------
+// Appending
+
+
+static bon_error bon_log_create(bon_log* log, const char* path, const char* idx_path)
+{
+	log->seg = fopen(path, "wb");
+	log->idx = fopen(idx_path, "wb");
+	if (!log->seg || !log->idx) {
+		return BON_ERR_WRITE_ERROR;
+	}
+	
+	if (fwrite(BON_LOG_MAGIC, 1, BON_LOG_MAGIC_SIZE, log->seg) != BON_LOG_MAGIC_SIZE ||
+		 fwrite(BON_IDX_MAGIC, 1, BON_LOG_MAGIC_SIZE, log->idx) != BON_LOG_MAGIC_SIZE)
+	{
+		return BON_ERR_WRITE_ERROR;
+	}
+	
+	log->count = 0;
+	log->end   = BON_LOG_MAGIC_SIZE;
+	return BON_SUCCESS;
+}
+
+static bon_error bon_log_recover(bon_log* log, const char* path, const char* idx_path)
+{
+	bon_size seg_size;
+	bon_bool ok;
+	const uint8_t* seg = bon_log_map(path, &seg_size, &ok);
+	
+	if (!ok) {
+		return BON_ERR_READ_ERROR;
+	}
+	
+	if (seg_size < BON_LOG_MAGIC_SIZE || memcmp(seg, BON_LOG_MAGIC, BON_LOG_MAGIC_SIZE) != 0) {
+		bon_log_unmap(seg, seg_size);
+		return BON_ERR_BAD_LOG;
+	}
+	
+	bon_log_entries idx = {0, 0, NULL};
+	bon_log_read_index(idx_path, &idx);
+	log->count = bon_log_scan(seg, seg_size, &idx, &log->end);
+	bon_log_unmap(seg, seg_size);
+	
+	bon_error err = BON_SUCCESS;
+	
+	if (log->end < seg_size && !bon_log_truncate(path, log->end)) {
+		// Drop the partially written record
+		err = BON_ERR_WRITE_ERROR;
+	}
+	
+	// Rewrite the (possibly repaired) index:
+	log->idx = fopen(idx_path, "wb");
+	if (!log->idx || fwrite(BON_IDX_MAGIC, 1, BON_LOG_MAGIC_SIZE, log->idx) != BON_LOG_MAGIC_SIZE) {
+		err = BON_ERR_WRITE_ERROR;
+	} else {
+		for (bon_size i=0; i<idx.size; ++i) {
+			if (!bon_log_write_entry(log->idx, idx.data[i].offset, idx.data[i].timestamp)) {
+				err = BON_ERR_WRITE_ERROR;
+			}
+		}
+	}
+	free(idx.data);
+	
+	log->seg = fopen(path, "ab");
+	if (!log->seg) {
+		err = BON_ERR_WRITE_ERROR;
+	}
+	
+	return err;
+}
+
+bon_log* bon_log_open(const char* path)
+{
+	bon_log* log = BON_CALLOC_TYPE(1, bon_log);
+	char* idx_path = bon_log_idx_path(path);
+	
+	FILE* probe = fopen(path, "rb");
+	if (probe) {
+		fclose(probe);
+		log->error = bon_log_recover(log, path, idx_path);
+	} else {
+		log->error = bon_log_create(log, path, idx_path);
+	}
+	
+	free(idx_path);
+	
+	if (log->error) {
+		bon_onError(bon_err_str(log->error));
+	}
+	
+	return log;
+}
+
+bon_error bon_log_append(bon_log* log, uint64_t timestamp, const uint8_t* data, bon_size size)
+{
+	if (log->error) {
+		return log->error;
+	}
+	
+	if (size > 0xffffffff) {
+		return BON_ERR_WRITE_ERROR; // Too large for the frame header
+	}
+	
+	/*
+	 Recovery stops at the first record with a bad CRC,
+	 so a bad record must never get into the segment.
+	 */
+	if (size < BON_LOG_FOOTER_SIZE || data[size-1] != BON_CTRL_FOOTER_CRC) {
+		return BON_ERR_MISSING_CRC;
+	}
+	if (!bon_log_check_crc(data, size)) {
+		return BON_ERR_WRONG_CRC;
+	}
+	
+	uint8_t header[BON_LOG_FRAME_HEADER];
+	bon_log_put_u32(header,     (uint32_t)size);
+	bon_log_put_u64(header + 4, timestamp);
+	
+	if (fwrite(header, 1, BON_LOG_FRAME_HEADER, log->seg) != BON_LOG_FRAME_HEADER ||
+		 fwrite(data, 1, size, log->seg) != size)
+	{
+		log->error = BON_ERR_WRITE_ERROR;
+		return log->error;
+	}
+	
+	// The index entry goes after the record, so it never points at nothing.
+	if (log->count % BON_LOG_INDEX_INTERVAL == 0) {
+		if (!bon_log_write_entry(log->idx, log->end, timestamp)) {
+			log->error = BON_ERR_WRITE_ERROR;
+		}
+	}
+	
+	log->count += 1;
+	log->end   += BON_LOG_FRAME_HEADER + size;
+	
+	return log->error;
+}
+
+bon_size bon_log_count(const bon_log* log)
+{
+	return log->count;
+}
+
+bon_error bon_log_flush(bon_log* log)
+{
+	if (log->seg && fflush(log->seg) != 0) {
+		log->error = BON_ERR_WRITE_ERROR;
+	}
+	if (log->idx && fflush(log->idx) != 0) {
+		log->error = BON_ERR_WRITE_ERROR;
+	}
+	return log->error;
+}
+
+bon_error bon_log_error(const bon_log* log)
+{
+	return log->error;
+}
+
+bon_error bon_log_close(bon_log* log)
+{
+	bon_error err = bon_log_flush(log);
+	if (log->seg) { fclose(log->seg); }
+	if (log->idx) { fclose(log->idx); }
+	free(log);
+	return err;
+}
+
+
+//------------------------------------------------------------------------------
+// Reading
+
+
+bon_log_reader* bon_log_reader_open(const char* path)
+{
+	bon_log_reader* L = BON_CALLOC_TYPE(1, bon_log_reader);
+	
+	bon_bool ok;
+	L->seg = bon_log_map(path, &L->seg_size, &ok);
+	
+	if (!ok) {
+		L->error = BON_ERR_READ_ERROR;
+	} else if (L->seg_size < BON_LOG_MAGIC_SIZE ||
+				  memcmp(L->seg, BON_LOG_MAGIC, BON_LOG_MAGIC_SIZE) != 0) {
+		L->error = BON_ERR_BAD_LOG;
+	} else {
+		char* idx_path = bon_log_idx_path(path);
+		bon_log_read_index(idx_path, &L->idx);
+		free(idx_path);
+		
+		bon_size end;
+		L->count = bon_log_scan(L->seg, L->seg_size, &L->idx, &end);
+	}
+	
+	if (L->error) {
+		bon_onError(bon_err_str(L->error));
+	}
+	
+	return L;
+}
+
+bon_error bon_log_reader_error(const bon_log_reader* L)
+{
+	return L->error;
+}
+
+bon_size bon_log_reader_count(const bon_log_reader* L)
+{
+	return L->count;
+}
+
+void bon_log_reader_close(bon_log_reader* L)
+{
+	bon_log_unmap(L->seg, L->seg_size);
+	free(L->idx.data);
+	free(L);
+}
+
+BON_INLINE void bon_log_fill(const bon_log_reader* L, bon_size index, bon_size offset,
+									  bon_log_record* out)
+{
+	out->index     = index;
+	out->offset    = offset;
+	out->size      = bon_log_get_u32(L->seg + offset);
+	out->timestamp = bon_log_get_u64(L->seg + offset + 4);
+	out->data      = L->seg + offset + BON_LOG_FRAME_HEADER;
+}
+
+// The records before L->count are already validated, so we only need to follow the sizes.
+BON_INLINE bon_size bon_log_skip(const bon_log_reader* L, bon_size offset)
+{
+	return offset + BON_LOG_FRAME_HEADER + bon_log_get_u32(L->seg + offset);
+}
+
+bon_bool bon_log_get(const bon_log_reader* L, bon_size index, bon_log_record* out)
+{
+	if (index >= L->count) {
+		return BON_FALSE;
+	}
+	
+	bon_size entry  = index / BON_LOG_INDEX_INTERVAL;
+	bon_size offset = L->idx.data[entry].offset;
+	
+	for (bon_size i = entry * BON_LOG_INDEX_INTERVAL; i < index; ++i) {
+		offset = bon_log_skip(L, offset);
+	}
+	
+	bon_log_fill(L, index, offset, out);
+	return BON_TRUE;
+}
+
+bon_bool bon_log_next(const bon_log_reader* L, bon_log_record* rec)
+{
+	if (rec->index + 1 >= L->count) {
+		return BON_FALSE;
+	}
+	
+	bon_log_fill(L, rec->index + 1, bon_log_skip(L, rec->offset), rec);
+	return BON_TRUE;
+}
+
+bon_size bon_log_find_time(const bon_log_reader* L, uint64_t t)
+{
+	// Binary search for the first index entry with a timestamp >= t:
+	bon_size lo = 0, hi = L->idx.size;
+	while (lo < hi) {
+		bon_size mid = lo + (hi - lo) / 2;
+		if (L->idx.data[mid].timestamp < t) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	
+	if (lo == 0) {
+		return 0;
+	}
+	
+	// The answer is in the interval of the entry before:
+	bon_log_record rec;
+	bon_log_get(L, (lo - 1) * BON_LOG_INDEX_INTERVAL, &rec);
+	
+	while (rec.timestamp < t) {
+		if (!bon_log_next(L, &rec)) {
+			return L->count;
+		}
+	}
+	
+	return rec.index;
+}
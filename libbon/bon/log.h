@@ -0,0 +1,118 @@
+//
+//  log.h
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+#ifndef BON_log_h
+#define BON_log_h
+
+#include "bon.h"
+
+
+//------------------------------------------------------------------------------
+// Append-only segment log of BON records
+
+/*
+ A segment file is an 8 byte magic ("BONLOG01") followed by frames:
+
+   uint32_le  size          of the record
+   uint64_le  timestamp     given by the user. Should be non-decreasing.
+   uint8_t    record[size]  a complete BON document with a CRC footer
+
+ A sidecar index file (the segment path + ".idx") starts with the magic "BONIDX01"
+ followed by the offset and timestamp (both uint64_le) of every BON_LOG_INDEX_INTERVAL:th record.
+ Finding record N or a point in time thus never reads more than that many frame headers.
+
+ The index is only a cache: it is repaired from the segment whenever it is stale.
+ After a crash, bon_log_open truncates the segment after the last record
+ with a valid CRC, so a half-written record is never seen by readers.
+
+ Usage:
+ bon_log* log = bon_log_open("events.bonlog");
+ bon_w_doc* B = bon_w_new_mem(BON_W_FLAG_CRC);
+ for each event {
+     bon_w_reset( B, NULL, NULL, BON_W_FLAG_CRC );
+     write_event( B );
+     bon_w_finish( B );
+     bon_size size;
+     const uint8_t* data = bon_w_mem_data(B, &size);
+     bon_log_append( log, now(), data, size );
+ }
+ bon_w_free( B );
+ bon_log_close( log );
+ */
+
+// Every this many records is indexed
+#define BON_LOG_INDEX_INTERVAL 256
+
+typedef struct bon_log bon_log;
+
+// Creates the segment if it does not exist, otherwise recovers it for appending. Check bon_log_error.
+bon_log*   bon_log_open   (const char* path);
+
+// 'data' must be a BON document written with BON_W_FLAG_CRC (else BON_ERR_MISSING_CRC).
+bon_error  bon_log_append (bon_log* log, uint64_t timestamp, const uint8_t* data, bon_size size);
+
+// Number of records in the segment
+bon_size   bon_log_count  (const bon_log* log);
+
+// Pushes appended records to the OS.
+bon_error  bon_log_flush  (bon_log* log);
+
+// First error (if any)
+bon_error  bon_log_error  (const bon_log* log);
+
+// Flushes and closes. Returns the first error (if any).
+bon_error  bon_log_close  (bon_log* log);
+
+
+//------------------------------------------------------------------------------
+// Reading a segment
+
+/*
+ Usage:
+ bon_log_reader* L = bon_log_reader_open("events.bonlog");
+ bon_log_record rec;
+ bon_size end = bon_log_find_time(L, t1);
+ if (bon_log_get(L, bon_log_find_time(L, t0), &rec)) {
+     do {
+         bon_r_doc* R = bon_r_open(rec.data, rec.size, BON_R_FLAG_DEFAULT);
+         ...
+         bon_r_close(R);
+     } while (rec.index + 1 < end && bon_log_next(L, &rec));
+ }
+ bon_log_reader_close( L );
+
+ The reader sees the records that were complete when it was opened.
+ */
+
+typedef struct bon_log_reader bon_log_reader;
+
+typedef struct {
+	bon_size        index;      // Record number
+	uint64_t        timestamp;
+	const uint8_t*  data;       // The BON document. Valid until the reader is closed.
+	bon_size        size;
+	bon_size        offset;     // Offset of the frame in the segment
+} bon_log_record;
+
+// Maps the segment to memory. Check bon_log_reader_error.
+bon_log_reader*  bon_log_reader_open  (const char* path);
+bon_error        bon_log_reader_error (const bon_log_reader* L);
+bon_size         bon_log_reader_count (const bon_log_reader* L);
+void             bon_log_reader_close (bon_log_reader* L);
+
+// Record number 'index'. Returns false if out of range.
+bon_bool  bon_log_get       (const bon_log_reader* L, bon_size index, bon_log_record* out);
+
+// Moves 'rec' to the record after it. Returns false at the end.
+bon_bool  bon_log_next      (const bon_log_reader* L, bon_log_record* rec);
+
+// Index of the first record with a timestamp >= t, or bon_log_reader_count if none.
+bon_size  bon_log_find_time (const bon_log_reader* L, uint64_t t);
+
+
+#endif
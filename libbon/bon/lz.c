@@ -0,0 +1,250 @@
+//
+//  lz.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#include "bon.h"
+#include "private.h"
+#include <string.h>       // memcpy, memset
+
+
+//------------------------------------------------------------------------------
+// A small, fast LZ compressor producing the LZ4 block format.
+
+/*
+ A compressed block is a series of sequences:
+
+   token            high nibble: number of literals, low nibble: match length - 4.
+                    A nibble of 15 is followed by bytes to add to it, until one is not 255.
+   literals
+   uint16_le offset back to the match (1-65535)
+
+ The last sequence only has the token and the literals.
+ Like LZ4, the last five bytes are always literals, and the last match starts
+ at least twelve bytes before the end, so any LZ4 decoder can read our output.
+ */
+
+#define BON_LZ_MIN_MATCH     4
+#define BON_LZ_LAST_LITERALS 5
+#define BON_LZ_MF_LIMIT      12
+#define BON_LZ_MAX_OFFSET    65535
+#define BON_LZ_HASH_LOG      14
+
+BON_INLINE uint32_t bon_lz_read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+BON_INLINE uint32_t bon_lz_hash(uint32_t seq)
+{
+	return (seq * 2654435761u) >> (32 - BON_LZ_HASH_LOG);
+}
+
+// Number of equal bytes at 'a' and 'b', not going past 'a_end'.
+BON_INLINE bon_size bon_lz_count(const uint8_t* a, const uint8_t* b, const uint8_t* a_end)
+{
+	const uint8_t* start = a;
+#if __LITTLE_ENDIAN__ && defined(__GNUC__)
+	while (a_end - a >= 8) {
+		uint64_t x, y;
+		memcpy(&x, a, 8);
+		memcpy(&y, b, 8);
+		if (x != y) {
+			return (bon_size)(a - start) + (bon_size)(__builtin_ctzll(x ^ y) / 8);
+		}
+		a += 8;
+		b += 8;
+	}
+#endif
+	while (a < a_end && *a == *b) {
+		++a;
+		++b;
+	}
+	return (bon_size)(a - start);
+}
+
+// Writes a length nibble overflow. Returns NULL if it does not fit.
+BON_INLINE uint8_t* bon_lz_put_length(uint8_t* op, const uint8_t* oend, bon_size len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op == oend) { return NULL; }
+		*op++ = 255;
+	}
+	if (op == oend) { return NULL; }
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+// Writes one sequence (without a match if 'match_len' is 0). Returns NULL if it does not fit.
+static uint8_t* bon_lz_sequence(uint8_t* op, const uint8_t* oend,
+										  const uint8_t* literals, bon_size num_literals,
+										  bon_size offset, bon_size match_len)
+{
+	if (op == oend) { return NULL; }
+	uint8_t* token = op++;
+	
+	*token = (uint8_t)((num_literals < 15 ? num_literals : 15) << 4);
+	if (num_literals >= 15 && !(op = bon_lz_put_length(op, oend, num_literals - 15))) {
+		return NULL;
+	}
+	
+	if ((bon_size)(oend - op) < num_literals) { return NULL; }
+	if (num_literals) {
+		memcpy(op, literals, num_literals);
+		op += num_literals;
+	}
+	
+	if (match_len == 0) {
+		return op;
+	}
+	
+	if (oend - op < 2) { return NULL; }
+	*op++ = (uint8_t)(offset);
+	*op++ = (uint8_t)(offset >> 8);
+	
+	bon_size ml = match_len - BON_LZ_MIN_MATCH;
+	*token |= (uint8_t)(ml < 15 ? ml : 15);
+	if (ml >= 15 && !(op = bon_lz_put_length(op, oend, ml - 15))) {
+		return NULL;
+	}
+	
+	return op;
+}
+
+bon_size bon_lz_compress(const uint8_t* src, bon_size n, uint8_t* dst, bon_size cap)
+{
+	if (n > 0xffffffffu) {
+		return 0; // Positions are 32 bit
+	}
+	
+	uint8_t*        op     = dst;
+	const uint8_t*  oend   = dst + cap;
+	const uint8_t*  anchor = src;
+	
+	if (n > BON_LZ_MF_LIMIT) {
+		uint32_t table[1 << BON_LZ_HASH_LOG];
+		memset(table, 0, sizeof(table));
+	
+		const uint8_t* ip          = src + 1;
+		const uint8_t* mf_limit    = src + n - BON_LZ_MF_LIMIT;
+		const uint8_t* match_limit = src + n - BON_LZ_LAST_LITERALS;
+	
+		while (ip < mf_limit) {
+			uint32_t seq = bon_lz_read32(ip);
+			uint32_t h   = bon_lz_hash(seq);
+			const uint8_t* ref = src + table[h];
+			table[h] = (uint32_t)(ip - src);
+	
+			if (ref >= ip || ip - ref > BON_LZ_MAX_OFFSET || bon_lz_read32(ref) != seq) {
+				ip += 1 + ((ip - anchor) >> 6); // Skip faster through incompressible data
+				continue;
+			}
+	
+			// Extend backwards, then forwards:
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				--ip;
+				--ref;
+			}
+			bon_size len = BON_LZ_MIN_MATCH + bon_lz_count(ip + BON_LZ_MIN_MATCH, ref + BON_LZ_MIN_MATCH, match_limit);
+	
+			op = bon_lz_sequence(op, oend, anchor, (bon_size)(ip - anchor), (bon_size)(ip - ref), len);
+			if (!op) {
+				return 0;
+			}
+	
+			ip    += len;
+			anchor = ip;
+	
+			if (ip < mf_limit) {
+				table[bon_lz_hash(bon_lz_read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+			}
+		}
+	}
+	
+	op = bon_lz_sequence(op, oend, anchor, (bon_size)(src + n - anchor), 0, 0);
+	return op ? (bon_size)(op - dst) : 0;
+}
+
+// Reads a length nibble overflow. Returns NULL on a truncated input.
+BON_INLINE const uint8_t* bon_lz_get_length(const uint8_t* ip, const uint8_t* iend, bon_size* len)
+{
+	for (;;) {
+		if (ip == iend) { return NULL; }
+		uint8_t b = *ip++;
+		*len += b;
+		if (b != 255) { return ip; }
+	}
+}
+
+bon_bool bon_lz_decompress(const uint8_t* src, bon_size n, uint8_t* dst, bon_size raw_size)
+{
+	const uint8_t* ip   = src;
+	const uint8_t* iend = src + n;
+	uint8_t*       op   = dst;
+	uint8_t*       oend = dst + raw_size;
+	
+	while (ip < iend) {
+		uint8_t token = *ip++;
+	
+		bon_size num_literals = token >> 4;
+		if (num_literals == 15 && !(ip = bon_lz_get_length(ip, iend, &num_literals))) {
+			return BON_FALSE;
+		}
+		if ((bon_size)(iend - ip) < num_literals || (bon_size)(oend - op) < num_literals) {
+			return BON_FALSE;
+		}
+		if (num_literals) {
+			memcpy(op, ip, num_literals);
+			op += num_literals;
+			ip += num_literals;
+		}
+	
+		if (ip == iend) {
+			break; // The last sequence has no match
+		}
+	
+		if (iend - ip < 2) { return BON_FALSE; }
+		bon_size offset = (bon_size)ip[0] | ((bon_size)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (bon_size)(op - dst)) {
+			return BON_FALSE;
+		}
+	
+		bon_size len = token & 15;
+		if (len == 15 && !(ip = bon_lz_get_length(ip, iend, &len))) {
+			return BON_FALSE;
+		}
+		len += BON_LZ_MIN_MATCH;
+		if ((bon_size)(oend - op) < len) {
+			return BON_FALSE;
+		}
+	
+		const uint8_t* match = op - offset;
+		if (offset >= 8) {
+			// Eight bytes at a time. Copies overlap, but never within eight bytes.
+			uint8_t* end = op + len;
+			while (oend - op >= 8 && op < end) {
+				memcpy(op, match, 8);
+				op    += 8;
+				match += 8;
+			}
+			while (op < end) {
+				*op++ = *match++;
+			}
+			op = end;
+		} else {
+			for (bon_size i=0; i<len; ++i) {
+				op[i] = match[i];
+			}
+			op += len;
+		}
+	}
+	
+	return op == oend;
+}
@@ -0,0 +1,183 @@
+//
+//  pool.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200809L  // pthreads, sysconf
+#endif
+
+#include "bon.h"
+#include "private.h"
+#include <stdlib.h>       // malloc, free, realloc, calloc, ...
+
+#if !defined(_WIN32)
+#  define BON_HAS_PTHREADS 1
+#  include <pthread.h>
+#  include <unistd.h>     // sysconf
+#else
+#  define BON_HAS_PTHREADS 0
+#endif
+
+
+//------------------------------------------------------------------------------
+// A minimal worker pool: one job (a number of independent tasks) at a time.
+
+
+#if BON_HAS_PTHREADS
+
+struct bon_pool {
+	pthread_mutex_t  mutex;
+	pthread_cond_t   work_cond;   // Signaled when there are tasks (or on quit)
+	pthread_cond_t   done_cond;   // Signaled when the last task is done
+	pthread_t*       threads;
+	unsigned         nthreads;
+	bon_bool         quit;
+	
+	// The current job:
+	bon_task_fn      fn;
+	void*            user;
+	unsigned         ntasks;
+	unsigned         next_task;   // Next to be picked up
+	unsigned         tasks_done;
+};
+
+// Call with the mutex locked. Runs tasks until there are none left to pick up.
+static void bon_pool_work(bon_pool* pool)
+{
+	while (pool->next_task < pool->ntasks) {
+		unsigned task = pool->next_task++;
+	
+		pthread_mutex_unlock(&pool->mutex);
+		pool->fn(pool->user, task);
+		pthread_mutex_lock(&pool->mutex);
+	
+		if (++pool->tasks_done == pool->ntasks) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+	}
+}
+
+static void* bon_pool_worker(void* pool_v)
+{
+	bon_pool* pool = (bon_pool*)pool_v;
+	
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->quit && pool->next_task >= pool->ntasks) {
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		}
+		if (pool->quit) {
+			break;
+		}
+		bon_pool_work(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	
+	return NULL;
+}
+
+bon_pool* bon_new_pool(unsigned nthreads)
+{
+	bon_pool* pool = BON_CALLOC_TYPE(1, bon_pool);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	
+	pool->threads = BON_ALLOC_TYPE((nthreads + 1), pthread_t);
+	for (unsigned ti=0; ti<nthreads; ++ti) {
+		if (pthread_create(&pool->threads[pool->nthreads], NULL, bon_pool_worker, pool) == 0) {
+			pool->nthreads += 1;
+		}
+		// else: make do with fewer
+	}
+	
+	return pool;
+}
+
+void bon_pool_run(bon_pool* pool, unsigned ntasks, bon_task_fn fn, void* user)
+{
+	if (!pool || pool->nthreads == 0) {
+		for (unsigned task=0; task<ntasks; ++task) {
+			fn(user, task);
+		}
+		return;
+	}
+	
+	pthread_mutex_lock(&pool->mutex);
+	pool->fn         = fn;
+	pool->user       = user;
+	pool->ntasks     = ntasks;
+	pool->next_task  = 0;
+	pool->tasks_done = 0;
+	pthread_cond_broadcast(&pool->work_cond);
+	
+	bon_pool_work(pool); // Help out
+	
+	while (pool->tasks_done < pool->ntasks) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void bon_free_pool(bon_pool* pool)
+{
+	if (!pool) { return; }
+	
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = BON_TRUE;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	
+	for (unsigned ti=0; ti<pool->nthreads; ++ti) {
+		pthread_join(pool->threads[ti], NULL);
+	}
+	
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+unsigned bon_num_cores(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned)n : 1;
+}
+
+#else // !BON_HAS_PTHREADS: everything runs on the calling thread
+
+struct bon_pool {
+	unsigned  nthreads;
+};
+
+bon_pool* bon_new_pool(unsigned nthreads)
+{
+	(void)nthreads;
+	return BON_CALLOC_TYPE(1, bon_pool);
+}
+
+void bon_pool_run(bon_pool* pool, unsigned ntasks, bon_task_fn fn, void* user)
+{
+	(void)pool;
+	for (unsigned task=0; task<ntasks; ++task) {
+		fn(user, task);
+	}
+}
+
+void bon_free_pool(bon_pool* pool)
+{
+	free(pool);
+}
+
+unsigned bon_num_cores(void)
+{
+	return 1;
+}
+
+#endif // BON_HAS_PTHREADS
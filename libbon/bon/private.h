@@ -10,6 +10,7 @@
 #define BON_private_h
 
 #include <stdarg.h>
+#include "xxhash.h"
 
 /*
  This is NOT part of the public API.
@@ -31,6 +32,7 @@ typedef enum {
 	BON_VALUE_BLOCK_REF  = BON_CTRL_BLOCK_REF,
 	BON_VALUE_LIST       = BON_CTRL_LIST_BEGIN,
 	BON_VALUE_OBJ        = BON_CTRL_OBJ_BEGIN,
+	BON_VALUE_TABLE      = BON_CTRL_TABLE,
 	BON_VALUE_AGGREGATE  = 255, // Won't conflict with any of the aboe
 } bon_value_type;
 
@@ -87,6 +89,13 @@ typedef enum {
 
 
 
+#if defined(_MSC_VER)
+#  define BON_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#  define BON_THREAD_LOCAL __thread
+#endif
+
+
 //------------------------------------------------------------------------------
 // bon_type etc
 
@@ -130,18 +139,38 @@ struct bon_kt {
 //------------------------------------------------------------------------------
 
 
+typedef enum {
+	BON_W_TARGET_WRITER,  // 'buff' is flushed to 'writer'
+	BON_W_TARGET_MEMORY,  // 'buff' is the output, and grows as needed
+	BON_W_TARGET_FIXED,   // 'buff' is the output, provided by the user. Never grows.
+	BON_W_TARGET_MEASURE, // No output. 'buff_ix' counts the bytes.
+} bon_w_target;
+
 struct bon_w_doc {
+	bon_w_target    target;
 	bon_w_writer_t  writer;
-	void*           userData;  // Sent to writer
+	bon_w_patcher_t patcher;   // Optional
+	void*           userData;  // Sent to writer and patcher
 	
 	// Write buffer:
 	uint8_t*     buff;
 	bon_size     buff_size;  // size of 'buff
 	bon_size     buff_ix;    // usage of 'buff'
+	bon_size     flushed;    // Bytes sent to 'writer' so far
 	
 	uint32_t     crc_inv;    // Accumulator of crc value (if BON_W_FLAG_CRC is set)
+	xxh64_state  xxh;        // Same for BON_W_FLAG_XXH64
 	bon_w_flags  flags;
 	bon_error    error;      // If any
+	
+	// Open-ended block:
+	bon_bool     block_patch;     // Is there a reserved size field to fill in?
+	bon_size     block_size_pos;  // Position of the size field (counted like bon_w_size)
+	
+	// With BON_W_FLAG_BLOCK_CRC, the payload of the current block is hashed as it is flushed:
+	bon_bool     block_crc;       // Inside a block?
+	bon_size     block_crc_pos;   // Start of the payload (counted like bon_w_size)
+	uint32_t     block_crc_inv;   // Accumulator, like crc_inv
 };
 
 //------------------------------------------------------------------------------
@@ -164,8 +193,11 @@ typedef struct {
 
 
 typedef struct {
-	bon_type        type;
-	const uint8_t*  data;
+	bon_type        type;     // Shallow copy. The insides are shared, and owned by the bon_r_doc.
+	const uint8_t*  data;     // NULL for encoded arrays until bon_agg_payload decodes them.
+	const uint8_t*  encoded;  // if non-NULL, an encoded integer array (see bon_w_pack_ints). Owns 'type' and 'data'.
+	bon_size        encoded_size;
+	unsigned        codec;
 	bon_value*      exploded; // if non-NULL, this contains the packed data in explicit form. Lazily calculated iff user queires it.
 } bon_value_agg;
 
@@ -176,16 +208,19 @@ typedef struct {
 } bon_obj;
 
 
+typedef struct bon_value_table bon_value_table;
+
 typedef union {
-	bon_bool        boolean;
-	uint64_t        u64;
-	int64_t         s64;
-	double          dbl;
-	bon_value_str   str;
-	bon_list        list;
-	bon_obj         obj;
-	bon_value_agg*  agg; // Pointer to keep down size of bon_value
-	bon_block_id    blockRefId;
+	bon_bool         boolean;
+	uint64_t         u64;
+	int64_t          s64;
+	double           dbl;
+	bon_value_str    str;
+	bon_list         list;
+	bon_obj          obj;
+	bon_value_agg*   agg; // Pointer to keep down size of bon_value
+	bon_value_table* table;
+	bon_block_id     blockRefId;
 } bon_value_union;
 
 
@@ -196,6 +231,26 @@ struct bon_value {
 };
 
 
+// A column of a table, as read.
+typedef struct {
+	bon_column      col;
+	bon_value       value;  // The column as a packed array (or list of strings). Made by bon_r_table_col_value.
+	bon_type        elem;   // For 'value':
+	bon_type_array  array;
+	bon_value_agg   agg;
+} bon_table_col;
+
+// A list of objects stored column by column. See bon_w_table_begin.
+struct bon_value_table {
+	bon_size        num_rows;
+	bon_size        num_cols;
+	bon_table_col*  cols;
+	bon_value*      rows;     // The rows as objects, made on demand by bon_r_table_row. NULL until the first.
+	const uint8_t*  encoded;  // The whole table, for copying it with bon_w_value
+	bon_size        encoded_size;
+};
+
+
 /* Low level statistics about a bon-file. */
 typedef struct {
 	bon_size  bytes_file;          // Number of bytes in the entire file
@@ -216,6 +271,15 @@ typedef struct {
 	bon_size        payload_size;    // Byte size of payload. 0 means unknown.
 	bon_value       value;           // value, if 'parsed' is true.
 	bon_bool        parsed;          // if false, 'value' is not yet valid.
+	
+	// An LZ compressed block has 'payload' NULL until decompressed into 'decompressed' (owned).
+	const uint8_t*  compressed;
+	bon_size        compressed_size;
+	uint8_t*        decompressed;
+	
+	// Written with BON_W_FLAG_BLOCK_CRC. Covers the payload as stored (compressed, if it is).
+	bon_bool        has_crc;
+	uint32_t        crc;
 } bon_r_block;
 
 
@@ -226,12 +290,56 @@ typedef struct {
 } bon_r_blocks;
 
 
+// A parsed aggregate type, shared by all aggregates with the same encoded type.
+typedef struct bon_type_entry bon_type_entry;
+struct bon_type_entry {
+	const uint8_t*   bytes;   // The encoded type, inside the document. NULL if it failed to parse.
+	bon_size         nbytes;
+	uint64_t         hash;    // Of the encoded type
+	bon_type         type;
+	bon_type_entry*  next;    // Next in bucket
+};
+
+// An element of a packed aggregate, made on demand by bon_r_list_elem etc.
+typedef struct bon_proxy bon_proxy;
+struct bon_proxy {
+	const uint8_t*   data;    // Start of the element in the aggregate payload
+	const bon_type*  type;    // Of the element. Owned by the doc.
+	bon_value        value;   // What the user gets
+	bon_value_agg    agg;     // value.u.agg points here
+	bon_proxy*       next;    // Next in bucket
+};
+
+typedef struct bon_pool bon_pool;
+
+// A compiled conversion between two aggregate types. See bon_r_cached_plan.
+typedef struct bon_plan_entry bon_plan_entry;
+struct bon_plan_entry {
+	bon_type         src;     // Shallow copy. The insides are owned by the bon_r_doc.
+	bon_type         dst;     // Deep copy. The keys point into 'keys'.
+	char*            keys;
+	bon_plan*        plan;    // NULL if the types are not compatible
+	bon_plan_entry*  next;    // Next in bucket
+};
+
 struct bon_r_doc {
 	bon_r_blocks   blocks;
+	bon_type_entry** types;     // Parsed aggregate types, hashed on their encoding. Lazily allocated.
+	bon_size       num_type_buckets;
+	bon_size       num_types;
+	bon_type_entry* last_type;  // The type parsed or found last
+	bon_plan_entry** plans;     // Compiled conversions, bucketed by source type. Lazily allocated.
+	bon_proxy**    proxies;     // Array and struct elements handed out so far, hashed on data and type
+	bon_value      numbers[BON_R_NUMBER_SLOTS]; // Number elements handed out lately, reused round-robin
+	unsigned       next_number;
+	bon_size       num_proxy_buckets;
+	bon_size       num_proxies;
 	bon_stats      stats;       // Info about the read file
 	bon_r_flags    flags;
 	bon_error      error;       // If any
 	char*          errstr;      // If applicable
+	unsigned       num_threads; // For unpacking large aggregates. 0 and 1 means serial.
+	bon_pool*      pool;        // num_threads-1 workers. Lazily created.
 };
 
 
@@ -270,6 +378,11 @@ uint64_t br_read_uint64(bon_reader* br, bon_type_id t);
 /* Read a simple value denoted by 't', and interpret is as a double. */
 double br_read_double(bon_reader* br, bon_type_id t);
 
+/* Read any value, e.g. rows written to a bon_w_table_begin doc. */
+void bon_r_value(bon_reader* br, bon_value* val);
+
+void bon_free_value_insides(bon_value* val);
+
 
 //------------------------------------------------------------------------------
 // Things common to bon.c, write.c, read.c:
@@ -278,6 +391,12 @@ void bon_onError(const char* msg);
 
 bon_type* bon_new_type_fmt_ap(const char** fmt, va_list* ap);
 
+/*
+ Like bon_new_type_fmt_ap, but cached per thread (keyed on the format and its arguments).
+ If *out_cached is set, the type belongs to the cache, and must not be freed.
+ */
+bon_type* bon_fmt_type_ap(const char* fmt, va_list* ap, bon_bool* out_cached);
+
 bon_size  bon_aggregate_payload_size(const bon_type* type);
 bon_size  bon_struct_payload_size(const bon_type_struct* strct);
 
@@ -286,15 +405,160 @@ void      bon_free_type_insides(bon_type* t);
 // Byte size of atomic types
 uint64_t  bon_type_size(bon_type_id t);
 
+uint16_t swap_endian_uint16(uint16_t us);
+uint32_t swap_endian_uint32(uint32_t ui);
+uint64_t swap_endian_uint64(uint64_t ull);
+
+// 16-bit floats <-> float. Rounds to nearest even.
+float     bon_half_to_float(uint16_t h);
+uint16_t  bon_float_to_half(float f);
+float     bon_bf16_to_float(uint16_t b);
+uint16_t  bon_float_to_bf16(float f);
+
+/*
+ Casts 'n' native numbers of one type to another, e.g. float -> double.
+ Returns false on narrowing: a real that is NaN or out of range of an integer destination.
+ */
+typedef bon_bool (*bon_cast_fn)(const void* src, void* dst, bon_size n);
+
+/*
+ Returns NULL unless 'dst' is a native number type, and 'src' a number type of either endian.
+ Non-native endian sources are byte swapped in bulk.
+ */
+bon_cast_fn bon_cast_kernel(bon_type_id src, bon_type_id dst);
+
+// uint8 -> float in [0, 1]
+bon_cast_fn bon_unorm8_kernel(void);
+
+// Instruction sets the cast kernels may use. Detected at first use.
+typedef enum {
+	BON_SIMD_NONE,
+	BON_SIMD_SSE2,
+	BON_SIMD_AVX2,
+	BON_SIMD_AVX512   // AVX-512 F and BW
+} bon_simd_level;
+
+bon_simd_level bon_get_simd_level(void);
+
+// Limit the kernels to 'level' (e.g. for testing). Returns the new level (never above what the CPU supports).
+// Kernels already returned by bon_cast_kernel (e.g. in plans) are not affected.
+bon_simd_level bon_set_simd_level(bon_simd_level level);
+
 // Returns NULL on fail
 bon_value* bon_r_get_block(bon_r_doc* B, bon_block_id block_id);
 
+// The block itself, which may not yet be decompressed or parsed. NULL if there is none.
+bon_r_block* bon_r_find_block(bon_r_doc* B, uint64_t id);
+
+// Row 'ix' of a table, as an object. NULL if out of range.
+bon_value* bon_r_table_row(bon_r_doc* B, bon_value_table* table, bon_size ix);
+
 static bon_value* bon_r_follow_refs(bon_r_doc* B, bon_value* val);
 
 // Endianness conversion (used for crc32)
 uint32_t le_to_uint32(uint32_t v);
 uint32_t uint32_to_le(uint32_t v);
 
+//------------------------------------------------------------------------------
+// Compiled unpacking of aggregates (see bon_r_new_plan)
+
+typedef enum {
+	BON_OP_COPY,     // memcpy 'count' bytes
+	BON_OP_CAST,     // 'count' native numbers, using 'cast'
+	BON_OP_CONVERT,  // 'count' numbers of type 'src_id' to 'dst_id', with endian and narrowing checks
+	BON_OP_LOOP,     // Run the 'body' ops following this one 'count' times
+} bon_op_code;
+
+typedef struct {
+	bon_op_code  code;
+	bon_size     src_offset;   // Relative to the source of the enclosing loop (or payload)
+	bon_size     dst_offset;
+	bon_size     count;
+	bon_size     src_stride;   // CONVERT, LOOP: bytes per element
+	bon_size     dst_stride;
+	bon_size     body;         // LOOP: number of ops in the loop body
+	bon_type_id  src_id;       // CONVERT
+	bon_type_id  dst_id;       // CONVERT
+	bon_cast_fn  cast;         // CAST
+} bon_op;
+
+struct bon_plan {
+	const bon_type*  src;       // The type it was compiled for. Points into the bon_r_doc.
+	bon_size         src_size;  // Payload sizes
+	bon_size         dst_size;
+	bon_size         nops;
+	bon_op*          ops;
+};
+
+// Returns NULL if the types are not compatible.
+bon_plan* bon_new_plan(const bon_type* srcType, const bon_type* dstType);
+
+
+//------------------------------------------------------------------------------
+// Encoded integer arrays (ints.c)
+
+// Largest encoded block: first value (with BON_INTS_DELTA), width, base and 64 bits per value
+#define BON_INTS_MAX_BLOCK_BYTES  (2 * BON_VARINT_MAX_LEN + 1 + 8 * BON_INTS_BLOCK)
+
+// The native integer type with the same signedness and width as 't', or 0 if 't' is not an integer type.
+bon_type_id  bon_ints_native_type  (bon_type_id t);
+
+// 'data' is 'n' integers of the native type 't'.
+bon_size     bon_ints_encoded_size (const void* data, bon_size n, bon_type_id t, unsigned codec);
+
+// Encodes block number 'block' into 'out' (of BON_INTS_MAX_BLOCK_BYTES). Returns the size.
+bon_size     bon_ints_encode_block (uint8_t* out, const void* data, bon_size n, bon_size block,
+                                    bon_type_id t, unsigned codec);
+
+// Does 'enc' hold exactly the blocks of 'n' values?
+bon_bool     bon_ints_check        (const uint8_t* enc, bon_size nbytes, unsigned codec, bon_size n);
+
+// Decodes into 'n' integers of native type 't'. 'enc' should have passed bon_ints_check,
+// but broken data stops the decoding (returning false) rather than reading past 'nbytes'.
+bon_bool     bon_ints_decode       (const uint8_t* enc, bon_size nbytes, unsigned codec,
+                                    bon_type_id t, void* dst, bon_size n);
+
+// The payload of 'agg', decoding it on first use if it is encoded. NULL if out of memory (or broken).
+const uint8_t* bon_agg_payload(const bon_value_agg* agg);
+
+
+//------------------------------------------------------------------------------
+// LZ compression of blocks (lz.c), in the LZ4 block format.
+
+// Blocks smaller than this are not worth compressing
+#define BON_LZ_MIN_BYTES  64
+
+// Worst case compressed size of 'n' bytes
+#define BON_LZ_BOUND(n)  ((n) + (n) / 255 + 16)
+
+// Largest size 'n' compressed bytes can decompress to (each byte of a match length adds at most 255)
+#define BON_LZ_MAX_RAW_SIZE(n)  ((n) * 255 + 16)
+
+// Returns the compressed size, or 0 if it did not fit in 'cap' bytes.
+bon_size  bon_lz_compress   (const uint8_t* src, bon_size n, uint8_t* dst, bon_size cap);
+
+// False unless 'src' decompresses to exactly 'raw_size' bytes. Never reads or writes out of bounds.
+bon_bool  bon_lz_decompress (const uint8_t* src, bon_size n, uint8_t* dst, bon_size raw_size);
+
+
+//------------------------------------------------------------------------------
+// Worker pool (pool.c)
+
+// Unpacking at least this many bytes is split over the threads set with bon_r_set_num_threads.
+#define BON_PARALLEL_MIN_BYTES  (1 << 20)
+
+typedef void (*bon_task_fn)(void* user, unsigned task);
+
+// 'nthreads' workers besides the calling thread. Without pthreads, all work is done by the caller.
+bon_pool*  bon_new_pool  (unsigned nthreads);
+
+// Runs fn(user, 0) ... fn(user, ntasks-1) on the pool and the calling thread, and waits for all.
+void       bon_pool_run  (bon_pool* pool, unsigned ntasks, bon_task_fn fn, void* user);
+
+void       bon_free_pool (bon_pool* pool);
+
+unsigned   bon_num_cores (void);
+
 //------------------------------------------------------------------------------
 
 // TODO: handle failed allocs
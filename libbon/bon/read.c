@@ -201,6 +201,10 @@ bon_bool bon_is_float_double(uint8_t ctrl)
 		case BON_CTRL_FLOAT_BE:
 		case BON_CTRL_DOUBLE_LE:
 		case BON_CTRL_DOUBLE_BE:
+		case BON_CTRL_HALF_LE:
+		case BON_CTRL_HALF_BE:
+		case BON_CTRL_BF16_LE:
+		case BON_CTRL_BF16_BE:
 			return BON_TRUE;
 			
 		default:
@@ -229,6 +233,10 @@ bon_bool bon_is_simple_type(uint8_t ctrl)
 		case BON_CTRL_FLOAT_BE:
 		case BON_CTRL_DOUBLE_LE:
 		case BON_CTRL_DOUBLE_BE:
+		case BON_CTRL_HALF_LE:
+		case BON_CTRL_HALF_BE:
+		case BON_CTRL_BF16_LE:
+		case BON_CTRL_BF16_BE:
 			return BON_TRUE;
 			
 		default:
@@ -455,6 +463,12 @@ double br_read_double(bon_reader* br, bon_type_id t) {
 			return br_read_double_native(br);
 #endif
 			
+			
+		case BON_CTRL_HALF_LE:  return bon_half_to_float( le_to_uint16(br_read_u16(br)) );
+		case BON_CTRL_HALF_BE:  return bon_half_to_float( be_to_uint16(br_read_u16(br)) );
+		case BON_CTRL_BF16_LE:  return bon_bf16_to_float( le_to_uint16(br_read_u16(br)) );
+		case BON_CTRL_BF16_BE:  return bon_bf16_to_float( be_to_uint16(br_read_u16(br)) );
+			
 		default:
 			br_set_err(br, BON_ERR_BAD_TYPE);
 			return 0;
@@ -620,14 +634,156 @@ void parse_aggr_type(bon_reader* br, bon_type* type)
 	}
 }
 
+// Advances 'br' past the keys and types of a struct type, without building it.
+static void skip_struct_type(bon_reader* br, bon_size structSize);
+
+// Advances 'br' past an encoded aggregate type, like parse_aggr_type but without building it.
+static void skip_aggr_type(bon_reader* br)
+{
+	if (br->error)
+		return;
+	
+	uint8_t ctrl = br_next(br);
+	
+	if (BON_SHORT_AGGREGATES_START <= ctrl   &&  ctrl < BON_SHORT_NEG_INT_START)
+	{
+		if (ctrl  >=  BON_SHORT_STRUCT_START) {
+			skip_struct_type(br, ctrl - BON_SHORT_STRUCT_START);
+		} else if (ctrl  <  BON_SHORT_BYTE_ARRAY_START) {
+			skip_aggr_type(br); // Element type
+		} // else: byte array, nothing more to read
+	}
+	else if (ctrl == BON_CTRL_ARRAY_VLQ) {
+		br_read_vlq(br);
+		skip_aggr_type(br);
+	} else if (ctrl == BON_CTRL_STRUCT_VLQ) {
+		skip_struct_type(br, br_read_vlq(br));
+	} else if (!bon_is_simple_type(ctrl)) {
+		br_set_err(br, BON_ERR_BAD_PACKED_TYPE);
+	}
+}
+
+static void skip_struct_type(bon_reader* br, bon_size structSize)
+{
+	for (bon_size ti=0; ti<structSize && !br->error; ++ti) {
+		// Keys are strings or block refs, which don't allocate:
+		bon_value key;
+		key.type = BON_VALUE_NIL;
+		bon_r_value(br, &key);
+		bon_free_value_insides(&key);
+		skip_aggr_type(br);
+	}
+}
+
+#define BON_TYPE_MIN_BUCKETS 64
+
+static void bon_grow_types(bon_r_doc* B)
+{
+	bon_type_entry** old_buckets = B->types;
+	bon_size         old_count   = B->num_type_buckets;
+	
+	B->num_type_buckets = (old_count ? 2 * old_count : BON_TYPE_MIN_BUCKETS);
+	B->types = BON_CALLOC_TYPE(B->num_type_buckets, bon_type_entry*);
+	
+	for (bon_size bi=0; bi<old_count; ++bi) {
+		bon_type_entry* e = old_buckets[bi];
+		while (e) {
+			bon_type_entry* next = e->next;
+			bon_size ix = (bon_size)(e->hash & (B->num_type_buckets - 1));
+			e->next = B->types[ix];
+			B->types[ix] = e;
+			e = next;
+		}
+	}
+	
+	free(old_buckets);
+}
+
+/*
+ Many aggregates in a document usually have the exact same type (e.g. one per vertex).
+ We parse each distinct encoded type once, and share the result.
+ The type encoding is prefix-free, so if the bytes of an earlier type come next,
+ that is the type. That is checked first for the last type seen (runs of the same type are common).
+ Otherwise the encoded type is measured by a pass that doesn't allocate,
+ and looked up in a hash table of its bytes.
+ */
+void parse_shared_aggr_type(bon_reader* br, bon_type* type)
+{
+	bon_r_doc* B = br->B;
+	assert(B);
+	
+	const uint8_t* start = br->data;
+	
+	bon_type_entry* last = B->last_type;
+	if (last && last->nbytes <= br->nbytes && memcmp(last->bytes, start, last->nbytes) == 0) {
+		br_skip(br, last->nbytes);
+		*type = last->type;
+		return;
+	}
+	
+	bon_stats  stats   = B->stats; // Keys are read twice on a miss, but should be counted once
+	bon_reader measure = *br;
+	skip_aggr_type(&measure);
+	B->stats = stats;
+	bon_size nbytes = (bon_size)(measure.data - start);
+	uint64_t hash   = xxh64_calc(start, nbytes, 0);
+	
+	if (!measure.error && B->types) {
+		for (bon_type_entry* e = B->types[hash & (B->num_type_buckets - 1)]; e; e = e->next) {
+			if (e->hash == hash && e->bytes && e->nbytes == nbytes && memcmp(e->bytes, start, nbytes) == 0) {
+				br_skip(br, nbytes);
+				*type = e->type;
+				B->last_type = e;
+				return;
+			}
+		}
+	}
+	
+	if (B->num_types >= 2 * B->num_type_buckets) {
+		bon_grow_types(B);
+	}
+	
+	bon_type_entry* e = BON_ALLOC_TYPE(1, bon_type_entry);
+	parse_aggr_type(br, &e->type);
+	e->bytes  = (br->error ? NULL : start);
+	e->nbytes = (bon_size)(br->data - start);
+	e->hash   = hash;
+	
+	bon_size ix = (bon_size)(hash & (B->num_type_buckets - 1));
+	e->next = B->types[ix];
+	B->types[ix] = e;
+	B->num_types += 1;
+	
+	if (e->bytes) {
+		B->last_type = e;
+	}
+	*type = e->type;
+}
+
+void bon_free_types(bon_r_doc* B)
+{
+	for (bon_size bi=0; bi<B->num_type_buckets; ++bi) {
+		bon_type_entry* e = B->types[bi];
+		while (e) {
+			bon_type_entry* next = e->next;
+			bon_free_type_insides(&e->type);
+			free(e);
+			e = next;
+		}
+	}
+	
+	free(B->types);
+}
+
 void bon_r_unpack_value(bon_reader* br, bon_value* val)
 {
 	val->type = BON_VALUE_AGGREGATE;
 	bon_value_agg* agg = BON_ALLOC_TYPE(1, bon_value_agg);
 	val->u.agg = agg;
 	bon_type* type = &agg->type;
-	parse_aggr_type(br, type);
+	parse_shared_aggr_type(br, type);
 	agg->data     = br->data;
+	agg->encoded  = NULL;
 	agg->exploded = NULL;
 	bon_size nBytesPayload = bon_aggregate_payload_size(type);
 	br_skip(br, nBytesPayload);
@@ -639,6 +795,171 @@ void bon_r_unpack_value(bon_reader* br, bon_value* val)
 	}
 }
 
+// An encoded integer array (see bon_w_pack_ints), after BON_CTRL_INTS.
+void bon_r_ints_value(bon_reader* br, bon_value* val)
+{
+	bon_type_id     elem   = bon_ints_native_type(br_next(br));
+	bon_size        n      = br_read_vlq(br);
+	unsigned        codec  = br_next(br);
+	bon_size        nbytes = br_read_vlq(br);
+	const uint8_t*  enc    = br->data;
+	br_skip(br, nbytes);
+	
+	val->type = BON_VALUE_NIL;
+	if (br->error) {
+		return;
+	}
+	if (elem == 0 || (codec & ~(BON_INTS_DELTA | BON_INTS_ZIGZAG)) != 0 || !bon_ints_check(enc, nbytes, codec, n)) {
+		br_set_err(br, BON_ERR_BAD_VALUE);
+		return;
+	}
+	
+	bon_type_array* array = BON_ALLOC_TYPE(1, bon_type_array);
+	array->size     = n;
+	array->type     = BON_ALLOC_TYPE(1, bon_type);
+	array->type->id = elem;
+	
+	bon_value_agg* agg = BON_ALLOC_TYPE(1, bon_value_agg);
+	agg->type.id      = BON_TYPE_ARRAY;
+	agg->type.u.array = array;
+	agg->data         = NULL; // Decoded on demand
+	agg->encoded      = enc;
+	agg->encoded_size = nbytes;
+	agg->codec        = codec;
+	agg->exploded     = NULL;
+	
+	val->type  = BON_VALUE_AGGREGATE;
+	val->u.agg = agg;
+	
+	if (br->B) {
+		br->B->stats.count_aggr      +=  1;
+		br->B->stats.bytes_aggr_dry  +=  nbytes;
+	}
+}
+
+BON_INLINE uint32_t bon_column_offset(const bon_column* col, bon_size ix)
+{
+	uint32_t le;
+	memcpy(&le, col->offsets + 4 * ix, 4);
+	return le_to_uint32(le);
+}
+
+// The offsets of a string column must go up, and each string must end with a zero.
+static bon_bool bon_column_check_strings(const bon_column* col, bon_size nbytes, bon_bool check_utf8)
+{
+	const char* strings = (const char*)col->data;
+	uint32_t begin = bon_column_offset(col, 0);
+	if (begin != 0) {
+		return BON_FALSE;
+	}
+	for (bon_size row=0; row<col->size; ++row) {
+		uint32_t end = bon_column_offset(col, row + 1);
+		if (end <= begin || end > nbytes || strings[end - 1] != 0) {
+			return BON_FALSE;
+		}
+		if (check_utf8 && !utf8_check_string(strings + begin, end - 1 - begin)) {
+			return BON_FALSE;
+		}
+		begin = end;
+	}
+	return BON_TRUE;
+}
+
+// A table (see bon_w_table_begin), after BON_CTRL_TABLE.
+void bon_r_table_value(bon_reader* br, bon_value* val)
+{
+	const uint8_t*  start    = br->data - 1;
+	bon_size        num_rows = br_read_vlq(br);
+	bon_size        num_cols = br_read_vlq(br);
+	
+	val->type = BON_VALUE_NIL;
+	if (br->error) {
+		return;
+	}
+	if (num_cols == 0 || num_cols > br->nbytes) {
+		br_set_err(br, BON_ERR_BAD_VALUE);
+		return;
+	}
+	
+	bon_value_table* table = BON_CALLOC_TYPE(1, bon_value_table);
+	table->num_rows = num_rows;
+	table->num_cols = num_cols;
+	table->cols     = BON_CALLOC_TYPE(num_cols, bon_table_col);
+	
+	// The schema:
+	for (bon_size ci=0; ci<num_cols && !br->error; ++ci) {
+		bon_column* col = &table->cols[ci].col;
+		col->key  = bon_r_key(br);
+		col->size = num_rows;
+		
+		uint8_t t = br_next(br);
+		if (t == BON_CTRL_TRUE) {
+			col->type = BON_TYPE_BOOL;
+		} else if (t == BON_CTRL_STRING_VLQ || bon_is_simple_type(t)) {
+			col->type = (bon_type_id)t;
+		} else {
+			br_set_err(br, BON_ERR_BAD_VALUE);
+		}
+	}
+	
+	// The columns:
+	for (bon_size ci=0; ci<num_cols && !br->error; ++ci) {
+		bon_column* col = &table->cols[ci].col;
+		
+		if (col->type == BON_TYPE_STRING) {
+			if (num_rows >= br->nbytes / 4) {
+				br_set_err(br, BON_ERR_TOO_SHORT);
+				break;
+			}
+			col->offsets = br->data;
+			br_skip(br, 4 * (num_rows + 1));
+			col->data = br->data;
+			
+			bon_bool check_utf8 = (br->flags & BON_R_FLAG_SKIP_STRING_CHECKS) == 0;
+			if (!bon_column_check_strings(col, br->nbytes, check_utf8)) {
+				br_set_err(br, BON_ERR_BAD_VALUE);
+				break;
+			}
+			br_skip(br, bon_column_offset(col, num_rows));
+		} else {
+			bon_size size = (col->type == BON_TYPE_BOOL ? 1 : bon_type_size(col->type));
+			if (num_rows > br->nbytes / size) {
+				br_set_err(br, BON_ERR_TOO_SHORT);
+				break;
+			}
+			col->data = br->data;
+			br_skip(br, num_rows * size);
+		}
+	}
+	
+	if (br->error) {
+		free(table->cols);
+		free(table);
+		return;
+	}
+	
+	table->encoded      = start;
+	table->encoded_size = (bon_size)(br->data - start);
+	
+	val->type    = BON_VALUE_TABLE;
+	val->u.table = table;
+}
+
+const uint8_t* bon_agg_payload(const bon_value_agg* agg)
+{
+	if (!agg->data && agg->encoded) {
+		const bon_type_array* array = agg->type.u.array;
+		uint8_t* decoded = (uint8_t*)malloc(array->size * bon_type_size(array->type->id) + 1);
+		if (decoded && !bon_ints_decode(agg->encoded, agg->encoded_size, agg->codec,
+												  array->type->id, decoded, array->size)) {
+			free(decoded);
+			decoded = NULL;
+		}
+		((bon_value_agg*)agg)->data = decoded; // Lazily computed, like 'exploded'
+	}
+	return agg->data;
+}
+
 void bon_r_string_sized(bon_reader* br, bon_value* val, size_t strLen)
 {
 	val->type = BON_VALUE_STRING;
@@ -737,6 +1058,10 @@ void bon_r_value_from_ctrl(bon_reader* br, bon_value* val, uint8_t ctrl)
 		case BON_CTRL_FLOAT_BE:
 		case BON_CTRL_DOUBLE_LE:
 		case BON_CTRL_DOUBLE_BE:
+		case BON_CTRL_HALF_LE:
+		case BON_CTRL_HALF_BE:
+		case BON_CTRL_BF16_LE:
+		case BON_CTRL_BF16_BE:
 			val->type  = BON_VALUE_DOUBLE;
 			val->u.dbl = br_read_double(br, ctrl);
 			break;
@@ -789,6 +1114,16 @@ void bon_r_value_from_ctrl(bon_reader* br, bon_value* val, uint8_t ctrl)
 		} break;
 			
 			
+		case BON_CTRL_INTS:
+			bon_r_ints_value(br, val);
+			break;
+			
+			
+		case BON_CTRL_TABLE:
+			bon_r_table_value(br, val);
+			break;
+			
+			
 		default: {
 			br_set_err(br, BON_ERR_BAD_CTRL);
 		}
@@ -934,6 +1269,12 @@ void bon_r_footer(bon_reader* br)
 		br_skip(br, 4); // ignore crc
 		br_swallow(br, BON_CTRL_FOOTER_CRC);
 	}
+	else if (br_peek(br) == BON_CTRL_FOOTER_XXH64)
+	{
+		br_skip(br, 1);
+		br_skip(br, 8); // ignore hash
+		br_swallow(br, BON_CTRL_FOOTER_XXH64);
+	}
 	else
 	{
 		br_set_err(br, BON_ERR_BAD_FOOTER);
@@ -942,23 +1283,47 @@ void bon_r_footer(bon_reader* br)
 	br_assert(br, br->nbytes==0, BON_ERR_TRAILING_DATA);
 }
 
+// BON_SUCCESS if the crc of the block is right, or if it has none and none is required.
+static bon_error bon_r_check_block(bon_r_doc* B, const bon_r_block* block)
+{
+	if (!block->has_crc) {
+		return (B->flags & BON_R_FLAG_REQUIRE_BLOCK_CRC) ? BON_ERR_MISSING_CRC : BON_SUCCESS;
+	}
+	
+	const uint8_t* data = (block->compressed ? block->compressed      : block->payload);
+	bon_size       size = (block->compressed ? block->compressed_size : block->payload_size);
+	return crc_calc(data, size) == block->crc ? BON_SUCCESS : BON_ERR_WRONG_CRC;
+}
+
 void bon_r_read_content(bon_reader* br)
 {
 	bon_r_blocks* blocks = &br->B->blocks;
 	
-	if (br_peek(br) == BON_CTRL_BLOCK_BEGIN)
+	if (br_peek(br) == BON_CTRL_BLOCK_BEGIN || br_peek(br) == BON_CTRL_BLOCK_LZ)
 	{
 		// Blocked document
 		
-		while (!br->error && br_peek(br)==BON_CTRL_BLOCK_BEGIN) {
+		while (!br->error && (br_peek(br)==BON_CTRL_BLOCK_BEGIN || br_peek(br)==BON_CTRL_BLOCK_LZ)) {
 			BON_VECTOR_EXPAND(*blocks, bon_r_block, 1);
 			bon_r_block* block = &blocks->data[blocks->size-1];
 			
-			br_swallow(br, BON_CTRL_BLOCK_BEGIN);
-			block->id            = br_read_vlq(br);
-			block->payload_size  = br_read_vlq(br);
-			
-			if (block->payload_size >= br->nbytes) {
+			bon_bool lz = (br_next(br) == BON_CTRL_BLOCK_LZ);
+			block->id              = br_read_vlq(br);
+			block->payload_size    = br_read_vlq(br);
+			block->compressed      = NULL;
+			block->compressed_size = 0;
+			block->decompressed    = NULL;
+			block->has_crc         = BON_FALSE;
+			
+			if (lz) {
+				// The size read was the compressed one. Decompressed lazily, in bon_r_load_block.
+				block->compressed_size = block->payload_size;
+				block->payload_size    = br_read_vlq(br);
+				if (block->compressed_size >= br->nbytes || block->payload_size == 0 ||
+					 block->payload_size > BON_LZ_MAX_RAW_SIZE(block->compressed_size)) {
+					br_set_err(br, BON_ERR_BAD_BLOCK);
+				}
+			} else if (block->payload_size >= br->nbytes) {
 				br_set_err(br, BON_ERR_BAD_BLOCK);
 			}
 			
@@ -970,7 +1335,12 @@ void bon_r_read_content(bon_reader* br)
 			
 			block->payload         = br->data;
 			
-			if (block->payload_size == 0) {
+			if (lz) {
+				block->compressed = br->data;
+				block->payload    = NULL;
+				block->parsed     = BON_FALSE;
+				br_skip(br, block->compressed_size);
+			} else if (block->payload_size == 0) {
 				// Unspecified size - forced parse:
 				
 				bon_reader block_br = make_br(
@@ -993,7 +1363,25 @@ void bon_r_read_content(bon_reader* br)
 				block->parsed = BON_FALSE;
 			}
 			
-			br_swallow(br, BON_CTRL_BLOCK_END);
+			if (br_peek(br) == BON_CTRL_BLOCK_END_CRC) {
+				br_skip(br, 1);
+				uint32_t crc_le = 0;
+				read(br, (uint8_t*)&crc_le, 4);
+				br_swallow(br, BON_CTRL_BLOCK_END_CRC);
+				block->has_crc = BON_TRUE;
+				block->crc     = le_to_uint32(crc_le);
+				
+			} else {
+				br_swallow(br, BON_CTRL_BLOCK_END);
+			}
+			
+			if (block->parsed && !br->error) {
+				// Had to be parsed already, so check it now
+				bon_error err = bon_r_check_block(br->B, block);
+				if (err) {
+					br_set_err(br, err);
+				}
+			}
 		}
 	}
 	else
@@ -1007,6 +1395,9 @@ void bon_r_read_content(bon_reader* br)
 		root->payload         = br->data;
 		root->payload_size    = 0;
 		root->parsed          = BON_TRUE;
+		root->compressed      = NULL;
+		root->decompressed    = NULL;
+		root->has_crc         = BON_FALSE;
 		bon_r_value(br, &root->value);
 	}
 }
@@ -1040,14 +1431,84 @@ void bon_r_set_error(bon_r_doc* B, bon_error err)
 	}
 }
 
+// Big files are checksummed in one piece per thread, and the pieces combined.
+typedef struct {
+	const uint8_t*  data;
+	bon_size        nbytes;
+	unsigned        nparts;
+	uint32_t*       crcs;
+} bon_crc_job;
+
+BON_INLINE bon_size bon_crc_part_begin(const bon_crc_job* job, unsigned part)
+{
+	return job->nbytes / job->nparts * part;
+}
+
+static void bon_crc_task(void* user, unsigned part)
+{
+	bon_crc_job* job   = (bon_crc_job*)user;
+	bon_size     begin = bon_crc_part_begin(job, part);
+	bon_size     end   = (part + 1 == job->nparts ? job->nbytes : bon_crc_part_begin(job, part + 1));
+	job->crcs[part] = crc_calc(job->data + begin, end - begin);
+}
+
+static uint32_t bon_r_crc(bon_r_doc* B, const uint8_t* data, bon_size nbytes)
+{
+	if (B->num_threads <= 1 || nbytes < BON_PARALLEL_MIN_BYTES) {
+		return crc_calc(data, nbytes);
+	}
+	
+	if (!B->pool) {
+		B->pool = bon_new_pool(B->num_threads - 1);
+	}
+	
+	bon_crc_job job;
+	job.data    = data;
+	job.nbytes  = nbytes;
+	job.nparts  = B->num_threads;
+	job.crcs    = BON_ALLOC_TYPE(job.nparts, uint32_t);
+	crc_init(); // Before the workers race to do it
+	bon_pool_run(B->pool, job.nparts, bon_crc_task, &job);
+	
+	uint32_t crc = job.crcs[0];
+	for (unsigned part=1; part<job.nparts; ++part) {
+		bon_size size = (part + 1 == job.nparts ? nbytes : bon_crc_part_begin(&job, part + 1)) - bon_crc_part_begin(&job, part);
+		crc = crc_combine(crc, job.crcs[part], size);
+	}
+	
+	free(job.crcs);
+	return crc;
+}
+
 bon_r_doc* bon_r_open(const uint8_t* data, bon_size nbytes, bon_r_flags flags)
+{
+	return bon_r_open_threaded(data, nbytes, flags, 1);
+}
+
+bon_r_doc* bon_r_open_threaded(const uint8_t* data, bon_size nbytes, bon_r_flags flags, unsigned num_threads)
 {
 	assert(data);
 	
 	bon_r_doc* B = BON_CALLOC_TYPE(1, bon_r_doc);
 	B->flags = flags;
+	bon_r_set_num_threads(B, num_threads);
 	
-	if (B->flags & BON_R_FLAG_REQUIRE_CRC)
+	if ((B->flags & BON_R_FLAG_REQUIRE_CRC) && nbytes >= 10 &&
+		 data[nbytes-1]  == BON_CTRL_FOOTER_XXH64 &&
+		 data[nbytes-10] == BON_CTRL_FOOTER_XXH64)
+	{
+		// Same as below, but with a 64-bit hash.
+		uint64_t hash_read = 0;
+		for (int i=0; i<8; ++i) {
+			hash_read |= (uint64_t)data[nbytes - 9 + i] << (8 * i);
+		}
+		
+		if (xxh64_calc(data, nbytes-10, 0) != hash_read) {
+			bon_r_set_error(B, BON_ERR_WRONG_CRC);
+			return B;
+		}
+	}
+	else if (B->flags & BON_R_FLAG_REQUIRE_CRC)
 	{
 		/*
 		 The last six bytes of the file should be:
@@ -1067,7 +1528,7 @@ bon_r_doc* bon_r_open(const uint8_t* data, bon_size nbytes, bon_r_flags flags)
 		}
 		else
 		{
-			uint32_t crc_calced  =  crc_calc(data, nbytes-6);
+			uint32_t crc_calced  =  bon_r_crc(B, data, nbytes-6);
 			uint32_t crc_read_le;
 			memcpy(&crc_read_le, data + nbytes - 5, 4);
 			uint32_t crc_read = le_to_uint32(crc_read_le);
@@ -1128,19 +1589,47 @@ void bon_free_value_insides(bon_value* val)
 			
 		case BON_VALUE_AGGREGATE: {
 			bon_value_agg* agg = val->u.agg;
-			bon_free_type_insides( &agg->type );
+			// agg->type is owned by the doc, unless the aggregate is encoded
 			if ( agg->exploded ) {
 				bon_free_value_insides( agg->exploded );
 				free( agg->exploded );
 			}
+			if ( agg->encoded ) {
+				bon_free_type_insides( &agg->type );
+				free( (uint8_t*)agg->data );
+			}
 			free(agg);
 		} break;
 			
+		case BON_VALUE_TABLE: {
+			bon_value_table* table = val->u.table;
+			if ( table->rows ) {
+				for (bon_size ix=0; ix<table->num_rows; ++ix) {
+					bon_free_value_insides( table->rows + ix );
+				}
+				free( table->rows );
+			}
+			for (bon_size ci=0; ci<table->num_cols; ++ci) {
+				bon_table_col* col = &table->cols[ci];
+				if ( col->value.type == BON_VALUE_LIST ) {
+					free( col->value.u.list.data );
+				} else if ( col->agg.exploded ) {
+					bon_free_value_insides( col->agg.exploded );
+					free( col->agg.exploded );
+				}
+			}
+			free( table->cols );
+			free( table );
+		} break;
+			
 		default:
 			break;
 	}
 }
 
+static void bon_free_proxies(bon_r_doc* B);
+static void bon_free_plans(bon_r_doc* B);
+
 void bon_r_close(bon_r_doc* B)
 {
 	for (bon_size bi=0; bi<B->blocks.size; ++bi) {
@@ -1148,8 +1637,13 @@ void bon_r_close(bon_r_doc* B)
 		if (block->parsed) {
 			bon_free_value_insides( &block->value );
 		}
+		free( block->decompressed );
 	}
 	free( B->blocks.data );
+	bon_free_types( B );
+	bon_free_plans( B );
+	bon_free_proxies( B );
+	bon_free_pool( B->pool );
 	free( B->errstr );
 		
 	free(B);
@@ -1167,6 +1661,84 @@ bon_r_block* bon_r_find_block(bon_r_doc* B, uint64_t id)
 	return NULL;
 }
 
+// Decompresses an LZ block into its payload (after checking its crc), if not already done.
+static bon_error bon_r_decompress_block(bon_r_doc* B, bon_r_block* block)
+{
+	if (block->payload) {
+		return BON_SUCCESS;
+	}
+	
+	bon_error err = bon_r_check_block(B, block);
+	if (err) {
+		return err;
+	}
+	
+	uint8_t* raw = BON_ALLOC_TYPE(block->payload_size, uint8_t);
+	if (!raw || !bon_lz_decompress(block->compressed, block->compressed_size, raw, block->payload_size)) {
+		free(raw);
+		return BON_ERR_BAD_BLOCK;
+	}
+	
+	block->decompressed = raw;
+	block->payload      = raw;
+	return BON_SUCCESS;
+}
+
+typedef struct {
+	bon_r_doc*     B;
+	bon_r_block**  blocks;
+	bon_error*     errors;
+} bon_lz_job;
+
+static void bon_lz_task(void* user, unsigned task)
+{
+	bon_lz_job* job = (bon_lz_job*)user;
+	job->errors[task] = bon_r_decompress_block(job->B, job->blocks[task]);
+}
+
+bon_bool bon_r_decompress_blocks(bon_r_doc* B)
+{
+	bon_size n = 0;
+	for (bon_size bi=0; bi<B->blocks.size; ++bi) {
+		if (!B->blocks.data[bi].payload) { ++n; }
+	}
+	if (n == 0) {
+		return BON_TRUE;
+	}
+	
+	bon_lz_job job;
+	job.B      = B;
+	job.blocks = BON_ALLOC_TYPE(n, bon_r_block*);
+	job.errors = BON_ALLOC_TYPE(n, bon_error);
+	
+	n = 0;
+	for (bon_size bi=0; bi<B->blocks.size; ++bi) {
+		if (!B->blocks.data[bi].payload) {
+			job.blocks[n++] = &B->blocks.data[bi];
+		}
+	}
+	
+	if (B->num_threads > 1 && n > 1 && !B->pool) {
+		B->pool = bon_new_pool(B->num_threads - 1);
+	}
+	crc_init(); // The block checksums are checked by the workers
+	bon_pool_run(B->num_threads > 1 ? B->pool : NULL, (unsigned)n, bon_lz_task, &job);
+	
+	bon_bool ok = BON_TRUE;
+	for (bon_size i=0; i<n; ++i) {
+		if (job.errors[i]) {
+			ok = BON_FALSE;
+			if (!B->error) {
+				B->error = job.errors[i];
+			}
+		}
+	}
+	
+	free(job.blocks);
+	free(job.errors);
+	return ok;
+}
+
 // Returns NULL on fail
 bon_value* bon_r_load_block(bon_r_doc* B, uint64_t id)
 {
@@ -1175,6 +1747,14 @@ bon_value* bon_r_load_block(bon_r_doc* B, uint64_t id)
 	if (!block) { return NULL; }
 	
 	if (!block->parsed) {
+		bon_error err = (block->compressed ? bon_r_decompress_block(B, block) : bon_r_check_block(B, block));
+		if (err) {
+			if (!B->error) {
+				B->error = err;
+			}
+			return NULL;
+		}
+		
 		// Lazy parsing:
 		bon_reader br = make_br(B, block->payload, block->payload_size, id );
 		
@@ -1212,6 +1792,19 @@ bon_error bon_r_error(bon_r_doc* B)
 	return B->error;
 }
 
+void bon_r_set_num_threads(bon_r_doc* B, unsigned num_threads)
+{
+	if (num_threads == 0) {
+		num_threads = bon_num_cores();
+	}
+	
+	if (num_threads != B->num_threads) {
+		bon_free_pool(B->pool);
+		B->pool        = NULL;
+		B->num_threads = num_threads;
+	}
+}
+
 const char* bon_r_err_str(bon_r_doc* B)
 {
 	if (B->error) {
@@ -1294,7 +1887,9 @@ bon_bool bon_explode_aggr(bon_r_doc* B, bon_value* dst,
 			
 			
 		case BON_TYPE_FLOAT_LE:  case BON_TYPE_FLOAT_BE:
-		case BON_TYPE_DOUBLE_LE:  case BON_TYPE_DOUBLE_BE: {
+		case BON_TYPE_DOUBLE_LE:  case BON_TYPE_DOUBLE_BE:
+		case BON_TYPE_HALF_LE:  case BON_TYPE_HALF_BE:
+		case BON_TYPE_BF16_LE:  case BON_TYPE_BF16_BE: {
 			dst->type   =  BON_VALUE_DOUBLE;
 			dst->u.dbl  =  br_read_double(br, id);
 			return BON_TRUE;
@@ -1318,8 +1913,13 @@ bon_value* bon_exploded_aggr(bon_r_doc* B, bon_value* val)
 	bon_value_agg* agg = val->u.agg;
 	
 	if (!agg->exploded) {
+		const uint8_t* data = bon_agg_payload(agg);
+		if (!data) {
+			return NULL;
+		}
+		
 		bon_reader br = make_br(B,
-			agg->data,
+			data,
 			bon_aggregate_payload_size(&agg->type),
 			BON_BAD_BLOCK_ID
 		);
@@ -1338,41 +1938,320 @@ bon_value* bon_exploded_aggr(bon_r_doc* B, bon_value* val)
 	
 	return agg->exploded;
 }
-//------------------------------------------------------------------------------
 
 
-// Helper for writing to a binary stream without overflowing:
+//------------------------------------------------------------------------------
+// Elements of aggregates, read in place.
+// Only the array and struct elements the user touches get a bon_value of their own, which lives as long as the doc.
 
-typedef struct {
-	uint8_t*    data;
-	bon_size    nbytes;
-	bon_error   error;
-} bon_writer;
+#define BON_PROXY_MIN_BUCKETS 64
 
-void bw_set_err(bon_writer* bw, bon_error err)
+BON_INLINE bon_size bon_proxy_bucket(const bon_r_doc* B, const uint8_t* data, const bon_type* type)
 {
-	bon_onError(bon_err_str(err));
-	
-	if (bw->error == BON_SUCCESS) {
-		bw->error = err;
-	}
+	uint64_t h = (uint64_t)(uintptr_t)data * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)type;
+	h ^= h >> 29;
+	return (bon_size)(h & (B->num_proxy_buckets - 1));
 }
 
-void bw_assert(bon_writer* bw, bon_bool statement, bon_error onFail)
+static void bon_grow_proxies(bon_r_doc* B)
 {
-	if (!statement) {
-		bw_set_err(bw, onFail);
+	bon_proxy** old_buckets = B->proxies;
+	bon_size    old_count   = B->num_proxy_buckets;
+	
+	B->num_proxy_buckets = (old_count ? 2 * old_count : BON_PROXY_MIN_BUCKETS);
+	B->proxies = BON_CALLOC_TYPE(B->num_proxy_buckets, bon_proxy*);
+	
+	for (bon_size bi=0; bi<old_count; ++bi) {
+		bon_proxy* p = old_buckets[bi];
+		while (p) {
+			bon_proxy* next = p->next;
+			bon_size ix = bon_proxy_bucket(B, p->data, p->type);
+			p->next = B->proxies[ix];
+			B->proxies[ix] = p;
+			p = next;
+		}
 	}
+	
+	free(old_buckets);
 }
 
-
-bon_bool bw_skip(bon_writer* bw, size_t n) {
-	if (bw->nbytes >= n) {
-		bw->data   += n;
-		bw->nbytes -= n;
-		return BON_TRUE;
-	} else {
-		bw_set_err(bw, BON_ERR_TOO_SHORT);
+/*
+ The value of the element of type 'type' starting at 'data'.
+ Arrays and structs get the same pointer every time. Numbers are cheap to read again,
+ so they are not kept: they go into the next of B->numbers.
+ */
+static bon_value* bon_r_proxy(bon_r_doc* B, const uint8_t* data, const bon_type* type)
+{
+	if (type->id != BON_TYPE_ARRAY && type->id != BON_TYPE_STRUCT) {
+		bon_value* val = &B->numbers[B->next_number];
+		B->next_number = (B->next_number + 1) % BON_R_NUMBER_SLOTS;
+		bon_reader br = make_br(B, data, bon_type_size(type->id), BON_BAD_BLOCK_ID);
+		bon_explode_aggr(B, val, (bon_type*)type, &br);
+		return val;
+	}
+	
+	if (B->proxies) {
+		for (bon_proxy* p = B->proxies[bon_proxy_bucket(B, data, type)]; p; p = p->next) {
+			if (p->data == data && p->type == type) {
+				return &p->value;
+			}
+		}
+	}
+	
+	if (B->num_proxies >= 2 * B->num_proxy_buckets) {
+		bon_grow_proxies(B);
+	}
+	
+	bon_proxy* p = BON_ALLOC_TYPE(1, bon_proxy);
+	p->data          = data;
+	p->type          = type;
+	p->agg.type      = *type; // Shallow copy
+	p->agg.data      = data;
+	p->agg.encoded   = NULL;
+	p->agg.exploded  = NULL;
+	p->value.type    = BON_VALUE_AGGREGATE;
+	p->value.u.agg   = &p->agg;
+	
+	bon_size ix = bon_proxy_bucket(B, data, type);
+	p->next = B->proxies[ix];
+	B->proxies[ix] = p;
+	B->num_proxies += 1;
+	
+	return &p->value;
+}
+
+static void bon_free_proxies(bon_r_doc* B)
+{
+	for (bon_size bi=0; bi<B->num_proxy_buckets; ++bi) {
+		bon_proxy* p = B->proxies[bi];
+		while (p) {
+			bon_proxy* next = p->next;
+			if (p->agg.exploded) {
+				bon_free_value_insides( p->agg.exploded );
+				free( p->agg.exploded );
+			}
+			free(p);
+			p = next;
+		}
+	}
+	free(B->proxies);
+}
+
+bon_value* bon_r_agg_elem(bon_r_doc* B, const bon_value_agg* agg, bon_size ix)
+{
+	if (agg->type.id != BON_TYPE_ARRAY) { return NULL; }
+	
+	const bon_type_array* array = agg->type.u.array;
+	if (ix >= array->size) { return NULL; }
+	
+	const uint8_t* data = bon_agg_payload(agg);
+	if (!data) { return NULL; }
+	
+	bon_size elem_size = bon_aggregate_payload_size(array->type);
+	return bon_r_proxy(B, data + ix * elem_size, array->type);
+}
+
+bon_value* bon_r_agg_field(bon_r_doc* B, const bon_value_agg* agg, bon_size ix)
+{
+	if (agg->type.id != BON_TYPE_STRUCT) { return NULL; }
+	
+	const bon_type_struct* strct = agg->type.u.strct;
+	if (ix >= strct->size) { return NULL; }
+	
+	bon_size offset = 0;
+	for (bon_size fi=0; fi<ix; ++fi) {
+		offset += bon_aggregate_payload_size(&strct->kts[fi].type);
+	}
+	return bon_r_proxy(B, agg->data + offset, &strct->kts[ix].type);
+}
+
+bon_value* bon_r_agg_get_key(bon_r_doc* B, const bon_value_agg* agg, const char* key)
+{
+	if (agg->type.id != BON_TYPE_STRUCT) { return NULL; }
+	
+	const bon_type_struct* strct = agg->type.u.strct;
+	bon_size offset = 0;
+	for (bon_size fi=0; fi<strct->size; ++fi) {
+		const bon_kt* kt = &strct->kts[fi];
+		if (strcmp(key, kt->key) == 0) {
+			return bon_r_proxy(B, agg->data + offset, &kt->type);
+		}
+		offset += bon_aggregate_payload_size(&kt->type);
+	}
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// Tables
+
+
+// Cell 'row' of 'col'. Strings point into the document.
+static void bon_table_cell(bon_r_doc* B, const bon_column* col, bon_size row, bon_value* out)
+{
+	if (col->type == BON_TYPE_STRING) {
+		out->type       = BON_VALUE_STRING;
+		out->u.str.ptr  = (const char*)col->data + bon_column_offset(col, row);
+		out->u.str.size = bon_column_offset(col, row + 1) - bon_column_offset(col, row) - 1;
+	} else if (col->type == BON_TYPE_BOOL) {
+		out->type      = BON_VALUE_BOOL;
+		out->u.boolean = (((const uint8_t*)col->data)[row] != 0);
+	} else {
+		bon_size size = bon_type_size(col->type);
+		bon_type type = { col->type, { NULL } };
+		bon_reader br = make_br(B, (const uint8_t*)col->data + row * size, size, BON_BAD_BLOCK_ID);
+		bon_explode_aggr(B, out, &type, &br);
+	}
+}
+
+// Makes row 'ix' into 'out', which must be freed with bon_free_value_insides.
+static void bon_table_make_row(bon_r_doc* B, const bon_value_table* table, bon_size ix, bon_value* out)
+{
+	out->type       = BON_VALUE_OBJ;
+	out->u.obj.size = table->num_cols;
+	out->u.obj.data = BON_ALLOC_TYPE(table->num_cols, bon_kv);
+	for (bon_size ci=0; ci<table->num_cols; ++ci) {
+		bon_kv* kv = &out->u.obj.data[ci];
+		kv->key = table->cols[ci].col.key;
+		bon_table_cell(B, &table->cols[ci].col, ix, &kv->val);
+	}
+}
+
+bon_value* bon_r_table_row(bon_r_doc* B, bon_value_table* table, bon_size ix)
+{
+	if (ix >= table->num_rows) { return NULL; }
+	
+	if (!table->rows) {
+		table->rows = BON_CALLOC_TYPE(table->num_rows, bon_value); // BON_VALUE_NONE
+	}
+	if (table->rows[ix].type == BON_VALUE_NONE) {
+		bon_table_make_row(B, table, ix, &table->rows[ix]);
+	}
+	return &table->rows[ix];
+}
+
+static bon_value_table* bon_r_table(bon_r_doc* B, bon_value* val)
+{
+	val = bon_r_follow_refs(B, val);
+	return (val && val->type == BON_VALUE_TABLE ? val->u.table : NULL);
+}
+
+bon_bool bon_r_is_table(bon_r_doc* B, bon_value* val)
+{
+	return bon_r_table(B, val) != NULL;
+}
+
+bon_size bon_r_table_cols(bon_r_doc* B, bon_value* val)
+{
+	bon_value_table* table = bon_r_table(B, val);
+	return table ? table->num_cols : 0;
+}
+
+const bon_column* bon_r_table_col(bon_r_doc* B, bon_value* val, bon_size ix)
+{
+	bon_value_table* table = bon_r_table(B, val);
+	if (!table || ix >= table->num_cols) { return NULL; }
+	return &table->cols[ix].col;
+}
+
+static bon_table_col* bon_table_find_col(bon_value_table* table, const char* key)
+{
+	for (bon_size ci=0; ci<table->num_cols; ++ci) {
+		if (strcmp(key, table->cols[ci].col.key) == 0) {
+			return &table->cols[ci];
+		}
+	}
+	return NULL;
+}
+
+const bon_column* bon_r_table_get_col(bon_r_doc* B, bon_value* val, const char* key)
+{
+	bon_value_table* table = bon_r_table(B, val);
+	bon_table_col* col = (table ? bon_table_find_col(table, key) : NULL);
+	return col ? &col->col : NULL;
+}
+
+const char* bon_column_str(const bon_column* col, bon_size row, bon_size* out_size)
+{
+	if (col->type != BON_TYPE_STRING || row >= col->size) { return NULL; }
+	
+	uint32_t begin = bon_column_offset(col, row);
+	if (out_size) {
+		*out_size = bon_column_offset(col, row + 1) - begin - 1;
+	}
+	return (const char*)col->data + begin;
+}
+
+bon_value* bon_r_table_col_value(bon_r_doc* B, bon_value* val, const char* key)
+{
+	bon_value_table* table = bon_r_table(B, val);
+	bon_table_col* tc = (table ? bon_table_find_col(table, key) : NULL);
+	if (!tc) { return NULL; }
+	
+	const bon_column* col = &tc->col;
+	
+	if (tc->value.type == BON_VALUE_NONE) {
+		if (col->type == BON_TYPE_STRING) {
+			bon_list* list = &tc->value.u.list;
+			list->size = col->size;
+			list->data = BON_ALLOC_TYPE(col->size, bon_value);
+			for (bon_size row=0; row<col->size; ++row) {
+				bon_table_cell(B, col, row, &list->data[row]);
+			}
+			tc->value.type = BON_VALUE_LIST;
+		} else {
+			tc->elem.id          = (col->type == BON_TYPE_BOOL ? BON_TYPE_UINT8 : col->type);
+			tc->array.size       = col->size;
+			tc->array.type       = &tc->elem;
+			tc->agg.type.id      = BON_TYPE_ARRAY;
+			tc->agg.type.u.array = &tc->array;
+			tc->agg.data         = (const uint8_t*)col->data;
+			tc->agg.encoded      = NULL;
+			tc->agg.exploded     = NULL;
+			tc->value.type       = BON_VALUE_AGGREGATE;
+			tc->value.u.agg      = &tc->agg;
+		}
+	}
+	
+	return &tc->value;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+// Helper for writing to a binary stream without overflowing:
+
+typedef struct {
+	uint8_t*    data;
+	bon_size    nbytes;
+	bon_error   error;
+} bon_writer;
+
+void bw_set_err(bon_writer* bw, bon_error err)
+{
+	bon_onError(bon_err_str(err));
+	
+	if (bw->error == BON_SUCCESS) {
+		bw->error = err;
+	}
+}
+
+void bw_assert(bon_writer* bw, bon_bool statement, bon_error onFail)
+{
+	if (!statement) {
+		bw_set_err(bw, onFail);
+	}
+}
+
+
+bon_bool bw_skip(bon_writer* bw, size_t n) {
+	if (bw->nbytes >= n) {
+		bw->data   += n;
+		bw->nbytes -= n;
+		return BON_TRUE;
+	} else {
+		bw_set_err(bw, BON_ERR_TOO_SHORT);
 		return BON_FALSE;
 	}
 }
@@ -1392,7 +2271,10 @@ bon_bool bw_write_raw(bon_writer* bw, const void* in, size_t n) {
 // Write bytes in reversed order (i.e. reverse endian)
 bon_bool bw_write_raw_reversed(bon_writer* bw, const void* in, size_t n) {
 	if (bw->nbytes >= n) {
-		memcpy(bw->data, in, n);
+		const uint8_t* bytes = (const uint8_t*)in;
+		for (size_t i=0; i<n; ++i) {
+			bw->data[i] = bytes[n - 1 - i];
+		}
 		bw->data   += n;
 		bw->nbytes -= n;
 		return BON_TRUE;
@@ -1495,6 +2377,8 @@ bon_bool bw_write_uint_as(bon_writer* bw, uint64_t val, bon_type_id type)
 			
 		case BON_TYPE_FLOAT_LE: case BON_TYPE_FLOAT_BE:
 		case BON_TYPE_DOUBLE_LE: case BON_TYPE_DOUBLE_BE:
+		case BON_TYPE_HALF_LE: case BON_TYPE_HALF_BE:
+		case BON_TYPE_BF16_LE: case BON_TYPE_BF16_BE:
 			return bw_write_double_as(bw, (double)val, type);
 			
 		default:
@@ -1522,6 +2406,8 @@ bon_bool bw_write_sint_as(bon_writer* bw, int64_t val, bon_type_id type)
 			
 		case BON_TYPE_FLOAT_LE: case BON_TYPE_FLOAT_BE:
 		case BON_TYPE_DOUBLE_LE: case BON_TYPE_DOUBLE_BE:
+		case BON_TYPE_HALF_LE: case BON_TYPE_HALF_BE:
+		case BON_TYPE_BF16_LE: case BON_TYPE_BF16_BE:
 			return bw_write_double_as(bw, (double)val, type);
 			
 		default:
@@ -1556,6 +2442,18 @@ bon_bool bw_write_double_as(bon_writer* bw, double val, bon_type_id type)
 		return bw_write_raw_reversed(bw, &val, sizeof(val));
 	}
 	
+	if (type == BON_TYPE_HALF_LE || type == BON_TYPE_HALF_BE ||
+		 type == BON_TYPE_BF16_LE || type == BON_TYPE_BF16_BE)
+	{
+		bon_bool half = (type == BON_TYPE_HALF_LE || type == BON_TYPE_HALF_BE);
+		uint16_t u = (half ? bon_float_to_half((float)val) : bon_float_to_bf16((float)val));
+		if (type == BON_TYPE_HALF || type == BON_TYPE_BF16) {
+			return bw_write_raw(bw, &u, sizeof(u));
+		} else {
+			return bw_write_raw_reversed(bw, &u, sizeof(u));
+		}
+	}
+	
 	if (bon_is_int(type)) {
 		return bw_write_sint_as(bw, (int64_t)val, type);
 	}
@@ -1582,49 +2480,22 @@ bon_bool translate_array(bon_r_doc* B,
 	
 	bon_size n = srcArray->size;
 	
-	// Common optimizations. Oh fuck C sucks - give me C++ templates...
-	
-	bon_type_id src_type = srcArray->type->id;
-	bon_type_id dst_type = dstArray->type->id;
-	
-#if 1
-#define COPY_ARRAY(Src, Dst)                               \
-/**/    const Src* src = (const Src*)br->data;             \
-/**/    Dst*       dst = (Dst*)      bw->data;             \
-/**/                                                       \
-/**/    for (bon_size ix=0; ix<n; ++ix) {                  \
-/**/        *dst = (Dst)*src;                              \
-/**/        ++dst;                                         \
-/**/        ++src;                                         \
-/**/    }                                                  \
-/**/                                                       \
-/**/    br_skip(br, n * sizeof(Src));                      \
-/**/    bw_skip(bw, n * sizeof(Dst));                      \
-/**/    return BON_TRUE;
-	
-#define COPY_BY_TYPE(SrcType)                                            \
-if (dst_type == BON_TYPE_DOUBLE)  { COPY_ARRAY(SrcType, double  ); }    \
-if (dst_type == BON_TYPE_FLOAT)  { COPY_ARRAY(SrcType, float   ); }    \
-if (dst_type == BON_TYPE_SINT64)   { COPY_ARRAY(SrcType, int64_t ); }    \
-if (dst_type == BON_TYPE_SINT32)   { COPY_ARRAY(SrcType, int32_t ); }    \
-if (dst_type == BON_TYPE_SINT16)   { COPY_ARRAY(SrcType, int16_t ); }    \
-if (dst_type == BON_TYPE_SINT8 )   { COPY_ARRAY(SrcType, int8_t  ); }    \
-if (dst_type == BON_TYPE_UINT64)   { COPY_ARRAY(SrcType, uint64_t); }    \
-if (dst_type == BON_TYPE_UINT32)   { COPY_ARRAY(SrcType, uint32_t); }    \
-if (dst_type == BON_TYPE_UINT16)   { COPY_ARRAY(SrcType, uint16_t); }    \
-if (dst_type == BON_TYPE_UINT8 )   { COPY_ARRAY(SrcType, uint8_t ); }
-	
-	if (src_type == BON_TYPE_DOUBLE) { COPY_BY_TYPE(double)   };
-	if (src_type == BON_TYPE_FLOAT) { COPY_BY_TYPE(float)    };
-	if (src_type == BON_TYPE_SINT64 ) { COPY_BY_TYPE(int64_t)  };
-	if (src_type == BON_TYPE_SINT32 ) { COPY_BY_TYPE(int32_t)  };
-	if (src_type == BON_TYPE_SINT16 ) { COPY_BY_TYPE(int16_t)  };
-	if (src_type == BON_TYPE_SINT8  ) { COPY_BY_TYPE(int8_t )  };
-	if (src_type == BON_TYPE_UINT64 ) { COPY_BY_TYPE(uint64_t) };
-	if (src_type == BON_TYPE_UINT32 ) { COPY_BY_TYPE(uint32_t) };
-	if (src_type == BON_TYPE_UINT16 ) { COPY_BY_TYPE(uint16_t) };
-	if (src_type == BON_TYPE_UINT8  ) { COPY_BY_TYPE(uint8_t ) };
-#endif
+	// Common optimization: native numbers
+	bon_cast_fn cast = bon_cast_kernel(srcArray->type->id, dstArray->type->id);
+	if (cast) {
+		bon_size src_size = n * bon_type_size(srcArray->type->id);
+		bon_size dst_size = n * bon_type_size(dstArray->type->id);
+		if (br->nbytes < src_size || bw->nbytes < dst_size) {
+			return BON_FALSE;
+		}
+		if (!cast(br->data, bw->data, n)) {
+			bw_set_err(bw, BON_ERR_NARROWING);
+			return BON_FALSE;
+		}
+		br_skip(br, src_size);
+		bw_skip(bw, dst_size);
+		return BON_TRUE;
+	}
 	
 	// If we get here its not numeric -> numeric
 	
@@ -1747,7 +2618,9 @@ bon_bool translate_aggregate(bon_r_doc* B,
 		}
 			
 		case BON_TYPE_FLOAT_LE:  case BON_TYPE_FLOAT_BE:
-		case BON_TYPE_DOUBLE_LE:  case BON_TYPE_DOUBLE_BE: {
+		case BON_TYPE_DOUBLE_LE:  case BON_TYPE_DOUBLE_BE:
+		case BON_TYPE_HALF_LE:  case BON_TYPE_HALF_BE:
+		case BON_TYPE_BF16_LE:  case BON_TYPE_BF16_BE: {
 			return bw_write_double_as(bw, br_read_double(br, srcType->id), dstType->id);
 		}
 			
@@ -1758,6 +2631,458 @@ bon_bool translate_aggregate(bon_r_doc* B,
 	}
 }
 
+
+//------------------------------------------------------------------------------
+// Compiled unpack plans
+
+
+typedef struct {
+	bon_size  size;
+	bon_size  cap;
+	bon_op*   data;
+} bon_ops;
+
+BON_INLINE bon_bool bon_is_number_type(bon_type_id id)
+{
+	return bon_is_int(id) || bon_is_float_double(id);
+}
+
+BON_INLINE bon_op* bon_plan_emit(bon_ops* ops, bon_op_code code,
+											bon_size src_offset, bon_size dst_offset, bon_size count)
+{
+	BON_VECTOR_EXPAND(*ops, bon_op, 1);
+	bon_op* op = &ops->data[ops->size - 1];
+	memset(op, 0, sizeof(bon_op));
+	op->code       = code;
+	op->src_offset = src_offset;
+	op->dst_offset = dst_offset;
+	op->count      = count;
+	return op;
+}
+
+/*
+ Appends the ops for converting a 'src' at 'src_offset' to a 'dst' at 'dst_offset'.
+ Does the same as translate_aggregate, but once and for all.
+ */
+bon_bool bon_plan_compile(bon_ops* ops,
+								  const bon_type* src, bon_size src_offset,
+								  const bon_type* dst, bon_size dst_offset)
+{
+	if (bon_type_eq(src, dst)) {
+		bon_size size = bon_aggregate_payload_size(dst);
+		
+		if (ops->size > 0) {
+			bon_op* last = &ops->data[ops->size - 1];
+			if (last->code == BON_OP_COPY &&
+				 last->src_offset + last->count == src_offset &&
+				 last->dst_offset + last->count == dst_offset)
+			{
+				// Continue the memcpy run
+				last->count += size;
+				return BON_TRUE;
+			}
+		}
+		
+		bon_plan_emit(ops, BON_OP_COPY, src_offset, dst_offset, size);
+		return BON_TRUE;
+	}
+	
+	if (src->id == BON_TYPE_ARRAY && dst->id == BON_TYPE_ARRAY) {
+		const bon_type_array* src_arr = src->u.array;
+		const bon_type_array* dst_arr = dst->u.array;
+		
+		if (src_arr->size != dst_arr->size) {
+			return BON_FALSE;
+		}
+		
+		bon_type_id src_id = src_arr->type->id;
+		bon_type_id dst_id = dst_arr->type->id;
+		
+		bon_cast_fn cast = bon_cast_kernel(src_id, dst_id);
+		if (cast) {
+			bon_op* op = bon_plan_emit(ops, BON_OP_CAST, src_offset, dst_offset, src_arr->size);
+			op->cast       = cast;
+			op->src_stride = bon_type_size(src_id);
+			op->dst_stride = bon_type_size(dst_id);
+			return BON_TRUE;
+		}
+		
+		if (bon_is_number_type(src_id) && bon_is_number_type(dst_id)) {
+			bon_op* op = bon_plan_emit(ops, BON_OP_CONVERT, src_offset, dst_offset, src_arr->size);
+			op->src_id     = src_id;
+			op->dst_id     = dst_id;
+			op->src_stride = bon_type_size(src_id);
+			op->dst_stride = bon_type_size(dst_id);
+			return BON_TRUE;
+		}
+		
+		bon_size loop_ix = ops->size;
+		bon_op* op = bon_plan_emit(ops, BON_OP_LOOP, src_offset, dst_offset, src_arr->size);
+		op->src_stride = bon_aggregate_payload_size(src_arr->type);
+		op->dst_stride = bon_aggregate_payload_size(dst_arr->type);
+		
+		if (!bon_plan_compile(ops, src_arr->type, 0, dst_arr->type, 0)) {
+			return BON_FALSE;
+		}
+		
+		ops->data[loop_ix].body = ops->size - loop_ix - 1; // 'op' may have moved
+		return BON_TRUE;
+	}
+	
+	if (src->id == BON_TYPE_STRUCT && dst->id == BON_TYPE_STRUCT) {
+		const bon_type_struct* src_strct = src->u.strct;
+		const bon_type_struct* dst_strct = dst->u.strct;
+		
+		bon_size dst_key_offset = dst_offset;
+		
+		for (bon_size dst_ki=0; dst_ki<dst_strct->size; ++dst_ki) {
+			const bon_kt* dst_kt = dst_strct->kts + dst_ki;
+			
+			// Key remapping:
+			bon_size src_key_offset = src_offset;
+			bon_size src_ki;
+			for (src_ki=0; src_ki<src_strct->size; ++src_ki) {
+				const bon_kt* src_kt = src_strct->kts + src_ki;
+				if (strcmp(dst_kt->key, src_kt->key) == 0) {
+					break;
+				}
+				src_key_offset += bon_aggregate_payload_size(&src_kt->type);
+			}
+			
+			if (src_ki == src_strct->size) {
+				return BON_FALSE; // Source lacked key. Not an error: the caller falls back to translate_aggregate.
+			}
+			
+			if (!bon_plan_compile(ops, &src_strct->kts[src_ki].type, src_key_offset,
+										 &dst_kt->type, dst_key_offset))
+			{
+				return BON_FALSE;
+			}
+			
+			dst_key_offset += bon_aggregate_payload_size(&dst_kt->type);
+		}
+		
+		return BON_TRUE;
+	}
+	
+	if (bon_is_number_type(src->id) && bon_is_number_type(dst->id)) {
+		bon_op* op = bon_plan_emit(ops, BON_OP_CONVERT, src_offset, dst_offset, 1);
+		op->src_id     = src->id;
+		op->dst_id     = dst->id;
+		op->src_stride = bon_type_size(src->id);
+		op->dst_stride = bon_type_size(dst->id);
+		return BON_TRUE;
+	}
+	
+	return BON_FALSE;
+}
+
+bon_plan* bon_new_plan(const bon_type* srcType, const bon_type* dstType)
+{
+	bon_ops ops = {0, 0, NULL};
+	
+	if (!bon_plan_compile(&ops, srcType, 0, dstType, 0)) {
+		free(ops.data);
+		return NULL;
+	}
+	
+	bon_plan* plan = BON_ALLOC_TYPE(1, bon_plan);
+	plan->src      = srcType;
+	plan->src_size = bon_aggregate_payload_size(srcType);
+	plan->dst_size = bon_aggregate_payload_size(dstType);
+	plan->nops     = ops.size;
+	plan->ops      = ops.data;
+	return plan;
+}
+
+#define BON_PLAN_BUCKETS 64
+
+// Bytes needed for copies of all the keys in 't'
+static size_t bon_type_keys_size(const bon_type* t)
+{
+	if (t->id == BON_TYPE_ARRAY) {
+		return bon_type_keys_size(t->u.array->type);
+	} else if (t->id == BON_TYPE_STRUCT) {
+		size_t n = 0;
+		for (bon_size ki=0; ki<t->u.strct->size; ++ki) {
+			const bon_kt* kt = &t->u.strct->kts[ki];
+			n += strlen(kt->key) + 1 + bon_type_keys_size(&kt->type);
+		}
+		return n;
+	} else {
+		return 0;
+	}
+}
+
+// Deep copy of 'src', with the keys copied to '*keys'. Free with bon_free_type_insides.
+static void bon_type_copy(bon_type* dst, const bon_type* src, char** keys)
+{
+	dst->id      = src->id;
+	dst->u.array = NULL;
+	
+	if (src->id == BON_TYPE_ARRAY) {
+		dst->u.array       = BON_ALLOC_TYPE(1, bon_type_array);
+		dst->u.array->size = src->u.array->size;
+		dst->u.array->type = BON_ALLOC_TYPE(1, bon_type);
+		bon_type_copy(dst->u.array->type, src->u.array->type, keys);
+	} else if (src->id == BON_TYPE_STRUCT) {
+		bon_size n = src->u.strct->size;
+		dst->u.strct       = BON_ALLOC_TYPE(1, bon_type_struct);
+		dst->u.strct->size = n;
+		dst->u.strct->kts  = BON_ALLOC_TYPE(n, bon_kt);
+		for (bon_size ki=0; ki<n; ++ki) {
+			const bon_kt* src_kt = &src->u.strct->kts[ki];
+			bon_kt*       dst_kt = &dst->u.strct->kts[ki];
+			size_t len = strlen(src_kt->key);
+			memcpy(*keys, src_kt->key, len + 1);
+			dst_kt->key = *keys;
+			*keys += len + 1;
+			bon_type_copy(&dst_kt->type, &src_kt->type, keys);
+		}
+	}
+}
+
+/*
+ The plan from 'srcType' (an aggregate type in B) to 'dstType', or NULL if they are not compatible.
+ Each pair is only compiled once, so converting many aggregates of the same type does not allocate.
+ The plan is owned by B. Source types are shared within a document, so they are looked up by their insides.
+ */
+static const bon_plan* bon_r_cached_plan(bon_r_doc* B, const bon_type* srcType, const bon_type* dstType)
+{
+	const void* insides = (srcType->id == BON_TYPE_ARRAY  ? (const void*)srcType->u.array :
+								  srcType->id == BON_TYPE_STRUCT ? (const void*)srcType->u.strct : NULL);
+	if (!insides) {
+		return NULL; // Not an aggregate
+	}
+	
+	if (!B->plans) {
+		B->plans = BON_CALLOC_TYPE(BON_PLAN_BUCKETS, bon_plan_entry*);
+	}
+	
+	bon_plan_entry** bucket = &B->plans[((uintptr_t)insides >> 4) % BON_PLAN_BUCKETS];
+	
+	for (bon_plan_entry* e = *bucket; e; e = e->next) {
+		if (bon_type_eq(&e->src, srcType) && bon_type_eq(&e->dst, dstType)) {
+			return e->plan;
+		}
+	}
+	
+	bon_plan_entry* e = BON_ALLOC_TYPE(1, bon_plan_entry);
+	e->src  = *srcType;
+	e->keys = BON_ALLOC_TYPE(bon_type_keys_size(dstType) + 1, char);
+	char* keys = e->keys;
+	bon_type_copy(&e->dst, dstType, &keys);
+	e->plan = bon_new_plan(&e->src, &e->dst);
+	e->next = *bucket;
+	*bucket = e;
+	return e->plan;
+}
+
+static void bon_free_plans(bon_r_doc* B)
+{
+	if (!B->plans) { return; }
+	
+	for (bon_size bi=0; bi<BON_PLAN_BUCKETS; ++bi) {
+		bon_plan_entry* e = B->plans[bi];
+		while (e) {
+			bon_plan_entry* next = e->next;
+			bon_free_plan(e->plan);
+			bon_free_type_insides(&e->dst);
+			free(e->keys);
+			free(e);
+			e = next;
+		}
+	}
+	
+	free(B->plans);
+}
+
+bon_bool bon_plan_run(bon_r_doc* B, const bon_op* ops, bon_size nops,
+							 const uint8_t* src, uint8_t* dst);
+
+// Runs elements [begin, end) of 'op' (bytes for a copy).
+bon_bool bon_plan_run_op(bon_r_doc* B, const bon_op* op, bon_size begin, bon_size end,
+								 const uint8_t* src, uint8_t* dst)
+{
+	src += op->src_offset;
+	dst += op->dst_offset;
+	
+	switch (op->code) {
+		case BON_OP_COPY: {
+			memcpy(dst + begin, src + begin, end - begin);
+		} break;
+			
+		case BON_OP_CAST: {
+			if (!op->cast(src + begin * op->src_stride, dst + begin * op->dst_stride, end - begin)) {
+				bon_onError(bon_err_str(BON_ERR_NARROWING));
+				return BON_FALSE;
+			}
+		} break;
+			
+		case BON_OP_CONVERT: {
+			bon_type src_type, dst_type;
+			src_type.id = op->src_id;
+			dst_type.id = op->dst_id;
+			
+			for (bon_size ei=begin; ei<end; ++ei) {
+				bon_reader br = make_br(B, src + ei * op->src_stride,
+												op->src_stride, BON_BAD_BLOCK_ID);
+				bon_writer bw = {dst + ei * op->dst_stride,
+									  op->dst_stride, BON_SUCCESS};
+				
+				if (!translate_aggregate(B, &src_type, &br, &dst_type, &bw) ||
+					 br.error || bw.error)
+				{
+					return BON_FALSE;
+				}
+			}
+		} break;
+			
+		case BON_OP_LOOP: {
+			for (bon_size ei=begin; ei<end; ++ei) {
+				if (!bon_plan_run(B, op + 1, op->body,
+										src + ei * op->src_stride,
+										dst + ei * op->dst_stride))
+				{
+					return BON_FALSE;
+				}
+			}
+		} break;
+	}
+	
+	return BON_TRUE;
+}
+
+bon_bool bon_plan_run(bon_r_doc* B, const bon_op* ops, bon_size nops,
+							 const uint8_t* src, uint8_t* dst)
+{
+	bon_size ix = 0;
+	while (ix < nops) {
+		const bon_op* op = ops + ix;
+		if (!bon_plan_run_op(B, op, 0, op->count, src, dst)) {
+			return BON_FALSE;
+		}
+		ix += 1 + (op->code == BON_OP_LOOP ? op->body : 0);
+	}
+	
+	return BON_TRUE;
+}
+
+
+//------------------------------------------------------------------------------
+// Splitting large ops over threads
+
+
+// One top-level op, split into 'nparts' ranges
+typedef struct {
+	bon_r_doc*      B;
+	const bon_op*   op;
+	const uint8_t*  src;
+	uint8_t*        dst;
+	unsigned        nparts;
+	bon_bool*       results;  // One per part
+} bon_plan_job;
+
+static void bon_plan_task(void* user, unsigned part)
+{
+	bon_plan_job* job = (bon_plan_job*)user;
+	const bon_op* op  = job->op;
+	
+	// Copies are split on cache lines (no false sharing), the rest on elements (e.g. struct boundaries).
+	bon_size granule = (op->code == BON_OP_COPY ? 64 : 1);
+	bon_size per     = (op->count + job->nparts - 1) / job->nparts;
+	per = (per + granule - 1) / granule * granule;
+	
+	bon_size begin = part * per;
+	bon_size end   = begin + per;
+	if (begin > op->count)  { begin = op->count; }
+	if (end   > op->count)  { end   = op->count; }
+	
+	job->results[part] = bon_plan_run_op(job->B, op, begin, end, job->src, job->dst);
+}
+
+// Runs 'op' (and its body) on B's threads if it is large enough, else on this thread.
+static bon_bool bon_plan_run_op_parallel(bon_r_doc* B, const bon_op* op,
+													  const uint8_t* src, uint8_t* dst)
+{
+	bon_size nbytes = (op->code == BON_OP_COPY ? op->count : op->count * op->dst_stride);
+	
+	if (B->num_threads <= 1 || nbytes < BON_PARALLEL_MIN_BYTES || op->count < 2) {
+		return bon_plan_run_op(B, op, 0, op->count, src, dst);
+	}
+	
+	if (!B->pool) {
+		B->pool = bon_new_pool(B->num_threads - 1);
+	}
+	
+	bon_plan_job job;
+	job.B       = B;
+	job.op      = op;
+	job.src     = src;
+	job.dst     = dst;
+	job.nparts  = B->num_threads;
+	job.results = BON_ALLOC_TYPE(job.nparts, bon_bool);
+	
+	bon_pool_run(B->pool, job.nparts, bon_plan_task, &job);
+	
+	bon_bool win = BON_TRUE;
+	for (unsigned pi=0; pi<job.nparts; ++pi) {
+		win = win && job.results[pi];
+	}
+	free(job.results);
+	return win;
+}
+
+// Like bon_plan_run, but large ops are split over B's threads.
+static bon_bool bon_plan_exec(bon_r_doc* B, const bon_plan* plan,
+										const uint8_t* src, uint8_t* dst)
+{
+	if (B->num_threads <= 1 || plan->dst_size < BON_PARALLEL_MIN_BYTES) {
+		return bon_plan_run(B, plan->ops, plan->nops, src, dst);
+	}
+	
+	bon_size ix = 0;
+	while (ix < plan->nops) {
+		const bon_op* op = plan->ops + ix;
+		if (!bon_plan_run_op_parallel(B, op, src, dst)) {
+			return BON_FALSE;
+		}
+		ix += 1 + (op->code == BON_OP_LOOP ? op->body : 0);
+	}
+	
+	return BON_TRUE;
+}
+
+// memcpy, split over B's threads if large enough
+static void bon_r_copy(bon_r_doc* B, void* dst, const void* src, bon_size nbytes)
+{
+	bon_op op;
+	memset(&op, 0, sizeof(op));
+	op.code  = BON_OP_COPY;
+	op.count = nbytes;
+	bon_plan_run_op_parallel(B, &op, (const uint8_t*)src, (uint8_t*)dst);
+}
+
+// Run 'plan' on 'agg' if it has the type the plan was compiled for.
+BON_INLINE bon_bool bw_run_plan(bon_r_doc* B, const bon_plan* plan,
+										  const bon_value_agg* agg, bon_writer* bw)
+{
+	if (!bon_type_eq(plan->src, &agg->type) || bw->nbytes < plan->dst_size) {
+		return BON_FALSE;
+	}
+	
+	const uint8_t* src = bon_agg_payload(agg);
+	if (!src || !bon_plan_exec(B, plan, src, bw->data)) {
+		return BON_FALSE;
+	}
+	
+	return bw_skip(bw, plan->dst_size);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 bon_bool bw_read_aggregate(bon_r_doc* B, bon_value* srcVal,
 									const bon_type* dstType, bon_writer* bw);
 
@@ -1838,8 +3163,27 @@ bon_bool bw_list_2_array(bon_r_doc* B, const bon_list* src_list,
 			
 		default: {
 			// Maybe a nested type, maybe wrong endian. Recurse.
+			// Consecutive aggregates usually share type, so reuse the plan while we can.
+			
+			const bon_type* plan_src = NULL; // The type 'plan' was looked up for
+			const bon_plan* plan     = NULL;
 			
 			for (bon_size ix=0; ix<n; ++ix) {
+				bon_value* val = bon_r_follow_refs(B, src_list->data + ix);
+				
+				if (val && val->type == BON_VALUE_AGGREGATE) {
+					const bon_value_agg* agg = val->u.agg;
+					
+					if (!plan_src || !bon_type_eq(plan_src, &agg->type)) {
+						plan_src = &agg->type;
+						plan     = bon_r_cached_plan(B, &agg->type, dst_array->type);
+					}
+					
+					if (plan && bw_run_plan(B, plan, agg, bw)) {
+						continue;
+					}
+				}
+				
 				bw_read_aggregate(B, src_list->data + ix,
 										dst_array->type, bw);
 			}
@@ -1910,13 +3254,41 @@ bon_bool bw_read_aggregate(bon_r_doc* B, bon_value* srcVal,
 			
 		case BON_VALUE_AGGREGATE: {
 			const bon_value_agg* agg = srcVal->u.agg;
+			
+			const bon_plan* plan = bon_r_cached_plan(B, &agg->type, dstType);
+			if (plan) {
+				return bw_run_plan(B, plan, agg, bw);
+			}
+			
+			const uint8_t* data = bon_agg_payload(agg);
+			if (!data) {
+				return BON_FALSE;
+			}
+			
 			bon_size byteSize = bon_aggregate_payload_size(&agg->type);
-			bon_reader br = make_br( B, agg->data, byteSize, BON_BAD_BLOCK_ID );
+			bon_reader br = make_br( B, data, byteSize, BON_BAD_BLOCK_ID );
 			bon_bool win = translate_aggregate(B, &agg->type, &br, dstType, bw);
 			return win && br.error==0;
 		}
 			
 			
+		case BON_VALUE_TABLE: {
+			const bon_value_table* table = srcVal->u.table;
+			if (dstType->id != BON_TYPE_ARRAY || dstType->u.array->size != table->num_rows) {
+				return BON_FALSE;
+			}
+			
+			// Like a list of objects, but the rows are only made one at a time:
+			for (bon_size ix=0; ix<table->num_rows; ++ix) {
+				bon_value row;
+				bon_table_make_row(B, table, ix, &row);
+				bw_read_aggregate(B, &row, dstType->u.array->type, bw);
+				bon_free_value_insides(&row);
+			}
+			return bw->nbytes == 0 && bw->error == 0;
+		}
+			
+			
 		case BON_VALUE_BLOCK_REF: {
 			bon_value* val = bon_r_get_block(B, srcVal->u.blockRefId );
 			if (val) {
@@ -1964,11 +3336,22 @@ bon_bool bon_r_unpack(bon_r_doc* B, bon_value* srcVal,
 								 void* dst, bon_size nbytes,
 								 const bon_type* dstType)
 {
+	bon_value* val = bon_r_follow_refs(B, srcVal);
+	if (val && val->type == BON_VALUE_AGGREGATE && val->u.agg->encoded && !val->u.agg->data
+		 && bon_type_eq(&val->u.agg->type, dstType)
+		 && nbytes == bon_aggregate_payload_size(dstType))
+	{
+		// Decode straight into the destination
+		const bon_value_agg* agg = val->u.agg;
+		return bon_ints_decode(agg->encoded, agg->encoded_size, agg->codec,
+									  agg->type.u.array->type->id, dst, agg->type.u.array->size);
+	}
+	
 	const void* src = bon_r_unpack_ptr(B, srcVal, nbytes, dstType);
 	
 	if (src) {
 		// Perfectly matching types
-		memcpy(dst, src, nbytes);
+		bon_r_copy(B, dst, src, nbytes);
 		return BON_TRUE;
 	} else {
 		bon_size expected = bon_aggregate_payload_size(dstType);
@@ -1990,14 +3373,17 @@ bon_bool bon_r_unpack_fmt(bon_r_doc* B, bon_value* srcVal,
 {
 	va_list ap;
 	va_start(ap, fmt);
-	bon_type* type = bon_new_type_fmt_ap(&fmt, &ap);
+	bon_bool cached;
+	bon_type* type = bon_fmt_type_ap(fmt, &ap, &cached);
 	va_end(ap);
 	
 	if (!type) {
 		return BON_FALSE;
 	}
 	bon_bool win = bon_r_unpack(B, srcVal, dst, nbytes, type);
-	bon_free_type(type);
+	if (!cached) {
+		bon_free_type(type);
+	}
 	
 	return win;
 }
@@ -2018,7 +3404,7 @@ const void* bon_r_unpack_ptr(bon_r_doc* B, bon_value* val,
 	}
 	
 	// All win
-	return val->u.agg->data;
+	return bon_agg_payload(val->u.agg);
 }
 
 const void* bon_r_unpack_ptr_fmt(bon_r_doc* B, bon_value* val,
@@ -2026,7 +3412,8 @@ const void* bon_r_unpack_ptr_fmt(bon_r_doc* B, bon_value* val,
 {
 	va_list ap;
 	va_start(ap, fmt);
-	bon_type* type = bon_new_type_fmt_ap(&fmt, &ap);
+	bon_bool cached;
+	bon_type* type = bon_fmt_type_ap(fmt, &ap, &cached);
 	va_end(ap);
 	
 	if (!type) {
@@ -2034,11 +3421,25 @@ const void* bon_r_unpack_ptr_fmt(bon_r_doc* B, bon_value* val,
 	}
 	
 	const void* ptr = bon_r_unpack_ptr(B, val, nbytes, type);
-	bon_free_type(type);
+	if (!cached) {
+		bon_free_type(type);
+	}
 	
 	return ptr;
 }
 
+// Largest alignment we report. Enough for mapping pages.
+#define BON_MAX_PAYLOAD_ALIGN 4096
+
+bon_size bon_r_payload_align(bon_r_doc* B, bon_value* val)
+{
+	val = bon_r_follow_refs(B, val);
+	if (!val || val->type != BON_VALUE_AGGREGATE) { return 0; }
+	
+	uintptr_t addr = (uintptr_t)bon_agg_payload(val->u.agg) | BON_MAX_PAYLOAD_ALIGN;
+	return (bon_size)(addr & (~addr + 1));
+}
+
 
 // Quick access to a pointer e.g. pointer of bytes or floats
 const void* bon_r_unpack_array(bon_r_doc* B, bon_value* val,
@@ -2056,5 +3457,354 @@ const void* bon_r_unpack_array(bon_r_doc* B, bon_value* val,
 	if (arr->type->id != type)  { return NULL; }
 	if (arr->size != nelem)     { return NULL; }
 	
-	return agg->data; // Win
+	return bon_agg_payload(agg); // Win
+}
+
+bon_bool bon_r_unpack_unorm8(bon_r_doc* B, bon_value* srcVal,
+									  float* dst, bon_size nelem)
+{
+	const uint8_t* src = (const uint8_t*)bon_r_unpack_array(B, srcVal, nelem, BON_TYPE_UINT8);
+	if (!src) {
+		return BON_FALSE;
+	}
+	
+	return bon_unorm8_kernel()(src, dst, nelem);
+}
+
+
+bon_plan* bon_r_new_plan(bon_r_doc* B, bon_value* srcVal, const bon_type* dstType)
+{
+	srcVal = bon_r_follow_refs(B, srcVal);
+	if (!srcVal || srcVal->type != BON_VALUE_AGGREGATE) {
+		return NULL;
+	}
+	
+	return bon_new_plan(&srcVal->u.agg->type, dstType);
+}
+
+bon_bool bon_r_unpack_plan(bon_r_doc* B, bon_value* srcVal,
+									void* dst, bon_size nbytes, const bon_plan* plan)
+{
+	srcVal = bon_r_follow_refs(B, srcVal);
+	if (!srcVal || srcVal->type != BON_VALUE_AGGREGATE) {
+		return BON_FALSE;
+	}
+	
+	if (nbytes != plan->dst_size) {
+		fprintf(stderr, "destination type and buffer size does not match. Expected %d, got %d\n", (int)plan->dst_size, (int)nbytes);
+		return BON_FALSE;
+	}
+	
+	bon_writer bw = {(uint8_t*)dst, nbytes, BON_SUCCESS};
+	return bw_run_plan(B, plan, srcVal->u.agg, &bw) && bw.nbytes==0;
+}
+
+void bon_free_plan(bon_plan* plan)
+{
+	if (plan) {
+		free(plan->ops);
+		free(plan);
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// Array of structs -> struct of arrays
+
+
+// Elements per block: the source block stays in cache while each field is pulled out of it.
+#define BON_SOA_BLOCK 256
+
+typedef struct {
+	bon_size     src_offset;  // Of the field, within a source struct
+	bon_size     src_size;
+	uint8_t*     dst;
+	bon_size     dst_stride;
+	bon_plan*    plan;        // Field -> destination element
+	bon_bool     copy;        // The plan is one memcpy
+	bon_cast_fn  cast;        // If set: gather a block into a temporary, then cast it in one go
+	bon_size     ncast;       // Numbers per element for 'cast'
+} bon_soa_out;
+
+typedef struct {
+	bon_r_doc*      B;
+	const uint8_t*  src;
+	bon_size        src_stride;
+	bon_size        nelem;
+	bon_soa_out*    outs;
+	bon_size        nouts;
+	bon_size        tmp_size;  // Bytes of temporary needed per block
+	unsigned        nparts;
+	bon_bool*       results;   // One per part
+} bon_soa_job;
+
+// The number type and count of a number or an array of numbers, else false.
+static bon_bool bon_soa_numbers(const bon_type* type, bon_type_id* out_id, bon_size* out_n)
+{
+	if (type->id == BON_TYPE_ARRAY) {
+		*out_id = type->u.array->type->id;
+		*out_n  = type->u.array->size;
+	} else {
+		*out_id = type->id;
+		*out_n  = 1;
+	}
+	return bon_is_number_type(*out_id);
+}
+
+// memcpy with the common small sizes spelled out, so they become plain (vector) moves.
+BON_INLINE void bon_soa_copy(uint8_t* dst, const uint8_t* src, bon_size n)
+{
+	switch (n) {
+		case 4:   memcpy(dst, src, 4);   break;
+		case 8:   memcpy(dst, src, 8);   break;
+		case 12:  memcpy(dst, src, 12);  break;
+		case 16:  memcpy(dst, src, 16);  break;
+		default:  memcpy(dst, src, n);   break;
+	}
+}
+
+static bon_bool bon_soa_run(const bon_soa_job* job, bon_size begin, bon_size end)
+{
+	uint8_t* tmp = (job->tmp_size ? BON_ALLOC_TYPE(job->tmp_size, uint8_t) : NULL);
+	bon_bool win = BON_TRUE;
+	
+	for (bon_size b=begin; b<end && win; b+=BON_SOA_BLOCK) {
+		bon_size e = (b + BON_SOA_BLOCK < end ? b + BON_SOA_BLOCK : end);
+		
+		for (bon_size fi=0; fi<job->nouts && win; ++fi) {
+			const bon_soa_out* out = &job->outs[fi];
+			const uint8_t*     src = job->src + out->src_offset;
+			
+			if (out->copy) {
+				for (bon_size ei=b; ei<e; ++ei) {
+					bon_soa_copy(out->dst + ei * out->dst_stride, src + ei * job->src_stride, out->src_size);
+				}
+			} else if (out->cast) {
+				// Transpose the block into 'tmp', then convert it with the (SIMD) cast kernel:
+				for (bon_size ei=b; ei<e; ++ei) {
+					bon_soa_copy(tmp + (ei - b) * out->src_size, src + ei * job->src_stride, out->src_size);
+				}
+				if (!out->cast(tmp, out->dst + b * out->dst_stride, (e - b) * out->ncast)) {
+					bon_onError(bon_err_str(BON_ERR_NARROWING));
+					win = BON_FALSE;
+				}
+			} else {
+				for (bon_size ei=b; ei<e && win; ++ei) {
+					win = bon_plan_run(job->B, out->plan->ops, out->plan->nops,
+											 src + ei * job->src_stride, out->dst + ei * out->dst_stride);
+				}
+			}
+		}
+	}
+	
+	free(tmp);
+	return win;
+}
+
+static void bon_soa_task(void* user, unsigned part)
+{
+	bon_soa_job* job = (bon_soa_job*)user;
+	
+	bon_size per = (job->nelem + job->nparts - 1) / job->nparts;
+	per = (per + BON_SOA_BLOCK - 1) / BON_SOA_BLOCK * BON_SOA_BLOCK;
+	
+	bon_size begin = part * per;
+	bon_size end   = begin + per;
+	if (begin > job->nelem)  { begin = job->nelem; }
+	if (end   > job->nelem)  { end   = job->nelem; }
+	
+	job->results[part] = bon_soa_run(job, begin, end);
+}
+
+// The aggregate of a packed array, else NULL.
+static const bon_value_agg* bon_r_packed_array(bon_r_doc* B, bon_value* val)
+{
+	val = bon_r_follow_refs(B, val);
+	if (!val || val->type != BON_VALUE_AGGREGATE || val->u.agg->type.id != BON_TYPE_ARRAY) {
+		return NULL;
+	}
+	return val->u.agg;
+}
+
+// Unpacks elements [begin, end) of the array of structs 'agg'.
+static bon_bool bon_soa_unpack(bon_r_doc* B, const bon_value_agg* agg,
+										 bon_size begin, bon_size end,
+										 const bon_soa_field* fields, bon_size nfields)
+{
+	const bon_type_array* arr = agg->type.u.array;
+	if (arr->type->id != BON_TYPE_STRUCT || begin > end || end > arr->size) {
+		return BON_FALSE;
+	}
+	
+	const uint8_t* data = bon_agg_payload(agg);
+	if (!data) {
+		return BON_FALSE;
+	}
+	
+	const bon_type_struct* strct = arr->type->u.strct;
+	bon_size nelem = end - begin;
+	
+	bon_soa_job job;
+	memset(&job, 0, sizeof(job));
+	job.B          = B;
+	job.src_stride = bon_struct_payload_size(strct);
+	job.src        = data + begin * job.src_stride;
+	job.nelem      = nelem;
+	job.outs       = BON_CALLOC_TYPE(nfields, bon_soa_out);
+	
+	bon_bool win = BON_TRUE;
+	bon_size dst_bytes = 0;
+	
+	for (bon_size fi=0; fi<nfields && win; ++fi) {
+		const bon_soa_field* field = &fields[fi];
+		bon_soa_out*         out   = &job.outs[fi];
+		
+		// Find the field:
+		const bon_type* src_type = NULL;
+		bon_size offset = 0;
+		for (bon_size ki=0; ki<strct->size; ++ki) {
+			if (strcmp(strct->kts[ki].key, field->key) == 0) {
+				src_type = &strct->kts[ki].type;
+				break;
+			}
+			offset += bon_aggregate_payload_size(&strct->kts[ki].type);
+		}
+		
+		if (!src_type) {
+			win = BON_FALSE; // Source lacked key
+			break;
+		}
+		
+		bon_size dst_size = bon_aggregate_payload_size(field->type);
+		
+		out->src_offset = offset;
+		out->src_size   = bon_aggregate_payload_size(src_type);
+		out->dst        = (uint8_t*)field->dst;
+		out->dst_stride = (field->stride ? field->stride : dst_size);
+		out->plan       = bon_new_plan(src_type, field->type);
+		job.nouts      += 1;
+		dst_bytes      += nelem * dst_size;
+		
+		if (!out->plan) {
+			win = BON_FALSE;
+			break;
+		}
+		
+		const bon_op* op0 = &out->plan->ops[0];
+		out->copy = (out->plan->nops == 1 && op0->code == BON_OP_COPY && op0->count == out->src_size);
+		
+		bon_type_id src_id, dst_id;
+		bon_size    src_n,  dst_n;
+		if (!out->copy && out->dst_stride == dst_size &&
+			 bon_soa_numbers(src_type,    &src_id, &src_n) &&
+			 bon_soa_numbers(field->type, &dst_id, &dst_n) && src_n == dst_n)
+		{
+			out->cast  = bon_cast_kernel(src_id, dst_id);
+			out->ncast = src_n;
+			if (out->cast && job.tmp_size < BON_SOA_BLOCK * out->src_size) {
+				job.tmp_size = BON_SOA_BLOCK * out->src_size;
+			}
+		}
+	}
+	
+	if (win) {
+		if (B->num_threads > 1 && dst_bytes >= BON_PARALLEL_MIN_BYTES) {
+			if (!B->pool) {
+				B->pool = bon_new_pool(B->num_threads - 1);
+			}
+			job.nparts  = B->num_threads;
+			job.results = BON_ALLOC_TYPE(job.nparts, bon_bool);
+			bon_pool_run(B->pool, job.nparts, bon_soa_task, &job);
+			for (unsigned pi=0; pi<job.nparts; ++pi) {
+				win = win && job.results[pi];
+			}
+			free(job.results);
+		} else {
+			win = bon_soa_run(&job, 0, nelem);
+		}
+	}
+	
+	for (bon_size fi=0; fi<job.nouts; ++fi) {
+		bon_free_plan(job.outs[fi].plan);
+	}
+	free(job.outs);
+	return win;
+}
+
+bon_bool bon_r_unpack_soa(bon_r_doc* B, bon_value* srcVal, bon_size nelem,
+								  const bon_soa_field* fields, bon_size nfields)
+{
+	const bon_value_agg* agg = bon_r_packed_array(B, srcVal);
+	if (!agg || agg->type.u.array->size != nelem) {
+		return BON_FALSE;
+	}
+	
+	return bon_soa_unpack(B, agg, 0, nelem, fields, nfields);
+}
+
+
+//------------------------------------------------------------------------------
+// Ranges and fields of packed arrays
+
+
+const void* bon_r_unpack_range_ptr(bon_r_doc* B, bon_value* srcVal,
+											  bon_size begin, bon_size end, const bon_type* elemType)
+{
+	const bon_value_agg* agg = bon_r_packed_array(B, srcVal);
+	if (!agg) { return NULL; }
+	
+	const bon_type_array* arr = agg->type.u.array;
+	if (begin > end || end > arr->size)        { return NULL; }
+	if (!bon_type_eq(arr->type, elemType))     { return NULL; }
+	
+	const uint8_t* data = bon_agg_payload(agg);
+	if (!data) { return NULL; }
+	
+	return data + begin * bon_aggregate_payload_size(arr->type);
+}
+
+bon_bool bon_r_unpack_range(bon_r_doc* B, bon_value* srcVal,
+									 bon_size begin, bon_size end,
+									 void* dst, bon_size nbytes, const bon_type* elemType)
+{
+	const bon_value_agg* agg = bon_r_packed_array(B, srcVal);
+	if (!agg) { return BON_FALSE; }
+	
+	const bon_type_array* arr = agg->type.u.array;
+	if (begin > end || end > arr->size) { return BON_FALSE; }
+	
+	bon_size n = end - begin;
+	bon_size expected = n * bon_aggregate_payload_size(elemType);
+	if (expected != nbytes) {
+		fprintf(stderr, "destination type and buffer size does not match. Expected %d, got %d\n", (int)expected, (int)nbytes);
+		return BON_FALSE;
+	}
+	
+	// Compile the slice as arrays of its own:
+	bon_type_array src_slice = { n, arr->type };
+	bon_type_array dst_slice = { n, (bon_type*)elemType };
+	bon_type src_type, dst_type;
+	src_type.id = BON_TYPE_ARRAY;  src_type.u.array = &src_slice;
+	dst_type.id = BON_TYPE_ARRAY;  dst_type.u.array = &dst_slice;
+	
+	bon_plan* plan = bon_new_plan(&src_type, &dst_type);
+	if (!plan) {
+		return BON_FALSE;
+	}
+	
+	const uint8_t* data = bon_agg_payload(agg);
+	bon_bool win = data && bon_plan_exec(B, plan, data + begin * bon_aggregate_payload_size(arr->type), (uint8_t*)dst);
+	bon_free_plan(plan);
+	return win;
+}
+
+bon_bool bon_r_unpack_field(bon_r_doc* B, bon_value* srcVal,
+									 bon_size begin, bon_size end, const char* key,
+									 void* dst, bon_size stride, const bon_type* fieldType)
+{
+	const bon_value_agg* agg = bon_r_packed_array(B, srcVal);
+	if (!agg) { return BON_FALSE; }
+	
+	bon_soa_field field = { key, fieldType, dst, stride };
+	return bon_soa_unpack(B, agg, begin, end, &field, 1);
 }
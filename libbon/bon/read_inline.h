@@ -64,7 +64,7 @@ BON_INLINE bon_bool bon_r_is_list(bon_r_doc* B, bon_value* val)
 {
 	val = bon_r_follow_refs(B, val);
 	if (!val) { return BON_FALSE; }
-	if (val->type == BON_VALUE_LIST) { return BON_TRUE; }
+	if (val->type == BON_VALUE_LIST || val->type == BON_VALUE_TABLE) { return BON_TRUE; }
 	if (val->type == BON_VALUE_AGGREGATE) {
 		const bon_value_agg* agg = val->u.agg;
 		return agg->type.id == BON_TYPE_ARRAY;
@@ -100,6 +100,7 @@ BON_INLINE bon_logical_type  bon_r_value_type(bon_r_doc* B, bon_value* val)
 		case BON_VALUE_DOUBLE:  { return BON_LOGICAL_DOUBLE; }
 		case BON_VALUE_STRING:  { return BON_LOGICAL_STRING; }
 		case BON_VALUE_LIST:    { return BON_LOGICAL_LIST; }
+		case BON_VALUE_TABLE:   { return BON_LOGICAL_LIST; }
 		case BON_VALUE_OBJ:     { return BON_LOGICAL_OBJECT; }
 			
 		case BON_VALUE_AGGREGATE: {
@@ -122,8 +123,18 @@ BON_INLINE bon_logical_type  bon_r_value_type(bon_r_doc* B, bon_value* val)
 //------------------------------------------------------------------------------
 
 
+/*
+ Converts a packed aggregate into a tree of lists, objects and numbers, cached in the aggregate.
+ That costs a bon_value per number, so it is only for callers that really want a tree.
+ The accessors below read aggregates in place.
+ */
 bon_value* bon_exploded_aggr(bon_r_doc* B, bon_value* val);
 
+// Elements of packed aggregates. NULL if out of range or of the wrong kind.
+bon_value* bon_r_agg_elem   (bon_r_doc* B, const bon_value_agg* agg, bon_size ix);
+bon_value* bon_r_agg_field  (bon_r_doc* B, const bon_value_agg* agg, bon_size ix);
+bon_value* bon_r_agg_get_key(bon_r_doc* B, const bon_value_agg* agg, const char* key);
+
 BON_INLINE bon_value* bon_r_follow_refs(bon_r_doc* B, bon_value* val)
 {
 	/* We should be protected from infinite recursion here,
@@ -137,19 +148,6 @@ BON_INLINE bon_value* bon_r_follow_refs(bon_r_doc* B, bon_value* val)
 }
 
 
-BON_INLINE bon_value* follow_and_explode(bon_r_doc* B, bon_value* val)
-{
-	val = bon_r_follow_refs(B, val);
-	
-	if (val && val->type == BON_VALUE_AGGREGATE) {
-		// If the user treats it like an object, convert it into one.
-		val = bon_exploded_aggr(B, val);
-	}
-	
-	return val;
-}
-
-
 //------------------------------------------------------------------------------
 
 BON_INLINE bon_bool bon_r_bool(bon_r_doc* B, bon_value* val)
@@ -256,6 +254,9 @@ BON_INLINE bon_size bon_r_list_size(bon_r_doc* B, bon_value* val)
 		case BON_VALUE_LIST:
 			return val->u.list.size;
 			
+		case BON_VALUE_TABLE:
+			return val->u.table->num_rows;
+			
 		case BON_VALUE_AGGREGATE: {
 			const bon_value_agg* agg = val->u.agg;
 			if (agg->type.id == BON_TYPE_ARRAY) {
@@ -273,7 +274,7 @@ BON_INLINE bon_size bon_r_list_size(bon_r_doc* B, bon_value* val)
 
 BON_INLINE bon_value* bon_r_list_elem(bon_r_doc* B, bon_value* val, bon_size ix)
 {
-	val = follow_and_explode(B, val);
+	val = bon_r_follow_refs(B, val);
 	if (!val) { return NULL; }
 	
 	if (val->type == BON_VALUE_LIST)
@@ -283,6 +284,14 @@ BON_INLINE bon_value* bon_r_list_elem(bon_r_doc* B, bon_value* val, bon_size ix)
 			return &vals->data[ ix ];
 		}
 	}
+	else if (val->type == BON_VALUE_AGGREGATE)
+	{
+		return bon_r_agg_elem(B, val->u.agg, ix);
+	}
+	else if (val->type == BON_VALUE_TABLE)
+	{
+		return bon_r_table_row(B, val->u.table, ix);
+	}
 	
 	return NULL;
 }
@@ -318,7 +327,15 @@ BON_INLINE bon_size bon_r_obj_size(bon_r_doc* B, bon_value* val)
 // Return NULL if 'val' is not an object, or ix is out of range.
 BON_INLINE const char* bon_r_obj_key(bon_r_doc* B, bon_value* val, bon_size ix)
 {
-	val = follow_and_explode(B, val);
+	val = bon_r_follow_refs(B, val);
+	
+	if (val && val->type == BON_VALUE_AGGREGATE) {
+		const bon_type* type = &val->u.agg->type;
+		if (type->id == BON_TYPE_STRUCT && ix < type->u.strct->size) {
+			return type->u.strct->kts[ix].key;
+		}
+		return NULL;
+	}
 	
 	if (!val || val->type != BON_VALUE_OBJ) {
 		return NULL;
@@ -334,7 +351,11 @@ BON_INLINE const char* bon_r_obj_key(bon_r_doc* B, bon_value* val, bon_size ix)
 
 BON_INLINE bon_value* bon_r_obj_value(bon_r_doc* B, bon_value* val, bon_size ix)
 {
-	val = follow_and_explode(B, val);
+	val = bon_r_follow_refs(B, val);
+	
+	if (val && val->type == BON_VALUE_AGGREGATE) {
+		return bon_r_agg_field(B, val->u.agg, ix);
+	}
 	
 	if (!val || val->type != BON_VALUE_OBJ) {
 		return NULL;
@@ -351,7 +372,11 @@ BON_INLINE bon_value* bon_r_obj_value(bon_r_doc* B, bon_value* val, bon_size ix)
 
 BON_INLINE bon_value* bon_r_get_key(bon_r_doc* B, bon_value* val, const char* key)
 {
-	val = follow_and_explode(B, val);
+	val = bon_r_follow_refs(B, val);
+	
+	if (val && val->type == BON_VALUE_AGGREGATE) {
+		return bon_r_agg_get_key(B, val->u.agg, key);
+	}
 	
 	if (!val || val->type != BON_VALUE_OBJ) {
 		return NULL;
@@ -6,12 +6,23 @@
 //  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
 //  This is free software, under the MIT license (see LICENSE.txt for details).
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200809L  // pthreads
+#endif
+
 #include "bon.h"
 #include "private.h"
 #include <inttypes.h>
 #include <stdlib.h>       // malloc, free, calloc
 #include <stdarg.h>       // va_list, va_start, va_arg, va_end
-#include <string.h>       // strcmp
+#include <string.h>       // strcmp, strncmp
+
+#if !defined(_WIN32)
+#  define BON_HAS_PTHREADS 1
+#  include <pthread.h>
+#else
+#  define BON_HAS_PTHREADS 0
+#endif
 
 
 
@@ -197,11 +208,19 @@ bon_type* bon_new_type_fmt_ap(const char** fmt, va_list* ap)
 			
 		case 'b': {
 			++*fmt;
+			if (strncmp(*fmt, "f16", 3) == 0) {
+				*fmt += 3;
+				return bon_new_type_simple(BON_TYPE_BF16);
+			}
 			return bon_new_type_simple(BON_TYPE_BOOL);
 		}
 			
 		case 'f': {
 			++*fmt;
+			if (strncmp(*fmt, "16", 2) == 0) {
+				*fmt += 2;
+				return bon_new_type_simple(BON_TYPE_HALF);
+			}
 			return bon_new_type_simple(BON_TYPE_FLOAT);
 		}
 			
@@ -251,6 +270,235 @@ bon_type* bon_new_type_fmt(const char* fmt, ...)
 	return type;
 }
 
+
+//------------------------------------------------------------------------------
+// Cache of the types built by the *_fmt functions
+
+
+#ifdef BON_THREAD_LOCAL
+
+#define BON_FMT_CACHE_SIZE  16
+#define BON_FMT_MAX_ARGS    32
+
+typedef union {
+	bon_size     size;  // #
+	const char*  key;   // $
+} bon_fmt_arg;
+
+typedef struct {
+	char*        fmt;    // Owned copy. NULL if the entry is unused.
+	bon_size     nargs;
+	bon_fmt_arg  args[BON_FMT_MAX_ARGS];  // Keys point into 'keys'
+	char*        keys;   // Owned copies of the keys
+	bon_type*    type;   // Keys point into 'keys'
+} bon_fmt_entry;
+
+typedef struct {
+	bon_fmt_entry  entries[BON_FMT_CACHE_SIZE];
+	bon_size       next;        // Round-robin eviction
+	bon_bool       registered;  // For clearing at thread exit
+} bon_fmt_cache;
+
+static BON_THREAD_LOCAL bon_fmt_cache s_fmt_cache;
+
+#if BON_HAS_PTHREADS
+static pthread_key_t   s_fmt_cache_key;
+static pthread_once_t  s_fmt_cache_once = PTHREAD_ONCE_INIT;
+
+static void bon_fmt_cache_at_exit(void* unused)
+{
+	(void)unused;
+	bon_fmt_cache_clear();
+}
+
+static void bon_fmt_cache_make_key(void)
+{
+	pthread_key_create(&s_fmt_cache_key, bon_fmt_cache_at_exit);
+}
+#endif
+
+// Makes sure the calling thread's cache is freed when it exits.
+static void bon_fmt_cache_register(bon_fmt_cache* cache)
+{
+	if (cache->registered) { return; }
+	cache->registered = BON_TRUE;
+#if BON_HAS_PTHREADS
+	pthread_once(&s_fmt_cache_once, bon_fmt_cache_make_key);
+	pthread_setspecific(s_fmt_cache_key, cache); // Any non-NULL value makes the destructor run
+#endif
+}
+
+/*
+ Reads the arguments that 'fmt' consumes.
+ Returns false if there are too many to cache.
+ */
+static bon_bool bon_fmt_read_args(const char* fmt, va_list* ap,
+											 bon_fmt_arg* args, bon_size* out_nargs)
+{
+	bon_size n = 0;
+	for (; *fmt; ++fmt) {
+		if (*fmt == '#' || *fmt == '$') {
+			if (n == BON_FMT_MAX_ARGS) {
+				return BON_FALSE;
+			}
+			if (*fmt == '#') {
+				args[n++].size = va_arg(*ap, bon_size);
+			} else {
+				args[n++].key  = va_arg(*ap, const char*);
+			}
+		}
+	}
+	*out_nargs = n;
+	return BON_TRUE;
+}
+
+static bon_bool bon_fmt_entry_matches(const bon_fmt_entry* e, const char* fmt,
+												  const bon_fmt_arg* args, bon_size nargs)
+{
+	if (!e->fmt || e->nargs != nargs || strcmp(e->fmt, fmt) != 0) {
+		return BON_FALSE;
+	}
+	
+	bon_size ai = 0;
+	for (const char* f = fmt; *f; ++f) {
+		if (*f == '#') {
+			if (e->args[ai].size != args[ai].size) { return BON_FALSE; }
+			++ai;
+		} else if (*f == '$') {
+			if (strcmp(e->args[ai].key, args[ai].key) != 0) { return BON_FALSE; }
+			++ai;
+		}
+	}
+	return BON_TRUE;
+}
+
+// Point the keys of 't' (in format order) to 'keys'.
+static void bon_type_set_keys(bon_type* t, const char*** keys)
+{
+	if (t->id == BON_TYPE_ARRAY) {
+		bon_type_set_keys(t->u.array->type, keys);
+	} else if (t->id == BON_TYPE_STRUCT) {
+		for (bon_size ki=0; ki<t->u.strct->size; ++ki) {
+			bon_kt* kt = &t->u.strct->kts[ki];
+			kt->key = **keys;
+			++*keys;
+			bon_type_set_keys(&kt->type, keys);
+		}
+	}
+}
+
+static void bon_fmt_entry_free(bon_fmt_entry* e)
+{
+	if (e->type) { bon_free_type(e->type); }
+	free(e->fmt);
+	free(e->keys);
+	memset(e, 0, sizeof(bon_fmt_entry));
+}
+
+// Takes ownership of 'type'
+static void bon_fmt_entry_set(bon_fmt_entry* e, const char* fmt,
+										const bon_fmt_arg* args, bon_size nargs, bon_type* type)
+{
+	bon_fmt_entry_free(e);
+	
+	size_t fmt_len = strlen(fmt);
+	e->fmt = BON_ALLOC_TYPE(fmt_len + 1, char);
+	memcpy(e->fmt, fmt, fmt_len + 1);
+	
+	// Copy the keys, so the user may free theirs:
+	size_t keys_len = 0;
+	bon_size ai = 0;
+	for (const char* f = fmt; *f; ++f) {
+		if (*f == '$') { keys_len += strlen(args[ai].key) + 1; }
+		if (*f == '$' || *f == '#') { ++ai; }
+	}
+	
+	e->keys  = BON_ALLOC_TYPE(keys_len + 1, char);
+	e->nargs = nargs;
+	
+	const char* key_ptrs[BON_FMT_MAX_ARGS]; // In format order
+	bon_size nkeys = 0;
+	char* dst = e->keys;
+	ai = 0;
+	for (const char* f = fmt; *f; ++f) {
+		if (*f == '#') {
+			e->args[ai].size = args[ai].size;
+			++ai;
+		} else if (*f == '$') {
+			size_t len = strlen(args[ai].key);
+			memcpy(dst, args[ai].key, len + 1);
+			e->args[ai].key   = dst;
+			key_ptrs[nkeys++] = dst;
+			dst += len + 1;
+			++ai;
+		}
+	}
+	
+	const char** key_it = key_ptrs;
+	bon_type_set_keys(type, &key_it);
+	e->type = type;
+}
+
+bon_type* bon_fmt_type_ap(const char* fmt, va_list* ap, bon_bool* out_cached)
+{
+	bon_fmt_arg args[BON_FMT_MAX_ARGS];
+	bon_size nargs;
+	
+	va_list ap_args;
+	va_copy(ap_args, *ap);
+	bon_bool cacheable = bon_fmt_read_args(fmt, &ap_args, args, &nargs);
+	va_end(ap_args);
+	
+	if (cacheable) {
+		bon_fmt_cache* cache = &s_fmt_cache;
+		for (bon_size ei=0; ei<BON_FMT_CACHE_SIZE; ++ei) {
+			if (bon_fmt_entry_matches(&cache->entries[ei], fmt, args, nargs)) {
+				*out_cached = BON_TRUE;
+				return cache->entries[ei].type;
+			}
+		}
+	}
+	
+	const char* fmt_it = fmt;
+	bon_type* type = bon_new_type_fmt_ap(&fmt_it, ap);
+	
+	// Only cache if the whole format was one type (so all arguments are accounted for):
+	if (cacheable && type && *fmt_it == '\0') {
+		bon_fmt_cache* cache = &s_fmt_cache;
+		bon_fmt_cache_register(cache);
+		bon_fmt_entry_set(&cache->entries[cache->next], fmt, args, nargs, type);
+		cache->next = (cache->next + 1) % BON_FMT_CACHE_SIZE;
+		*out_cached = BON_TRUE;
+	} else {
+		*out_cached = BON_FALSE;
+	}
+	
+	return type;
+}
+
+void bon_fmt_cache_clear(void)
+{
+	for (bon_size ei=0; ei<BON_FMT_CACHE_SIZE; ++ei) {
+		bon_fmt_entry_free(&s_fmt_cache.entries[ei]);
+	}
+	s_fmt_cache.next       = 0;
+	s_fmt_cache.registered = BON_FALSE;
+}
+
+#else // No thread-local storage: no cache
+
+bon_type* bon_fmt_type_ap(const char* fmt, va_list* ap, bon_bool* out_cached)
+{
+	*out_cached = BON_FALSE;
+	return bon_new_type_fmt_ap(&fmt, ap);
+}
+
+void bon_fmt_cache_clear(void)
+{
+}
+
+#endif
+
 bon_size bon_struct_payload_size(const bon_type_struct* strct)
 {
 	bon_size sum = 0;
@@ -283,6 +531,10 @@ bon_bool bon_type_eq(const bon_type* a, const bon_type* b)
 	if (!a || !b)        { return BON_FALSE; }
 	if (a->id != b->id)  { return BON_FALSE; }
 	
+	// Types parsed from the same document share their insides:
+	if (a->id == BON_TYPE_ARRAY  && a->u.array == b->u.array)  { return BON_TRUE; }
+	if (a->id == BON_TYPE_STRUCT && a->u.strct == b->u.strct)  { return BON_TRUE; }
+	
 	if (a->id == BON_TYPE_ARRAY) {
 		if (a->u.array->size != b->u.array->size)  { return BON_FALSE; }
 		return bon_type_eq(a->u.array->type, b->u.array->type);
@@ -314,6 +566,10 @@ uint64_t bon_type_size(bon_type_id t)
 		case BON_TYPE_SINT16_BE:
 		case BON_TYPE_UINT16_LE:
 		case BON_TYPE_UINT16_BE:
+		case BON_TYPE_HALF_LE:
+		case BON_TYPE_HALF_BE:
+		case BON_TYPE_BF16_LE:
+		case BON_TYPE_BF16_BE:
 			return 2;
 			
 		case BON_TYPE_SINT32_LE:
@@ -14,6 +14,11 @@
 #include <stdarg.h>       // va_list, va_start, va_arg, va_end
 #include <stdlib.h>       // malloc, free, realloc, calloc, ...
 
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>  // SSE2
+#  define BON_SSE2 1
+#endif
+
 
 //------------------------------------------------------------------------------
 
@@ -32,6 +37,16 @@ bon_bool bon_vec_writer(void* userData, const void* data, uint64_t nbytes) {
 }
 
 
+bon_bool bon_vec_patcher(void* userData, uint64_t back, const void* data, uint64_t nbytes) {
+	bon_byte_vec* vec = (bon_byte_vec*)userData;
+	if (back < nbytes || back > vec->size) {
+		return BON_FALSE;
+	}
+	memcpy(vec->data + vec->size - back, data, nbytes);
+	return BON_TRUE;
+}
+
+
 bon_bool bon_file_writer(void* user, const void* data, uint64_t nbytes)
 {
 	FILE* fp = (FILE*)user;
@@ -39,6 +54,17 @@ bon_bool bon_file_writer(void* user, const void* data, uint64_t nbytes)
 	return !ferror(fp);
 }
 
+bon_bool bon_file_patcher(void* user, uint64_t back, const void* data, uint64_t nbytes)
+{
+	FILE* fp = (FILE*)user;
+	if (back < nbytes || fseek(fp, -(long)back, SEEK_CUR) != 0) {
+		return BON_FALSE;
+	}
+	fwrite(data, 1, nbytes, fp);
+	fseek(fp, (long)(back - nbytes), SEEK_CUR);
+	return !ferror(fp);
+}
+
 
 //------------------------------------------------------------------------------
 
@@ -80,20 +106,82 @@ BON_INLINE void bon_write_to_writer(bon_w_doc* B, const void* data, bon_size n)
 	if (!B->writer(B->userData, data, n)) {
 		B->error = BON_ERR_WRITE_ERROR;
 	}
+	B->flushed += n;
 	
-	if (B->flags & BON_W_FLAG_CRC) {
+	if (B->flags & BON_W_FLAG_XXH64) {
+		xxh64_update(&B->xxh, (const uint8_t*)data, n);
+	} else if (B->flags & BON_W_FLAG_CRC) {
 		B->crc_inv = crc_update(B->crc_inv, (const uint8_t*)data, n);
 	}
+	
+	if (B->block_crc && B->block_crc_pos < B->flushed) {
+		// The part of it in the block payload:
+		bon_size skip = (B->block_crc_pos + n > B->flushed ? B->block_crc_pos + n - B->flushed : 0);
+		B->block_crc_inv = crc_update(B->block_crc_inv, (const uint8_t*)data + skip, n - skip);
+	}
 }
 
 void bon_w_flush(bon_w_doc* B) {
+	if (B->target != BON_W_TARGET_WRITER) {
+		return; // The buffer is the output (if any)
+	}
+	
 	if (B->buff_ix > 0) {
 		bon_write_to_writer(B, B->buff, B->buff_ix);
 		B->buff_ix = 0;
 	}
 }
 
+// Memory mode: make room for 'n' more bytes in 'buff'. Returns false on alloc fail.
+BON_INLINE bon_bool bon_w_mem_grow(bon_w_doc* B, bon_size n)
+{
+	if (B->buff_ix + n < B->buff_size) {
+		return BON_TRUE;
+	}
+	
+	// Keep one byte of slack, since bon_w_raw checks with '<'
+	bon_size new_size = 2 * B->buff_size;
+	if (new_size < B->buff_ix + n + 1) {
+		new_size = B->buff_ix + n + 1;
+	}
+	
+	uint8_t* new_buff = (uint8_t*)realloc(B->buff, new_size);
+	if (!new_buff) {
+		bon_w_set_error(B, BON_ERR_WRITE_ERROR);
+		return BON_FALSE;
+	}
+	
+	B->buff      = new_buff;
+	B->buff_size = new_size;
+	return BON_TRUE;
+}
+
 void bon_w_raw_flush_buff(bon_w_doc* B, const void* data, bon_size bs) {
+	switch (B->target) {
+		case BON_W_TARGET_WRITER:
+			break;
+			
+		case BON_W_TARGET_MEMORY:
+			if (bon_w_mem_grow(B, bs)) {
+				memcpy(B->buff + B->buff_ix, data, bs);
+				B->buff_ix += bs;
+			}
+			return;
+			
+		case BON_W_TARGET_FIXED:
+			if (B->buff_ix + bs <= B->buff_size) {
+				memcpy(B->buff + B->buff_ix, data, bs);
+				B->buff_ix += bs;
+			} else {
+				bon_w_set_error(B, BON_ERR_WRITE_ERROR);
+			}
+			return;
+			
+		case BON_W_TARGET_MEASURE:
+			B->buff_ix += bs;
+			return;
+	}
+	
 	if (!B->buff) {
 		// Unbuffered
 		bon_write_to_writer(B, data, bs);
@@ -143,10 +231,29 @@ void bon_w_header(bon_w_doc* B)
 
 void bon_w_footer(bon_w_doc* B)
 {
-	if (B->flags & BON_W_FLAG_CRC)
+	if (B->flags & BON_W_FLAG_XXH64)
 	{
-		// Add contribution of buffered data:
-		B->crc_inv = crc_update(B->crc_inv, B->buff, B->buff_ix);
+		if (B->target != BON_W_TARGET_MEASURE) {
+			// Add contribution of buffered data:
+			xxh64_update(&B->xxh, B->buff, B->buff_ix);
+		}
+		
+		uint8_t hash_le[8];
+		uint64_t hash = xxh64_digest(&B->xxh);
+		for (int i=0; i<8; ++i) {
+			hash_le[i] = (uint8_t)(hash >> (8 * i));
+		}
+		
+		bon_w_raw_uint8 (B, BON_CTRL_FOOTER_XXH64);
+		bon_w_raw       (B, hash_le, 8);
+		bon_w_raw_uint8 (B, BON_CTRL_FOOTER_XXH64);
+	}
+	else if (B->flags & BON_W_FLAG_CRC)
+	{
+		if (B->target != BON_W_TARGET_MEASURE) {
+			// Add contribution of buffered data:
+			B->crc_inv = crc_update(B->crc_inv, B->buff, B->buff_ix);
+		}
 		
 		uint32_t crc = B->crc_inv ^ 0xffffffff;
 		uint32_t crc_le = uint32_to_le(crc);
@@ -162,68 +269,367 @@ void bon_w_footer(bon_w_doc* B)
 }
 
 bon_w_doc* bon_w_new(bon_w_writer_t writer, void* userData, bon_w_flags flags)
+{
+	return bon_w_new_sized(writer, userData, flags, BON_W_DEFAULT_BUFF_SIZE);
+}
+
+bon_w_doc* bon_w_new_sized(bon_w_writer_t writer, void* userData, bon_w_flags flags,
+									bon_size buff_size)
 {
 	bon_w_doc* B = BON_CALLOC_TYPE(1, bon_w_doc);
+	
+	if (buff_size > 0) {
+		B->buff      = malloc(buff_size);
+		B->buff_size = buff_size;
+	} else {
+		// Unbuffered. Slower.
+		B->buff      = NULL;
+		B->buff_size = 0;
+	}
+	
+	bon_w_reset(B, writer, userData, flags);
+	
+	return B;
+}
+
+bon_w_doc* bon_w_new_mem(bon_w_flags flags)
+{
+	return bon_w_new_sized(NULL, NULL, flags, BON_W_DEFAULT_MEM_SIZE);
+}
+
+bon_w_doc* bon_w_new_measure(bon_w_flags flags)
+{
+	bon_w_doc* B = BON_CALLOC_TYPE(1, bon_w_doc);
+	B->target = BON_W_TARGET_MEASURE;
+	bon_w_reset(B, NULL, NULL, flags);
+	return B;
+}
+
+bon_w_doc* bon_w_new_fixed(void* dst, bon_size capacity, bon_w_flags flags)
+{
+	bon_w_doc* B = BON_CALLOC_TYPE(1, bon_w_doc);
+	B->target    = BON_W_TARGET_FIXED;
+	B->buff      = (uint8_t*)dst;
+	B->buff_size = capacity;
+	bon_w_reset(B, NULL, NULL, flags);
+	return B;
+}
+
+void bon_w_reset(bon_w_doc* B, bon_w_writer_t writer, void* userData, bon_w_flags flags)
+{
+	if (writer) {
+		if (B->target == BON_W_TARGET_FIXED || B->target == BON_W_TARGET_MEASURE) {
+			// The user's buffer (or none) is no write buffer of ours, so get one:
+			B->buff      = malloc(BON_W_DEFAULT_BUFF_SIZE);
+			B->buff_size = BON_W_DEFAULT_BUFF_SIZE;
+		}
+		B->target = BON_W_TARGET_WRITER;
+	} else if (B->target == BON_W_TARGET_WRITER) {
+		B->target = BON_W_TARGET_MEMORY;
+	} // else: keep memory/fixed/measure mode
+	
 	B->writer    = writer;
+	B->patcher   = NULL;
 	B->userData  = userData;
+	B->buff_ix   = 0;
+	B->flushed   = 0;
+	B->block_patch = BON_FALSE;
+	B->block_crc   = BON_FALSE;
 	B->crc_inv   = 0xffffffff;
+	xxh64_reset(&B->xxh, 0);
 	B->error     = BON_SUCCESS;
 	B->flags     = flags;
 	
-#if 0
-	// Slower.
-	B->buff      = NULL;
-	B->buff_ix   = 0;
-	B->buff_size = 0;
-#else
-	const unsigned BUFF_SIZE = 64*1024;
-	B->buff      = malloc(BUFF_SIZE);
-	B->buff_ix   = 0;
-	B->buff_size = BUFF_SIZE;
-#endif
-	
 	if ((B->flags & BON_W_FLAG_SKIP_HEADER_FOOTER) == 0) {
 		bon_w_header(B);
 	}
-	
-	return B;
 }
 
-bon_error bon_w_close(bon_w_doc* B)
+bon_error bon_w_finish(bon_w_doc* B)
 {
 	if ((B->flags & BON_W_FLAG_SKIP_HEADER_FOOTER) == 0) {
 		bon_w_footer(B);
 	}
 	bon_w_flush(B);
-	bon_error err = B->error;
-	free(B->buff);
+	return B->error;
+}
+
+const uint8_t* bon_w_mem_data(const bon_w_doc* B, bon_size* out_size)
+{
+	bon_bool in_mem = (B->target == BON_W_TARGET_MEMORY || B->target == BON_W_TARGET_FIXED);
+	if (out_size) {
+		*out_size = (in_mem ? B->buff_ix : 0);
+	}
+	return (in_mem ? B->buff : NULL);
+}
+
+bon_size bon_w_size(const bon_w_doc* B)
+{
+	return B->flushed + B->buff_ix;
+}
+
+uint8_t* bon_w_mem_take(bon_w_doc* B, bon_size* out_size)
+{
+	if (B->target != BON_W_TARGET_MEMORY) {
+		if (out_size) { *out_size = 0; }
+		return NULL;
+	}
+	
+	uint8_t* data = B->buff;
+	if (out_size) { *out_size = B->buff_ix; }
+	
+	B->buff      = NULL;
+	B->buff_size = 0;
+	B->buff_ix   = 0;
+	
+	return data;
+}
+
+void bon_w_free(bon_w_doc* B)
+{
+	if (B->target != BON_W_TARGET_FIXED) {
+		free(B->buff);  // Fixed buffers belong to the user
+	}
 	free(B);
+}
+
+bon_error bon_w_close(bon_w_doc* B)
+{
+	bon_error err = bon_w_finish(B);
+	bon_w_free(B);
 	return err;
 }
 
+// With BON_W_FLAG_BLOCK_CRC: start hashing the payload, which starts here.
+BON_INLINE void bon_w_block_crc_begin(bon_w_doc* B)
+{
+	if (B->flags & BON_W_FLAG_BLOCK_CRC) {
+		B->block_crc     = BON_TRUE;
+		B->block_crc_pos = bon_w_size(B);
+		B->block_crc_inv = 0xffffffff;
+	}
+}
+
+// Ends a block, with its crc if it has one.
+static void bon_w_block_close(bon_w_doc* B)
+{
+	if (!B->block_crc) {
+		bon_w_raw_uint8(B, BON_CTRL_BLOCK_END);
+		return;
+	}
+	
+	B->block_crc = BON_FALSE;
+	
+	if (B->target != BON_W_TARGET_MEASURE) {
+		// Add the contribution of the buffered part:
+		bon_size skip = (B->block_crc_pos > B->flushed ? B->block_crc_pos - B->flushed : 0);
+		if (skip < B->buff_ix) {
+			B->block_crc_inv = crc_update(B->block_crc_inv, B->buff + skip, B->buff_ix - skip);
+		}
+	}
+	
+	bon_w_raw_uint8 (B, BON_CTRL_BLOCK_END_CRC);
+	bon_w_raw_uint32(B, uint32_to_le(B->block_crc_inv ^ 0xffffffff));
+	bon_w_raw_uint8 (B, BON_CTRL_BLOCK_END_CRC);
+}
+
 void bon_w_begin_block_sized(bon_w_doc* B, bon_block_id block_id, bon_size nbytes)
 {
 	bon_w_ctrl_vlq(B, BON_CTRL_BLOCK_BEGIN, block_id);
 	bon_w_vlq(B, nbytes);
+	bon_w_block_crc_begin(B);
+}
+
+void bon_w_set_patcher(bon_w_doc* B, bon_w_patcher_t patcher)
+{
+	B->patcher = patcher;
+}
+
+// Width of the size field reserved by bon_w_block_begin. Good for blocks up to 32 GiB.
+#define BON_BLOCK_SIZE_LEN 5
+
+// Write 'x' as a VLQ padded with leading zero-groups to exactly 'len' bytes.
+BON_INLINE void bon_vlq_padded_to(uint8_t* out, bon_size x, uint32_t len)
+{
+	for (int i = (int)len - 1; i >= 0; --i) {
+		out[i] = (uint8_t)((x & 0x7f) | 0x80);
+		x >>= 7;
+	}
+	out[len - 1] &= 0x7f; // Remove last flag
+}
+
+// Write 'x' as a VLQ padded to exactly BON_BLOCK_SIZE_LEN bytes.
+// Too large values are written as 0 (unknown size), which is still a valid block.
+BON_INLINE void bon_block_size_to(uint8_t* out, bon_size x)
+{
+	if (x >= (1ULL << (7 * BON_BLOCK_SIZE_LEN))) {
+		x = 0;
+	}
+	bon_vlq_padded_to(out, x, BON_BLOCK_SIZE_LEN);
 }
 
 void bon_w_block_begin(bon_w_doc* B, bon_block_id block_id)
 {
-	bon_w_begin_block_sized(B, block_id, 0);
+	if (B->target == BON_W_TARGET_WRITER && !B->patcher) {
+		// Can't go back - size unknown.
+		bon_w_begin_block_sized(B, block_id, 0);
+		return;
+	}
+	
+	bon_w_ctrl_vlq(B, BON_CTRL_BLOCK_BEGIN, block_id);
+	
+	uint8_t size_field[BON_BLOCK_SIZE_LEN];
+	bon_block_size_to(size_field, 0);
+	B->block_patch    = BON_TRUE;
+	B->block_size_pos = bon_w_size(B);
+	bon_w_raw(B, size_field, BON_BLOCK_SIZE_LEN);
+	bon_w_block_crc_begin(B);
+}
+
+// Fill in the size field reserved by bon_w_block_begin, if possible.
+BON_INLINE void bon_w_patch_block_size(bon_w_doc* B)
+{
+	B->block_patch = BON_FALSE;
+	
+	bon_size end          = bon_w_size(B);
+	bon_size payload_size = end - B->block_size_pos - BON_BLOCK_SIZE_LEN;
+	uint8_t  size_field[BON_BLOCK_SIZE_LEN];
+	bon_block_size_to(size_field, payload_size);
+	
+	if (B->target == BON_W_TARGET_MEASURE) {
+		return; // Same size either way
+	}
+	
+	if (B->block_size_pos >= B->flushed) {
+		if (B->block_size_pos + BON_BLOCK_SIZE_LEN > end) {
+			return; // Fixed buffer overflowed - the error is already set
+		}
+		// Still in the buffer. Any CRC will be computed after this.
+		memcpy(B->buff + (B->block_size_pos - B->flushed), size_field, BON_BLOCK_SIZE_LEN);
+		return;
+	}
+	
+	if (B->flags & (BON_W_FLAG_CRC | BON_W_FLAG_XXH64)) {
+		// Already hashed into the CRC - leave size as 0 (unknown).
+		return;
+	}
+	
+	bon_w_flush(B);
+	if (!B->patcher(B->userData, end - B->block_size_pos, size_field, BON_BLOCK_SIZE_LEN)) {
+		bon_w_set_error(B, BON_ERR_WRITE_ERROR);
+	}
 }
 
 void bon_w_block_end(bon_w_doc* B)
 {
-	bon_w_raw_uint8(B, BON_CTRL_BLOCK_END);
+	if (B->block_patch) {
+		bon_w_patch_block_size(B);
+	}
+	bon_w_block_close(B);
+}
+
+// Compresses 'nbytes' of 'data' into a new buffer, if worth it. Returns the compressed size, or 0.
+static bon_size bon_w_compress(const void* data, bon_size nbytes, uint8_t** out)
+{
+	*out = NULL;
+	if (nbytes < BON_LZ_MIN_BYTES) {
+		return 0;
+	}
+	
+	// Only keep it if it saves more than the extra size field:
+	bon_size cap = nbytes - BON_VARINT_MAX_LEN;
+	*out = BON_ALLOC_TYPE(cap, uint8_t);
+	bon_size size = *out ? bon_lz_compress((const uint8_t*)data, nbytes, *out, cap) : 0;
+	if (size == 0) {
+		free(*out);
+		*out = NULL;
+	}
+	return size;
+}
+
+// 'nbytes' of 'data' compressed to 'compressed_size' bytes of 'compressed'.
+static void bon_w_block_lz(bon_w_doc* B, bon_block_id block_id, bon_size nbytes,
+									const uint8_t* compressed, bon_size compressed_size)
+{
+	bon_w_ctrl_vlq(B, BON_CTRL_BLOCK_LZ, block_id);
+	bon_w_vlq(B, compressed_size);
+	bon_w_vlq(B, nbytes);
+	bon_w_block_crc_begin(B);
+	bon_w_raw(B, compressed, compressed_size);
+	bon_w_block_close(B);
 }
 
 void bon_w_block(bon_w_doc* B, bon_block_id block_id, const void* data, bon_size nbytes)
 {
+	if (B->flags & BON_W_FLAG_COMPRESS_BLOCKS) {
+		uint8_t* compressed;
+		bon_size compressed_size = bon_w_compress(data, nbytes, &compressed);
+		if (compressed_size) {
+			bon_w_block_lz(B, block_id, nbytes, compressed, compressed_size);
+			free(compressed);
+			return;
+		}
+	}
+	
 	bon_w_begin_block_sized(B, block_id, nbytes);
 	bon_w_raw(B, data, nbytes);
 	bon_w_block_end(B);
 }
 
+typedef struct {
+	const bon_w_block_src*  blocks;
+	uint8_t**               compressed;
+	bon_size*               compressed_size;
+} bon_w_blocks_job;
+
+static void bon_w_blocks_task(void* user, unsigned task)
+{
+	bon_w_blocks_job* job = (bon_w_blocks_job*)user;
+	const bon_w_block_src* src = &job->blocks[task];
+	job->compressed_size[task] = bon_w_compress(src->data, src->nbytes, &job->compressed[task]);
+}
+
+void bon_w_blocks(bon_w_doc* B, const bon_w_block_src* blocks, bon_size count, unsigned num_threads)
+{
+	if (!(B->flags & BON_W_FLAG_COMPRESS_BLOCKS) || count == 0) {
+		for (bon_size bi=0; bi<count; ++bi) {
+			bon_w_block(B, blocks[bi].id, blocks[bi].data, blocks[bi].nbytes);
+		}
+		return;
+	}
+	
+	if (num_threads == 0) {
+		num_threads = bon_num_cores();
+	}
+	
+	bon_w_blocks_job job;
+	job.blocks          = blocks;
+	job.compressed      = BON_ALLOC_TYPE(count, uint8_t*);
+	job.compressed_size = BON_ALLOC_TYPE(count, bon_size);
+	
+	bon_pool* pool = (num_threads > 1 && count > 1) ? bon_new_pool(num_threads - 1) : NULL;
+	bon_pool_run(pool, (unsigned)count, bon_w_blocks_task, &job);
+	bon_free_pool(pool);
+	
+	// Written in order, so the output is identical to that of calling bon_w_block for each:
+	for (bon_size bi=0; bi<count; ++bi) {
+		if (job.compressed_size[bi]) {
+			bon_w_block_lz(B, blocks[bi].id, blocks[bi].nbytes, job.compressed[bi], job.compressed_size[bi]);
+			free(job.compressed[bi]);
+		} else {
+			bon_w_begin_block_sized(B, blocks[bi].id, blocks[bi].nbytes);
+			bon_w_raw(B, blocks[bi].data, blocks[bi].nbytes);
+			bon_w_block_end(B);
+		}
+	}
+	
+	free(job.compressed);
+	free(job.compressed_size);
+}
+
+
+static void bon_w_ints_header(bon_w_doc* B, bon_size len, bon_type_id element_t,
+										unsigned codec, bon_size encoded_size);
 
 // Write a value read from another BON-file:
 void bon_w_value(bon_w_doc* B, bon_value* v)
@@ -281,9 +687,20 @@ void bon_w_value(bon_w_doc* B, bon_value* v)
 		case BON_VALUE_AGGREGATE: {
 			bon_value_agg* agg = v->u.agg;
 			bon_type* type = &agg->type;
-			bon_w_pack(B, agg->data, bon_aggregate_payload_size(type), type);
+			if (agg->encoded) {
+				// Copy as is
+				bon_w_ints_header(B, type->u.array->size, type->u.array->type->id, agg->codec, agg->encoded_size);
+				bon_w_raw(B, agg->encoded, agg->encoded_size);
+			} else {
+				bon_w_pack(B, agg->data, bon_aggregate_payload_size(type), type);
+			}
 		} break;
 			
+		case BON_VALUE_TABLE:
+			// Copy as is
+			bon_w_raw(B, v->u.table->encoded, v->u.table->encoded_size);
+			break;
+			
 		default:
 			bon_w_set_error(B, BON_ERR_BAD_VALUE);
 	}
@@ -294,6 +711,196 @@ void bon_w_value(bon_w_doc* B, bon_value* v)
 // Value writing
 
 
+// Number of values classified and encoded per step of the bon_w_*s functions
+#define BON_BATCH_SIZE 64
+
+/*
+ Returns a pointer to 'n' bytes free for writing at the end of the write buffer,
+ flushing first if necessary. Returns NULL if the buffer can't hold 'n' bytes.
+ Advance B->buff_ix by the number of bytes actually used.
+ */
+BON_INLINE uint8_t* bon_w_reserve(bon_w_doc* B, bon_size n)
+{
+	if (B->target == BON_W_TARGET_MEMORY) {
+		return (bon_w_mem_grow(B, n) ? B->buff + B->buff_ix : NULL);
+	}
+	if (B->target == BON_W_TARGET_FIXED) {
+		return (B->buff_ix + n <= B->buff_size ? B->buff + B->buff_ix : NULL);
+	}
+	if (!B->buff || n >= B->buff_size) {
+		return NULL;
+	}
+	if (B->buff_ix + n >= B->buff_size) {
+		bon_w_flush(B);
+	}
+	return B->buff + B->buff_ix;
+}
+
+void bon_w_uint64s(bon_w_doc* B, const uint64_t* vals, bon_size n)
+{
+	while (n > 0) {
+		bon_size batch = (n < BON_BATCH_SIZE ? n : BON_BATCH_SIZE);
+		uint8_t* out = bon_w_reserve(B, batch * BON_NUMBER_MAX_LEN);
+		
+		if (!out) {
+			// Unbuffered
+			for (bon_size i=0; i<batch; ++i) {
+				bon_w_uint64(B, vals[i]);
+			}
+		} else {
+			uint8_t* start = out;
+			for (bon_size i=0; i<batch; ++i) {
+				out += bon_w_uint64_to(out, vals[i]);
+			}
+			B->buff_ix += (bon_size)(out - start);
+		}
+		
+		vals += batch;
+		n    -= batch;
+	}
+}
+
+void bon_w_sint64s(bon_w_doc* B, const int64_t* vals, bon_size n)
+{
+	while (n > 0) {
+		bon_size batch = (n < BON_BATCH_SIZE ? n : BON_BATCH_SIZE);
+		uint8_t* out = bon_w_reserve(B, batch * BON_NUMBER_MAX_LEN);
+		
+		if (!out) {
+			// Unbuffered
+			for (bon_size i=0; i<batch; ++i) {
+				bon_w_sint64(B, vals[i]);
+			}
+		} else {
+			uint8_t* start = out;
+			for (bon_size i=0; i<batch; ++i) {
+				out += bon_w_sint64_to(out, vals[i]);
+			}
+			B->buff_ix += (bon_size)(out - start);
+		}
+		
+		vals += batch;
+		n    -= batch;
+	}
+}
+
+/*
+ Sets is_int[i] if vals[i] is an integer in the int32 range.
+ Other values may still be integers (larger ones) - bon_w_float_to will find those.
+ */
+static void bon_classify_floats(const float* vals, bon_size n, uint8_t* is_int)
+{
+	bon_size i = 0;
+	
+#if BON_SSE2
+	for (; i+4 <= n; i += 4) {
+		// Out-of-range and NaN convert to 0x80000000 which won't round-trip (except for -2^31 itself, which is correct).
+		__m128 x    = _mm_loadu_ps(vals + i);
+		__m128 rt   = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		int    mask = _mm_movemask_ps(_mm_cmpeq_ps(rt, x));
+		is_int[i+0] = (uint8_t)((mask >> 0) & 1);
+		is_int[i+1] = (uint8_t)((mask >> 1) & 1);
+		is_int[i+2] = (uint8_t)((mask >> 2) & 1);
+		is_int[i+3] = (uint8_t)((mask >> 3) & 1);
+	}
+#endif
+	
+	for (; i<n; ++i) {
+		is_int[i] = (-2147483648.0f <= vals[i] && vals[i] < 2147483648.0f &&
+						 vals[i] == (float)(int32_t)vals[i]);
+	}
+}
+
+// Sets as_float[i] iff bon_w_double would write vals[i] as a float (or integer).
+static void bon_classify_doubles(const double* vals, bon_size n, uint8_t* as_float)
+{
+	bon_size i = 0;
+	
+#if BON_SSE2
+	for (; i+2 <= n; i += 2) {
+		// Round-trips through float, or is NaN (inf round-trips).
+		__m128d x    = _mm_loadu_pd(vals + i);
+		__m128d rt   = _mm_cvtps_pd(_mm_cvtpd_ps(x));
+		__m128d same = _mm_or_pd(_mm_cmpeq_pd(rt, x), _mm_cmpunord_pd(x, x));
+		int     mask = _mm_movemask_pd(same);
+		as_float[i+0] = (uint8_t)((mask >> 0) & 1);
+		as_float[i+1] = (uint8_t)((mask >> 1) & 1);
+	}
+#endif
+	
+	for (; i<n; ++i) {
+		as_float[i] = (!isfinite(vals[i]) || (double)(float)vals[i] == vals[i]);
+	}
+}
+
+void bon_w_floats(bon_w_doc* B, const float* vals, bon_size n)
+{
+	uint8_t is_int[BON_BATCH_SIZE];
+	
+	while (n > 0) {
+		bon_size batch = (n < BON_BATCH_SIZE ? n : BON_BATCH_SIZE);
+		uint8_t* out = bon_w_reserve(B, batch * BON_NUMBER_MAX_LEN);
+		
+		if (!out) {
+			// Unbuffered
+			for (bon_size i=0; i<batch; ++i) {
+				bon_w_float(B, vals[i]);
+			}
+		} else {
+			bon_classify_floats(vals, batch, is_int);
+			
+			uint8_t* start = out;
+			for (bon_size i=0; i<batch; ++i) {
+				if (is_int[i]) {
+					out += bon_w_sint64_to(out, (int32_t)vals[i]);
+				} else {
+					out += bon_w_float_to(out, vals[i]);
+				}
+			}
+			B->buff_ix += (bon_size)(out - start);
+		}
+		
+		vals += batch;
+		n    -= batch;
+	}
+}
+
+void bon_w_doubles(bon_w_doc* B, const double* vals, bon_size n)
+{
+	uint8_t as_float[BON_BATCH_SIZE];
+	
+	while (n > 0) {
+		bon_size batch = (n < BON_BATCH_SIZE ? n : BON_BATCH_SIZE);
+		uint8_t* out = bon_w_reserve(B, batch * BON_NUMBER_MAX_LEN);
+		
+		if (!out) {
+			// Unbuffered
+			for (bon_size i=0; i<batch; ++i) {
+				bon_w_double(B, vals[i]);
+			}
+		} else {
+			bon_classify_doubles(vals, batch, as_float);
+			
+			uint8_t* start = out;
+			for (bon_size i=0; i<batch; ++i) {
+				if (as_float[i]) {
+					out += bon_w_float_to(out, (float)vals[i]);
+				} else {
+					const double val = vals[i];
+					out[0] = BON_CTRL_DOUBLE;
+					memcpy(out + 1, &val, sizeof(val));
+					out += 1 + sizeof(val);
+				}
+			}
+			B->buff_ix += (bon_size)(out - start);
+		}
+		
+		vals += batch;
+		n    -= batch;
+	}
+}
+
+
 //------------------------------------------------------------------------------
 
 void bon_w_packegate_type(bon_w_doc* B, bon_type* type);
@@ -370,24 +977,21 @@ void bon_w_pack_fmt(bon_w_doc* B, const void* data, bon_size nbytes,
 {
 	va_list ap;
 	va_start(ap, fmt);
-	bon_type* type = bon_new_type_fmt_ap(&fmt, &ap);
+	bon_bool cached;
+	bon_type* type = bon_fmt_type_ap(fmt, &ap, &cached);
 	va_end(ap);
 	
 	if (type) {
 		bon_w_pack(B, data, nbytes, type);
-		bon_free_type(type);
+		if (!cached) {
+			bon_free_type(type);
+		}
 	}
 }
 
-void bon_w_pack_array(bon_w_doc* B, const void* data, bon_size nbytes,
-							 bon_size len, bon_type_id element_t)
+static void bon_w_plain_array(bon_w_doc* B, const void* data, bon_size nbytes,
+										bon_size len, bon_type_id element_t)
 {
-	bon_w_assert(B, len * bon_type_size(element_t) == nbytes,
-					 BON_ERR_BAD_AGGREGATE_SIZE);
-	if (B->error) {
-		return;
-	}
-	
 	if (element_t == BON_TYPE_UINT8 && len < BON_SHORT_BYTE_ARRAY_COUNT)
 	{
 		bon_w_raw_uint8(B, BON_SHORT_BYTE_ARRAY(len));
@@ -408,3 +1012,386 @@ void bon_w_pack_array(bon_w_doc* B, const void* data, bon_size nbytes,
 	
 	bon_w_raw(B, data, nbytes);
 }
+
+void bon_w_pack_array(bon_w_doc* B, const void* data, bon_size nbytes,
+							 bon_size len, bon_type_id element_t)
+{
+	bon_w_assert(B, len * bon_type_size(element_t) == nbytes,
+					 BON_ERR_BAD_AGGREGATE_SIZE);
+	if (B->error) {
+		return;
+	}
+	
+	if ((B->flags & BON_W_FLAG_ENCODE_INTS) && len >= BON_INTS_BLOCK
+		 && bon_ints_native_type(element_t) == element_t)
+	{
+		bon_w_pack_ints(B, data, nbytes, len, element_t, BON_INTS_AUTO);
+		return;
+	}
+	
+	bon_w_plain_array(B, data, nbytes, len, element_t);
+}
+
+
+//------------------------------------------------------------------------------
+// Encoded integer arrays
+
+static void bon_w_ints_header(bon_w_doc* B, bon_size len, bon_type_id element_t,
+										unsigned codec, bon_size encoded_size)
+{
+	bon_w_raw_uint8(B, BON_CTRL_INTS);
+	bon_w_raw_uint8(B, element_t);
+	bon_w_vlq(B, len);
+	bon_w_raw_uint8(B, (uint8_t)codec);
+	bon_w_vlq(B, encoded_size);
+}
+
+void bon_w_pack_ints(bon_w_doc* B, const void* data, bon_size nbytes,
+							bon_size len, bon_type_id element_t, bon_ints_codec codec)
+{
+	bon_w_assert(B, len * bon_type_size(element_t) == nbytes,
+					 BON_ERR_BAD_AGGREGATE_SIZE);
+	if (B->error) {
+		return;
+	}
+	
+	if (bon_ints_native_type(element_t) != element_t) {
+		bon_w_plain_array(B, data, nbytes, len, element_t);
+		return;
+	}
+	
+	unsigned best      = codec & (BON_INTS_DELTA | BON_INTS_ZIGZAG);
+	bon_size best_size = bon_ints_encoded_size(data, len, element_t, best);
+	
+	if (codec & BON_INTS_AUTO) {
+		static const unsigned s_codecs[] = { BON_INTS_DELTA | BON_INTS_ZIGZAG, BON_INTS_DELTA, BON_INTS_ZIGZAG };
+		for (unsigned ci=0; ci<sizeof(s_codecs)/sizeof(s_codecs[0]); ++ci) {
+			bon_size size = bon_ints_encoded_size(data, len, element_t, s_codecs[ci]);
+			if (size < best_size) {
+				best      = s_codecs[ci];
+				best_size = size;
+			}
+		}
+		
+		if (best_size >= nbytes) {
+			bon_w_plain_array(B, data, nbytes, len, element_t);
+			return;
+		}
+	}
+	
+	bon_w_ints_header(B, len, element_t, best, best_size);
+	
+	uint8_t buff[BON_INTS_MAX_BLOCK_BYTES];
+	for (bon_size block=0; block * BON_INTS_BLOCK < len; ++block) {
+		bon_w_raw(B, buff, bon_ints_encode_block(buff, data, len, block, element_t, best));
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// Tables
+
+bon_w_doc* bon_w_table_begin(bon_w_doc* B)
+{
+	return bon_w_new_mem((bon_w_flags)(BON_W_FLAG_SKIP_HEADER_FOOTER | (B->flags & BON_W_FLAG_SKIP_STRING_CHECKS)));
+}
+
+// Largest integers stored exactly by a float and a double
+#define BON_FLOAT_EXACT_INT   (1ULL << 24)
+#define BON_DOUBLE_EXACT_INT  (1ULL << 53)
+
+BON_INLINE uint64_t bon_abs64(int64_t x)
+{
+	return x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+}
+
+// Cell 'ci' of object 'row'
+#define BON_TABLE_CELL(rows, row, ci)  (&(rows)[row].u.obj.data[ci].val)
+
+/*
+ The smallest type that holds all the numbers of column 'ci' of 'rows' exactly,
+ or BON_TYPE_BOOL or BON_TYPE_STRING. False if they don't make a column.
+ */
+static bon_bool bon_table_col_type(const bon_value* rows, bon_size nrows, bon_size ci, bon_type_id* out)
+{
+	bon_value_type kind = BON_TABLE_CELL(rows, 0, ci)->type;
+	
+	if (kind == BON_VALUE_BOOL || kind == BON_VALUE_STRING) {
+		uint64_t total = 0;
+		for (bon_size row=0; row<nrows; ++row) {
+			const bon_value* v = BON_TABLE_CELL(rows, row, ci);
+			if (v->type != kind) { return BON_FALSE; }
+			total += (kind == BON_VALUE_STRING ? v->u.str.size + 1 : 0);
+		}
+		if (total > 0xffffffffu) {
+			return BON_FALSE; // Offsets are 32 bit
+		}
+		*out = (kind == BON_VALUE_BOOL ? BON_TYPE_BOOL : BON_TYPE_STRING);
+		return BON_TRUE;
+	}
+	
+	bon_bool  any_double = BON_FALSE, floats_ok = BON_TRUE, doubles_ok = BON_TRUE;
+	uint64_t  max_u = 0;
+	int64_t   min_s = 0;
+	
+	for (bon_size row=0; row<nrows; ++row) {
+		const bon_value* v = BON_TABLE_CELL(rows, row, ci);
+		uint64_t mag;
+		if (v->type == BON_VALUE_UINT64) {
+			mag = v->u.u64;
+			if (mag > max_u) { max_u = mag; }
+		} else if (v->type == BON_VALUE_SINT64) {
+			mag = bon_abs64(v->u.s64);
+			if (v->u.s64 < min_s) { min_s = v->u.s64; }
+			if (v->u.s64 > 0 && (uint64_t)v->u.s64 > max_u) { max_u = (uint64_t)v->u.s64; }
+		} else if (v->type == BON_VALUE_DOUBLE) {
+			any_double = BON_TRUE;
+			double d = v->u.dbl;
+			if (d == d && (double)(float)d != d) { floats_ok = BON_FALSE; }
+			continue;
+		} else {
+			return BON_FALSE;
+		}
+		if (mag > BON_FLOAT_EXACT_INT)  { floats_ok  = BON_FALSE; }
+		if (mag > BON_DOUBLE_EXACT_INT) { doubles_ok = BON_FALSE; }
+	}
+	
+	if (any_double) {
+		if (floats_ok)  { *out = BON_TYPE_FLOAT;  return BON_TRUE; }
+		if (doubles_ok) { *out = BON_TYPE_DOUBLE; return BON_TRUE; }
+		return BON_FALSE;
+	}
+	
+	if (min_s < 0) {
+		if      (min_s >= INT8_MIN  && max_u <= INT8_MAX)  { *out = BON_TYPE_SINT8;  }
+		else if (min_s >= INT16_MIN && max_u <= INT16_MAX) { *out = BON_TYPE_SINT16; }
+		else if (min_s >= INT32_MIN && max_u <= INT32_MAX) { *out = BON_TYPE_SINT32; }
+		else if (max_u <= INT64_MAX)                       { *out = BON_TYPE_SINT64; }
+		else { return BON_FALSE; }
+	} else {
+		if      (max_u <= UINT8_MAX)  { *out = BON_TYPE_UINT8;  }
+		else if (max_u <= UINT16_MAX) { *out = BON_TYPE_UINT16; }
+		else if (max_u <= UINT32_MAX) { *out = BON_TYPE_UINT32; }
+		else                          { *out = BON_TYPE_UINT64; }
+	}
+	return BON_TRUE;
+}
+
+// Writes number 'v' as type 't' (as chosen by bon_table_col_type) to 'out'.
+static void bon_table_store(uint8_t* out, bon_type_id t, const bon_value* v)
+{
+	uint64_t bits = (v->type == BON_VALUE_SINT64 ? (uint64_t)v->u.s64 : v->u.u64);
+	double   dbl  = (v->type == BON_VALUE_DOUBLE ? v->u.dbl :
+						  v->type == BON_VALUE_SINT64 ? (double)v->u.s64 : (double)v->u.u64);
+	
+#define BON_TABLE_STORE(Type, x)  { Type y = (Type)(x); memcpy(out, &y, sizeof(Type)); } break;
+	
+	switch (t) {
+		case BON_TYPE_SINT8:   BON_TABLE_STORE(int8_t,   bits)
+		case BON_TYPE_UINT8:   BON_TABLE_STORE(uint8_t,  bits)
+		case BON_TYPE_SINT16:  BON_TABLE_STORE(int16_t,  bits)
+		case BON_TYPE_UINT16:  BON_TABLE_STORE(uint16_t, bits)
+		case BON_TYPE_SINT32:  BON_TABLE_STORE(int32_t,  bits)
+		case BON_TYPE_UINT32:  BON_TABLE_STORE(uint32_t, bits)
+		case BON_TYPE_SINT64:  BON_TABLE_STORE(int64_t,  bits)
+		case BON_TYPE_UINT64:  BON_TABLE_STORE(uint64_t, bits)
+		case BON_TYPE_FLOAT:   BON_TABLE_STORE(float,    dbl)
+		case BON_TYPE_DOUBLE:  BON_TABLE_STORE(double,   dbl)
+		default: break;
+	}
+	
+#undef BON_TABLE_STORE
+}
+
+// Columns types of 'rows', if they make a table.
+static bon_bool bon_table_schema(const bon_value* rows, bon_size nrows, bon_type_id* types)
+{
+	bon_size ncols = rows[0].u.obj.size;
+	
+	for (bon_size row=0; row<nrows; ++row) {
+		const bon_value* v = &rows[row];
+		if (v->type != BON_VALUE_OBJ || v->u.obj.size != ncols) {
+			return BON_FALSE;
+		}
+		for (bon_size ci=0; ci<ncols && row>0; ++ci) {
+			if (strcmp(v->u.obj.data[ci].key, rows[0].u.obj.data[ci].key) != 0) {
+				return BON_FALSE;
+			}
+		}
+	}
+	
+	for (bon_size ci=0; ci<ncols; ++ci) {
+		if (!bon_table_col_type(rows, nrows, ci, &types[ci])) {
+			return BON_FALSE;
+		}
+	}
+	return BON_TRUE;
+}
+
+static void bon_w_table(bon_w_doc* B, const bon_value* rows, bon_size nrows, const bon_type_id* types)
+{
+	bon_size ncols = rows[0].u.obj.size;
+	
+	bon_w_ctrl_vlq(B, BON_CTRL_TABLE, nrows);
+	bon_w_vlq(B, ncols);
+	for (bon_size ci=0; ci<ncols; ++ci) {
+		bon_w_cstring(B, rows[0].u.obj.data[ci].key);
+		bon_w_raw_uint8(B, types[ci] == BON_TYPE_BOOL ? BON_CTRL_TRUE : (uint8_t)types[ci]);
+	}
+	
+	for (bon_size ci=0; ci<ncols; ++ci) {
+		bon_type_id t = types[ci];
+		
+		if (t == BON_TYPE_STRING) {
+			uint32_t* offsets = BON_ALLOC_TYPE((nrows + 1), uint32_t);
+			uint32_t  offset  = 0;
+			offsets[0] = uint32_to_le(0);
+			for (bon_size row=0; row<nrows; ++row) {
+				offset += (uint32_t)BON_TABLE_CELL(rows, row, ci)->u.str.size + 1;
+				offsets[row + 1] = uint32_to_le(offset);
+			}
+			bon_w_raw(B, offsets, (nrows + 1) * sizeof(uint32_t));
+			free(offsets);
+			
+			for (bon_size row=0; row<nrows; ++row) {
+				const bon_value_str* str = &BON_TABLE_CELL(rows, row, ci)->u.str;
+				bon_w_raw(B, str->ptr, str->size + 1); // Including the zero
+			}
+		} else if (t == BON_TYPE_BOOL) {
+			uint8_t* bools = BON_ALLOC_TYPE(nrows, uint8_t);
+			for (bon_size row=0; row<nrows; ++row) {
+				bools[row] = (BON_TABLE_CELL(rows, row, ci)->u.boolean ? 1 : 0);
+			}
+			bon_w_raw(B, bools, nrows);
+			free(bools);
+		} else {
+			bon_size size = bon_type_size(t);
+			uint8_t* column = BON_ALLOC_TYPE(nrows * size, uint8_t);
+			for (bon_size row=0; row<nrows; ++row) {
+				bon_table_store(column + row * size, t, BON_TABLE_CELL(rows, row, ci));
+			}
+			bon_w_raw(B, column, nrows * size);
+			free(column);
+		}
+	}
+}
+
+void bon_w_table_end(bon_w_doc* B, bon_w_doc* T)
+{
+	bon_size        nbytes;
+	const uint8_t*  data = bon_w_mem_data(T, &nbytes);
+	
+	if (T->error) {
+		bon_w_set_error(B, T->error);
+		bon_w_free(T);
+		return;
+	}
+	
+	// Read back the rows:
+	struct {
+		bon_size    size;
+		bon_size    cap;
+		bon_value*  data;
+	} rows = {0,0,0};
+	
+	bon_r_doc* R = BON_CALLOC_TYPE(1, bon_r_doc);
+	R->flags = BON_R_FLAG_SKIP_STRING_CHECKS; // Checked when written
+	bon_reader br = make_br(R, data, nbytes, BON_BAD_BLOCK_ID);
+	while (br.nbytes > 0 && !br.error) {
+		BON_VECTOR_EXPAND(rows, bon_value, 1);
+		bon_r_value(&br, &rows.data[rows.size - 1]);
+	}
+	
+	bon_type_id* types = NULL;
+	if (!br.error && rows.size > 0 && rows.data[0].type == BON_VALUE_OBJ && rows.data[0].u.obj.size > 0) {
+		types = BON_ALLOC_TYPE(rows.data[0].u.obj.size, bon_type_id);
+		if (!bon_table_schema(rows.data, rows.size, types)) {
+			free(types);
+			types = NULL;
+		}
+	}
+	
+	if (types) {
+		bon_w_table(B, rows.data, rows.size, types);
+		free(types);
+	} else {
+		// Not a table. Just a list then:
+		bon_w_list_begin(B);
+		bon_w_raw(B, data, nbytes);
+		bon_w_list_end(B);
+	}
+	
+	for (bon_size ix=0; ix<rows.size; ++ix) {
+		bon_free_value_insides(&rows.data[ix]);
+	}
+	free(rows.data);
+	bon_r_close(R);
+	bon_w_free(T);
+}
+
+
+//------------------------------------------------------------------------------
+// Aligned blocks
+
+// Write a block of exactly 'len' bytes that no one refers to.
+static void bon_w_pad_block(bon_w_doc* B, bon_size len)
+{
+	const uint32_t id_len    = bon_vlq_size(BON_PAD_BLOCK_ID);
+	const uint32_t size_len  = bon_vlq_size(len);  // Enough, since the payload is smaller
+	const bon_size payload   = len - 2 - id_len - size_len;
+	
+	uint8_t size_field[BON_VARINT_MAX_LEN];
+	bon_vlq_padded_to(size_field, payload, size_len);
+	
+	bon_w_raw_uint8(B, BON_CTRL_BLOCK_BEGIN);
+	bon_w_vlq(B, BON_PAD_BLOCK_ID);
+	bon_w_raw(B, size_field, size_len);
+	
+	uint8_t zeros[64] = {0};
+	for (bon_size left = payload; left > 0; ) {
+		bon_size n = (left < sizeof(zeros) ? left : sizeof(zeros));
+		bon_w_raw(B, zeros, n);
+		left -= n;
+	}
+	
+	bon_w_raw_uint8(B, BON_CTRL_BLOCK_END);
+}
+
+void bon_w_block_pack(bon_w_doc* B, bon_block_id block_id,
+							 const void* data, bon_size nbytes, bon_type* type, bon_size align)
+{
+	assert(align != 0 && (align & (align - 1)) == 0);
+	
+	bon_size expected_size = bon_aggregate_payload_size(type);
+	if (nbytes != expected_size) {
+		fprintf(stderr, "bon_w_block_pack: wrong size. Expected %d, got %d\n", (int)expected_size, (int)nbytes);
+		bon_w_set_error(B, BON_ERR_BAD_AGGREGATE_SIZE);
+		return;
+	}
+	
+	// The type goes first in the block, so we need its size up front:
+	bon_w_doc* header = bon_w_new_mem(BON_W_FLAG_SKIP_HEADER_FOOTER);
+	bon_w_packegate_type(header, type);
+	bon_size header_size;
+	const uint8_t* header_data = bon_w_mem_data(header, &header_size);
+	
+	const bon_size payload_size = header_size + nbytes;
+	const bon_size data_offset  = bon_w_size(B) + 1 + bon_vlq_size(block_id)
+	                            + bon_vlq_size(payload_size) + header_size;
+	
+	bon_size pad = (align - (data_offset & (align - 1))) & (align - 1);
+	if (pad != 0) {
+		const bon_size min_pad = 3 + bon_vlq_size(BON_PAD_BLOCK_ID) + 1; // One byte of payload
+		while (pad < min_pad) {
+			pad += align;
+		}
+		bon_w_pad_block(B, pad);
+	}
+	
+	bon_w_begin_block_sized(B, block_id, payload_size);
+	bon_w_raw(B, header_data, header_size);
+	bon_w_raw(B, data, nbytes);
+	bon_w_block_end(B);
+	
+	bon_w_free(header);
+}
@@ -17,7 +17,7 @@
 
 #define BON_INLINE static inline
 
-#ifndef isfinite
+#if !defined(isfinite) && !defined(__cplusplus)
 BON_INLINE int isfinite(double x) { return x-x == 0.0; }
 #endif
 
@@ -125,18 +125,6 @@ BON_INLINE void bon_w_ctrl_vlq(bon_w_doc* B, bon_ctrl ctrl, bon_size x)
 // Public API functions:
 
 
-/*
- A much faster version of
- bon_w_raw_uint8(B, type_ctrl);
- bon_w_raw(B, &data, sizeof(data));
- */
-#define BON_WRITE_QUICKLY(type_ctrl, data)     \
-/**/    unsigned char buf[1 + sizeof(data)];   \
-/**/    buf[0] = type_ctrl;                    \
-/**/    memcpy(buf+1, &data, sizeof(data));    \
-/**/    bon_w_raw(B, buf, sizeof(buf));        \
-
-
 BON_INLINE void bon_w_obj_begin(bon_w_doc* B) {
 	bon_w_raw_uint8(B, BON_CTRL_OBJ_BEGIN);
 }
@@ -215,66 +203,113 @@ BON_INLINE void bon_w_cstring(bon_w_doc* B, const char* utf8)
 	bon_w_string(B, utf8, BON_ZERO_ENDED);
 }
 
-BON_INLINE void bon_w_uint64(bon_w_doc* B, uint64_t u64)
+/*
+ The bon_w_*_to functions encode a number into 'out',
+ which must have room for BON_NUMBER_MAX_LEN bytes.
+ They return the number of bytes written.
+ */
+
+// Maximum number of bytes to encode a number (control code + 8 bytes)
+#define BON_NUMBER_MAX_LEN 9
+
+/*
+ A much faster version of
+ out[0] = type_ctrl;
+ memcpy(out + 1, &data, sizeof(data));
+ return 1 + sizeof(data);
+ */
+#define BON_ENCODE_QUICKLY(out, type_ctrl, data)   \
+/**/    out[0] = type_ctrl;                        \
+/**/    memcpy(out+1, &data, sizeof(data));        \
+/**/    return 1 + sizeof(data);                   \
+
+
+BON_INLINE uint32_t bon_w_uint64_to(uint8_t* out, uint64_t u64)
 {
 	if (u64 < BON_SHORT_POS_INT_COUNT) {
-		bon_w_raw_uint8(B, (uint8_t)u64);
+		out[0] = (uint8_t)u64;
+		return 1;
 	} else if (u64 == (u64 & 0xff)) {
 		uint8_t u8 = (uint8_t)u64;
-		BON_WRITE_QUICKLY(BON_CTRL_UINT8, u8);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_UINT8, u8);
 	} else if (u64 == (u64 & 0xffff)) {
 		uint16_t u16 = (uint16_t)u64;
-		BON_WRITE_QUICKLY(BON_CTRL_UINT16, u16);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_UINT16, u16);
 	} else if (u64 == (u64 & 0xffffffff)) {
 		uint32_t u32 = (uint32_t)u64;
-		BON_WRITE_QUICKLY(BON_CTRL_UINT32, u32);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_UINT32, u32);
 	} else {
-		BON_WRITE_QUICKLY(BON_CTRL_UINT64, u64);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_UINT64, u64);
 	}
 }
 
-BON_INLINE void bon_w_sint64(bon_w_doc* B, int64_t s64) {
+BON_INLINE uint32_t bon_w_sint64_to(uint8_t* out, int64_t s64) {
 	if (s64 >= 0) {
-		bon_w_uint64(B, (uint64_t)s64);
+		return bon_w_uint64_to(out, (uint64_t)s64);
 	} else if (-16 <= s64) {
-		bon_w_raw_uint8(B, (uint8_t)s64);
+		out[0] = (uint8_t)s64;
+		return 1;
 	} else if (-0x80 <= s64 && s64 < 0x80) {
 		uint8_t u8 = (uint8_t)s64;
-		BON_WRITE_QUICKLY(BON_CTRL_SINT8, u8);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_SINT8, u8);
 	} else if (-0x8000 <= s64 && s64 < 0x8000) {
 		uint16_t u16 = (uint16_t)s64;
-		BON_WRITE_QUICKLY(BON_CTRL_SINT16, u16);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_SINT16, u16);
 	} else if (-0x80000000LL <= s64 && s64 < 0x80000000LL) {
 		uint32_t u32 = (uint32_t)s64;
-		BON_WRITE_QUICKLY(BON_CTRL_SINT32, u32);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_SINT32, u32);
 	} else {
-		BON_WRITE_QUICKLY(BON_CTRL_SINT64, s64);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_SINT64, s64);
 	}
 }
 
 
-BON_INLINE void bon_w_float(bon_w_doc* B, float val)
+BON_INLINE uint32_t bon_w_float_to(uint8_t* out, float val)
 {
 #if 1
 	// I think this can be optimized to testing just the exponent sign bit.
 	int64_t ival = (int64_t)val;
 	if (val == (float)ival) {
-		bon_w_sint64(B, ival);
-		return;
+		return bon_w_sint64_to(out, ival);
 	}
 #endif
 	
-	BON_WRITE_QUICKLY(BON_CTRL_FLOAT, val);
+	BON_ENCODE_QUICKLY(out, BON_CTRL_FLOAT, val);
 }
 
-BON_INLINE void bon_w_double(bon_w_doc* B, double val)
+BON_INLINE uint32_t bon_w_double_to(uint8_t* out, double val)
 {
 	if (!isfinite(val) || (double)(float)val == val) {
-		bon_w_float(B, (float)val);
+		return bon_w_float_to(out, (float)val);
 	} else {
-		BON_WRITE_QUICKLY(BON_CTRL_DOUBLE, val);
+		BON_ENCODE_QUICKLY(out, BON_CTRL_DOUBLE, val);
 	}
 }
 
 
+BON_INLINE void bon_w_uint64(bon_w_doc* B, uint64_t u64)
+{
+	uint8_t buf[BON_NUMBER_MAX_LEN];
+	bon_w_raw(B, buf, bon_w_uint64_to(buf, u64));
+}
+
+BON_INLINE void bon_w_sint64(bon_w_doc* B, int64_t s64)
+{
+	uint8_t buf[BON_NUMBER_MAX_LEN];
+	bon_w_raw(B, buf, bon_w_sint64_to(buf, s64));
+}
+
+BON_INLINE void bon_w_float(bon_w_doc* B, float val)
+{
+	uint8_t buf[BON_NUMBER_MAX_LEN];
+	bon_w_raw(B, buf, bon_w_float_to(buf, val));
+}
+
+BON_INLINE void bon_w_double(bon_w_doc* B, double val)
+{
+	uint8_t buf[BON_NUMBER_MAX_LEN];
+	bon_w_raw(B, buf, bon_w_double_to(buf, val));
+}
+
+
 #endif
@@ -0,0 +1,155 @@
+//
+//  xxhash.c
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+#include "xxhash.h"
+#include <string.h>       // memcpy
+
+
+#define XXH_PRIME64_1  11400714785074694791ULL
+#define XXH_PRIME64_2  14029467366897019727ULL
+#define XXH_PRIME64_3   1609587929392839161ULL
+#define XXH_PRIME64_4   9650029242287828579ULL
+#define XXH_PRIME64_5   2870177450012600261ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Byte by byte so it works on big endian too (compilers merge these into one load).
+static inline uint64_t xxh_read64(const uint8_t* p)
+{
+	return (uint64_t)p[0]       | (uint64_t)p[1] <<  8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	       (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint32_t xxh_read32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc  = xxh_rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// Consumes 32 bytes at a time. Returns the number of bytes consumed.
+static uint64_t xxh_stripes(uint64_t v[4], const uint8_t* p, uint64_t len)
+{
+	uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+	uint64_t n = 0;
+	for (; len - n >= 32; n += 32) {
+		v0 = xxh_round(v0, xxh_read64(p + n));
+		v1 = xxh_round(v1, xxh_read64(p + n + 8));
+		v2 = xxh_round(v2, xxh_read64(p + n + 16));
+		v3 = xxh_round(v3, xxh_read64(p + n + 24));
+	}
+	v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+	return n;
+}
+
+void xxh64_reset(xxh64_state* state, uint64_t seed)
+{
+	memset(state, 0, sizeof(*state));
+	state->seed = seed;
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+}
+
+void xxh64_update(xxh64_state* state, const uint8_t* data, uint64_t size)
+{
+	if (size == 0) {
+		return;
+	}
+	
+	state->total_len += size;
+	
+	if (state->mem_size + size < 32) {
+		memcpy(state->mem + state->mem_size, data, size);
+		state->mem_size += (uint32_t)size;
+		return;
+	}
+	
+	if (state->mem_size > 0) {
+		// Complete the stripe in 'mem':
+		uint32_t fill = 32 - state->mem_size;
+		memcpy(state->mem + state->mem_size, data, fill);
+		xxh_stripes(state->v, state->mem, 32);
+		data += fill;
+		size -= fill;
+		state->mem_size = 0;
+	}
+	
+	uint64_t n = xxh_stripes(state->v, data, size);
+	if (n < size) {
+		memcpy(state->mem, data + n, size - n);
+		state->mem_size = (uint32_t)(size - n);
+	}
+}
+
+uint64_t xxh64_digest(const xxh64_state* state)
+{
+	uint64_t h;
+	
+	if (state->total_len >= 32) {
+		const uint64_t* v = state->v;
+		h = xxh_rotl64(v[0], 1) + xxh_rotl64(v[1], 7) + xxh_rotl64(v[2], 12) + xxh_rotl64(v[3], 18);
+		h = xxh_merge_round(h, v[0]);
+		h = xxh_merge_round(h, v[1]);
+		h = xxh_merge_round(h, v[2]);
+		h = xxh_merge_round(h, v[3]);
+	} else {
+		h = state->seed + XXH_PRIME64_5;
+	}
+	
+	h += state->total_len;
+	
+	// The rest, in 'mem':
+	const uint8_t* p   = state->mem;
+	const uint8_t* end = state->mem + state->mem_size;
+	
+	for (; end - p >= 8; p += 8) {
+		h ^= xxh_round(0, xxh_read64(p));
+		h  = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (end - p >= 4) {
+		h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+		h  = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= (uint64_t)*p * XXH_PRIME64_5;
+		h  = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+	}
+	
+	// Avalanche:
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t xxh64_calc(const uint8_t* data, uint64_t size, uint64_t seed)
+{
+	xxh64_state state;
+	xxh64_reset(&state, seed);
+	xxh64_update(&state, data, size);
+	return xxh64_digest(&state);
+}
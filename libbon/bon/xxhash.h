@@ -0,0 +1,43 @@
+//
+//  xxhash.h
+//  BON
+//
+//  Written 2013 by Emil Ernerfeldt.
+//  Copyright (c) 2013 Emil Ernerfeldt <emil.ernerfeldt@gmail.com>
+//  This is free software, under the MIT license (see LICENSE.txt for details).
+
+#ifndef BON_xxhash_h
+#define BON_xxhash_h
+
+#include <stdint.h>
+
+/*
+ XXH64, the 64-bit hash of the xxHash family (by Yann Collet).
+ Not cryptographic, but fast (memory bandwidth) and good at catching corruption.
+ https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+
+typedef struct {
+	uint64_t  total_len;
+	uint64_t  v[4];       // The four accumulators
+	uint8_t   mem[32];    // Input not yet consumed by the accumulators
+	uint32_t  mem_size;
+	uint64_t  seed;
+} xxh64_state;
+
+/*
+ Usage:
+ xxh64_state state;
+ xxh64_reset(&state, 0);
+ xxh64_update(&state, buff1, sizeof(buff1));
+ xxh64_update(&state, buff2, sizeof(buff2));
+ uint64_t hash = xxh64_digest(&state);
+ */
+void      xxh64_reset  (xxh64_state* state, uint64_t seed);
+void      xxh64_update (xxh64_state* state, const uint8_t* data, uint64_t size);
+uint64_t  xxh64_digest (const xxh64_state* state);
+
+// Calculate the hash of the given bytes.
+uint64_t  xxh64_calc   (const uint8_t* data, uint64_t size, uint64_t seed);
+
+#endif
@@ -14,10 +14,12 @@ extern "C" {
 #include <bon/bon.h>
 #include <bon/private.h>
 #include <bon/crc32.h>
+#include <bon/xxhash.h>
 }
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm> // reverse
 #include <numeric>  // accumulate
 
 
@@ -385,3 +387,99 @@ TEST_CASE( "BON/bench", "Benching writing and reading of packed values vs" )
 	
 }
 #endif // DEBUG/bench
+
+
+#if 1
+
+TEST_CASE( "BON/bench/crc", "Speed of crc32 and xxh64" )
+{
+	const std::vector<uint8_t> data(NUM_VALS * sizeof(float), 42);
+	uint32_t crc = 0;
+	
+	printf("\ncrc32 of %d MiB:\n", (int)(data.size() >> 20));
+	
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_SSE2; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		
+		printf("%-8s ", level == BON_SIMD_NONE ? "sliced" : "clmul");
+		time_n(16, [&]() {
+			crc = crc_calc(data.data(), data.size());
+		});
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512); // Back to the best supported
+	REQUIRE( crc != 0 );
+	
+	uint64_t hash = 0;
+	printf("%-8s ", "xxh64");
+	time_n(16, [&]() {
+		hash = xxh64_calc(data.data(), data.size(), 0);
+	});
+	REQUIRE( hash != 0 );
+}
+
+// 'big_endian': the source is stored byte swapped (we only bench these on little endian machines).
+template<typename Src, typename Dst>
+void cast_bench(const char* name, bon_type_id src_id, bon_type_id dst_id, bool big_endian = false)
+{
+	Src val = (Src)100;
+	if (big_endian) {
+		std::reverse((uint8_t*)&val, (uint8_t*)&val + sizeof(Src));
+	}
+	const std::vector<Src> src(NUM_VALS, val);
+	std::vector<Dst> dst(NUM_VALS);
+	
+	printf("\n%s:\n", name);
+	
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		
+		bon_cast_fn cast = bon_cast_kernel(src_id, dst_id);
+		
+		const char* level_names[] = {"scalar", "SSE2", "AVX2", "AVX-512"};
+		printf("%-8s ", level_names[level]);
+		time_n(16, [&]() {
+			REQUIRE( cast(src.data(), dst.data(), NUM_VALS) );
+		});
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512); // Back to the best supported
+	REQUIRE( dst[1] == (Dst)100 );
+}
+
+TEST_CASE( "BON/bench/convert", "Speed of the cast kernels used when unpacking to another type" )
+{
+	printf("\nCasting %d values:\n", NUM_VALS);
+	cast_bench<float,   double> ("float -> double",  BON_TYPE_FLOAT,  BON_TYPE_DOUBLE);
+	cast_bench<double,  float>  ("double -> float",  BON_TYPE_DOUBLE, BON_TYPE_FLOAT);
+	cast_bench<int32_t, float>  ("int32 -> float",   BON_TYPE_SINT32, BON_TYPE_FLOAT);
+	cast_bench<int16_t, float>  ("int16 -> float",   BON_TYPE_SINT16, BON_TYPE_FLOAT);
+	cast_bench<int8_t,  float>  ("int8 -> float",    BON_TYPE_SINT8,  BON_TYPE_FLOAT);
+	cast_bench<uint8_t, float>  ("uint8 -> float",   BON_TYPE_UINT8,  BON_TYPE_FLOAT);
+	cast_bench<float,   int32_t>("float -> int32",   BON_TYPE_FLOAT,  BON_TYPE_SINT32);
+	cast_bench<float,   int16_t>("float -> int16",   BON_TYPE_FLOAT,  BON_TYPE_SINT16);
+	cast_bench<float,   int8_t> ("float -> int8",    BON_TYPE_FLOAT,  BON_TYPE_SINT8);
+	cast_bench<float,   uint8_t>("float -> uint8",   BON_TYPE_FLOAT,  BON_TYPE_UINT8);
+	
+#if __LITTLE_ENDIAN__
+	cast_bench<float,   float>  ("float BE -> float",   BON_TYPE_FLOAT_BE,  BON_TYPE_FLOAT,  true);
+	cast_bench<float,   double> ("float BE -> double",  BON_TYPE_FLOAT_BE,  BON_TYPE_DOUBLE, true);
+	cast_bench<int16_t, float>  ("int16 BE -> float",   BON_TYPE_SINT16_BE, BON_TYPE_FLOAT,  true);
+	cast_bench<double,  double> ("double BE -> double", BON_TYPE_DOUBLE_BE, BON_TYPE_DOUBLE, true);
+#endif
+	
+	printf("\nuint8 -> float normalized:\n");
+	const std::vector<uint8_t> colors(NUM_VALS, 255);
+	std::vector<float> unorm(NUM_VALS);
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		bon_cast_fn cast = bon_unorm8_kernel();
+		time_n(16, [&]() {
+			cast(colors.data(), unorm.data(), NUM_VALS);
+		});
+	}
+	bon_set_simd_level(BON_SIMD_AVX512);
+	REQUIRE( unorm[1] == 1.0f );
+}
+
+#endif
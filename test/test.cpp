@@ -14,9 +14,16 @@ extern "C" {
 #include <bon/bon.h>
 #include <bon/private.h>
 #include <bon/crc32.h>
+#include <bon/log.h>
+#include <bon/xxhash.h>
 }
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
 
 
 using namespace std;
@@ -29,6 +36,49 @@ TEST_CASE( "crc32", "Santiy checking of crc32 implementation" )
 	REQUIRE( crc == 0xED82CD11 );
 }
 
+// The classic bit at a time definition
+static uint32_t crc_reference(uint32_t c, const uint8_t* buf, size_t len)
+{
+	for (size_t n = 0; n < len; n++) {
+		c ^= buf[n];
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+	}
+	return c;
+}
+
+TEST_CASE( "crc32/fast", "Slicing and folding crc32 match the bitwise definition" )
+{
+	std::vector<uint8_t> data(4096 + 64);
+	uint32_t seed = 12345;
+	for (auto& b : data) {
+		seed = seed * 1103515245u + 12345u;
+		b = (uint8_t)(seed >> 16);
+	}
+	
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+	
+		for (size_t offset : {0, 1, 3, 8, 13}) {
+			for (size_t len : {0, 1, 7, 8, 9, 15, 16, 63, 64, 65, 79, 80, 127, 128, 129, 1000, 4096}) {
+				const uint8_t* p = data.data() + offset;
+				REQUIRE( crc_update(0xffffffff, p, len) == crc_reference(0xffffffff, p, len) );
+				REQUIRE( crc_update(0x12345678, p, len) == crc_reference(0x12345678, p, len) );
+			}
+		}
+	
+		// In pieces, as the writer does:
+		uint32_t crc_inv = 0xffffffff;
+		for (size_t at = 0, step = 1; at < data.size(); at += step, step = step * 3 % 257 + 1) {
+			crc_inv = crc_update(crc_inv, data.data() + at, std::min(step, data.size() - at));
+		}
+		REQUIRE( crc_inv == crc_reference(0xffffffff, data.data(), data.size()) );
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512); // Back to the best supported
+}
+
 
 // Checks a binary byte stream against code supplied values
 class Verifier
@@ -506,6 +556,109 @@ TEST_CASE( "BON/blocks", "Blocks and references" )
 }
 
 
+TEST_CASE( "BON/blocks/patched", "Open-ended blocks get their size patched in" )
+{
+	auto write_doc = [](bon_w_doc* B) {
+		bon_w_block_begin(B, 1);
+		bon_w_list_begin(B);
+		for (int i=0; i<100; ++i) { bon_w_sint64(B, i * 1000); }
+		bon_w_list_end(B);
+		bon_w_block_end(B);
+		
+		bon_w_block_begin(B, 0);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "list");  bon_w_block_ref(B, 1);
+		bon_w_obj_end(B);
+		bon_w_block_end(B);
+	};
+	
+	// Returns number of lazily loaded (sized) blocks
+	auto check = [](const uint8_t* data, bon_size size, bon_r_flags flags) {
+		bon_r_doc* R = bon_r_open(data, size, flags);
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		REQUIRE( R->blocks.size == 2 );
+		int nLazy = 0;
+		for (bon_size i=0; i<R->blocks.size; ++i) {
+			nLazy += !R->blocks.data[i].parsed;
+		}
+		bon_value* list = bon_r_get_key(R, bon_r_root(R), "list");
+		REQUIRE( bon_r_list_size(R, list) == 100 );
+		REQUIRE( bon_r_int(R, bon_r_list_elem(R, list, 99)) == 99000 );
+		bon_r_close(R);
+		return nLazy;
+	};
+	
+	for (bon_w_flags flags : {BON_W_FLAG_DEFAULT, BON_W_FLAG_CRC}) {
+		CAPTURE( flags );
+		bon_r_flags rflags = (flags & BON_W_FLAG_CRC ? BON_R_FLAG_REQUIRE_CRC : BON_R_FLAG_DEFAULT);
+		
+		// Memory
+		bon_w_doc* M = bon_w_new_mem(flags);
+		write_doc(M);
+		REQUIRE( bon_w_finish(M) == BON_SUCCESS );
+		bon_size mem_size;
+		uint8_t* mem = bon_w_mem_take(M, &mem_size);
+		bon_w_free(M);
+		REQUIRE( check(mem, mem_size, rflags) == 2 );
+		
+		// Measuring gives the same size
+		bon_w_doc* S = bon_w_new_measure(flags);
+		write_doc(S);
+		REQUIRE( bon_w_finish(S) == BON_SUCCESS );
+		REQUIRE( bon_w_size(S) == mem_size );
+		bon_w_free(S);
+		
+		// Writer without patcher: unknown sizes, as before
+		bon_byte_vec plain = {0,0,0};
+		bon_w_doc* P = bon_w_new(bon_vec_writer, &plain, flags);
+		write_doc(P);
+		REQUIRE( bon_w_close(P) == BON_SUCCESS );
+		REQUIRE( check(plain.data, plain.size, rflags) == 0 );
+		free(plain.data);
+		
+		// Writer with patcher. A tiny buffer forces patching of flushed data.
+		for (bon_size buff_size : {0, 16, 4096}) {
+			CAPTURE( buff_size );
+			bon_byte_vec vec = {0,0,0};
+			bon_w_doc* B = bon_w_new_sized(bon_vec_writer, &vec, flags, buff_size);
+			bon_w_set_patcher(B, bon_vec_patcher);
+			write_doc(B);
+			REQUIRE( bon_w_close(B) == BON_SUCCESS );
+			REQUIRE( vec.size == mem_size );
+			
+			bool flushed = (buff_size < 512);
+			if (flushed && (flags & BON_W_FLAG_CRC)) {
+				// Can't patch what's in the CRC, but it is still valid:
+				REQUIRE( check(vec.data, vec.size, rflags) == 0 );
+			} else {
+				REQUIRE( memcmp(vec.data, mem, mem_size) == 0 );
+			}
+			free(vec.data);
+		}
+		
+		// File
+		FILE* fp = tmpfile();
+		REQUIRE( fp );
+		fputs("prefix", fp); // The patcher works relative to the end
+		bon_w_doc* F = bon_w_new_sized(bon_file_writer, fp, flags, 0);
+		bon_w_set_patcher(F, bon_file_patcher);
+		write_doc(F);
+		REQUIRE( bon_w_close(F) == BON_SUCCESS );
+		REQUIRE( ftell(fp) == (long)(6 + mem_size) );
+		
+		if (!(flags & BON_W_FLAG_CRC)) {
+			std::vector<uint8_t> file_data(mem_size);
+			fseek(fp, 6, SEEK_SET);
+			REQUIRE( fread(file_data.data(), 1, mem_size, fp) == mem_size );
+			REQUIRE( memcmp(file_data.data(), mem, mem_size) == 0 );
+		}
+		fclose(fp);
+		
+		free(mem);
+	}
+}
+
+
 TEST_CASE( "BON/parse", "Writing and parsing aggregates" )
 {
 	const int NVecs = 2;
@@ -877,6 +1030,2208 @@ TEST_CASE( "BON/integers", "Writing and reading of integers" )
 }
 
 
+// Returns the bytes written by 'w' to a header-less document.
+std::vector<uint8_t> write_bytes(Writer w)
+{
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_SKIP_HEADER_FOOTER);
+	w(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	std::vector<uint8_t> bytes(vec.data, vec.data + vec.size);
+	free(vec.data);
+	return bytes;
+}
+
+
+TEST_CASE( "BON/batch", "Batch writing of numbers gives the same bytes as one-by-one writing" )
+{
+	std::vector<int64_t> ints = {
+		0, 1, 31, 32, 127, 128, 255, 256, 0xffff, 0x10000,
+		0xffffffffLL, 0x100000000LL, INT64_MAX
+	};
+	
+	{
+		auto n = ints.size();
+		for (size_t i=0; i<n; ++i) {
+			ints.push_back( -ints[i] );
+		}
+		ints.push_back( INT64_MIN );
+	}
+	
+	std::vector<float> floats = {
+		0.0f, -0.0f, 1.0f, -16.0f, 3.14f, -3.14f, 1e10f, -1e30f,
+		2147483648.0f, -2147483648.0f, 1099511627776.0f,
+		INFINITY, -INFINITY, NAN, 1e-40f
+	};
+	
+	std::vector<double> doubles = {
+		0.0, -0.0, 1.0, -17.0, 3.14, 0.5, 1e300, -1e-300, 1e10,
+		9007199254740993.0, 2147483648.0,
+		INFINITY, -INFINITY, NAN, 3.14f
+	};
+	
+	// Make the batches longer than one internal step:
+	while (ints.size() < 200)    { ints.insert(ints.end(), ints.begin(), ints.end()); }
+	while (floats.size() < 200)  { floats.insert(floats.end(), floats.begin(), floats.end()); }
+	while (doubles.size() < 200) { doubles.insert(doubles.end(), doubles.begin(), doubles.end()); }
+	
+	std::vector<uint64_t> uints(ints.begin(), ints.end());
+	
+	REQUIRE( write_bytes([&](bon_w_doc* B) { for (auto v : uints) { bon_w_uint64(B, v); } }) ==
+	         write_bytes([&](bon_w_doc* B) { bon_w_uint64s(B, uints.data(), uints.size()); }) );
+	
+	REQUIRE( write_bytes([&](bon_w_doc* B) { for (auto v : ints) { bon_w_sint64(B, v); } }) ==
+	         write_bytes([&](bon_w_doc* B) { bon_w_sint64s(B, ints.data(), ints.size()); }) );
+	
+	REQUIRE( write_bytes([&](bon_w_doc* B) { for (auto v : floats) { bon_w_float(B, v); } }) ==
+	         write_bytes([&](bon_w_doc* B) { bon_w_floats(B, floats.data(), floats.size()); }) );
+	
+	REQUIRE( write_bytes([&](bon_w_doc* B) { for (auto v : doubles) { bon_w_double(B, v); } }) ==
+	         write_bytes([&](bon_w_doc* B) { bon_w_doubles(B, doubles.data(), doubles.size()); }) );
+}
+
+
+TEST_CASE( "BON/reset", "Reusing a bon_w_doc for many documents" )
+{
+	auto write_msg = [](bon_w_doc* B, int i) {
+		bon_w_obj_begin(B);
+		bon_w_key(B, "id");   bon_w_sint64(B, i);
+		bon_w_key(B, "msg");  bon_w_cstring(B, "The quick brown fox jumps over the lazy dog");
+		bon_w_obj_end(B);
+	};
+	
+	for (bon_size buff_size : {0, 16, 1024}) {
+		CAPTURE( buff_size );
+		
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new_sized(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT, buff_size);
+		
+		for (int i=0; i<3; ++i) {
+			CAPTURE( i );
+			
+			if (i > 0) {
+				vec.size = 0;
+				bon_w_reset(B, bon_vec_writer, &vec, BON_W_FLAG_CRC);
+			}
+			write_msg(B, i);
+			REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+			
+			// Compare with a fresh document:
+			bon_byte_vec fresh = {0,0,0};
+			bon_w_doc* F = bon_w_new(bon_vec_writer, &fresh, i > 0 ? BON_W_FLAG_CRC : BON_W_FLAG_DEFAULT);
+			write_msg(F, i);
+			REQUIRE( bon_w_close(F) == BON_SUCCESS );
+			
+			REQUIRE( vec.size == fresh.size );
+			REQUIRE( memcmp(vec.data, fresh.data, vec.size) == 0 );
+			free(fresh.data);
+			
+			bon_r_doc* R = bon_r_open(vec.data, vec.size, i > 0 ? BON_R_FLAG_REQUIRE_CRC : BON_R_FLAG_DEFAULT);
+			REQUIRE( bon_r_error(R) == BON_SUCCESS );
+			test_key_int(R, bon_r_root(R), "id", i);
+			bon_r_close(R);
+		}
+		
+		bon_w_free(B);
+		free(vec.data);
+	}
+}
+
+
+TEST_CASE( "BON/mem", "Encoding straight to memory" )
+{
+	std::string big(5000, 'x'); // Forces growth, and is a BIG_CHUNK for writers
+	
+	auto write_doc = [&](bon_w_doc* B) {
+		bon_w_obj_begin(B);
+		bon_w_key(B, "big");   bon_w_string(B, big.data(), big.size());
+		bon_w_key(B, "nums");
+		bon_w_list_begin(B);
+		for (int i=0; i<300; ++i) { bon_w_sint64(B, i * 1000 - 77); }
+		bon_w_list_end(B);
+		bon_w_obj_end(B);
+	};
+	
+	for (bon_w_flags flags : {BON_W_FLAG_DEFAULT, BON_W_FLAG_CRC}) {
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* V = bon_w_new(bon_vec_writer, &vec, flags);
+		write_doc(V);
+		REQUIRE( bon_w_close(V) == BON_SUCCESS );
+		
+		bon_w_doc* B = bon_w_new_mem(flags);
+		
+		for (int i=0; i<2; ++i) {
+			CAPTURE( i );
+			if (i > 0) {
+				bon_w_reset(B, NULL, NULL, flags);
+			}
+			write_doc(B);
+			REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+			
+			bon_size peek_size = 0;
+			const uint8_t* peek = bon_w_mem_data(B, &peek_size);
+			
+			bon_size size = 0;
+			uint8_t* data = bon_w_mem_take(B, &size);
+			REQUIRE( data == peek );
+			REQUIRE( size == peek_size );
+			REQUIRE( size == vec.size );
+			REQUIRE( memcmp(data, vec.data, size) == 0 );
+			
+			bon_r_doc* R = bon_r_open(data, size, flags & BON_W_FLAG_CRC ? BON_R_FLAG_REQUIRE_CRC : BON_R_FLAG_DEFAULT);
+			REQUIRE( bon_r_error(R) == BON_SUCCESS );
+			REQUIRE( bon_r_list_size(R, bon_r_get_key(R, bon_r_root(R), "nums")) == 300 );
+			bon_r_close(R);
+			free(data);
+		}
+		
+		bon_w_free(B);
+		free(vec.data);
+	}
+}
+
+
+TEST_CASE( "BON/measure", "Measuring, then encoding into a buffer of exactly the right size" )
+{
+	auto write_doc = [](bon_w_doc* B) {
+		bon_w_obj_begin(B);
+		bon_w_key(B, "name");   bon_w_cstring(B, "measure me");
+		bon_w_key(B, "pi");     bon_w_double(B, 3.14);
+		bon_w_key(B, "nums");
+		bon_w_list_begin(B);
+		for (int64_t i=-200; i<200; i += 7) { bon_w_sint64(B, i * i * i); }
+		bon_w_list_end(B);
+		bon_w_obj_end(B);
+	};
+	
+	for (bon_w_flags flags : {BON_W_FLAG_DEFAULT, BON_W_FLAG_CRC, BON_W_FLAG_SKIP_HEADER_FOOTER}) {
+		CAPTURE( flags );
+		
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* V = bon_w_new(bon_vec_writer, &vec, flags);
+		write_doc(V);
+		REQUIRE( bon_w_close(V) == BON_SUCCESS );
+		
+		bon_w_doc* M = bon_w_new_measure(flags);
+		write_doc(M);
+		REQUIRE( bon_w_finish(M) == BON_SUCCESS );
+		bon_size size = bon_w_size(M);
+		REQUIRE( size == vec.size );
+		bon_w_free(M);
+		
+		std::vector<uint8_t> exact(size);
+		bon_w_doc* B = bon_w_new_fixed(exact.data(), size, flags);
+		write_doc(B);
+		REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+		REQUIRE( bon_w_size(B) == size );
+		REQUIRE( memcmp(exact.data(), vec.data, size) == 0 );
+		
+		// Reset keeps writing into the same buffer:
+		memset(exact.data(), 0, size);
+		bon_w_reset(B, NULL, NULL, flags);
+		write_doc(B);
+		REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+		REQUIRE( memcmp(exact.data(), vec.data, size) == 0 );
+		
+		// Reset to a writer leaves the fixed buffer alone:
+		bon_byte_vec out = {0,0,0};
+		bon_w_reset(B, bon_vec_writer, &out, flags);
+		write_doc(B);
+		REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+		REQUIRE( out.size == size );
+		REQUIRE( memcmp(out.data, vec.data, size) == 0 );
+		bon_w_free(B);
+		free(out.data);
+		
+		// A buffer that is one byte too small:
+		bon_w_doc* S = bon_w_new_fixed(exact.data(), size - 1, flags);
+		write_doc(S);
+		REQUIRE( bon_w_close(S) == BON_ERR_WRITE_ERROR );
+		
+		free(vec.data);
+	}
+}
+
+
+TEST_CASE( "BON/log", "Segment log: append, random access, time search and recovery" )
+{
+	const char* path     = "test.bonlog";
+	const char* idx_path = "test.bonlog.idx";
+	remove(path);
+	remove(idx_path);
+	
+	const int N = 1000;
+	
+	bon_w_doc* B = bon_w_new_mem(BON_W_FLAG_CRC);
+	auto append = [&](bon_log* log, int i) {
+		bon_w_reset(B, NULL, NULL, BON_W_FLAG_CRC);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "i");  bon_w_sint64(B, i);
+		bon_w_obj_end(B);
+		REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+		bon_size size;
+		const uint8_t* data = bon_w_mem_data(B, &size);
+		REQUIRE( bon_log_append(log, 10 * (uint64_t)i, data, size) == BON_SUCCESS );
+	};
+	
+	auto verify = [&](int n) {
+		bon_log_reader* L = bon_log_reader_open(path);
+		REQUIRE( bon_log_reader_error(L) == BON_SUCCESS );
+		REQUIRE( bon_log_reader_count(L) == (bon_size)n );
+		
+		bon_log_record rec;
+		for (int i : {0, 1, 255, 256, 257, 700, n-1}) {
+			REQUIRE( bon_log_get(L, i, &rec) );
+			REQUIRE( rec.index == (bon_size)i );
+			REQUIRE( rec.timestamp == 10 * (uint64_t)i );
+			bon_r_doc* R = bon_r_open(rec.data, rec.size, BON_R_FLAG_REQUIRE_CRC);
+			test_key_int(R, bon_r_root(R), "i", i);
+			bon_r_close(R);
+		}
+		REQUIRE( !bon_log_get(L, n, &rec) );
+		
+		REQUIRE( bon_log_get(L, 0, &rec) );
+		int nRead = 1;
+		while (bon_log_next(L, &rec)) {
+			REQUIRE( rec.timestamp == 10 * (uint64_t)nRead );
+			++nRead;
+		}
+		REQUIRE( nRead == n );
+		
+		REQUIRE( bon_log_find_time(L, 0)        == 0 );
+		REQUIRE( bon_log_find_time(L, 2560)     == 256 );
+		REQUIRE( bon_log_find_time(L, 5555)     == 556 );
+		REQUIRE( bon_log_find_time(L, 10 * n)   == (bon_size)n );
+		bon_log_reader_close(L);
+	};
+	
+	{
+		bon_log* log = bon_log_open(path);
+		REQUIRE( bon_log_error(log) == BON_SUCCESS );
+		for (int i=0; i<N; ++i) {
+			append(log, i);
+		}
+		
+		// Records without a (correct) CRC are refused:
+		uint8_t no_crc[] = {'B', 'O', 'N', '0', BON_CTRL_NIL, BON_CTRL_FOOTER};
+		REQUIRE( bon_log_append(log, 0, no_crc, sizeof(no_crc)) == BON_ERR_MISSING_CRC );
+		
+		REQUIRE( bon_log_count(log) == (bon_size)N );
+		REQUIRE( bon_log_close(log) == BON_SUCCESS );
+	}
+	
+	verify(N);
+	
+	// Simulate a crash in the middle of appending a record:
+	{
+		FILE* fp = fopen(path, "ab");
+		uint8_t partial[] = {100, 0, 0, 0,  1, 2, 3, 4, 5, 6, 7, 8,  'B', 'O'};
+		fwrite(partial, 1, sizeof(partial), fp);
+		fclose(fp);
+	}
+	
+	verify(N); // Readers ignore the partial record
+	
+	{
+		bon_log* log = bon_log_open(path);
+		REQUIRE( bon_log_error(log) == BON_SUCCESS );
+		REQUIRE( bon_log_count(log) == (bon_size)N );
+		append(log, N);
+		REQUIRE( bon_log_close(log) == BON_SUCCESS );
+	}
+	
+	verify(N + 1);
+	
+	// A lost index is rebuilt:
+	remove(idx_path);
+	verify(N + 1);
+	{
+		bon_log* log = bon_log_open(path);
+		REQUIRE( bon_log_count(log) == (bon_size)N + 1 );
+		REQUIRE( bon_log_close(log) == BON_SUCCESS );
+	}
+	verify(N + 1);
+	
+	bon_w_free(B);
+	remove(path);
+	remove(idx_path);
+}
+
+
+TEST_CASE( "BON/plan", "Compiled unpacking of many aggregates" )
+{
+	struct InVert {
+		float    pos[3];
+		uint8_t  color[4];
+		int16_t  id;
+		int16_t  extra;
+	};
+	
+	struct OutVert {
+		double   pos[3];
+		int32_t  id;
+		uint8_t  color[4];
+	};
+	
+	static_assert(sizeof(InVert)  == 20, "pack");
+	static_assert(sizeof(OutVert) == 32, "pack");
+	
+	const int N = 100;
+	std::vector<InVert> in(N);
+	for (int i=0; i<N; ++i) {
+		in[i] = InVert{ {(float)i, 0.5f, -2.0f}, {(uint8_t)i, 1, 2, 3}, (int16_t)-i, 42 };
+	}
+	
+	const char* in_fmt  = "{$[3f]$[4u8]$i16$i16}";
+	const char* out_fmt = "{$[3d]$i32$[4u8]}";
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "list");  // A list of aggregates
+	bon_w_list_begin(B);
+	for (int i=0; i<N; ++i) {
+		bon_w_pack_fmt(B, &in[i], sizeof(InVert), in_fmt, "pos", "color", "id", "extra");
+	}
+	bon_w_list_end(B);
+	bon_w_key(B, "array");  // One aggregate
+	bon_w_pack_fmt(B, in.data(), N * sizeof(InVert), "[#{$[3f]$[4u8]$i16$i16}]", N, "pos", "color", "id", "extra");
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* list  = bon_r_get_key(R, bon_r_root(R), "list");
+	bon_value* array = bon_r_get_key(R, bon_r_root(R), "array");
+	
+	auto check = [&](const std::vector<OutVert>& out) {
+		for (int i=0; i<N; ++i) {
+			REQUIRE( out[i].id == -i );
+			REQUIRE( out[i].color[0] == (uint8_t)i );
+			REQUIRE( out[i].color[3] == 3 );
+			REQUIRE( out[i].pos[0] == i );
+			REQUIRE( out[i].pos[1] == 0.5 );
+			REQUIRE( out[i].pos[2] == -2.0 );
+		}
+	};
+	
+	bon_type* out_type = bon_new_type_fmt(out_fmt, "pos", "id", "color");
+	
+	{
+		// Explicit plan:
+		std::vector<OutVert> out(N);
+		bon_plan* plan = bon_r_new_plan(R, bon_r_list_elem(R, list, 0), out_type);
+		REQUIRE( plan );
+		for (int i=0; i<N; ++i) {
+			REQUIRE( bon_r_unpack_plan(R, bon_r_list_elem(R, list, i), &out[i], sizeof(OutVert), plan) );
+		}
+		check(out);
+		
+		// Wrong source type:
+		OutVert dummy;
+		REQUIRE( !bon_r_unpack_plan(R, array, &dummy, sizeof(OutVert), plan) );
+		bon_free_plan(plan);
+	}
+	
+	{
+		// Plans used by bon_r_unpack for lists of aggregates:
+		std::vector<OutVert> out(N);
+		REQUIRE( bon_r_unpack_fmt(R, list, out.data(), N * sizeof(OutVert),
+										  "[#{$[3d]$i32$[4u8]}]", N, "pos", "id", "color") );
+		check(out);
+	}
+	
+	{
+		// ...and for arrays of structs:
+		std::vector<OutVert> out(N);
+		REQUIRE( bon_r_unpack_fmt(R, array, out.data(), N * sizeof(OutVert),
+										  "[#{$[3d]$i32$[4u8]}]", N, "pos", "id", "color") );
+		check(out);
+	}
+	
+	{
+		// Missing key:
+		bon_type* bad_type = bon_new_type_fmt("{$i64$[3d]}", "id", "normal");
+		REQUIRE( bon_r_new_plan(R, bon_r_list_elem(R, list, 0), bad_type) == NULL );
+		bon_free_type(bad_type);
+	}
+	
+	bon_free_type(out_type);
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/shared_types", "Aggregates with identical types share one parsed type" )
+{
+	const int N = 1000;
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_list_begin(B);
+	for (int i=0; i<N; ++i) {
+		float pos[3] = {(float)i, 1, 2};
+		if (i % 100 == 99) {
+			double other[3] = {(double)i, 1, 2};
+			bon_w_pack_fmt(B, other, sizeof(other), "{$[3d]}", "pos");
+		} else {
+			bon_w_pack_fmt(B, pos, sizeof(pos), "{$[3f]}", "pos");
+		}
+	}
+	bon_w_list_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* list = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, list) == N );
+	
+	const bon_type* float_type  = &bon_r_list_elem(R, list,  0)->u.agg->type;
+	const bon_type* double_type = &bon_r_list_elem(R, list, 99)->u.agg->type;
+	REQUIRE( float_type->u.strct != double_type->u.strct );
+	
+	for (int i=0; i<N; ++i) {
+		const bon_type* type = &bon_r_list_elem(R, list, i)->u.agg->type;
+		REQUIRE( type->u.strct == (i % 100 == 99 ? double_type : float_type)->u.strct );
+		
+		float pos[3];
+		REQUIRE( bon_r_unpack_fmt(R, bon_r_list_elem(R, list, i), pos, sizeof(pos), "{$[3f]}", "pos") );
+		REQUIRE( pos[0] == i );
+	}
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/shared_types/many", "Many distinct aggregate types are hashed on their whole encoding" )
+{
+	const int N = 20000;
+	
+	// Long arrays all start with the same control byte, and so do structs with one field:
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_list_begin(B);
+	std::vector<uint8_t> bytes(64 + N / 10);
+	for (int i=0; i<N; ++i) {
+		if (i % 10 == 0) {
+			bon_size n = 64 + (bon_size)i / 10;
+			bon_w_pack_array(B, bytes.data(), n, n, BON_TYPE_UINT8);
+		} else {
+			int32_t v = i;
+			bon_w_pack_fmt(B, &v, sizeof(v), "{$i32}", ("k" + std::to_string(i)).c_str());
+		}
+	}
+	bon_w_list_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	REQUIRE( R->num_types == (bon_size)N );
+	
+	// The types are spread out over the table:
+	bon_size longest = 0;
+	for (bon_size bi=0; bi<R->num_type_buckets; ++bi) {
+		bon_size len = 0;
+		for (bon_type_entry* e = R->types[bi]; e; e = e->next) { ++len; }
+		longest = std::max(longest, len);
+	}
+	REQUIRE( longest < 16 );
+	
+	bon_value* list = bon_r_root(R);
+	for (int i : {1, 10, 9999, 10000, N-1}) {
+		bon_value* elem = bon_r_list_elem(R, list, i);
+		if (i % 10 == 0) {
+			REQUIRE( bon_r_list_size(R, elem) == 64 + (bon_size)i / 10 );
+		} else {
+			int32_t v = 0;
+			REQUIRE( bon_r_unpack_fmt(R, elem, &v, sizeof(v), "{$i32}", ("k" + std::to_string(i)).c_str()) );
+			REQUIRE( v == i );
+		}
+	}
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/fmt_cache", "Cached *_fmt types are keyed on the format and its arguments" )
+{
+	bon_fmt_cache_clear();
+	
+	const float a[4] = {1, 2, 3, 4};
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_list_begin(B);
+	std::string key = "x";
+	for (int i=0; i<3; ++i) {
+		// Same format and key content every time (a cache hit after the first):
+		bon_w_pack_fmt(B, a, 2*sizeof(float), "{$[#f]}", key.c_str(), (bon_size)2);
+	}
+	// Same format, different size:
+	bon_w_pack_fmt(B, a, 4*sizeof(float), "{$[#f]}", key.c_str(), (bon_size)4);
+	// Same key buffer, different key content:
+	key[0] = 'y';
+	bon_w_pack_fmt(B, a, 4*sizeof(float), "{$[#f]}", key.c_str(), (bon_size)4);
+	bon_w_list_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* list = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, list) == 5 );
+	
+	for (int i=0; i<3; ++i) {
+		auto xs = read_key(R, bon_r_list_elem(R, list, i), "x");
+		REQUIRE( bon_r_list_size(R, xs) == 2 );
+	}
+	REQUIRE( bon_r_list_size(R, read_key(R, bon_r_list_elem(R, list, 3), "x")) == 4 );
+	REQUIRE( bon_r_get_key(R, bon_r_list_elem(R, list, 4), "x") == NULL );
+	REQUIRE( bon_r_list_size(R, read_key(R, bon_r_list_elem(R, list, 4), "y")) == 4 );
+	
+	for (int rep=0; rep<3; ++rep) {
+		double out[2] = {0, 0};
+		REQUIRE( bon_r_unpack_fmt(R, bon_r_list_elem(R, list, 0), out, sizeof(out), "{$[#d]}", "x", (bon_size)2) );
+		REQUIRE( out[1] == 2 );
+		
+		double out4[4] = {0, 0, 0, 0};
+		REQUIRE( bon_r_unpack_fmt(R, bon_r_list_elem(R, list, 3), out4, sizeof(out4), "{$[#d]}", "x", (bon_size)4) );
+		REQUIRE( out4[3] == 4 );
+		
+		// Cached type with the wrong key must still fail:
+		REQUIRE( !bon_r_unpack_fmt(R, bon_r_list_elem(R, list, 4), out4, sizeof(out4), "{$[#d]}", "x", (bon_size)4) );
+		
+		auto ptr = (const float*)bon_r_unpack_ptr_fmt(R, bon_r_list_elem(R, list, 4), 4*sizeof(float), "{$[#f]}", "y", (bon_size)4);
+		REQUIRE( ptr );
+		REQUIRE( ptr[2] == 3 );
+	}
+	
+	// Other threads get caches of their own, freed when they exit:
+	bool thread_ok = false;
+	std::thread([&]() {
+		double out[2] = {0, 0};
+		thread_ok = bon_r_unpack_fmt(R, bon_r_list_elem(R, list, 0), out, sizeof(out), "{$[#d]}", "x", (bon_size)2) && out[1] == 2;
+	}).join();
+	REQUIRE( thread_ok );
+	
+	bon_r_close(R);
+	free(vec.data);
+	bon_fmt_cache_clear();
+}
+
+
+template<typename Src, typename Dst>
+void test_cast_kernel(bon_type_id src_id, bon_type_id dst_id, std::function<Src(int)> gen)
+{
+	for (int n : {0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 100}) {
+		std::vector<Src> src(n);
+		for (int i=0; i<n; ++i) {
+			src[i] = gen(i);
+		}
+		
+		bon_set_simd_level(BON_SIMD_NONE);
+		std::vector<Dst> expected(n);
+		REQUIRE( bon_cast_kernel(src_id, dst_id)(src.data(), expected.data(), n) );
+		
+		for (int level=BON_SIMD_SSE2; level<=BON_SIMD_AVX512; ++level) {
+			if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+			
+			std::vector<Dst> dst(n);
+			REQUIRE( bon_cast_kernel(src_id, dst_id)(src.data(), dst.data(), n) );
+			REQUIRE( dst == expected );
+		}
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512); // Back to the best supported
+}
+
+// Every level must reject 'bad' wherever it is in the array:
+template<typename Dst>
+void test_narrowing_kernel(bon_type_id dst_id, float good, float bad)
+{
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		
+		const int n = 37;
+		for (int at=0; at<n; ++at) {
+			std::vector<float> src(n, good);
+			std::vector<Dst>   dst(n);
+			REQUIRE( bon_cast_kernel(BON_TYPE_FLOAT, dst_id)(src.data(), dst.data(), n) );
+			src[at] = bad;
+			REQUIRE( !bon_cast_kernel(BON_TYPE_FLOAT, dst_id)(src.data(), dst.data(), n) );
+		}
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512);
+}
+
+TEST_CASE( "BON/simd", "SIMD cast kernels match the scalar ones" )
+{
+	INFO( "SIMD level: " << (int)bon_get_simd_level() );
+	
+	test_cast_kernel<float,  double>(BON_TYPE_FLOAT,  BON_TYPE_DOUBLE, [](int i) { return 0.1f * (float)i - 3; });
+	test_cast_kernel<double, float> (BON_TYPE_DOUBLE, BON_TYPE_FLOAT,  [](int i) { return 0.1 * i - 3; });
+	
+	test_cast_kernel<int32_t, float>(BON_TYPE_SINT32, BON_TYPE_FLOAT, [](int i) { return (int32_t)(i * 123456789u); });
+	test_cast_kernel<int16_t, float>(BON_TYPE_SINT16, BON_TYPE_FLOAT, [](int i) { return (int16_t)(i * 1237 - 32768); });
+	test_cast_kernel<int8_t,  float>(BON_TYPE_SINT8,  BON_TYPE_FLOAT, [](int i) { return (int8_t)(i * 7 - 128); });
+	test_cast_kernel<uint8_t, float>(BON_TYPE_UINT8,  BON_TYPE_FLOAT, [](int i) { return (uint8_t)(i * 7); });
+	
+	test_cast_kernel<float, int32_t> (BON_TYPE_FLOAT, BON_TYPE_SINT32, [](int i) { return (i%2 ? -2147483648.0f : 2147483520.0f) * (float)(i%3) / 2; });
+	test_cast_kernel<float, int16_t> (BON_TYPE_FLOAT, BON_TYPE_SINT16, [](int i) { return (i%2 ? -32768.9f : 32767.9f) * (float)(i%3) / 2; });
+	test_cast_kernel<float, uint16_t>(BON_TYPE_FLOAT, BON_TYPE_UINT16, [](int i) { return (i%2 ? -0.9f : 65535.9f) * (float)(i%3) / 2; });
+	test_cast_kernel<float, int8_t>  (BON_TYPE_FLOAT, BON_TYPE_SINT8,  [](int i) { return (i%2 ? -128.9f : 127.9f) * (float)(i%3) / 2; });
+	test_cast_kernel<float, uint8_t> (BON_TYPE_FLOAT, BON_TYPE_UINT8,  [](int i) { return (i%2 ? -0.9f : 255.9f) * (float)(i%3) / 2; });
+	
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	test_narrowing_kernel<int32_t> (BON_TYPE_SINT32, 1, 2147483648.0f);
+	test_narrowing_kernel<int32_t> (BON_TYPE_SINT32, 1, nan);
+	test_narrowing_kernel<int16_t> (BON_TYPE_SINT16, 1, -32769.0f);
+	test_narrowing_kernel<uint16_t>(BON_TYPE_UINT16, 1, 65536.0f);
+	test_narrowing_kernel<int8_t>  (BON_TYPE_SINT8,  1, 128.0f);
+	test_narrowing_kernel<uint8_t> (BON_TYPE_UINT8,  1, -1.0f);
+	test_narrowing_kernel<uint8_t> (BON_TYPE_UINT8,  1, nan);
+	
+	// Through the API:
+	std::vector<float> floats(100, 100.0f);
+	std::vector<uint8_t> colors(100);
+	for (int i=0; i<100; ++i) {
+		colors[i] = (uint8_t)(i * 5 / 2);
+	}
+	colors[99] = 255;
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "floats");
+	bon_w_pack_array(B, floats.data(), floats.size() * sizeof(float), floats.size(), BON_TYPE_FLOAT);
+	bon_w_key(B, "colors");
+	bon_w_pack_array(B, colors.data(), colors.size(), colors.size(), BON_TYPE_UINT8);
+	floats[50] = 1000;
+	bon_w_key(B, "too_big");
+	bon_w_pack_array(B, floats.data(), floats.size() * sizeof(float), floats.size(), BON_TYPE_FLOAT);
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	
+	int8_t s8[100];
+	REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "floats"), s8, sizeof(s8), "[100i8]") );
+	REQUIRE( s8[99] == 100 );
+	
+	REQUIRE( !bon_r_unpack_fmt(R, read_key(R, root, "too_big"), s8, sizeof(s8), "[100i8]") );
+	
+	float unorm[100];
+	REQUIRE( bon_r_unpack_unorm8(R, read_key(R, root, "colors"), unorm, 100) );
+	REQUIRE( unorm[0]  == 0.0f );
+	REQUIRE( unorm[2]  == 5.0f / 255.0f );
+	REQUIRE( unorm[99] == 1.0f );
+	REQUIRE( !bon_r_unpack_unorm8(R, read_key(R, root, "colors"), unorm, 99) );
+	REQUIRE( !bon_r_unpack_unorm8(R, read_key(R, root, "floats"), unorm, 100) );
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+template<typename T>
+T reverse_bytes(T value)
+{
+	T out;
+	auto in_bytes  = (const uint8_t*)&value;
+	auto out_bytes = (uint8_t*)&out;
+	for (size_t i=0; i<sizeof(T); ++i) {
+		out_bytes[i] = in_bytes[sizeof(T) - 1 - i];
+	}
+	return out;
+}
+
+// 'Src' values stored with 'foreign_id' (non-native endian) must cast like native ones.
+template<typename Src, typename Dst>
+void test_swap_kernel(bon_type_id foreign_id, bon_type_id dst_id, std::function<Src(int)> gen)
+{
+	for (int n : {0, 1, 3, 7, 8, 15, 16, 17, 31, 32, 33, 255, 256, 257, 600}) {
+		std::vector<Src> swapped(n);
+		std::vector<Dst> expected(n);
+		for (int i=0; i<n; ++i) {
+			Src v       = gen(i);
+			swapped[i]  = reverse_bytes(v);
+			expected[i] = (Dst)v;
+		}
+		
+		for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+			if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+			
+			std::vector<Dst> dst(n);
+			bon_cast_fn cast = bon_cast_kernel(foreign_id, dst_id);
+			REQUIRE( cast );
+			REQUIRE( cast(swapped.data(), dst.data(), n) );
+			REQUIRE( dst == expected );
+		}
+	}
+	
+	bon_set_simd_level(BON_SIMD_AVX512);
+}
+
+TEST_CASE( "BON/swap", "Non-native endian arrays are byte swapped in bulk" )
+{
+#if __LITTLE_ENDIAN__
+	const bon_type_id F32 = BON_TYPE_FLOAT_BE,  F64 = BON_TYPE_DOUBLE_BE;
+	const bon_type_id S16 = BON_TYPE_SINT16_BE, U16 = BON_TYPE_UINT16_BE;
+	const bon_type_id S32 = BON_TYPE_SINT32_BE, U32 = BON_TYPE_UINT32_BE;
+	const bon_type_id S64 = BON_TYPE_SINT64_BE, U64 = BON_TYPE_UINT64_BE;
+#else
+	const bon_type_id F32 = BON_TYPE_FLOAT_LE,  F64 = BON_TYPE_DOUBLE_LE;
+	const bon_type_id S16 = BON_TYPE_SINT16_LE, U16 = BON_TYPE_UINT16_LE;
+	const bon_type_id S32 = BON_TYPE_SINT32_LE, U32 = BON_TYPE_UINT32_LE;
+	const bon_type_id S64 = BON_TYPE_SINT64_LE, U64 = BON_TYPE_UINT64_LE;
+#endif
+	
+	// To the same native type: just a swap
+	test_swap_kernel<float,    float>   (F32, BON_TYPE_FLOAT,  [](int i) { return 0.25f * (float)i - 7; });
+	test_swap_kernel<double,   double>  (F64, BON_TYPE_DOUBLE, [](int i) { return 0.1 * i - 7; });
+	test_swap_kernel<int16_t,  int16_t> (S16, BON_TYPE_SINT16, [](int i) { return (int16_t)(i * 1237 - 32768); });
+	test_swap_kernel<uint16_t, uint16_t>(U16, BON_TYPE_UINT16, [](int i) { return (uint16_t)(i * 1237); });
+	test_swap_kernel<int32_t,  int32_t> (S32, BON_TYPE_SINT32, [](int i) { return (int32_t)(i * 123456789u); });
+	test_swap_kernel<uint32_t, uint32_t>(U32, BON_TYPE_UINT32, [](int i) { return (uint32_t)(i * 123456789u); });
+	test_swap_kernel<int64_t,  int64_t> (S64, BON_TYPE_SINT64, [](int i) { return (int64_t)(i * 1234567890123ull); });
+	test_swap_kernel<uint64_t, uint64_t>(U64, BON_TYPE_UINT64, [](int i) { return (uint64_t)(i * 1234567890123ull); });
+	
+	// To other types:
+	test_swap_kernel<float,    double>  (F32, BON_TYPE_DOUBLE, [](int i) { return 0.25f * (float)i - 7; });
+	test_swap_kernel<float,    int16_t> (F32, BON_TYPE_SINT16, [](int i) { return 0.25f * (float)i - 7; });
+	test_swap_kernel<double,   float>   (F64, BON_TYPE_FLOAT,  [](int i) { return 0.1 * i - 7; });
+	test_swap_kernel<int16_t,  float>   (S16, BON_TYPE_FLOAT,  [](int i) { return (int16_t)(i * 1237 - 32768); });
+	test_swap_kernel<uint16_t, int32_t> (U16, BON_TYPE_SINT32, [](int i) { return (uint16_t)(i * 1237); });
+	test_swap_kernel<int32_t,  double>  (S32, BON_TYPE_DOUBLE, [](int i) { return (int32_t)(i * 123456789u); });
+	test_swap_kernel<uint32_t, uint64_t>(U32, BON_TYPE_UINT64, [](int i) { return (uint32_t)(i * 123456789u); });
+	test_swap_kernel<int64_t,  double>  (S64, BON_TYPE_DOUBLE, [](int i) { return (int64_t)(i * 1234567890123ull); });
+	test_swap_kernel<uint64_t, uint8_t> (U64, BON_TYPE_UINT8,  [](int i) { return (uint64_t)(i * 1234567890123ull); });
+	
+	// Narrowing is still caught after the swap:
+	{
+		std::vector<float> src(300, reverse_bytes(1.0f));
+		src[280] = reverse_bytes(1000.0f);
+		std::vector<int8_t> dst(300);
+		REQUIRE( !bon_cast_kernel(F32, BON_TYPE_SINT8)(src.data(), dst.data(), src.size()) );
+	}
+	
+	// Through the API:
+	const int N = 1000;
+	std::vector<float> be_floats(N);
+	for (int i=0; i<N; ++i) {
+		be_floats[i] = reverse_bytes((float)i);
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "be");
+	bon_w_pack_array(B, be_floats.data(), N * sizeof(float), N, F32);
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* be = read_key(R, bon_r_root(R), "be");
+	
+	std::vector<float> floats(N);
+	REQUIRE( bon_r_unpack_fmt(R, be, floats.data(), N * sizeof(float), "[#f]", (bon_size)N) );
+	std::vector<double> doubles(N);
+	REQUIRE( bon_r_unpack_fmt(R, be, doubles.data(), N * sizeof(double), "[#d]", (bon_size)N) );
+	std::vector<uint16_t> shorts(N);
+	REQUIRE( bon_r_unpack_fmt(R, be, shorts.data(), N * sizeof(uint16_t), "[#u16]", (bon_size)N) );
+	for (int i=0; i<N; ++i) {
+		REQUIRE( floats[i]  == i );
+		REQUIRE( doubles[i] == i );
+		REQUIRE( shorts[i]  == i );
+	}
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/threads", "Unpacking large aggregates on many threads gives the serial result" )
+{
+	struct InVert {
+		float    pos[3];
+		int32_t  id;
+		uint8_t  color[4];
+	};
+	static_assert(sizeof(InVert) == 20, "pack");
+	const size_t OutVertSize = 3*sizeof(double) + sizeof(int16_t) + 4; // Unaligned: bytes only
+	
+	const int NVerts  = 100 * 1000;  // 2 MB in, 3 MB out
+	const int NFloats = 1000 * 1000 + 7;
+	
+	std::vector<InVert> verts(NVerts);
+	for (int i=0; i<NVerts; ++i) {
+		InVert& v = verts[i];
+		v.pos[0] = (float)i;  v.pos[1] = 0.5f * (float)i;  v.pos[2] = -(float)i;
+		v.id = i % 30000;
+		for (int c=0; c<4; ++c) { v.color[c] = (uint8_t)(i + c); }
+	}
+	std::vector<float> floats(NFloats);
+	for (int i=0; i<NFloats; ++i) {
+		floats[i] = 0.25f * (float)(i % 1000);
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "verts");
+	bon_w_pack_fmt(B, verts.data(), verts.size() * sizeof(InVert), "[#{$[3f]$i32$[4u8]}]",
+						(bon_size)NVerts, "pos", "id", "color");
+	bon_w_key(B, "floats");
+	bon_w_pack_array(B, floats.data(), floats.size() * sizeof(float), floats.size(), BON_TYPE_FLOAT);
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	
+	struct Result {
+		std::vector<uint8_t>  verts;
+		std::vector<double>   doubles;
+		std::vector<float>    floats;
+		std::vector<int16_t>  shorts;
+	};
+	
+	auto unpack = [&](unsigned num_threads) {
+		bon_r_set_num_threads(R, num_threads);
+		
+		Result res;
+		res.verts.resize(NVerts * OutVertSize);
+		REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "verts"), res.verts.data(), res.verts.size(),
+										  "[#{$[3d]$i16$[4u8]}]", (bon_size)NVerts, "pos", "id", "color") );
+		
+		res.doubles.resize(NFloats);
+		REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "floats"), res.doubles.data(), NFloats * sizeof(double),
+										  "[#d]", (bon_size)NFloats) );
+		res.floats.resize(NFloats);
+		REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "floats"), res.floats.data(), NFloats * sizeof(float),
+										  "[#f]", (bon_size)NFloats) );
+		res.shorts.resize(NFloats);
+		REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "floats"), res.shorts.data(), NFloats * sizeof(int16_t),
+										  "[#i16]", (bon_size)NFloats) );
+		return res;
+	};
+	
+	Result serial = unpack(1);
+	double  last_x;
+	int16_t last_id;
+	memcpy(&last_x,  &serial.verts[(NVerts-1) * OutVertSize], sizeof(double));
+	memcpy(&last_id, &serial.verts[(NVerts-1) * OutVertSize + 3*sizeof(double)], sizeof(int16_t));
+	REQUIRE( last_x  == NVerts-1 );
+	REQUIRE( last_id == (NVerts-1) % 30000 );
+	REQUIRE( serial.doubles[NFloats-1]     == floats[NFloats-1] );
+	REQUIRE( serial.floats == floats );
+	
+	for (unsigned num_threads : {2u, 3u, 8u, 0u}) {
+		Result parallel = unpack(num_threads);
+		REQUIRE( parallel.verts   == serial.verts );
+		REQUIRE( parallel.doubles == serial.doubles );
+		REQUIRE( parallel.floats  == serial.floats );
+		REQUIRE( parallel.shorts  == serial.shorts );
+	}
+	
+	// A narrowing anywhere still fails the whole unpack:
+	bon_r_close(R);
+	floats[NFloats - 3] = 1e6f;
+	free(vec.data);
+	vec = {0,0,0};
+	B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_pack_array(B, floats.data(), floats.size() * sizeof(float), floats.size(), BON_TYPE_FLOAT);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	bon_r_set_num_threads(R, 4);
+	std::vector<int16_t> shorts(NFloats);
+	REQUIRE( !bon_r_unpack_fmt(R, bon_r_root(R), shorts.data(), NFloats * sizeof(int16_t), "[#i16]", (bon_size)NFloats) );
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/soa", "Unpacking an array of structs into a struct of arrays" )
+{
+	struct Vert {
+		float    pos[3];
+		float    normal[3];
+		uint8_t  color[4];
+	};
+	static_assert(sizeof(Vert) == 28, "pack");
+	
+	const int N = 50 * 1000 + 13; // Not a multiple of the block size
+	std::vector<Vert> verts(N);
+	for (int i=0; i<N; ++i) {
+		for (int d=0; d<3; ++d) {
+			verts[i].pos[d]    = (float)(i + d);
+			verts[i].normal[d] = 0.5f * (float)d - (float)(i % 7);
+		}
+		for (int c=0; c<4; ++c) {
+			verts[i].color[c] = (uint8_t)(i * 3 + c);
+		}
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_pack_fmt(B, verts.data(), N * sizeof(Vert), "[#{$[3f]$[3f]$[4u8]}]",
+						(bon_size)N, "pos", "normal", "color");
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	
+	bon_type* vec3f = bon_new_type_fmt("[3f]");
+	bon_type* vec3d = bon_new_type_fmt("[3d]");
+	bon_type* rgba  = bon_new_type_fmt("[4u8]");
+	bon_type* rgbaf = bon_new_type_fmt("[4f]");
+	
+	struct Padded { double normal[3]; double pad; };
+	
+	for (unsigned num_threads : {1u, 4u}) {
+		bon_r_set_num_threads(R, num_threads);
+		
+		std::vector<float>    positions(3 * N);
+		std::vector<double>   normals(3 * N);
+		std::vector<Padded>   padded(N);
+		std::vector<uint8_t>  colors(8 * N, 0xAB); // Every other 4 bytes
+		std::vector<float>    colorsf(4 * N);
+		
+		bon_soa_field fields[] = {
+			{"pos",    vec3f, positions.data(), 0},               // Plain copy
+			{"normal", vec3d, normals.data(),   0},               // Gather, then cast
+			{"normal", vec3d, padded.data(),    sizeof(Padded)},  // Converted element by element
+			{"color",  rgba,  colors.data(),    8},               // Strided copy
+			{"color",  rgbaf, colorsf.data(),   0},
+		};
+		REQUIRE( bon_r_unpack_soa(R, root, N, fields, sizeof(fields) / sizeof(fields[0])) );
+		
+		bool all_match = true;
+		for (int i=0; i<N; ++i) {
+			for (int d=0; d<3; ++d) {
+				all_match &= positions[3*i + d]  == verts[i].pos[d];
+				all_match &= normals[3*i + d]    == verts[i].normal[d];
+				all_match &= padded[i].normal[d] == verts[i].normal[d];
+			}
+			for (int c=0; c<4; ++c) {
+				all_match &= colors[8*i + c]     == verts[i].color[c];
+				all_match &= colors[8*i + 4 + c] == 0xAB;
+				all_match &= colorsf[4*i + c]    == verts[i].color[c];
+			}
+		}
+		REQUIRE( all_match );
+	}
+	
+	std::vector<float> positions(3 * N);
+	bon_soa_field missing[] = { {"normal", vec3f, positions.data(), 0}, {"uv", vec3f, positions.data(), 0} };
+	REQUIRE( !bon_r_unpack_soa(R, root, N, missing, 2) );
+	REQUIRE( !bon_r_unpack_soa(R, root, N - 1, missing, 1) );
+	bon_soa_field wrong[] = { {"color", vec3f, positions.data(), 0} };
+	REQUIRE( !bon_r_unpack_soa(R, root, N, wrong, 1) );
+	
+	bon_free_type(vec3f);
+	bon_free_type(vec3d);
+	bon_free_type(rgba);
+	bon_free_type(rgbaf);
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/range", "Unpacking slices and fields of packed arrays" )
+{
+	struct Vert {
+		float    pos[3];
+		uint8_t  color[4];
+	};
+	static_assert(sizeof(Vert) == 16, "pack");
+	
+	const int NFloats = 100 * 1000;
+	const int NVerts  = 1000;
+	
+	std::vector<float> floats(NFloats);
+	for (int i=0; i<NFloats; ++i) {
+		floats[i] = (float)i;
+	}
+	std::vector<Vert> verts(NVerts);
+	for (int i=0; i<NVerts; ++i) {
+		verts[i].pos[0] = (float)i;  verts[i].pos[1] = 1;  verts[i].pos[2] = 2;
+		for (int c=0; c<4; ++c) {
+			verts[i].color[c] = (uint8_t)(i + c);
+		}
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "floats");
+	bon_w_pack_array(B, floats.data(), NFloats * sizeof(float), NFloats, BON_TYPE_FLOAT);
+	bon_w_key(B, "verts");
+	bon_w_pack_fmt(B, verts.data(), NVerts * sizeof(Vert), "[#{$[3f]$[4u8]}]", (bon_size)NVerts, "pos", "color");
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	bon_value* fv   = read_key(R, root, "floats");
+	bon_value* vv   = read_key(R, root, "verts");
+	
+	bon_type* f32  = bon_new_type_simple(BON_TYPE_FLOAT);
+	bon_type* f64  = bon_new_type_simple(BON_TYPE_DOUBLE);
+	bon_type* i32  = bon_new_type_simple(BON_TYPE_SINT32);
+	bon_type* vec3 = bon_new_type_fmt("[3d]");
+	bon_type* vert = bon_new_type_fmt("{$[4u8]$[3d]}", "color", "pos");
+	
+	// Pointers to slices:
+	auto ptr = (const float*)bon_r_unpack_range_ptr(R, fv, 90000, 90100, f32);
+	REQUIRE( ptr );
+	REQUIRE( ptr[0]  == 90000 );
+	REQUIRE( ptr[99] == 90099 );
+	REQUIRE( bon_r_unpack_range_ptr(R, fv, 0, NFloats, f32) );
+	REQUIRE( bon_r_unpack_range_ptr(R, fv, NFloats, NFloats, f32) ); // Empty
+	REQUIRE( !bon_r_unpack_range_ptr(R, fv, 0, NFloats + 1, f32) );
+	REQUIRE( !bon_r_unpack_range_ptr(R, fv, 10, 9, f32) );
+	REQUIRE( !bon_r_unpack_range_ptr(R, fv, 0, 10, f64) );
+	REQUIRE( !bon_r_unpack_range_ptr(R, root, 0, 1, f32) );
+	
+	// Converting slices:
+	double dbls[100];
+	REQUIRE( bon_r_unpack_range(R, fv, 90000, 90100, dbls, sizeof(dbls), f64) );
+	REQUIRE( dbls[0]  == 90000 );
+	REQUIRE( dbls[99] == 90099 );
+	REQUIRE( !bon_r_unpack_range(R, fv, 90000, 90100, dbls, sizeof(dbls) - 8, f64) );
+	REQUIRE( !bon_r_unpack_range(R, fv, NFloats - 50, NFloats + 50, dbls, sizeof(dbls), f64) );
+	
+	int32_t ints[3];
+	REQUIRE( bon_r_unpack_range(R, fv, 7, 10, ints, sizeof(ints), i32) );
+	REQUIRE( ints[2] == 9 );
+	
+	struct OutVert {
+		uint8_t  color[4];
+		double   pos[3];
+	};
+	std::vector<OutVert> out(10);
+	std::vector<uint8_t> out_bytes(10 * 28);
+	REQUIRE( bon_r_unpack_range(R, vv, 500, 510, out_bytes.data(), out_bytes.size(), vert) );
+	for (int i=0; i<10; ++i) {
+		memcpy(&out[i].color, &out_bytes[28*i], 4);
+		memcpy(&out[i].pos,   &out_bytes[28*i + 4], 24);
+		REQUIRE( out[i].color[1] == (uint8_t)(501 + i) );
+		REQUIRE( out[i].pos[0]   == 500 + i );
+		REQUIRE( out[i].pos[2]   == 2 );
+	}
+	
+	// Single fields, written with a stride:
+	struct MyVert {
+		double  pos[3];
+		int     extra;
+	};
+	std::vector<MyVert> my(NVerts, MyVert{{0,0,0}, 42});
+	REQUIRE( bon_r_unpack_field(R, vv, 0, NVerts, "pos", &my[0].pos, sizeof(MyVert), vec3) );
+	for (int i=0; i<NVerts; ++i) {
+		REQUIRE( my[i].pos[0] == i );
+		REQUIRE( my[i].extra == 42 );
+	}
+	
+	double pos[2][3];
+	REQUIRE( bon_r_unpack_field(R, vv, 998, 1000, "pos", pos, 0, vec3) );
+	REQUIRE( pos[1][0] == 999 );
+	REQUIRE( !bon_r_unpack_field(R, vv, 998, 1001, "pos", pos, 0, vec3) );
+	REQUIRE( !bon_r_unpack_field(R, vv, 0, 2, "normal", pos, 0, vec3) );
+	REQUIRE( !bon_r_unpack_field(R, fv, 0, 2, "pos", pos, 0, vec3) );
+	
+	bon_free_type(f32);
+	bon_free_type(f64);
+	bon_free_type(i32);
+	bon_free_type(vec3);
+	bon_free_type(vert);
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/align", "Aligned packed blocks" )
+{
+	const int NFloats = 1000;
+	std::vector<float> floats(NFloats);
+	for (int i=0; i<NFloats; ++i) {
+		floats[i] = (float)i;
+	}
+	
+	struct Vert {
+		float    pos[3];
+		uint8_t  color[4];
+	};
+	std::vector<Vert> verts(100);
+	for (int i=0; i<100; ++i) {
+		verts[i] = Vert{{(float)i, 0, 0}, {1, 2, 3, (uint8_t)i}};
+	}
+	bon_type* vert_type = bon_new_type_fmt("[#{$[3f]$[4u8]}]", (bon_size)100, "pos", "color");
+	bon_type* float_type = bon_new_type_simple_array(NFloats, BON_TYPE_FLOAT);
+	
+	auto write_doc = [&](bon_w_doc* B) {
+		bon_w_block_begin(B, 0);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "floats");  bon_w_block_ref(B, 1);
+		bon_w_key(B, "verts");   bon_w_block_ref(B, 2);
+		bon_w_obj_end(B);
+		bon_w_block_end(B);
+		
+		bon_w_block_pack(B, 1, floats.data(), NFloats * sizeof(float), float_type, 64);
+		bon_w_block_pack(B, 2, verts.data(), verts.size() * sizeof(Vert), vert_type, 4096);
+	};
+	
+	for (bon_w_flags flags : {BON_W_FLAG_DEFAULT, BON_W_FLAG_CRC}) {
+		CAPTURE( flags );
+		
+		bon_w_doc* M = bon_w_new_mem(flags);
+		write_doc(M);
+		REQUIRE( bon_w_finish(M) == BON_SUCCESS );
+		bon_size size;
+		const uint8_t* data = bon_w_mem_data(M, &size);
+		
+		bon_w_doc* S = bon_w_new_measure(flags);
+		write_doc(S);
+		REQUIRE( bon_w_finish(S) == BON_SUCCESS );
+		REQUIRE( bon_w_size(S) == size );
+		bon_w_free(S);
+		
+		// Load the document at a page boundary:
+		std::vector<uint8_t> storage(size + 4096);
+		uint8_t* doc = storage.data() + (4096 - (uintptr_t)storage.data() % 4096) % 4096;
+		memcpy(doc, data, size);
+		bon_w_free(M);
+		
+		bon_r_flags rflags = (flags & BON_W_FLAG_CRC ? BON_R_FLAG_REQUIRE_CRC : BON_R_FLAG_DEFAULT);
+		bon_r_doc* R = bon_r_open(doc, size, rflags);
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		bon_value* root = bon_r_root(R);
+		
+		bon_value* fv = read_key(R, root, "floats");
+		auto fptr = (const float*)bon_r_unpack_ptr(R, fv, NFloats * sizeof(float), float_type);
+		REQUIRE( fptr );
+		REQUIRE( ((uintptr_t)fptr % 64) == 0 );
+		REQUIRE( bon_r_payload_align(R, fv) >= 64 );
+		REQUIRE( fptr[NFloats - 1] == NFloats - 1 );
+		
+		bon_value* vv = read_key(R, root, "verts");
+		auto vptr = (const Vert*)bon_r_unpack_ptr(R, vv, verts.size() * sizeof(Vert), vert_type);
+		REQUIRE( vptr );
+		REQUIRE( bon_r_payload_align(R, vv) == 4096 );
+		REQUIRE( vptr[99].pos[0] == 99 );
+		REQUIRE( vptr[99].color[3] == 99 );
+		
+		REQUIRE( bon_r_payload_align(R, root) == 0 );
+		
+		bon_r_close(R);
+	}
+	
+	bon_free_type(vert_type);
+	bon_free_type(float_type);
+}
+
+
+TEST_CASE( "BON/agg_access", "Element access on packed data without exploding it" )
+{
+	struct Vert {
+		float    pos[3];
+		uint8_t  color[4];
+	};
+	
+	const int NFloats = 1000 * 1000;
+	std::vector<float> floats(NFloats);
+	for (int i=0; i<NFloats; ++i) {
+		floats[i] = (float)i;
+	}
+	std::vector<Vert> verts(10);
+	for (int i=0; i<10; ++i) {
+		verts[i] = Vert{{(float)i, 10.0f + i, 20.0f + i}, {1, 2, 3, (uint8_t)i}};
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "floats");
+	bon_w_pack_array(B, floats.data(), NFloats * sizeof(float), NFloats, BON_TYPE_FLOAT);
+	bon_w_key(B, "verts");
+	bon_w_pack_fmt(B, verts.data(), verts.size() * sizeof(Vert), "[#{$[3f]$[4u8]}]", (bon_size)verts.size(), "pos", "color");
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	
+	bon_value* fv = read_key(R, root, "floats");
+	REQUIRE( bon_r_list_size(R, fv) == NFloats );
+	REQUIRE( bon_r_double(R, bon_r_list_elem(R, fv, 0)) == 0 );
+	REQUIRE( bon_r_double(R, bon_r_list_elem(R, fv, 777777)) == 777777 );
+	REQUIRE( bon_r_list_elem(R, fv, NFloats) == NULL );
+	REQUIRE( bon_r_get_key(R, fv, "foo") == NULL );
+	
+	bon_value* vv = read_key(R, root, "verts");
+	bon_value* v7 = bon_r_list_elem(R, vv, 7);
+	REQUIRE( bon_r_is_object(R, v7) );
+	REQUIRE( bon_r_list_elem(R, vv, 7) == v7 );
+	REQUIRE( bon_r_obj_size(R, v7) == 2 );
+	REQUIRE( std::string(bon_r_obj_key(R, v7, 1)) == "color" );
+	REQUIRE( bon_r_obj_key(R, v7, 2) == NULL );
+	REQUIRE( bon_r_list_size(R, bon_r_obj_value(R, v7, 1)) == 4 );
+	REQUIRE( bon_r_int(R, bon_r_list_elem(R, bon_r_obj_value(R, v7, 1), 3)) == 7 );
+	
+	bon_value* pos = bon_r_get_key(R, v7, "pos");
+	REQUIRE( bon_r_is_list(R, pos) );
+	REQUIRE( bon_r_float(R, bon_r_list_elem(R, pos, 1)) == 17 );
+	REQUIRE( bon_r_get_key(R, v7, "normal") == NULL );
+	
+	float pos_f[3];
+	REQUIRE( bon_r_unpack_fmt(R, pos, pos_f, sizeof(pos_f), "[3f]") );
+	REQUIRE( pos_f[2] == 27 );
+	
+	// Nothing was exploded, and only what we touched got a value:
+	REQUIRE( fv->u.agg->exploded == NULL );
+	REQUIRE( vv->u.agg->exploded == NULL );
+	REQUIRE( R->num_proxies < 20 );
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/agg_access/flat", "Reading every element of a big array keeps no value per element" )
+{
+	const int NFloats = 1000 * 1000;
+	std::vector<float> floats(NFloats);
+	for (int i=0; i<NFloats; ++i) {
+		floats[i] = (float)i;
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_pack_array(B, floats.data(), NFloats * sizeof(float), NFloats, BON_TYPE_FLOAT);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	
+	bon_size num_proxies = R->num_proxies;
+	int num_wrong = 0;
+	for (int i=0; i<NFloats; ++i) {
+		if (bon_r_float(R, bon_r_list_elem(R, root, (bon_size)i)) != (float)i) {
+			++num_wrong;
+		}
+	}
+	REQUIRE( num_wrong == 0 );
+	REQUIRE( R->num_proxies == num_proxies );
+	REQUIRE( R->proxies == NULL );
+	
+	// A number stays put until BON_R_NUMBER_SLOTS more have been read:
+	bon_value* first = bon_r_list_elem(R, root, 42);
+	for (int i=1; i<BON_R_NUMBER_SLOTS; ++i) {
+		bon_r_list_elem(R, root, (bon_size)i);
+	}
+	REQUIRE( bon_r_float(R, first) == 42 );
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+
+TEST_CASE( "BON/half", "Half precision and bfloat16 packed arrays" )
+{
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	
+	// Scalar conversions:
+	REQUIRE( bon_float_to_half(1.0f)    == 0x3c00 );
+	REQUIRE( bon_float_to_half(-2.0f)   == 0xc000 );
+	REQUIRE( bon_float_to_half(65504)   == 0x7bff );
+	REQUIRE( bon_float_to_half(65520)   == 0x7c00 ); // Rounds to inf
+	REQUIRE( bon_float_to_half(inf)     == 0x7c00 );
+	REQUIRE( bon_float_to_half(1e-10f)  == 0x0000 );
+	REQUIRE( bon_float_to_half(1.0f + 1.0f/2048) == 0x3c00 ); // Tie to even
+	REQUIRE( bon_float_to_half(1.0f + 3.0f/2048) == 0x3c02 ); // Tie to even
+	REQUIRE( std::isnan(bon_half_to_float(bon_float_to_half(nan))) );
+	REQUIRE( bon_half_to_float(0x0001)  == std::ldexp(1.0f, -24) ); // Smallest subnormal
+	REQUIRE( bon_half_to_float(0x7c00)  == inf );
+	REQUIRE( bon_half_to_float(0xfbff)  == -65504 );
+	
+	REQUIRE( bon_float_to_bf16(1.0f)    == 0x3f80 );
+	REQUIRE( bon_float_to_bf16(inf)     == 0x7f80 );
+	REQUIRE( bon_bf16_to_float(0xc040)  == -3.0f );
+	REQUIRE( std::isnan(bon_bf16_to_float(bon_float_to_bf16(nan))) );
+	
+	for (uint32_t h=0; h<0x10000; ++h) {
+		float f = bon_half_to_float((uint16_t)h);
+		if (!std::isnan(f)) {
+			REQUIRE( bon_float_to_half(f) == h );
+		}
+	}
+	
+	// Every SIMD level agrees with the portable code:
+	const int n = 1001;
+	std::vector<uint16_t> halfs(n), bf16s(n);
+	std::vector<float>    floats(n);
+	for (int i=0; i<n; ++i) {
+		halfs[i]  = (uint16_t)(i * 65);
+		bf16s[i]  = (uint16_t)(i * 65);
+		floats[i] = (float)(i - 500) * 1.37f;
+	}
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		
+		std::vector<float>    f(n);
+		std::vector<uint16_t> h(n);
+		REQUIRE( bon_cast_kernel(BON_TYPE_HALF, BON_TYPE_FLOAT)(halfs.data(), f.data(), n) );
+		for (int i=0; i<n; ++i) {
+			float expected = bon_half_to_float(halfs[i]);
+			REQUIRE( (f[i] == expected || (std::isnan(f[i]) && std::isnan(expected))) );
+		}
+		REQUIRE( bon_cast_kernel(BON_TYPE_BF16, BON_TYPE_FLOAT)(bf16s.data(), f.data(), n) );
+		for (int i=0; i<n; ++i) {
+			float expected = bon_bf16_to_float(bf16s[i]);
+			REQUIRE( (f[i] == expected || (std::isnan(f[i]) && std::isnan(expected))) );
+		}
+		REQUIRE( bon_cast_kernel(BON_TYPE_FLOAT, BON_TYPE_HALF)(floats.data(), h.data(), n) );
+		for (int i=0; i<n; ++i) {
+			REQUIRE( h[i] == bon_float_to_half(floats[i]) );
+		}
+	}
+	bon_set_simd_level(BON_SIMD_AVX512);
+	
+	// Packing and unpacking:
+	std::vector<uint16_t> packed(n), packed_be(n);
+	for (int i=0; i<n; ++i) {
+		packed[i]    = bon_float_to_half((float)(i - 500));
+		packed_be[i] = (uint16_t)(packed[i] << 8 | packed[i] >> 8);
+	}
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_obj_begin(B);
+	bon_w_key(B, "half");
+	bon_w_pack_array(B, packed.data(), n * 2, n, BON_TYPE_HALF);
+	bon_w_key(B, "half_be");
+	bon_w_pack_array(B, packed_be.data(), n * 2, n, BON_TYPE_HALF_BE);
+	bon_w_key(B, "bf16");
+	bon_w_pack_array(B, bf16s.data(), n * 2, n, BON_TYPE_BF16);
+	bon_w_key(B, "pi");
+	bon_w_pack_fmt(B, &packed[501], 2, "f16");
+	bon_w_obj_end(B);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	bon_value* hv   = read_key(R, root, "half");
+	bon_value* hbv  = read_key(R, root, "half_be");
+	bon_value* bv   = read_key(R, root, "bf16");
+	
+	REQUIRE( bon_r_list_size(R, hv) == (bon_size)n );
+	REQUIRE( bon_r_double(R, bon_r_list_elem(R, hv, 700)) == 200 );
+	REQUIRE( bon_r_double(R, bon_r_list_elem(R, hbv, 700)) == 200 );
+	REQUIRE( bon_r_double(R, read_key(R, root, "pi")) == 1 );
+	
+	// Zero-copy:
+	auto ptr = (const uint16_t*)bon_r_unpack_ptr_fmt(R, hv, n * 2, "[#f16]", (bon_size)n);
+	REQUIRE( ptr );
+	REQUIRE( ptr[3] == packed[3] );
+	REQUIRE( !bon_r_unpack_ptr_fmt(R, hbv, n * 2, "[#f16]", (bon_size)n) );
+	REQUIRE( !bon_r_unpack_ptr_fmt(R, bv,  n * 2, "[#f16]", (bon_size)n) );
+	REQUIRE( bon_r_unpack_ptr_fmt(R, bv, n * 2, "[#bf16]", (bon_size)n) );
+	
+	// Converting:
+	for (bon_value* v : {hv, hbv}) {
+		std::vector<float>   f(n);
+		std::vector<double>  d(n);
+		std::vector<int32_t> i32(n);
+		REQUIRE( bon_r_unpack_fmt(R, v, f.data(),   n * sizeof(float),   "[#f]", (bon_size)n) );
+		REQUIRE( bon_r_unpack_fmt(R, v, d.data(),   n * sizeof(double),  "[#d]", (bon_size)n) );
+		REQUIRE( bon_r_unpack_fmt(R, v, i32.data(), n * sizeof(int32_t), "[#i32]", (bon_size)n) );
+		for (int i=0; i<n; ++i) {
+			REQUIRE( f[i]   == (float)(i - 500) );
+			REQUIRE( d[i]   == (double)(i - 500) );
+			REQUIRE( i32[i] == i - 500 );
+		}
+		std::vector<uint8_t> u8(n);
+		REQUIRE( !bon_r_unpack_fmt(R, v, u8.data(), n, "[#u8]", (bon_size)n) ); // Negatives
+	}
+	
+	std::vector<float> f(n);
+	REQUIRE( bon_r_unpack_fmt(R, bv, f.data(), n * sizeof(float), "[#f]", (bon_size)n) );
+	for (int i=0; i<n; ++i) {
+		float expected = bon_bf16_to_float(bf16s[i]);
+		REQUIRE( (f[i] == expected || (std::isnan(f[i]) && std::isnan(expected))) );
+	}
+	
+	// Converting to half:
+	std::vector<uint16_t> h(n);
+	REQUIRE( bon_r_unpack_fmt(R, hbv, h.data(), n * 2, "[#f16]", (bon_size)n) );
+	REQUIRE( h == packed );
+	
+	bon_r_close(R);
+	free(vec.data);
+}
+
+// Writes 'vals' with 'codec', and checks that it reads back the same, in more than one way.
+template<typename T>
+void test_ints_round_trip(const std::vector<T>& vals, bon_type_id type_id, bon_ints_codec codec)
+{
+	const bon_size n = vals.size();
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_pack_ints(B, vals.data(), n * sizeof(T), n, type_id, codec);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	
+	bon_r_doc* R = bon_r_open(vec.data, vec.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, root) == n );
+	
+	bon_type* type = bon_new_type_simple_array(n, type_id);
+	
+	std::vector<T> direct(n);
+	REQUIRE( bon_r_unpack(R, root, direct.data(), n * sizeof(T), type) );
+	REQUIRE( direct == vals );
+	
+	std::vector<double> dbls(n);
+	REQUIRE( bon_r_unpack_fmt(R, root, dbls.data(), n * sizeof(double), "[#d]", n) );
+	for (bon_size i=0; i<n; ++i) {
+		REQUIRE( dbls[i] == (double)vals[i] );
+	}
+	
+	auto ptr = (const T*)bon_r_unpack_ptr(R, root, n * sizeof(T), type);
+	REQUIRE( ptr );
+	REQUIRE( std::vector<T>(ptr, ptr + n) == vals );
+	if (n > 0) {
+		REQUIRE( bon_r_double(R, bon_r_list_elem(R, root, n-1)) == (double)vals[n-1] );
+	}
+	
+	bon_free_type(type);
+	bon_r_close(R);
+	free(vec.data);
+}
+
+TEST_CASE( "BON/ints", "Delta and bit packed integer arrays" )
+{
+	// Timestamps: a few milliseconds apart.
+	const int N = 10 * 1000 + 17;
+	std::vector<uint64_t> times(N);
+	std::vector<int32_t>  noise(N);
+	std::vector<int64_t>  wild(N);
+	uint64_t state = 42;
+	for (int i=0; i<N; ++i) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		times[i] = 1500000000000ULL + (uint64_t)i * 10 + (state >> 61);
+		noise[i] = (int32_t)(state >> 54) - 512;
+		wild[i]  = (int64_t)state;
+	}
+	wild[5] = std::numeric_limits<int64_t>::min();
+	wild[6] = std::numeric_limits<int64_t>::max();
+	
+	bon_ints_codec codecs[] = { BON_INTS_FOR, BON_INTS_DELTA, BON_INTS_ZIGZAG,
+	                            (bon_ints_codec)(BON_INTS_DELTA | BON_INTS_ZIGZAG), BON_INTS_AUTO };
+	for (bon_ints_codec codec : codecs) {
+		test_ints_round_trip(times, BON_TYPE_UINT64, codec);
+		test_ints_round_trip(noise, BON_TYPE_SINT32, codec);
+		test_ints_round_trip(wild,  BON_TYPE_SINT64, codec);
+		test_ints_round_trip(std::vector<uint8_t>{1, 2, 3, 255, 0}, BON_TYPE_UINT8, codec);
+		test_ints_round_trip(std::vector<int16_t>{-32768, 32767, 0}, BON_TYPE_SINT16, codec);
+		test_ints_round_trip(std::vector<uint32_t>(300, 7), BON_TYPE_UINT32, codec);
+		test_ints_round_trip(std::vector<uint16_t>(1, 65535), BON_TYPE_UINT16, codec);
+	}
+	
+	// The SIMD and scalar decoders agree:
+	for (int level=BON_SIMD_NONE; level<=BON_SIMD_AVX512; ++level) {
+		if (bon_set_simd_level((bon_simd_level)level) != level) { break; }
+		test_ints_round_trip(times, BON_TYPE_UINT64, BON_INTS_DELTA);
+		test_ints_round_trip(noise, BON_TYPE_SINT32, BON_INTS_ZIGZAG);
+	}
+	bon_set_simd_level(BON_SIMD_AVX512);
+	
+	// Broken encodings stop the decoder:
+	const uint32_t few[3] = {10, 20, 30};
+	uint32_t few_out[3];
+	uint8_t enc[BON_INTS_MAX_BLOCK_BYTES];
+	bon_size enc_size = bon_ints_encode_block(enc, few, 3, 0, BON_TYPE_UINT32, BON_INTS_FOR);
+	REQUIRE( bon_ints_decode(enc, enc_size, BON_INTS_FOR, BON_TYPE_UINT32, few_out, 3) );
+	REQUIRE( few_out[2] == 30 );
+	REQUIRE( !bon_ints_decode(enc, 0, BON_INTS_FOR, BON_TYPE_UINT32, few_out, 3) );
+	REQUIRE( !bon_ints_decode(enc, 1, BON_INTS_FOR, BON_TYPE_UINT32, few_out, 3) );
+	
+	// Sizes, and the writer flag:
+	bon_byte_vec plain = {0,0,0}, packed = {0,0,0};
+	for (bon_byte_vec* vec : {&plain, &packed}) {
+		bon_w_doc* B = bon_w_new(bon_vec_writer, vec, vec == &packed ? BON_W_FLAG_ENCODE_INTS : BON_W_FLAG_DEFAULT);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "times");
+		bon_w_pack_array(B, times.data(), N * sizeof(uint64_t), N, BON_TYPE_UINT64);
+		bon_w_key(B, "wild");
+		bon_w_pack_array(B, wild.data(), N * sizeof(int64_t), N, BON_TYPE_SINT64);
+		bon_w_obj_end(B);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	}
+	// The times shrink 20x, but the wild ones are best left as is:
+	REQUIRE( packed.size < plain.size / 2 + (N * sizeof(uint64_t)) / 10 );
+	REQUIRE( packed.size > plain.size / 2 );
+	
+	bon_r_doc* R = bon_r_open(packed.data, packed.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_value* root = bon_r_root(R);
+	std::vector<uint64_t> t(N);
+	REQUIRE( bon_r_unpack_fmt(R, read_key(R, root, "times"), t.data(), N * sizeof(uint64_t), "[#u64]", (bon_size)N) );
+	REQUIRE( t == times );
+	bon_type* u64 = bon_new_type_simple(BON_TYPE_UINT64);
+	auto slice = (const uint64_t*)bon_r_unpack_range_ptr(R, read_key(R, root, "times"), 5000, 5010, u64);
+	REQUIRE( slice );
+	REQUIRE( slice[3] == times[5003] );
+	bon_free_type(u64);
+	
+	// Copying an encoded array keeps it encoded:
+	bon_byte_vec copy = {0,0,0};
+	bon_w_doc* C = bon_w_new(bon_vec_writer, &copy, BON_W_FLAG_DEFAULT);
+	bon_w_value(C, root);
+	REQUIRE( bon_w_close(C) == BON_SUCCESS );
+	REQUIRE( copy.size == packed.size );
+	REQUIRE( memcmp(copy.data, packed.data, copy.size) == 0 );
+	bon_r_close(R);
+	
+	// Corruption is detected:
+	bon_byte_vec bad = {0,0,0};
+	bon_w_doc* W = bon_w_new(bon_vec_writer, &bad, BON_W_FLAG_DEFAULT);
+	bon_w_pack_ints(W, times.data(), 50 * sizeof(uint64_t), 50, BON_TYPE_UINT64, BON_INTS_FOR);
+	REQUIRE( bon_w_close(W) == BON_SUCCESS );
+	uint8_t* z = (uint8_t*)memchr(bad.data, BON_CTRL_INTS, bad.size);
+	REQUIRE( z );
+	REQUIRE( z[5] <= 64 ); // Width of the first block (after the type, size, codec and byte size)
+	z[5] = 65;
+	R = bon_r_open(bad.data, bad.size, BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_ERR_BAD_VALUE );
+	bon_r_close(R);
+	
+	free(plain.data);
+	free(packed.data);
+	free(copy.data);
+	free(bad.data);
+}
+
+TEST_CASE( "BON/lz", "LZ compressed blocks" )
+{
+	// The codec itself, on data that compresses well, a bit, and not at all:
+	uint64_t state = 7;
+	std::vector<uint8_t> random(100 * 1000), text, runs(70 * 1000, 'x');
+	for (auto& b : random) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		b = (uint8_t)(state >> 56);
+	}
+	for (int i=0; text.size() < 200 * 1000; ++i) {
+		std::string line = "{\"id\": " + std::to_string(i) + ", \"name\": \"item" + std::to_string(i % 97) + "\"}\n";
+		text.insert(text.end(), line.begin(), line.end());
+	}
+	for (size_t i=0; i<runs.size(); i += 1000) { runs[i] = (uint8_t)i; }
+	
+	for (const std::vector<uint8_t>& raw : {random, text, runs, std::vector<uint8_t>(13, 1), std::vector<uint8_t>()}) {
+		CAPTURE( raw.size() );
+		std::vector<uint8_t> comp(BON_LZ_BOUND(raw.size()));
+		bon_size size = bon_lz_compress(raw.data(), raw.size(), comp.data(), comp.size());
+		REQUIRE( size > 0 );
+		std::vector<uint8_t> back(raw.size());
+		REQUIRE( bon_lz_decompress(comp.data(), size, back.data(), back.size()) );
+		REQUIRE( back == raw );
+		if (raw.size() > 1) {
+			REQUIRE( !bon_lz_decompress(comp.data(), size, back.data(), back.size() - 1) );
+			REQUIRE( !bon_lz_decompress(comp.data(), size - 1, back.data(), back.size()) );
+		}
+		if (&raw == &text || raw.size() == runs.size()) {
+			REQUIRE( size < raw.size() / 4 );
+		}
+	}
+	
+	// A document of compressible blocks:
+	std::vector<std::vector<uint8_t>> payloads;
+	for (int bi=1; bi<=8; ++bi) {
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_SKIP_HEADER_FOOTER);
+		bon_w_list_begin(B);
+		for (int i=0; i<2000; ++i) { bon_w_uint64(B, 1000000 + (uint64_t)(i % 10) * bi); }
+		bon_w_list_end(B);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+		payloads.emplace_back(vec.data, vec.data + vec.size);
+		free(vec.data);
+	}
+	std::vector<bon_w_block_src> srcs;
+	for (int bi=1; bi<=8; ++bi) {
+		srcs.push_back({ (bon_block_id)bi, payloads[bi-1].data(), payloads[bi-1].size() });
+	}
+	srcs.push_back({ 9, "tiny", 4 }); // Not worth compressing
+	
+	auto write_doc = [&](bon_w_flags flags, unsigned num_threads) {
+		bon_w_doc* B = bon_w_new_mem(flags);
+		bon_w_block_begin(B, 0);
+		bon_w_list_begin(B);
+		for (bon_block_id bi=1; bi<=8; ++bi) { bon_w_block_ref(B, bi); }
+		bon_w_list_end(B);
+		bon_w_block_end(B);
+		if (num_threads == 1) {
+			for (auto& src : srcs) { bon_w_block(B, src.id, src.data, src.nbytes); }
+		} else {
+			bon_w_blocks(B, srcs.data(), srcs.size(), num_threads);
+		}
+		REQUIRE( bon_w_finish(B) == BON_SUCCESS );
+		bon_size size;
+		uint8_t* data = bon_w_mem_take(B, &size);
+		bon_w_free(B);
+		std::vector<uint8_t> doc(data, data + size);
+		free(data);
+		return doc;
+	};
+	
+	auto plain = write_doc(BON_W_FLAG_DEFAULT, 1);
+	REQUIRE( write_doc(BON_W_FLAG_DEFAULT, 4) == plain );
+	auto comp = write_doc((bon_w_flags)(BON_W_FLAG_COMPRESS_BLOCKS | BON_W_FLAG_CRC), 1);
+	REQUIRE( write_doc((bon_w_flags)(BON_W_FLAG_COMPRESS_BLOCKS | BON_W_FLAG_CRC), 4) == comp );
+	REQUIRE( comp.size() < plain.size() / 4 );
+	
+	auto check = [&](const std::vector<uint8_t>& doc, unsigned num_threads, bool upfront) {
+		bon_r_doc* R = bon_r_open(doc.data(), doc.size(), BON_R_FLAG_DEFAULT);
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		REQUIRE( R->blocks.size == 10 );
+		bon_r_set_num_threads(R, num_threads);
+		if (upfront) {
+			REQUIRE( bon_r_decompress_blocks(R) );
+		}
+		bon_value* list = bon_r_root(R);
+		REQUIRE( bon_r_list_size(R, list) == 8 );
+		for (int bi=1; bi<=8; ++bi) {
+			bon_value* inner = bon_r_list_elem(R, list, bi-1);
+			REQUIRE( bon_r_list_size(R, inner) == 2000 );
+			REQUIRE( bon_r_uint(R, bon_r_list_elem(R, inner, 1999)) == 1000000 + 9 * (uint64_t)bi );
+		}
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		bon_r_close(R);
+	};
+	for (bool upfront : {false, true}) {
+		check(plain, 1, upfront);
+		check(comp,  1, upfront);
+		check(comp,  4, upfront);
+	}
+	
+	// Blocks are decompressed lazily:
+	{
+		bon_r_doc* R = bon_r_open(comp.data(), comp.size(), BON_R_FLAG_DEFAULT);
+		int ncompressed = 0;
+		for (bon_size i=0; i<R->blocks.size; ++i) {
+			ncompressed += (R->blocks.data[i].payload == NULL);
+		}
+		REQUIRE( ncompressed == 8 );
+		REQUIRE( bon_r_uint(R, bon_r_list_elem(R, bon_r_list_elem(R, bon_r_root(R), 2), 0)) == 1000000 );
+		REQUIRE( bon_r_find_block(R, 3)->payload != NULL );
+		REQUIRE( bon_r_find_block(R, 4)->payload == NULL );
+		bon_r_close(R);
+	}
+	
+	// Corrupt compressed data is detected:
+	auto bad = write_doc(BON_W_FLAG_COMPRESS_BLOCKS, 1);
+	bon_r_doc* R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	bon_r_block* block = bon_r_find_block(R, 5);
+	REQUIRE( block->compressed );
+	uint8_t* z = const_cast<uint8_t*>(block->compressed);
+	z[0] = 0xf0; z[1] = 0xff; z[2] = 0xff; // A literal run past the end
+	REQUIRE( !bon_r_decompress_blocks(R) );
+	REQUIRE( bon_r_error(R) == BON_ERR_BAD_BLOCK );
+	bon_r_close(R);
+	
+	R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	bon_value* list = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, list, 3)) == 2000 );
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, list, 4)) == 0 );
+	REQUIRE( bon_r_error(R) == BON_ERR_BAD_BLOCK );
+	bon_r_close(R);
+}
+
+
+TEST_CASE( "BON/table", "Lists of records stored column by column" )
+{
+	const int N = 1000;
+	auto write_rows = [&](bon_w_doc* T, bool odd_one_out) {
+		for (int i=0; i<N; ++i) {
+			bon_w_obj_begin(T);
+			bon_w_key(T, "id");     bon_w_uint64(T, (uint64_t)i);
+			bon_w_key(T, "name");   bon_w_cstring(T, ("item" + std::to_string(i % 37)).c_str());
+			bon_w_key(T, "price");  bon_w_double(T, i * 0.25);
+			bon_w_key(T, "delta");  bon_w_sint64(T, 300 - i);
+			bon_w_key(T, "ok");     bon_w_bool(T, i % 3 == 0);
+			bon_w_key(T, odd_one_out && i == N-1 ? "bog" : "big");
+			bon_w_uint64(T, 0xffffffffffffULL + (uint64_t)i);
+			bon_w_obj_end(T);
+		}
+	};
+	
+	auto write_doc = [&](int kind) {
+		// 0: table, 1: a table that doesn't fit (written as a list), 2: plain list
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "rows");
+		if (kind == 2) {
+			bon_w_list_begin(B);
+			write_rows(B, false);
+			bon_w_list_end(B);
+		} else {
+			bon_w_doc* T = bon_w_table_begin(B);
+			write_rows(T, kind == 1);
+			bon_w_table_end(B, T);
+		}
+		bon_w_key(B, "empty");
+		bon_w_table_end(B, bon_w_table_begin(B));
+		bon_w_obj_end(B);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+		std::vector<uint8_t> doc(vec.data, vec.data + vec.size);
+		free(vec.data);
+		return doc;
+	};
+	
+	auto table = write_doc(0);
+	auto mixed = write_doc(1);
+	auto plain = write_doc(2);
+	REQUIRE( table.size() < plain.size() / 2 );
+	REQUIRE( mixed.size() == plain.size() );
+	
+	// Same through the list and object accessors:
+	for (auto* doc : {&table, &mixed, &plain}) {
+		bool mixed_up = (doc == &mixed);
+		bon_r_doc* R = bon_r_open(doc->data(), doc->size(), BON_R_FLAG_DEFAULT);
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		bon_value* rows = read_key(R, bon_r_root(R), "rows");
+		REQUIRE( bon_r_is_table(R, rows) == (doc == &table) );
+		REQUIRE( bon_r_value_type(R, rows) == BON_LOGICAL_LIST );
+		REQUIRE( bon_r_list_size(R, rows) == N );
+		for (int i : {0, 1, 500, N-1}) {
+			bon_value* row = bon_r_list_elem(R, rows, i);
+			REQUIRE( bon_r_is_object(R, row) );
+			REQUIRE( bon_r_obj_size(R, row) == 6 );
+			REQUIRE( std::string(bon_r_obj_key(R, row, 1)) == "name" );
+			REQUIRE( bon_r_uint(R, read_key(R, row, "id")) == (uint64_t)i );
+			REQUIRE( std::string(bon_r_cstr(R, read_key(R, row, "name"))) == "item" + std::to_string(i % 37) );
+			REQUIRE( bon_r_double(R, read_key(R, row, "price")) == i * 0.25 );
+			REQUIRE( bon_r_int(R, read_key(R, row, "delta")) == 300 - i );
+			REQUIRE( bon_r_bool(R, read_key(R, row, "ok")) == (i % 3 == 0) );
+			const char* big = (mixed_up && i == N-1 ? "bog" : "big");
+			REQUIRE( bon_r_uint(R, read_key(R, row, big)) == 0xffffffffffffULL + (uint64_t)i );
+		}
+		REQUIRE( bon_r_list_elem(R, rows, N) == NULL );
+		REQUIRE( bon_r_list_size(R, read_key(R, bon_r_root(R), "empty")) == 0 );
+		
+		// Unpacked as a list of structs:
+		struct Row { double price; uint32_t id; int32_t delta; };
+		std::vector<Row> unpacked(N);
+		REQUIRE( bon_r_unpack_fmt(R, rows, unpacked.data(), N * sizeof(Row),
+										  "[#{$d$u32$i32}]", (bon_size)N, "price", "id", "delta") );
+		REQUIRE( unpacked[N-1].id == N-1 );
+		REQUIRE( unpacked[N-1].price == (N-1) * 0.25 );
+		REQUIRE( unpacked[N-1].delta == 301 - N );
+		bon_r_close(R);
+	}
+	
+	// Columns:
+	bon_r_doc* R = bon_r_open(table.data(), table.size(), BON_R_FLAG_DEFAULT);
+	bon_value* rows = read_key(R, bon_r_root(R), "rows");
+	REQUIRE( bon_r_table_cols(R, rows) == 6 );
+	REQUIRE( bon_r_table_col(R, rows, 6) == NULL );
+	REQUIRE( bon_r_table_get_col(R, rows, "nope") == NULL );
+	
+	const std::pair<const char*, bon_type_id> types[] = {
+		{"id", BON_TYPE_UINT16}, {"name", BON_TYPE_STRING}, {"price", BON_TYPE_FLOAT},
+		{"delta", BON_TYPE_SINT16}, {"ok", BON_TYPE_BOOL}, {"big", BON_TYPE_UINT64}
+	};
+	for (bon_size ci=0; ci<6; ++ci) {
+		const bon_column* col = bon_r_table_col(R, rows, ci);
+		REQUIRE( std::string(col->key) == types[ci].first );
+		REQUIRE( col->type == types[ci].second );
+		REQUIRE( col->size == N );
+		REQUIRE( bon_r_table_get_col(R, rows, types[ci].first) == col );
+	}
+	
+	const bon_column* names = bon_r_table_get_col(R, rows, "name");
+	bon_size len = 0;
+	REQUIRE( std::string(bon_column_str(names, 40, &len)) == "item3" );
+	REQUIRE( len == 5 );
+	REQUIRE( bon_column_str(names, N, &len) == NULL );
+	
+	const uint16_t* ids = (const uint16_t*)bon_r_unpack_array(R, bon_r_table_col_value(R, rows, "id"), N, BON_TYPE_UINT16);
+	REQUIRE( ids );
+	uint16_t id_999;
+	memcpy(&id_999, ids + 999, sizeof(id_999));
+	REQUIRE( id_999 == 999 );
+	
+	std::vector<double> prices(N);
+	REQUIRE( bon_r_unpack_fmt(R, bon_r_table_col_value(R, rows, "price"), prices.data(), N * sizeof(double), "[#d]", (bon_size)N) );
+	REQUIRE( prices[N-1] == (N-1) * 0.25 );
+	
+	bon_value* name_list = bon_r_table_col_value(R, rows, "name");
+	REQUIRE( bon_r_list_size(R, name_list) == N );
+	REQUIRE( std::string(bon_r_cstr(R, bon_r_list_elem(R, name_list, 38))) == "item1" );
+	
+	// Copied as is:
+	bon_byte_vec copy = {0,0,0};
+	bon_w_doc* C = bon_w_new(bon_vec_writer, &copy, BON_W_FLAG_DEFAULT);
+	bon_w_value(C, bon_r_root(R));
+	REQUIRE( bon_w_close(C) == BON_SUCCESS );
+	REQUIRE( copy.size == table.size() );
+	REQUIRE( memcmp(copy.data, table.data(), table.size()) == 0 );
+	free(copy.data);
+	bon_r_close(R);
+	
+	// Broken string offsets:
+	auto bad = table;
+	const uint8_t item0[] = {'i', 't', 'e', 'm', '0', 0};
+	auto it = std::search(bad.begin(), bad.end(), item0, item0 + sizeof(item0));
+	REQUIRE( it != bad.end() );
+	it[-4 * (N + 1)] = 1; // The first offset
+	R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_ERR_BAD_VALUE );
+	bon_r_close(R);
+}
+
+
+TEST_CASE( "BON/block_crc", "Per-block checksums" )
+{
+	// Compressible, incompressible and short payloads:
+	std::vector<std::vector<uint8_t>> payloads;
+	uint64_t state = 3;
+	for (int bi=1; bi<=3; ++bi) {
+		bon_w_doc* B = bon_w_new_mem(BON_W_FLAG_SKIP_HEADER_FOOTER);
+		bon_w_list_begin(B);
+		for (int i=0; i<(bi == 3 ? 3 : 500); ++i) {
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			bon_w_uint64(B, bi == 2 ? state : (uint64_t)(bi * 1000 + i % 10));
+		}
+		bon_w_list_end(B);
+		bon_size size;
+		const uint8_t* data = bon_w_mem_data(B, &size);
+		payloads.emplace_back(data, data + size);
+		bon_w_free(B);
+	}
+	
+	auto write_doc = [&](bon_w_flags flags, bon_size buff_size) {
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new_sized(bon_vec_writer, &vec, flags, buff_size);
+		bon_w_block_begin(B, 0); // Open-ended, and flushed past when the buffer is small
+		bon_w_list_begin(B);
+		for (bon_block_id bi=1; bi<=3; ++bi) { bon_w_block_ref(B, bi); }
+		for (int i=0; i<100; ++i) { bon_w_uint64(B, 100000 + (uint64_t)i); }
+		bon_w_list_end(B);
+		bon_w_block_end(B);
+		for (int bi=1; bi<=3; ++bi) {
+			bon_w_block(B, (bon_block_id)bi, payloads[bi-1].data(), payloads[bi-1].size());
+		}
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+		std::vector<uint8_t> doc(vec.data, vec.data + vec.size);
+		free(vec.data);
+		return doc;
+	};
+	
+	const auto flags = (bon_w_flags)(BON_W_FLAG_BLOCK_CRC | BON_W_FLAG_COMPRESS_BLOCKS | BON_W_FLAG_CRC);
+	const auto doc   = write_doc(flags, 16);
+	REQUIRE( write_doc(flags, 64 * 1024) == doc );
+	
+	const auto strict = (bon_r_flags)(BON_R_FLAG_REQUIRE_CRC | BON_R_FLAG_REQUIRE_BLOCK_CRC);
+	bon_r_doc* R = bon_r_open(doc.data(), doc.size(), strict);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	REQUIRE( bon_r_find_block(R, 1)->compressed );
+	REQUIRE( !bon_r_find_block(R, 2)->compressed );
+	bon_value* root = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, root) == 103 );
+	REQUIRE( bon_r_uint(R, bon_r_list_elem(R, root, 102)) == 100099 );
+	for (int bi=1; bi<=3; ++bi) {
+		REQUIRE( bon_r_find_block(R, (bon_block_id)bi)->has_crc );
+		REQUIRE( !bon_r_find_block(R, (bon_block_id)bi)->parsed );
+		bon_value* list = bon_r_list_elem(R, root, (bon_size)bi - 1);
+		REQUIRE( bon_r_list_size(R, list) == (bi == 3 ? 3u : 500u) );
+	}
+	REQUIRE( bon_r_uint(R, bon_r_list_elem(R, bon_r_list_elem(R, root, 2), 2)) == 3002 );
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	
+	// Where things are, for tampering:
+	const size_t root_end = (size_t)(R->blocks.data[0].payload + R->blocks.data[0].payload_size - doc.data());
+	const size_t lz_at    = (size_t)(bon_r_find_block(R, 1)->compressed - doc.data());
+	const size_t plain_at = (size_t)(bon_r_find_block(R, 2)->payload - doc.data()) + 100;
+	bon_r_close(R);
+	
+	// Only the blocks that are used are checked:
+	auto bad = doc;
+	bad[plain_at] ^= 1;
+	R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	root = bon_r_root(R);
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, root, 0)) == 500 );
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, root, 2)) == 3 );
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, root, 1)) == 0 );
+	REQUIRE( bon_r_error(R) == BON_ERR_WRONG_CRC );
+	bon_r_close(R);
+	
+	// Compressed blocks are checked before they are decompressed:
+	bad = doc;
+	bad[lz_at + 1] ^= 1;
+	R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	REQUIRE( !bon_r_decompress_blocks(R) );
+	REQUIRE( bon_r_error(R) == BON_ERR_WRONG_CRC );
+	bon_r_close(R);
+	
+	// The open-ended root block is parsed, and so checked, on open:
+	bad = doc;
+	bad[root_end - 2] ^= 1; // In the last integer
+	R = bon_r_open(bad.data(), bad.size(), BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_error(R) == BON_ERR_WRONG_CRC );
+	bon_r_close(R);
+	
+	// Blocks without checksums:
+	const auto plain = write_doc(BON_W_FLAG_COMPRESS_BLOCKS, 16);
+	REQUIRE( doc.size() == plain.size() + 4 * 5 + 5 ); // Four block crcs, and the footer crc
+	R = bon_r_open(plain.data(), plain.size(), BON_R_FLAG_DEFAULT);
+	REQUIRE( bon_r_list_size(R, bon_r_list_elem(R, bon_r_root(R), 0)) == 500 );
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_r_close(R);
+	R = bon_r_open(plain.data(), plain.size(), BON_R_FLAG_REQUIRE_BLOCK_CRC);
+	REQUIRE( bon_r_error(R) == BON_ERR_MISSING_CRC );
+	bon_r_close(R);
+}
+
+
+TEST_CASE( "crc32/combine", "Combining crcs of pieces" )
+{
+	std::vector<uint8_t> data(1000);
+	for (size_t i=0; i<data.size(); ++i) {
+		data[i] = (uint8_t)(i * 7 + i / 13);
+	}
+	const uint32_t whole = crc_calc(data.data(), data.size());
+	
+	for (size_t split : {0, 1, 17, 500, 999, 1000}) {
+		uint32_t a = crc_calc(data.data(), split);
+		uint32_t b = crc_calc(data.data() + split, data.size() - split);
+		REQUIRE( crc_combine(a, b, data.size() - split) == whole );
+	}
+}
+
+
+TEST_CASE( "BON/crc/parallel", "CRC checking of big files on several threads" )
+{
+	bon_byte_vec vec = {0,0,0};
+	
+	std::vector<uint32_t> vals(1000 * 1000);
+	for (size_t i=0; i<vals.size(); ++i) {
+		vals[i] = (uint32_t)(i * 2654435761u);
+	}
+	
+	{
+		bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_CRC);
+		bon_w_pack_array(B, vals.data(), vals.size() * sizeof(uint32_t), vals.size(), BON_TYPE_UINT32);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	}
+	REQUIRE( vec.size >= BON_PARALLEL_MIN_BYTES );
+	
+	for (unsigned num_threads : {1u, 2u, 3u, 8u}) {
+		bon_r_doc* R = bon_r_open_threaded(vec.data, vec.size, BON_R_FLAG_REQUIRE_CRC, num_threads);
+		REQUIRE( bon_r_error(R) == BON_SUCCESS );
+		
+		std::vector<uint32_t> read(vals.size());
+		REQUIRE( bon_r_unpack_fmt(R, bon_r_root(R), read.data(), read.size() * sizeof(uint32_t), "[#u32]", (bon_size)read.size()) );
+		REQUIRE( read == vals );
+		bon_r_close(R);
+	}
+	
+	vec.data[vec.size / 2] ^= 1; // Tampering in the middle of a piece
+	for (unsigned num_threads : {1u, 2u, 3u, 8u}) {
+		bon_r_doc* R = bon_r_open_threaded(vec.data, vec.size, BON_R_FLAG_REQUIRE_CRC, num_threads);
+		REQUIRE( bon_r_error(R) == BON_ERR_WRONG_CRC );
+		bon_r_close(R);
+	}
+	
+	free(vec.data);
+}
+
+
+TEST_CASE( "xxh64", "XXH64 against known hashes, and in pieces" )
+{
+	const char* spam = "Nobody inspects the spammish repetition";
+	REQUIRE( xxh64_calc((const uint8_t*)"",    0, 0) == 0xEF46DB3751D8E999ULL );
+	REQUIRE( xxh64_calc((const uint8_t*)"abc", 3, 0) == 0x44BC2CF5AD770999ULL );
+	REQUIRE( xxh64_calc((const uint8_t*)spam, strlen(spam), 0) == 0xFBCEA83C8A378BF1ULL );
+	
+	std::vector<uint8_t> data(1000);
+	for (size_t i=0; i<data.size(); ++i) {
+		data[i] = (uint8_t)(i * 7 + i / 13);
+	}
+	const uint64_t whole = xxh64_calc(data.data(), data.size(), 42);
+	
+	for (size_t step : {1, 5, 31, 32, 33, 100}) {
+		xxh64_state state;
+		xxh64_reset(&state, 42);
+		for (size_t at=0; at<data.size(); at += step) {
+			xxh64_update(&state, data.data() + at, std::min(step, data.size() - at));
+		}
+		REQUIRE( xxh64_digest(&state) == whole );
+	}
+}
+
+
+TEST_CASE( "BON/xxh64", "Documents with an XXH64 footer" )
+{
+	auto write_doc = [](bon_size buff_size) {
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new_sized(bon_vec_writer, &vec, (bon_w_flags)(BON_W_FLAG_XXH64 | BON_W_FLAG_CRC), buff_size);
+		bon_w_list_begin(B);
+		for (int i=0; i<1000; ++i) { bon_w_uint64(B, 1000000 + (uint64_t)i); }
+		bon_w_list_end(B);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+		std::vector<uint8_t> doc(vec.data, vec.data + vec.size);
+		free(vec.data);
+		return doc;
+	};
+	
+	auto doc = write_doc(16);
+	REQUIRE( write_doc(64 * 1024) == doc );
+	REQUIRE( doc.size() > 10 );
+	REQUIRE( doc[doc.size() - 10] == BON_CTRL_FOOTER_XXH64 );
+	REQUIRE( doc[doc.size() -  1] == BON_CTRL_FOOTER_XXH64 );
+	
+	bon_r_doc* R = bon_r_open(doc.data(), doc.size(), BON_R_FLAG_REQUIRE_CRC);
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	REQUIRE( bon_r_list_size(R, bon_r_root(R)) == 1000 );
+	bon_r_close(R);
+	
+	doc[100] ^= 1;
+	R = bon_r_open(doc.data(), doc.size(), BON_R_FLAG_REQUIRE_CRC);
+	REQUIRE( bon_r_error(R) == BON_ERR_WRONG_CRC );
+	bon_r_close(R);
+	
+	R = bon_r_open(doc.data(), doc.size(), BON_R_FLAG_DEFAULT); // Not checked
+	REQUIRE( bon_r_error(R) == BON_SUCCESS );
+	bon_r_close(R);
+}
+
+
+TEST_CASE( "BON/json", "Streaming JSON output" )
+{
+	auto write_doc = [](bool table) {
+		bon_byte_vec vec = {0,0,0};
+		bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+		bon_w_obj_begin(B);
+		bon_w_key(B, "s");
+		bon_w_cstring(B, "a/\"\xC3\xA9\n");
+		bon_w_key(B, "arr");
+		const uint16_t arr[3] = {1, 2, 3};
+		bon_w_pack_array(B, arr, sizeof(arr), 3, BON_TYPE_UINT16);
+		bon_w_key(B, "d");
+		bon_w_double(B, 0.5);
+		bon_w_key(B, "nan");
+		bon_w_double(B, NAN);
+		bon_w_key(B, "t");
+		const char* names[2] = {"x", "y"};
+		if (table) {
+			bon_w_doc* T = bon_w_table_begin(B);
+			for (int i=0; i<2; ++i) {
+				bon_w_obj_begin(T);
+				bon_w_key(T, "id");    bon_w_uint64(T, (uint64_t)i + 1);
+				bon_w_key(T, "name");  bon_w_cstring(T, names[i]);
+				bon_w_obj_end(T);
+			}
+			bon_w_table_end(B, T);
+		} else {
+			bon_w_list_begin(B);
+			for (int i=0; i<2; ++i) {
+				bon_w_obj_begin(B);
+				bon_w_key(B, "id");    bon_w_uint64(B, (uint64_t)i + 1);
+				bon_w_key(B, "name");  bon_w_cstring(B, names[i]);
+				bon_w_obj_end(B);
+			}
+			bon_w_list_end(B);
+		}
+		bon_w_obj_end(B);
+		REQUIRE( bon_w_close(B) == BON_SUCCESS );
+		std::vector<uint8_t> doc(vec.data, vec.data + vec.size);
+		free(vec.data);
+		return doc;
+	};
+	
+	auto to_json = [](const std::vector<uint8_t>& doc, unsigned flags) {
+		bon_r_doc* B = bon_r_open(doc.data(), doc.size(), BON_R_FLAG_DEFAULT);
+		REQUIRE( bon_r_error(B) == BON_SUCCESS );
+		bon_byte_vec vec = {0,0,0};
+		REQUIRE( bon_r_write_json(B, bon_r_root(B), bon_vec_writer, &vec, flags) );
+		std::string json((const char*)vec.data, vec.size);
+		free(vec.data);
+		bon_r_close(B);
+		return json;
+	};
+	
+	auto table = write_doc(true);
+	auto plain = write_doc(false);
+	
+	REQUIRE( to_json(table, 0) ==
+	        "{\"s\": \"a/\\\"\xC3\xA9\\n\", \"arr\": [1, 2, 3], \"d\": 0.5, \"nan\": 0e666, "
+	        "\"t\": [{\"id\": 1, \"name\": \"x\"}, {\"id\": 2, \"name\": \"y\"}]}" );
+	
+	REQUIRE( to_json(table, BON_JSON_COMPACT | BON_JSON_ENSURE_ASCII | BON_JSON_ESCAPE_SLASH) ==
+	        "{\"s\":\"a\\/\\\"\\u00e9\\n\",\"arr\":[1,2,3],\"d\":0.5,\"nan\":0e666,"
+	        "\"t\":[{\"id\":1,\"name\":\"x\"},{\"id\":2,\"name\":\"y\"}]}" );
+	
+	const char* indented =
+		"{\n"
+		"  \"s\": \"a/\\\"\xC3\xA9\\n\",\n"
+		"  \"arr\": [\n"
+		"    1,\n"
+		"    2,\n"
+		"    3\n"
+		"  ],\n"
+		"  \"d\": 0.5,\n"
+		"  \"nan\": 0e666,\n"
+		"  \"t\": [\n"
+		"    {\n"
+		"      \"id\": 1,\n"
+		"      \"name\": \"x\"\n"
+		"    },\n"
+		"    {\n"
+		"      \"id\": 2,\n"
+		"      \"name\": \"y\"\n"
+		"    }\n"
+		"  ]\n"
+		"}";
+	REQUIRE( to_json(table, BON_JSON_INDENT(2)) == indented );
+	REQUIRE( to_json(plain, BON_JSON_INDENT(2)) == indented );
+	
+	// Bigger than the output buffer:
+	const uint32_t n = 100000;
+	std::vector<uint32_t> big(n);
+	std::string expected = "[";
+	for (uint32_t i=0; i<n; ++i) {
+		big[i] = i * 2654435761u;
+		expected += (i ? "," : "") + std::to_string(big[i]);
+	}
+	expected += "]";
+	
+	bon_byte_vec vec = {0,0,0};
+	bon_w_doc* B = bon_w_new(bon_vec_writer, &vec, BON_W_FLAG_DEFAULT);
+	bon_w_pack_array(B, big.data(), n * sizeof(uint32_t), n, BON_TYPE_UINT32);
+	REQUIRE( bon_w_close(B) == BON_SUCCESS );
+	std::vector<uint8_t> doc(vec.data, vec.data + vec.size);
+	free(vec.data);
+	REQUIRE( to_json(doc, BON_JSON_COMPACT) == expected );
+}
+
+
 TEST_CASE( "BON/crc/short/pass", "Test of CRC checking" )
 {
 	bon_byte_vec vec = {0,0,0};
@@ -1072,6 +3427,8 @@ TEST_CASE( "BON/bad", "Error detection when reading a bad BON file" )
 	test_err(__LINE__, BON_ERR_MISSING_TOKEN,          "BON0 D\0\0\1 F"                                                 );  // Bock with no end
 	test_err(__LINE__, BON_ERR_TRAILING_DATA,          "BON0{}Fx"                                                       );
 	test_err(__LINE__, BON_ERR_BAD_BLOCK,              "BON0 D\0\x01d F"                                                );
+	test_err(__LINE__, BON_SUCCESS,                    "BON0 K\1\2\x04\x40x d F"                                        );
+	test_err(__LINE__, BON_ERR_BAD_BLOCK,              "BON0 K\1\2\x81\x80\x80\x00\x40x d F"                            );  // Claims 2 MiB
 	test_err(__LINE__, BON_ERR_BAD_BLOCK_REF,          "BON0 D\2\1 \x81 d F"                                            );
 	test_err(__LINE__, BON_ERR_NOT_UTF8,               "BON0{ `\1\x80\0 `\1\x80\0 }F"                                   );
 	test_err(__LINE__, BON_ERR_NOT_UTF8,               "BON0{ `\1\a\0   `\1\x80\0 }F"                                   );